@@ -209,6 +209,11 @@ namespace GamescopeWSILayer {
     GamescopeLayerClient::Flags flags;
     bool hdrOutput;
 
+    // Watches the window tree on a connection shared with the app's other
+    // surfaces, and holds the bypass decision below between presents.
+    // Null if we couldn't connect, in which case we query every time.
+    std::shared_ptr<xcb::WindowWatcher> windowWatcher;
+
     bool isWayland() const {
       return connection == nullptr;
     }
@@ -222,19 +227,33 @@ namespace GamescopeWSILayer {
       return hdrOutput && hdrAllowed;
     }
 
+    // This is called on every present, so only go and ask the X server
+    // again if the window tree changed underneath us.
     bool canBypassXWayland() const {
       if (isWayland())
         return true;
 
-      auto rect = xcb::getWindowRect(connection, window);
-      auto largestObscuringWindowSize = xcb::getLargestObscuringChildWindowSize(connection, window);
-      auto toplevelWindow = xcb::getToplevelWindow(connection, window);
+      if (windowWatcher) {
+        auto cachedCanBypass = windowWatcher->cached([this](xcb_connection_t* queryConnection, std::optional<xcb_window_t> toplevelWindow) {
+          return computeCanBypassXWayland(queryConnection, toplevelWindow);
+        });
+        if (cachedCanBypass)
+          return *cachedCanBypass;
+      }
+
+      return computeCanBypassXWayland(connection, xcb::getToplevelWindow(connection, window));
+    }
+
+  private:
+    bool computeCanBypassXWayland(xcb_connection_t* queryConnection, std::optional<xcb_window_t> toplevelWindow) const {
+      auto rect = xcb::getWindowRect(queryConnection, window);
+      auto largestObscuringWindowSize = xcb::getLargestObscuringChildWindowSize(queryConnection, window);
       if (!rect || !largestObscuringWindowSize || !toplevelWindow) {
         fprintf(stderr, "[Gamescope WSI] canBypassXWayland: failed to get window info for window 0x%x.\n", window);
         return false;
       }
 
-      auto toplevelRect = xcb::getWindowRect(connection, *toplevelWindow);
+      auto toplevelRect = xcb::getWindowRect(queryConnection, *toplevelWindow);
       if (!toplevelRect) {
         fprintf(stderr, "[Gamescope WSI] canBypassXWayland: failed to get window info for window 0x%x.\n", window);
         return false;
@@ -813,6 +832,7 @@ namespace GamescopeWSILayer {
         .window          = window,
         .flags           = flags,
         .hdrOutput       = hdrOutput,
+        .windowWatcher   = xcb::WindowWatcher::create(connection, window),
       });
 
       DumpGamescopeSurfaceState(gamescopeInstance, gamescopeSurface);
@@ -2,8 +2,18 @@
 
 #include <X11/Xlib-xcb.h>
 #include <xcb/composite.h>
+#include <atomic>
+#include <charconv>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
 
 namespace xcb {
 
@@ -149,6 +159,214 @@ namespace xcb {
     return largestExtent;
   }
 
+  // Works out which X display the app's connection is talking to from the
+  // socket it connected on, so we can open our own connection to the same
+  // server rather than whatever $DISPLAY happens to say.
+  static std::optional<std::string> getDisplayName(xcb_connection_t* connection) {
+    sockaddr_un addr = {};
+    socklen_t addrLen = sizeof(addr);
+    if (getpeername(xcb_get_file_descriptor(connection), reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0 || addr.sun_family != AF_UNIX)
+      return std::nullopt;
+
+    // Either /tmp/.X11-unix/X<n>, or the same in the abstract namespace.
+    const char* path = addr.sun_path[0] == '\0' ? &addr.sun_path[1] : addr.sun_path;
+    const size_t pathLen = strnlen(path, sizeof(addr.sun_path) - (path - addr.sun_path));
+    std::string_view pathView{ path, pathLen };
+
+    static constexpr std::string_view socketPrefix = "/tmp/.X11-unix/X";
+    if (!pathView.starts_with(socketPrefix))
+      return std::nullopt;
+
+    std::string_view displayNumber = pathView.substr(socketPrefix.size());
+    uint32_t number = 0;
+    auto result = std::from_chars(displayNumber.data(), displayNumber.data() + displayNumber.size(), number);
+    if (result.ec != std::errc{} || result.ptr != displayNumber.data() + displayNumber.size())
+      return std::nullopt;
+
+    return ":" + std::to_string(number);
+  }
+
+  // A private connection to the app's X server that WindowWatchers listen
+  // for structure events on.
+  //
+  // This needs to be separate from the app's connection: event masks are
+  // per-client, so selecting on the app's connection would clobber the app's
+  // own mask and put our events in its queue.
+  // It is shared between all the surfaces of one app connection though,
+  // rather than opening a connection per surface.
+  class WatcherConnection {
+  public:
+    static std::shared_ptr<WatcherConnection> get(xcb_connection_t* appConnection) {
+      static std::mutex s_mutex;
+      static std::unordered_map<xcb_connection_t*, std::weak_ptr<WatcherConnection>> s_connections;
+
+      std::scoped_lock lock{ s_mutex };
+
+      std::erase_if(s_connections, [](const auto& entry) { return entry.second.expired(); });
+
+      if (auto iter = s_connections.find(appConnection); iter != s_connections.end())
+        return iter->second.lock();
+
+      auto displayName = getDisplayName(appConnection);
+      if (!displayName) {
+        fprintf(stderr, "[Gamescope WSI] WatcherConnection: couldn't work out the app's display, not caching window state.\n");
+        return nullptr;
+      }
+
+      xcb_connection_t* connection = xcb_connect(displayName->c_str(), nullptr);
+      if (xcb_connection_has_error(connection)) {
+        fprintf(stderr, "[Gamescope WSI] WatcherConnection: failed to connect to %s, not caching window state.\n", displayName->c_str());
+        xcb_disconnect(connection);
+        return nullptr;
+      }
+
+      // Make sure we really ended up on the same server as the app.
+      xcb_window_t appRoot = xcb_setup_roots_iterator(xcb_get_setup(appConnection)).data->root;
+      xcb_window_t ourRoot = xcb_setup_roots_iterator(xcb_get_setup(connection)).data->root;
+      if (appRoot != ourRoot) {
+        xcb_disconnect(connection);
+        return nullptr;
+      }
+
+      auto watcherConnection = std::shared_ptr<WatcherConnection>(new WatcherConnection(connection));
+      s_connections[appConnection] = watcherConnection;
+      return watcherConnection;
+    }
+
+    ~WatcherConnection() {
+      xcb_disconnect(m_connection);
+    }
+
+    WatcherConnection(const WatcherConnection&) = delete;
+    WatcherConnection& operator=(const WatcherConnection&) = delete;
+
+    xcb_connection_t* connection() const { return m_connection; }
+
+    // Drains any pending events without blocking, and returns a generation
+    // that changes whenever anything happened to any watched window tree.
+    //
+    // Returns nullopt once the connection has broken. That is latched and
+    // only logged the first time, callers should stop using the connection.
+    std::optional<uint64_t> poll() {
+      if (m_failed.load(std::memory_order_acquire))
+        return std::nullopt;
+
+      std::scoped_lock lock{ m_pollMutex };
+
+      if (xcb_connection_has_error(m_connection)) {
+        if (!m_failed.exchange(true, std::memory_order_acq_rel))
+          fprintf(stderr, "[Gamescope WSI] WatcherConnection: connection broke, not caching window state anymore.\n");
+        return std::nullopt;
+      }
+
+      while (auto event = Reply<xcb_generic_event_t>{ xcb_poll_for_event(m_connection) })
+        m_generation++;
+
+      return m_generation;
+    }
+
+  private:
+    WatcherConnection(xcb_connection_t* connection)
+      : m_connection(connection) {}
+
+    xcb_connection_t* m_connection;
+    std::mutex m_pollMutex;
+    uint64_t m_generation = 0;
+    std::atomic<bool> m_failed = { false };
+  };
+
+  // Watches a window and its ancestors for structure changes (configure,
+  // map/unmap, reparent, child creation/destruction), so something derived
+  // from the window tree can be cached and only re-queried when the tree
+  // actually changed.
+  class WindowWatcher {
+  public:
+    static std::unique_ptr<WindowWatcher> create(xcb_connection_t* appConnection, xcb_window_t window) {
+      auto connection = WatcherConnection::get(appConnection);
+      if (!connection)
+        return nullptr;
+
+      // Make sure the window is visible from our connection.
+      xcb_get_geometry_cookie_t cookie = xcb_get_geometry(connection->connection(), window);
+      auto reply = Reply<xcb_get_geometry_reply_t>{ xcb_get_geometry_reply(connection->connection(), cookie, nullptr) };
+      if (!reply)
+        return nullptr;
+
+      return std::unique_ptr<WindowWatcher>(new WindowWatcher(std::move(connection), window));
+    }
+
+    WindowWatcher(const WindowWatcher&) = delete;
+    WindowWatcher& operator=(const WindowWatcher&) = delete;
+
+    // Returns the cached result of compute(connection, toplevelWindow),
+    // re-evaluating it only if the window tree may have changed since.
+    // Returns nullopt if the connection broke, callers should query
+    // on their own connection then.
+    //
+    // Presents can come in on any thread, so the cached result is atomic
+    // and re-evaluations are serialized.
+    template <typename Compute>
+    std::optional<bool> cached(Compute&& compute) {
+      auto generation = m_connection->poll();
+      if (!generation)
+        return std::nullopt;
+
+      uint64_t cachedResult = m_cachedResult.load(std::memory_order_acquire);
+      if (cachedResult != 0 && cachedResult >> 2 == *generation)
+        return !!(cachedResult & 1);
+
+      std::scoped_lock lock{ m_computeMutex };
+
+      // Selecting events happens before the queries in compute, so a change
+      // after those queries is guaranteed to bump the generation again.
+      auto toplevelWindow = watchTree();
+      bool result = compute(m_connection->connection(), toplevelWindow);
+
+      m_cachedResult.store((*generation << 2) | 2 | uint64_t(result), std::memory_order_release);
+      return result;
+    }
+
+  private:
+    WindowWatcher(std::shared_ptr<WatcherConnection> connection, xcb_window_t window)
+      : m_connection(std::move(connection)), m_window(window) {}
+
+    // (Re-)selects structure events on the window and the path up to
+    // its toplevel, which may have changed after a reparent, and returns
+    // the toplevel.
+    std::optional<xcb_window_t> watchTree() {
+      // The same mask on everything, as the connection is shared and one
+      // surface's ancestor may be another surface's window.
+      static constexpr uint32_t eventMask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+
+      xcb_connection_t* connection = m_connection->connection();
+      xcb_change_window_attributes(connection, m_window, XCB_CW_EVENT_MASK, &eventMask);
+
+      xcb_window_t window = m_window;
+      for (;;) {
+        xcb_query_tree_cookie_t cookie = xcb_query_tree(connection, window);
+        auto reply = Reply<xcb_query_tree_reply_t>{ xcb_query_tree_reply(connection, cookie, nullptr) };
+
+        if (!reply) {
+          fprintf(stderr, "[Gamescope WSI] WindowWatcher: xcb_query_tree failed for window 0x%x.\n", window);
+          return std::nullopt;
+        }
+
+        if (reply->root == reply->parent)
+          return window;
+
+        window = reply->parent;
+        xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK, &eventMask);
+      }
+    }
+
+    std::shared_ptr<WatcherConnection> m_connection;
+    xcb_window_t m_window;
+
+    std::mutex m_computeMutex;
+    // Generation << 2 | valid << 1 | result.
+    std::atomic<uint64_t> m_cachedResult = { 0 };
+  };
+
 }
 
 inline int32_t iabs(int32_t a) {
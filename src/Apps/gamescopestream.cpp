@@ -91,6 +91,10 @@ struct data {
     bool needs_decor_commit;
 
     uint32_t appid;
+
+    // Bumped whenever the format is renegotiated, so cached imports
+    // made against the old format get re-imported on next use.
+    uint32_t uFormatGeneration;
  
     std::unordered_map<uint32_t, std::vector<uint64_t>> m_FormatModifiers;
  
@@ -190,6 +194,99 @@ void commit_libdecor( struct data *data, libdecor_configuration *pConfiguration
     data->needs_decor_commit = false;
 }
  
+// Imported wl_buffer for a pw_buffer, kept in pw_buffer::user_data.
+//
+// PipeWire cycles through the same handful of buffers, so we import each one
+// once and reuse the wl_buffer until the buffer is removed or the format is
+// renegotiated, instead of re-importing the dmabuf every frame.
+struct StreamBuffer
+{
+    struct data *pData = nullptr;
+    pw_buffer *pPipewireBuffer = nullptr;
+    wl_buffer *pWaylandBuffer = nullptr;
+    uint32_t uFormatGeneration = 0;
+};
+
+static void destroy_stream_buffer_import( StreamBuffer *pStreamBuffer )
+{
+    if ( pStreamBuffer->pWaylandBuffer )
+    {
+        wl_buffer_destroy( pStreamBuffer->pWaylandBuffer );
+        pStreamBuffer->pWaylandBuffer = nullptr;
+    }
+}
+
+static wl_buffer *import_stream_buffer( struct data *data, struct spa_buffer *buf )
+{
+    zwp_linux_buffer_params_v1 *pBufferParams = zwp_linux_dmabuf_v1_create_params( data->pLinuxDmabuf );
+    if ( !pBufferParams )
+        return nullptr;
+
+    for ( uint32_t i = 0; i < buf->n_datas; i++ )
+    {
+        zwp_linux_buffer_params_v1_add(
+            pBufferParams,
+            buf->datas[i].fd,
+            i,
+            buf->datas[i].chunk->offset,
+            buf->datas[i].chunk->stride,
+            data->format.info.raw.modifier >> 32,
+            data->format.info.raw.modifier & 0xffffffff);
+    }
+
+    uint32_t uDrmFormat = spa_format_to_drm(data->format.info.raw.format);
+    
+    wl_buffer *pImportedBuffer = zwp_linux_buffer_params_v1_create_immed(
+        pBufferParams,
+        data->format.info.raw.size.width,
+        data->format.info.raw.size.height,
+        uDrmFormat,
+        0u );
+    zwp_linux_buffer_params_v1_destroy( pBufferParams );
+
+    return pImportedBuffer;
+}
+
+static StreamBuffer *get_stream_buffer( struct data *data, pw_buffer *b )
+{
+    StreamBuffer *pStreamBuffer = (StreamBuffer *)b->user_data;
+    if ( !pStreamBuffer )
+    {
+        pStreamBuffer = new StreamBuffer
+        {
+            .pData = data,
+            .pPipewireBuffer = b,
+        };
+        b->user_data = pStreamBuffer;
+    }
+
+    // We only get here with buffers PipeWire handed back to us,
+    // so the compositor is done with any old import.
+    if ( pStreamBuffer->pWaylandBuffer && pStreamBuffer->uFormatGeneration != data->uFormatGeneration )
+        destroy_stream_buffer_import( pStreamBuffer );
+
+    if ( pStreamBuffer->pWaylandBuffer )
+        return pStreamBuffer;
+
+    wl_buffer *pImportedBuffer = import_stream_buffer( data, b->buffer );
+    if ( !pImportedBuffer )
+        return nullptr;
+
+    static constexpr wl_buffer_listener s_BufferListener =
+    {
+        .release = []( void *pData, wl_buffer *pBuffer )
+        {
+            StreamBuffer *pStreamBuffer = ( StreamBuffer * )pData;
+            pw_stream_queue_buffer( pStreamBuffer->pData->stream, pStreamBuffer->pPipewireBuffer );
+        },
+    };
+    wl_buffer_add_listener( pImportedBuffer, &s_BufferListener, pStreamBuffer );
+
+    pStreamBuffer->pWaylandBuffer = pImportedBuffer;
+    pStreamBuffer->uFormatGeneration = data->uFormatGeneration;
+    return pStreamBuffer;
+}
+ 
 /* our data processing function is in general:
  *
  *  struct pw_buffer *b;
@@ -229,62 +326,14 @@ on_process(void *_data)
  
     handle_events(data);
 
-    zwp_linux_buffer_params_v1 *pBufferParams = zwp_linux_dmabuf_v1_create_params( data->pLinuxDmabuf );
-    if ( !pBufferParams )
+    StreamBuffer *pStreamBuffer = get_stream_buffer( data, b );
+    if ( !pStreamBuffer )
     {
         pw_stream_queue_buffer(stream, b);
         return;
     }
 
-    for ( uint32_t i = 0; i < buf->n_datas; i++ )
-    {
-        zwp_linux_buffer_params_v1_add(
-            pBufferParams,
-            buf->datas[i].fd,
-            i,
-            buf->datas[i].chunk->offset,
-            buf->datas[i].chunk->stride,
-            data->format.info.raw.modifier >> 32,
-            data->format.info.raw.modifier & 0xffffffff);
-    }
-
-    uint32_t uDrmFormat = spa_format_to_drm(data->format.info.raw.format);
-    
-    wl_buffer *pImportedBuffer = zwp_linux_buffer_params_v1_create_immed(
-        pBufferParams,
-        data->format.info.raw.size.width,
-        data->format.info.raw.size.height,
-        uDrmFormat,
-        0u );
-
-    assert( pImportedBuffer );
-
-    struct StreamBuffer
-    {
-        struct data *pData = nullptr;
-        wl_buffer *pWaylandBuffer = nullptr;
-        pw_buffer *pPipewireBuffer = nullptr;
-    };
-
-    StreamBuffer *pStreamBuffer = new StreamBuffer
-    {
-        .pData = data,
-        .pWaylandBuffer = pImportedBuffer,
-        .pPipewireBuffer = b,
-    };
-    static constexpr wl_buffer_listener s_BufferListener =
-    {
-        .release = []( void *pData, wl_buffer *pBuffer )
-        {
-            StreamBuffer *pStreamBuffer = ( StreamBuffer * )pData;
-            pw_stream_queue_buffer( pStreamBuffer->pData->stream, pStreamBuffer->pPipewireBuffer );
-            wl_buffer_destroy( pStreamBuffer->pWaylandBuffer );
-            delete pStreamBuffer;
-        },
-    };
-    wl_buffer_add_listener( pImportedBuffer, &s_BufferListener, pStreamBuffer );
-
-    wl_surface_attach( data->pSurface, pImportedBuffer, 0, 0 );
+    wl_surface_attach( data->pSurface, pStreamBuffer->pWaylandBuffer, 0, 0 );
     wl_surface_damage( data->pSurface, 0, 0, INT32_MAX, INT32_MAX );
     wl_surface_set_buffer_scale( data->pSurface, 1 );
 
@@ -351,6 +400,7 @@ on_stream_param_changed(void *_data, uint32_t id, const struct spa_pod *param)
     /* call a helper function to parse the format for us. */
     spa_format_video_raw_parse(param, &data->format.info.raw);
     data->size = data->format.info.raw.size;
+    data->uFormatGeneration++;
  
     uint32_t drm_format = spa_format_to_drm(data->format.info.raw.format);
     if (drm_format == DRM_FORMAT_INVALID) {
@@ -378,11 +428,28 @@ on_stream_param_changed(void *_data, uint32_t id, const struct spa_pod *param)
     pw_stream_update_params(stream, params, 1);
 }
  
+/* PipeWire is done with this buffer, drop our import of it.
+ *
+ * If the compositor still holds it, we will never see the release,
+ * which is fine as the buffer must not be queued again anyway. */
+static void
+on_stream_remove_buffer(void *_data, struct pw_buffer *b)
+{
+    StreamBuffer *pStreamBuffer = (StreamBuffer *)b->user_data;
+    if (!pStreamBuffer)
+        return;
+
+    destroy_stream_buffer_import( pStreamBuffer );
+    delete pStreamBuffer;
+    b->user_data = nullptr;
+}
+ 
 /* these are the stream events we listen for */
 static const struct pw_stream_events stream_events = {
     .version = PW_VERSION_STREAM_EVENTS,
     .state_changed = on_stream_state_changed,
     .param_changed = on_stream_param_changed,
+    .remove_buffer = on_stream_remove_buffer,
     .process = on_process,
 };
  
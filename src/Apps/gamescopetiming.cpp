@@ -0,0 +1,198 @@
+#include "../FrameTiming.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gamescope
+{
+    // Reads the frame timing ring that Gamescope exports through
+    // GAMESCOPE_FRAME_TIMING_FILE and dumps it as CSV.
+    //
+    // Without --follow, it prints whatever is currently in the ring and exits.
+    // With --follow, it keeps polling for new frames until killed.
+
+    static void PrintUsage()
+    {
+        fprintf( stderr,
+            "usage: gamescopetiming [options] [path]\n"
+            "Dumps Gamescope's frame timing records as CSV.\n"
+            "If no path is given, GAMESCOPE_FRAME_TIMING_FILE is used.\n"
+            "\n"
+            "  -f, --follow      keep printing new frames as they are presented\n"
+            "  -h, --help        show this help message\n" );
+    }
+
+    static void PrintCSVHeader()
+    {
+        printf( "frame,target_vblank_ns,wakeup_ns,present_ns,draw_time_ns,base_commit_id,base_commit_ready_ns,present_latency_ns,layer_count,composited,async,new_commit,fifo\n" );
+    }
+
+    static void PrintCSVRecord( const FrameTimingRecord_t &record )
+    {
+        printf( "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u,%d,%d,%d,%d\n",
+            record.ulFrame,
+            record.ulTargetVBlank,
+            record.ulWakeupTime,
+            record.ulPresentTime,
+            record.ulDrawTime,
+            record.ulBaseCommitID,
+            record.ulBaseCommitReadyTime,
+            record.ulPresentLatency,
+            record.uLayerCount,
+            !!( record.uFlags & FRAME_TIMING_FLAG_COMPOSITED ),
+            !!( record.uFlags & FRAME_TIMING_FLAG_ASYNC ),
+            !!( record.uFlags & FRAME_TIMING_FLAG_NEW_COMMIT ),
+            !!( record.uFlags & FRAME_TIMING_FLAG_FIFO ) );
+    }
+
+    // Copies a record out of the ring, returns false if the writer
+    // was touching it or it has since been overwritten by a newer frame.
+    static bool ReadRecord( const FrameTimingRecord_t &shared, uint64_t ulFrame, FrameTimingRecord_t *pOutRecord )
+    {
+        const uint64_t ulSequence = shared.ulSequence.load( std::memory_order_acquire );
+        if ( ulSequence & 1 )
+            return false;
+
+        pOutRecord->ulFrame = shared.ulFrame;
+        pOutRecord->ulTargetVBlank = shared.ulTargetVBlank;
+        pOutRecord->ulWakeupTime = shared.ulWakeupTime;
+        pOutRecord->ulPresentTime = shared.ulPresentTime;
+        pOutRecord->ulDrawTime = shared.ulDrawTime;
+        pOutRecord->ulBaseCommitID = shared.ulBaseCommitID;
+        pOutRecord->ulBaseCommitReadyTime = shared.ulBaseCommitReadyTime;
+        pOutRecord->ulPresentLatency = shared.ulPresentLatency;
+        pOutRecord->uLayerCount = shared.uLayerCount;
+        pOutRecord->uFlags = shared.uFlags;
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( shared.ulSequence.load( std::memory_order_relaxed ) != ulSequence )
+            return false;
+
+        return pOutRecord->ulFrame == ulFrame;
+    }
+
+    int GamescopeTimingProcess( int argc, char **argv )
+    {
+        static constexpr struct option k_TimingOptions[] =
+        {
+            { "follow", no_argument, nullptr, 'f' },
+            { "help",   no_argument, nullptr, 'h' },
+            {},
+        };
+
+        bool bFollow = false;
+
+        int nOption = -1;
+        while ( ( nOption = getopt_long( argc, argv, "fh", k_TimingOptions, nullptr ) ) != -1 )
+        {
+            switch ( nOption )
+            {
+                case 'f':
+                    bFollow = true;
+                    break;
+                case 'h':
+                    PrintUsage();
+                    return 0;
+                default:
+                    PrintUsage();
+                    return 1;
+            }
+        }
+
+        const char *pszPath = optind < argc ? argv[ optind ] : getenv( "GAMESCOPE_FRAME_TIMING_FILE" );
+        if ( !pszPath || !*pszPath )
+        {
+            fprintf( stderr, "gamescopetiming: No path given and GAMESCOPE_FRAME_TIMING_FILE is not set.\n" );
+            return 1;
+        }
+
+        int nFd = open( pszPath, O_RDONLY | O_CLOEXEC );
+        if ( nFd < 0 )
+        {
+            fprintf( stderr, "gamescopetiming: Failed to open %s: %s\n", pszPath, strerror( errno ) );
+            return 1;
+        }
+
+        struct stat fileStat;
+        if ( fstat( nFd, &fileStat ) != 0 || size_t( fileStat.st_size ) < sizeof( FrameTimingHeader_t ) )
+        {
+            fprintf( stderr, "gamescopetiming: %s is not a frame timing file.\n", pszPath );
+            close( nFd );
+            return 1;
+        }
+
+        void *pMapping = mmap( nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, nFd, 0 );
+        close( nFd );
+        if ( pMapping == MAP_FAILED )
+        {
+            fprintf( stderr, "gamescopetiming: Failed to map %s: %s\n", pszPath, strerror( errno ) );
+            return 1;
+        }
+
+        const FrameTimingHeader_t *pHeader = reinterpret_cast<const FrameTimingHeader_t *>( pMapping );
+        if ( pHeader->uMagic.load( std::memory_order_acquire ) != k_uFrameTimingMagic )
+        {
+            fprintf( stderr, "gamescopetiming: %s has not been initialized by Gamescope.\n", pszPath );
+            return 1;
+        }
+
+        if ( pHeader->uVersion != k_uFrameTimingVersion ||
+             pHeader->uRecordSize != sizeof( FrameTimingRecord_t ) ||
+             pHeader->uRecordCount == 0 ||
+             pHeader->uHeaderSize + size_t( pHeader->uRecordSize ) * pHeader->uRecordCount > size_t( fileStat.st_size ) )
+        {
+            fprintf( stderr, "gamescopetiming: Unsupported frame timing version %u (expected %u).\n", pHeader->uVersion, k_uFrameTimingVersion );
+            return 1;
+        }
+
+        const FrameTimingRecord_t *pRecords = GetFrameTimingRecords( pHeader );
+        const uint32_t uRecordCount = pHeader->uRecordCount;
+
+        PrintCSVHeader();
+
+        uint64_t ulWriteCount = pHeader->ulWriteCount.load( std::memory_order_acquire );
+        uint64_t ulNextFrame = ulWriteCount > uRecordCount ? ulWriteCount - uRecordCount : 0;
+        for ( ;; )
+        {
+            // If we fell behind by more than a whole ring, skip ahead.
+            if ( ulWriteCount - ulNextFrame > uRecordCount )
+            {
+                uint64_t ulNewNextFrame = ulWriteCount - uRecordCount;
+                fprintf( stderr, "gamescopetiming: Missed %" PRIu64 " frames.\n", ulNewNextFrame - ulNextFrame );
+                ulNextFrame = ulNewNextFrame;
+            }
+
+            for ( ; ulNextFrame < ulWriteCount; ulNextFrame++ )
+            {
+                FrameTimingRecord_t record;
+                if ( ReadRecord( pRecords[ ulNextFrame % uRecordCount ], ulNextFrame, &record ) )
+                    PrintCSVRecord( record );
+            }
+
+            if ( !bFollow )
+                break;
+
+            fflush( stdout );
+
+            // Roughly twice a frame at 240Hz.
+            usleep( 2'000 );
+            ulWriteCount = pHeader->ulWriteCount.load( std::memory_order_acquire );
+        }
+
+        return 0;
+    }
+}
+
+int main( int argc, char **argv )
+{
+    return gamescope::GamescopeTimingProcess( argc, argv );
+}
@@ -27,6 +27,7 @@
 
 #include "backend.h"
 #include "color_helpers.h"
+#include "DRMCompositeFence.h"
 #include "Utils/Defer.h"
 #include "drm_include.h"
 #include "edid.h"
@@ -69,6 +70,7 @@ gamescope::ConVar<bool> cv_drm_debug_disable_color_encoding( "drm_debug_disable_
 gamescope::ConVar<bool> cv_drm_debug_disable_color_range( "drm_debug_disable_color_range", false, "YUV Color Range chicken bit. (Forces COLOR_RANGE to DEFAULT, does not affect other logic)" );
 gamescope::ConVar<bool> cv_drm_debug_disable_explicit_sync( "drm_debug_disable_explicit_sync", false, "Force disable explicit sync on the DRM backend." );
 gamescope::ConVar<bool> cv_drm_debug_disable_in_fence_fd( "drm_debug_disable_in_fence_fd", false, "Force disable IN_FENCE_FD being set to avoid over-synchronization on the DRM backend." );
+gamescope::ConVar<bool> cv_drm_composite_in_fence( "drm_composite_in_fence", true, "Flip composited frames with the composite as IN_FENCE_FD instead of waiting for composition to finish on the CPU." );
 
 // HACK:
 // Workaround for AMDGPU bug on SteamOS 3.6 right now.
@@ -481,6 +483,10 @@ struct drm_t {
 	// Accessed only on page flip handler thread.
 	std::vector<gamescope::Rc<gamescope::IBackendFb>> m_VisibleFbIds;
 
+	// Composite that is still in flight, see CDRMCompositeFence.
+	// Accessed only on req thread
+	gamescope::CDRMCompositeFence compositeFence;
+
 	std::mutex flip_lock;
 
 	std::atomic < bool > paused;
@@ -2360,7 +2366,7 @@ drm_prepare_liftoff( struct drm_t *drm, const struct FrameInfo_t *frameInfo, boo
 				return -EINVAL;
 			}
 
-			const int nFence = cv_drm_debug_disable_in_fence_fd ? -1 : g_nAlwaysSignalledSyncFile;
+			const int nFence = drm->compositeFence.GetInFence( pLayer->tex.get(), g_nAlwaysSignalledSyncFile, cv_drm_debug_disable_in_fence_fd );
 
 
 			liftoff_layer_set_property( drm->lo_layers[ i ], "FB_ID", pDrmFb->GetFbId());
@@ -2536,6 +2542,8 @@ drm_prepare_liftoff( struct drm_t *drm, const struct FrameInfo_t *frameInfo, boo
 			liftoff_layer_set_property( drm->lo_layers[ i ], "IN_FENCE_FD", -1 );
 		}
 
+		drm->compositeFence.Wait();
+
 		ret = liftoff_output_apply( drm->lo_output, drm->req, drm->flags, &lo_options );
 
 		if ( ret == 0 )
@@ -3314,7 +3322,19 @@ namespace gamescope
 				return -EINVAL;
 			}
 
-			vulkan_wait( *oCompositeResult, true );
+			// If we are flipping what we just composited, let the kernel wait for
+			// the composite through IN_FENCE_FD so we can queue the flip right away.
+			// A deferred partial composition flips an older image instead, so keep
+			// waiting on the CPU for that, which also covers everything before it.
+			const bool bPresentsThisComposite = bNeedsFullComposite || !bDefer;
+			if ( bPresentsThisComposite && SupportsAsyncCompositeFlips() )
+				g_DRM.compositeFence.Set( vulkan_export_sync_file( *oCompositeResult ), vulkan_get_last_output_image( !bNeedsFullComposite, false ).get() );
+
+			// The commit has been submitted by the time we leave, the kernel holds its own reference.
+			defer( g_DRM.compositeFence.Reset() );
+
+			if ( !g_DRM.compositeFence.IsSet() )
+				vulkan_wait( *oCompositeResult, true );
 
 			FrameInfo_t presentCompFrameInfo = {};
 			presentCompFrameInfo.allowVRR = pFrameInfo->allowVRR;
@@ -3400,6 +3420,11 @@ namespace gamescope
 
 			int ret = drm_prepare( &g_DRM, bAsync, &presentCompFrameInfo );
 
+			// Async flips can't change the plane layout, eg. when we
+			// just started compositing, so try a sync flip for that.
+			if ( ret != 0 && ret != -EACCES && bAsync )
+				ret = drm_prepare( &g_DRM, false, &presentCompFrameInfo );
+
 			// Happens when we're VT-switched away
 			if ( ret == -EACCES )
 				return 0;
@@ -3565,6 +3590,14 @@ namespace gamescope
 			return g_bSupportsSyncObjs && !cv_drm_debug_disable_explicit_sync;
 		}
 
+		virtual bool SupportsAsyncCompositeFlips() const override
+		{
+			return cv_drm_composite_in_fence &&
+			       !cv_drm_debug_disable_in_fence_fd &&
+			       g_DRM.bUseLiftoff &&
+			       g_device.supportsSyncFileExport();
+		}
+
 		virtual bool IsVisible() const override
 		{
 			return !g_DRM.paused;
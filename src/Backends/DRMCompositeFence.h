@@ -0,0 +1,85 @@
+#pragma once
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+class CVulkanTexture;
+
+namespace gamescope
+{
+    // The sync file for a composite that is still in flight, which the
+    // DRM backend hands to the kernel as the IN_FENCE_FD of the layer
+    // showing it, instead of waiting for composition on the CPU.
+    //
+    // Owns the sync file, it must stay open until the atomic commit that
+    // uses it has been submitted, and is closed by Reset or on destruction.
+    class CDRMCompositeFence
+    {
+    public:
+        CDRMCompositeFence() = default;
+        ~CDRMCompositeFence() { Reset(); }
+
+        CDRMCompositeFence( const CDRMCompositeFence & ) = delete;
+        CDRMCompositeFence &operator=( const CDRMCompositeFence & ) = delete;
+
+        // Takes ownership of nSyncFile, which signals once pTexture has been composited.
+        // A negative nSyncFile (a failed export) leaves it unset.
+        void Set( int nSyncFile, const CVulkanTexture *pTexture )
+        {
+            Reset();
+            if ( nSyncFile < 0 )
+                return;
+
+            m_nSyncFile = nSyncFile;
+            m_pTexture = pTexture;
+        }
+
+        void Reset()
+        {
+            if ( m_nSyncFile >= 0 )
+                close( m_nSyncFile );
+            m_nSyncFile = -1;
+            m_pTexture = nullptr;
+        }
+
+        bool IsSet() const { return m_nSyncFile >= 0; }
+
+        // What to set as IN_FENCE_FD for a layer showing pTexture.
+        // The composite's sync file if that's what the layer shows, otherwise nDefaultFence.
+        // -1 if IN_FENCE_FD is disabled.
+        int GetInFence( const CVulkanTexture *pTexture, int nDefaultFence, bool bInFenceDisabled ) const
+        {
+            if ( bInFenceDisabled )
+                return -1;
+
+            if ( m_nSyncFile >= 0 && pTexture == m_pTexture )
+                return m_nSyncFile;
+
+            return nDefaultFence;
+        }
+
+        // For when a commit has to go out without IN_FENCE_FD after all,
+        // the kernel won't wait for the composite then so we have to.
+        void Wait() const
+        {
+            if ( m_nSyncFile < 0 )
+                return;
+
+            pollfd fencePollFd =
+            {
+                .fd     = m_nSyncFile,
+                .events = POLLIN,
+            };
+            int nPollRet;
+            do
+            {
+                nPollRet = poll( &fencePollFd, 1, -1 );
+            } while ( nPollRet < 0 && ( errno == EINTR || errno == EAGAIN ) );
+        }
+
+    private:
+        int m_nSyncFile = -1;
+        const CVulkanTexture *m_pTexture = nullptr;
+    };
+}
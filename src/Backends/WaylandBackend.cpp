@@ -11,6 +11,7 @@
 #include "waitable.h"
 #include "Utils/TempFiles.h"
 
+#include <cinttypes>
 #include <cstring>
 #include <unordered_map>
 #include <unordered_set>
@@ -34,6 +35,7 @@
 #include <relative-pointer-unstable-v1-client-protocol.h>
 #include <fractional-scale-v1-client-protocol.h>
 #include <xdg-toplevel-icon-v1-client-protocol.h>
+#include <linux-drm-syncobj-v1-client-protocol.h>
 #include "wlr_end.hpp"
 
 #include "drm_include.h"
@@ -78,6 +80,7 @@ namespace gamescope
     gamescope::ConVar<bool> cv_wayland_mouse_warp_without_keyboard_focus( "wayland_mouse_warp_without_keyboard_focus", true, "Should we only forward mouse warps to the app when we have keyboard focus?" );
     gamescope::ConVar<bool> cv_wayland_mouse_relmotion_without_keyboard_focus( "wayland_mouse_relmotion_without_keyboard_focus", false, "Should we only forward mouse relative motion to the app when we have keyboard focus?" );
     gamescope::ConVar<bool> cv_wayland_use_modifiers( "wayland_use_modifiers", true, "Use DMA-BUF modifiers?" );
+    gamescope::ConVar<bool> cv_wayland_explicit_sync( "wayland_explicit_sync", true, "Hand composited frames to the host compositor with linux-drm-syncobj acquire points instead of waiting for them on the CPU, if supported." );
 
     class CWaylandConnector;
     class CWaylandPlane;
@@ -152,6 +155,14 @@ namespace gamescope
         uint32_t uFractionalScale;
     };
 
+    struct WaylandSyncPoints
+    {
+        wp_linux_drm_syncobj_timeline_v1 *pAcquireTimeline;
+        uint64_t ulAcquirePoint;
+        wp_linux_drm_syncobj_timeline_v1 *pReleaseTimeline;
+        uint64_t ulReleasePoint;
+    };
+
     inline WaylandPlaneState ClipPlane( const WaylandPlaneState &state )
     {
         int32_t nClippedDstWidth  = std::min<int32_t>( g_nOutputWidth,  state.nDstWidth  + state.nDestX ) - state.nDestX;
@@ -179,6 +190,9 @@ namespace gamescope
 
         void Present( std::optional<WaylandPlaneState> oState );
         void Present( const FrameInfo_t::Layer_t *pLayer );
+        // Explicit sync points for the buffer attached by Present.
+        // Passing nullopt puts the surface back on implicit sync.
+        void SetSyncPoints( std::optional<WaylandSyncPoints> oPoints );
 
         void CommitLibDecor( libdecor_configuration *pConfiguration );
         void Commit();
@@ -253,6 +267,7 @@ namespace gamescope
         frog_color_managed_surface *m_pFrogColorManagedSurface = nullptr;
         xx_color_management_surface_v3 *m_pXXColorManagedSurface = nullptr;
         wp_fractional_scale_v1 *m_pFractionalScale = nullptr;
+        wp_linux_drm_syncobj_surface_v1 *m_pSyncobjSurface = nullptr;
         libdecor_window_state m_eWindowState = LIBDECOR_WINDOW_STATE_NONE;
         std::vector<wl_output *> m_pOutputs;
         bool m_bNeedsDecorCommit = false;
@@ -494,6 +509,7 @@ namespace gamescope
     {
     public:
         CWaylandBackend();
+        virtual ~CWaylandBackend();
 
         /////////////
         // IBackend
@@ -554,6 +570,13 @@ namespace gamescope
         bool SupportsColorManagement() const;
         void UpdateCursor();
 
+        bool InitExplicitSync();
+        void DestroyExplicitSync();
+        bool UsingExplicitSync() const { return m_bExplicitSyncInitialized && cv_wayland_explicit_sync; }
+        bool IsOutputImageReleased( CVulkanTexture *pTexture );
+        bool AcquireReleasedOutputImage();
+        std::optional<WaylandSyncPoints> ExportCompositeSyncPoints( uint64_t ulCompositeSeqNo, CVulkanTexture *pTexture );
+
         friend CWaylandConnector;
         friend CWaylandPlane;
         friend CWaylandInputThread;
@@ -572,6 +595,7 @@ namespace gamescope
         xx_color_manager_v3 *GetXXColorManager() const { return m_pXXColorManager; }
         wp_fractional_scale_manager_v1 *GetFractionalScaleManager() const { return m_pFractionalScaleManager; }
         xdg_toplevel_icon_manager_v1 *GetToplevelIconManager() const { return m_pToplevelIconManager; }
+        wp_linux_drm_syncobj_manager_v1 *GetDrmSyncobjManager() const { return m_pDrmSyncobjManager; }
         libdecor *GetLibDecor() const { return m_pLibDecor; }
 
         void SetFullscreen( bool bFullscreen ); // Thread safe, can be called from the input thread.
@@ -650,6 +674,33 @@ namespace gamescope
         zwp_relative_pointer_manager_v1 *m_pRelativePointerManager = nullptr;
         wp_fractional_scale_manager_v1 *m_pFractionalScaleManager = nullptr;
         xdg_toplevel_icon_manager_v1 *m_pToplevelIconManager = nullptr;
+        wp_linux_drm_syncobj_manager_v1 *m_pDrmSyncobjManager = nullptr;
+
+        // Explicit sync for composited frames.
+        // The composite's completion is transferred onto the acquire timeline,
+        // and the host signals the release timeline once it's done with the
+        // output image. They are separate timelines as timeline points must
+        // signal in order, and a release point will only signal after the
+        // acquire point of the frame that replaces it.
+        struct WaylandTimeline
+        {
+            uint32_t uSyncobj = 0;
+            wp_linux_drm_syncobj_timeline_v1 *pTimeline = nullptr;
+            uint64_t ulLastPoint = 0;
+        };
+        bool m_bExplicitSyncInitialized = false;
+        int m_nExplicitSyncDrmFd = -1;
+        WaylandTimeline m_AcquireTimeline;
+        WaylandTimeline m_ReleaseTimeline;
+        // Scratch binary syncobj to import the composite's sync file into.
+        uint32_t m_uSyncFileSyncobj = 0;
+        struct OutputImageRelease_t
+        {
+            // Only used for identity.
+            CVulkanTexture *pTexture = nullptr;
+            uint64_t ulReleasePoint = 0;
+        };
+        std::array<OutputImageRelease_t, 3> m_OutputImageReleases;
 
         struct 
         {
@@ -888,6 +939,8 @@ namespace gamescope
 
     CWaylandPlane::~CWaylandPlane()
     {
+        if ( m_pSyncobjSurface )
+            wp_linux_drm_syncobj_surface_v1_destroy( m_pSyncobjSurface );
     }
 
     bool CWaylandPlane::Init( CWaylandPlane *pParent, CWaylandPlane *pSiblingBelow )
@@ -1038,6 +1091,26 @@ namespace gamescope
         }
     }
 
+    void CWaylandPlane::SetSyncPoints( std::optional<WaylandSyncPoints> oPoints )
+    {
+        if ( !oPoints )
+        {
+            // Any points set before the last commit are unaffected.
+            if ( m_pSyncobjSurface )
+            {
+                wp_linux_drm_syncobj_surface_v1_destroy( m_pSyncobjSurface );
+                m_pSyncobjSurface = nullptr;
+            }
+            return;
+        }
+
+        if ( !m_pSyncobjSurface )
+            m_pSyncobjSurface = wp_linux_drm_syncobj_manager_v1_get_surface( m_pBackend->GetDrmSyncobjManager(), m_pSurface );
+
+        wp_linux_drm_syncobj_surface_v1_set_acquire_point( m_pSyncobjSurface, oPoints->pAcquireTimeline, uint32_t( oPoints->ulAcquirePoint >> 32 ), uint32_t( oPoints->ulAcquirePoint ) );
+        wp_linux_drm_syncobj_surface_v1_set_release_point( m_pSyncobjSurface, oPoints->pReleaseTimeline, uint32_t( oPoints->ulReleasePoint >> 32 ), uint32_t( oPoints->ulReleasePoint ) );
+    }
+
     void CWaylandPlane::CommitLibDecor( libdecor_configuration *pConfiguration )
     {
         libdecor_state *pState = libdecor_state_new( g_nOutputWidth, g_nOutputHeight );
@@ -1360,6 +1433,11 @@ namespace gamescope
     {
     }
 
+    CWaylandBackend::~CWaylandBackend()
+    {
+        DestroyExplicitSync();
+    }
+
     bool CWaylandBackend::Init()
     {
         g_nOutputWidth = g_nPreferredOutputWidth;
@@ -1522,9 +1600,151 @@ namespace gamescope
         if ( g_bForceRelativeMouse )
             this->SetRelativeMouseMode( true );
 
+        m_bExplicitSyncInitialized = InitExplicitSync();
+        xdg_log.infof( "%s explicit sync for composited frames", m_bExplicitSyncInitialized ? "Using" : "Not using" );
+
+        return true;
+    }
+
+    bool CWaylandBackend::InitExplicitSync()
+    {
+        if ( !m_pDrmSyncobjManager || !g_device.supportsSyncFileExport() )
+            return false;
+
+        m_nExplicitSyncDrmFd = g_device.drmRenderFd();
+
+        for ( WaylandTimeline *pTimeline : { &m_AcquireTimeline, &m_ReleaseTimeline } )
+        {
+            if ( drmSyncobjCreate( m_nExplicitSyncDrmFd, 0, &pTimeline->uSyncobj ) != 0 )
+            {
+                xdg_log.errorf_errno( "Failed to create syncobj timeline" );
+                DestroyExplicitSync();
+                return false;
+            }
+
+            int nTimelineFd = -1;
+            if ( drmSyncobjHandleToFD( m_nExplicitSyncDrmFd, pTimeline->uSyncobj, &nTimelineFd ) != 0 )
+            {
+                xdg_log.errorf_errno( "Failed to export syncobj timeline" );
+                DestroyExplicitSync();
+                return false;
+            }
+
+            pTimeline->pTimeline = wp_linux_drm_syncobj_manager_v1_import_timeline( m_pDrmSyncobjManager, nTimelineFd );
+            close( nTimelineFd );
+        }
+
+        if ( drmSyncobjCreate( m_nExplicitSyncDrmFd, 0, &m_uSyncFileSyncobj ) != 0 )
+        {
+            xdg_log.errorf_errno( "Failed to create syncobj" );
+            DestroyExplicitSync();
+            return false;
+        }
+
         return true;
     }
 
+    void CWaylandBackend::DestroyExplicitSync()
+    {
+        m_bExplicitSyncInitialized = false;
+
+        for ( WaylandTimeline *pTimeline : { &m_AcquireTimeline, &m_ReleaseTimeline } )
+        {
+            if ( pTimeline->pTimeline )
+                wp_linux_drm_syncobj_timeline_v1_destroy( pTimeline->pTimeline );
+            if ( pTimeline->uSyncobj )
+                drmSyncobjDestroy( m_nExplicitSyncDrmFd, pTimeline->uSyncobj );
+            *pTimeline = WaylandTimeline{};
+        }
+
+        if ( m_uSyncFileSyncobj )
+            drmSyncobjDestroy( m_nExplicitSyncDrmFd, m_uSyncFileSyncobj );
+        m_uSyncFileSyncobj = 0;
+
+        m_OutputImageReleases = {};
+        m_nExplicitSyncDrmFd = -1;
+    }
+
+    bool CWaylandBackend::IsOutputImageReleased( CVulkanTexture *pTexture )
+    {
+        auto iter = std::find_if( m_OutputImageReleases.begin(), m_OutputImageReleases.end(),
+            [pTexture]( const OutputImageRelease_t &release ) { return release.pTexture == pTexture; } );
+        if ( iter == m_OutputImageReleases.end() )
+            return true;
+
+        uint64_t ulSignalledPoint = 0;
+        if ( drmSyncobjQuery( m_nExplicitSyncDrmFd, &m_ReleaseTimeline.uSyncobj, &ulSignalledPoint, 1u ) != 0 )
+        {
+            xdg_log.errorf_errno( "Failed to query release timeline" );
+            return false;
+        }
+
+        return ulSignalledPoint >= iter->ulReleasePoint;
+    }
+
+    // Makes sure the next composite goes into an output image the host is done with,
+    // skipping over any it still holds. Never blocks, returns false if it holds them all.
+    bool CWaylandBackend::AcquireReleasedOutputImage()
+    {
+        for ( uint32_t i = 0; i < 3; i++ )
+        {
+            if ( IsOutputImageReleased( vulkan_get_next_output_image( false ).get() ) )
+                return true;
+
+            vulkan_skip_output_image();
+        }
+
+        return false;
+    }
+
+    std::optional<WaylandSyncPoints> CWaylandBackend::ExportCompositeSyncPoints( uint64_t ulCompositeSeqNo, CVulkanTexture *pTexture )
+    {
+        int nSyncFile = vulkan_export_sync_file( ulCompositeSeqNo );
+        if ( nSyncFile < 0 )
+            return std::nullopt;
+        defer( close( nSyncFile ) );
+
+        const int nDrmFd = m_nExplicitSyncDrmFd;
+
+        if ( drmSyncobjImportSyncFile( nDrmFd, m_uSyncFileSyncobj, nSyncFile ) != 0 )
+        {
+            xdg_log.errorf_errno( "Failed to import composite sync file" );
+            return std::nullopt;
+        }
+
+        const uint64_t ulAcquirePoint = m_AcquireTimeline.ulLastPoint + 1;
+        if ( drmSyncobjTransfer( nDrmFd, m_AcquireTimeline.uSyncobj, ulAcquirePoint, m_uSyncFileSyncobj, 0, 0 ) != 0 )
+        {
+            xdg_log.errorf_errno( "Failed to transfer composite fence to acquire point" );
+            return std::nullopt;
+        }
+        m_AcquireTimeline.ulLastPoint = ulAcquirePoint;
+
+        const uint64_t ulReleasePoint = ++m_ReleaseTimeline.ulLastPoint;
+
+        // Replace the entry for this image, or the oldest one if it's new to us.
+        auto iter = std::find_if( m_OutputImageReleases.begin(), m_OutputImageReleases.end(),
+            [pTexture]( const OutputImageRelease_t &release ) { return release.pTexture == pTexture; } );
+        if ( iter == m_OutputImageReleases.end() )
+        {
+            iter = std::min_element( m_OutputImageReleases.begin(), m_OutputImageReleases.end(),
+                []( const OutputImageRelease_t &a, const OutputImageRelease_t &b ) { return a.ulReleasePoint < b.ulReleasePoint; } );
+        }
+        *iter = OutputImageRelease_t
+        {
+            .pTexture       = pTexture,
+            .ulReleasePoint = ulReleasePoint,
+        };
+
+        return WaylandSyncPoints
+        {
+            .pAcquireTimeline = m_AcquireTimeline.pTimeline,
+            .ulAcquirePoint   = ulAcquirePoint,
+            .pReleaseTimeline = m_ReleaseTimeline.pTimeline,
+            .ulReleasePoint   = ulReleasePoint,
+        };
+    }
+
     std::span<const char *const> CWaylandBackend::GetInstanceExtensions() const
     {
         return std::span<const char *const>{};
@@ -1603,6 +1823,9 @@ namespace gamescope
 
             if ( !bNeedsFullComposite )
             {
+                // Client buffers go straight to the host with implicit sync.
+                m_Planes[0].SetSyncPoints( std::nullopt );
+
                 bool bNeedsBacking = true;
                 if ( pFrameInfo->layerCount >= 1 )
                 {
@@ -1635,6 +1858,16 @@ namespace gamescope
             }
             else
             {
+                const bool bExplicitSync = UsingExplicitSync();
+
+                // Rather than wait for the host, drop this frame and try again
+                // next time if it's still holding on to every output image.
+                if ( bExplicitSync && !AcquireReleasedOutputImage() )
+                {
+                    force_repaint();
+                    return -EAGAIN;
+                }
+
                 std::optional oCompositeResult = vulkan_composite( (FrameInfo_t *)pFrameInfo, nullptr, false );
 
                 if ( !oCompositeResult )
@@ -1643,7 +1876,16 @@ namespace gamescope
                     return -EINVAL;
                 }
 
-                vulkan_wait( *oCompositeResult, true );
+                gamescope::Rc<CVulkanTexture> pCompositeImage = vulkan_get_last_output_image( false, false );
+
+                // With explicit sync, the host waits for the composite on the GPU.
+                // Otherwise, wait for it here so the host can't sample a half-done frame.
+                std::optional<WaylandSyncPoints> oSyncPoints;
+                if ( bExplicitSync )
+                    oSyncPoints = ExportCompositeSyncPoints( *oCompositeResult, pCompositeImage.get() );
+
+                if ( !oSyncPoints )
+                    vulkan_wait( *oCompositeResult, true );
 
                 FrameInfo_t::Layer_t compositeLayer{};
                 compositeLayer.scale.x = 1.0;
@@ -1651,7 +1893,7 @@ namespace gamescope
                 compositeLayer.opacity = 1.0;
                 compositeLayer.zpos = g_zposBase;
 
-                compositeLayer.tex = vulkan_get_last_output_image( false, false );
+                compositeLayer.tex = pCompositeImage;
                 compositeLayer.applyColorMgmt = false;
 
                 compositeLayer.filter = GamescopeUpscaleFilter::NEAREST;
@@ -1659,6 +1901,7 @@ namespace gamescope
                 compositeLayer.colorspace = pFrameInfo->outputEncodingEOTF == EOTF_PQ ? GAMESCOPE_APP_TEXTURE_COLORSPACE_HDR10_PQ : GAMESCOPE_APP_TEXTURE_COLORSPACE_SRGB;
 
                 m_Planes[0].Present( &compositeLayer );
+                m_Planes[0].SetSyncPoints( oSyncPoints );
 
                 for ( int i = 1; i < 8; i++ )
                     m_Planes[i].Present( nullptr );
@@ -2157,6 +2400,10 @@ namespace gamescope
         {
             m_pToplevelIconManager = (xdg_toplevel_icon_manager_v1 *)wl_registry_bind( pRegistry, uName, &xdg_toplevel_icon_manager_v1_interface, 1u );
         }
+        else if ( !strcmp( pInterface, wp_linux_drm_syncobj_manager_v1_interface.name ) )
+        {
+            m_pDrmSyncobjManager = (wp_linux_drm_syncobj_manager_v1 *)wl_registry_bind( pRegistry, uName, &wp_linux_drm_syncobj_manager_v1_interface, 1u );
+        }
     }
 
     void CWaylandBackend::Wayland_Modifier( zwp_linux_dmabuf_v1 *pDmabuf, uint32_t uFormat, uint32_t uModifierHi, uint32_t uModifierLo )
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the frame timing file exported through GAMESCOPE_FRAME_TIMING_FILE.
+//
+// The file is a header followed by a ring of fixed-size records, one per
+// presented frame. Gamescope is the only writer, any number of readers can
+// mmap the file read-only and poll it without syscalls.
+//
+// Each record is protected by its own sequence number (seqlock):
+// it is odd while the record is being written, and even once it is complete.
+// Readers copy the record and then re-check the sequence, discarding the copy
+// if it changed underneath them.
+//
+// Bump k_uFrameTimingVersion when changing anything in here, readers must
+// reject versions they do not know.
+
+namespace gamescope
+{
+    static constexpr uint32_t k_uFrameTimingMagic = 0x54465347; // 'GSFT'
+    static constexpr uint32_t k_uFrameTimingVersion = 1;
+    static constexpr uint32_t k_uFrameTimingRecordCount = 1024;
+
+    enum FrameTimingFlags : uint32_t
+    {
+        // The frame went through the Vulkan composite rather than
+        // being scanned out directly.
+        FRAME_TIMING_FLAG_COMPOSITED     = ( 1u << 0 ),
+        // The frame was an async (tearing) flip.
+        FRAME_TIMING_FLAG_ASYNC          = ( 1u << 1 ),
+        // The base plane commit is different from the previous frame's.
+        FRAME_TIMING_FLAG_NEW_COMMIT     = ( 1u << 2 ),
+        // The base plane commit came from a FIFO swapchain.
+        FRAME_TIMING_FLAG_FIFO           = ( 1u << 3 ),
+    };
+
+    struct FrameTimingRecord_t
+    {
+        std::atomic<uint64_t> ulSequence;
+
+        // Index of this frame, the record lives at ulFrame % uRecordCount.
+        uint64_t ulFrame;
+
+        // All times are CLOCK_MONOTONIC nanoseconds.
+        uint64_t ulTargetVBlank;
+        uint64_t ulWakeupTime;
+        uint64_t ulPresentTime;
+        // Wake-up to page flip, as fed back into the vblank timer.
+        uint64_t ulDrawTime;
+
+        // Commit that was on the base plane, and when its buffer became ready.
+        uint64_t ulBaseCommitID;
+        uint64_t ulBaseCommitReadyTime;
+        // ulPresentTime - ulBaseCommitReadyTime, or 0 if unknown.
+        uint64_t ulPresentLatency;
+
+        uint32_t uLayerCount;
+        uint32_t uFlags;
+    };
+
+    struct FrameTimingHeader_t
+    {
+        // Written last, once the rest of the header is valid.
+        std::atomic<uint32_t> uMagic;
+        uint32_t uVersion;
+        uint32_t uHeaderSize;
+        uint32_t uRecordSize;
+        uint32_t uRecordCount;
+        uint32_t uPad;
+        // Total number of records ever written.
+        // The newest one is at ( ulWriteCount - 1 ) % uRecordCount.
+        alignas( 64 ) std::atomic<uint64_t> ulWriteCount;
+    };
+
+    static_assert( std::atomic<uint64_t>::is_always_lock_free, "Frame timing file needs lock-free atomics to be shared across processes." );
+
+    static constexpr size_t k_zFrameTimingHeaderSize = ( sizeof( FrameTimingHeader_t ) + 63 ) & ~size_t( 63 );
+    static constexpr size_t k_zFrameTimingFileSize = k_zFrameTimingHeaderSize + sizeof( FrameTimingRecord_t ) * k_uFrameTimingRecordCount;
+
+    inline FrameTimingRecord_t *GetFrameTimingRecords( FrameTimingHeader_t *pHeader )
+    {
+        return reinterpret_cast<FrameTimingRecord_t *>( reinterpret_cast<uint8_t *>( pHeader ) + pHeader->uHeaderSize );
+    }
+
+    inline const FrameTimingRecord_t *GetFrameTimingRecords( const FrameTimingHeader_t *pHeader )
+    {
+        return reinterpret_cast<const FrameTimingRecord_t *>( reinterpret_cast<const uint8_t *>( pHeader ) + pHeader->uHeaderSize );
+    }
+}
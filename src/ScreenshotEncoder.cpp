@@ -0,0 +1,390 @@
+#include "ScreenshotEncoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Utils/Defer.h"
+
+namespace gamescope
+{
+    // Screenshots are taken on their own thread, so it's fine to use
+    // a good chunk of the machine for the second or so it takes.
+    static constexpr uint32_t k_uMaxScreenshotThreads = 8;
+
+    // 64 rows of 4K RGB is ~720KiB per band.
+    // Big enough that each band compresses well on its own,
+    // small enough that a wave of them doesn't add up to much.
+    static constexpr uint32_t k_uScreenshotBandRows = 64;
+
+    static constexpr int k_nPNGCompressionLevel = 6;
+
+    uint32_t GetScreenshotThreadCount()
+    {
+        static const uint32_t s_uThreads = std::clamp( std::thread::hardware_concurrency(), 1u, k_uMaxScreenshotThreads );
+        return s_uThreads;
+    }
+
+    // Calls fnBand( uBand, uWorker ) for every band in [uFirstBand, uFirstBand + uBandCount),
+    // spread between the calling thread and uWorkers - 1 short-lived workers.
+    template <typename Fn>
+    static void ParallelForBands( uint32_t uFirstBand, uint32_t uBandCount, uint32_t uWorkers, Fn &fnBand )
+    {
+        uWorkers = std::clamp( uWorkers, 1u, uBandCount );
+
+        std::atomic<uint32_t> uNextBand = { 0 };
+        auto runWorker = [&]( uint32_t uWorker )
+        {
+            uint32_t uBand;
+            while ( ( uBand = uNextBand++ ) < uBandCount )
+                fnBand( uFirstBand + uBand, uWorker );
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve( uWorkers - 1 );
+        for ( uint32_t uWorker = 1; uWorker < uWorkers; uWorker++ )
+            workers.emplace_back( runWorker, uWorker );
+
+        runWorker( 0 );
+
+        for ( std::thread &worker : workers )
+            worker.join();
+    }
+
+    //
+    // A2R10G10B10 -> planes
+    //
+
+    void SplitScreenshotA2R10G10B10( const ScreenshotImage_t &image,
+        uint16_t *pR, uint32_t uRRowBytes,
+        uint16_t *pG, uint32_t uGRowBytes,
+        uint16_t *pB, uint32_t uBRowBytes )
+    {
+        const uint32_t uBands = ( image.uHeight + k_uScreenshotBandRows - 1 ) / k_uScreenshotBandRows;
+        auto splitBand = [&]( uint32_t uBand, uint32_t uWorker )
+        {
+            const uint32_t uFirstRow = uBand * k_uScreenshotBandRows;
+            const uint32_t uLastRow = std::min( uFirstRow + k_uScreenshotBandRows, image.uHeight );
+            for ( uint32_t y = uFirstRow; y < uLastRow; y++ )
+            {
+                const uint32_t *__restrict pInRow = (const uint32_t *)( image.pData + size_t( y ) * image.uRowPitch );
+                uint16_t *__restrict pOutR = (uint16_t *)( (uint8_t *)pR + size_t( y ) * uRRowBytes );
+                uint16_t *__restrict pOutG = (uint16_t *)( (uint8_t *)pG + size_t( y ) * uGRowBytes );
+                uint16_t *__restrict pOutB = (uint16_t *)( (uint8_t *)pB + size_t( y ) * uBRowBytes );
+
+                // Straight-line shifts and masks so this vectorizes.
+                for ( uint32_t x = 0; x < image.uWidth; x++ )
+                {
+                    const uint32_t uPixel = pInRow[x];
+                    pOutR[x] = uint16_t( ( uPixel >> 20 ) & 0x3ff );
+                    pOutG[x] = uint16_t( ( uPixel >> 10 ) & 0x3ff );
+                    pOutB[x] = uint16_t( ( uPixel >> 0 )  & 0x3ff );
+                }
+            }
+        };
+        ParallelForBands( 0, uBands, GetScreenshotThreadCount(), splitBand );
+    }
+
+    //
+    // PNG
+    //
+
+    static constexpr uint32_t k_uPNGBytesPerPixel = 3;
+
+    enum PNGFilter : uint8_t
+    {
+        PNG_FILTER_NONE    = 0,
+        PNG_FILTER_SUB     = 1,
+        PNG_FILTER_UP      = 2,
+        PNG_FILTER_AVERAGE = 3,
+        PNG_FILTER_PAETH   = 4,
+
+        PNG_FILTER_COUNT,
+    };
+
+    static void ConvertRowBGRAToRGB( const uint8_t *__restrict pIn, uint8_t *__restrict pOut, uint32_t uWidth )
+    {
+        for ( uint32_t x = 0; x < uWidth; x++ )
+        {
+            pOut[x * 3 + 0] = pIn[x * 4 + 2];
+            pOut[x * 3 + 1] = pIn[x * 4 + 1];
+            pOut[x * 3 + 2] = pIn[x * 4 + 0];
+        }
+    }
+
+    // Returns row y as packed RGB, converting it into pScratch if it isn't already.
+    static const uint8_t *GetRGBRow( const ScreenshotImage_t &image, uint32_t y, uint8_t *pScratch )
+    {
+        const uint8_t *pRow = image.pData + size_t( y ) * image.uRowPitch;
+        if ( image.eFormat == k_EScreenshotPixelFormat_R8G8B8 )
+            return pRow;
+
+        ConvertRowBGRAToRGB( pRow, pScratch, image.uWidth );
+        return pScratch;
+    }
+
+    static uint8_t PaethPredictor( int a, int b, int c )
+    {
+        int p = a + b - c;
+        int pa = abs( p - a );
+        int pb = abs( p - b );
+        int pc = abs( p - c );
+        if ( pa <= pb && pa <= pc )
+            return uint8_t( a );
+        if ( pb <= pc )
+            return uint8_t( b );
+        return uint8_t( c );
+    }
+
+    // One tight loop per filter, so the simple ones vectorize.
+    // The first pixel of a row has no left neighbour, handled separately.
+    static void FilterRow( PNGFilter eFilter, const uint8_t *__restrict pCur, const uint8_t *__restrict pPrev, uint8_t *__restrict pOut, uint32_t uRowBytes )
+    {
+        constexpr uint32_t bpp = k_uPNGBytesPerPixel;
+        switch ( eFilter )
+        {
+            default:
+            case PNG_FILTER_NONE:
+                memcpy( pOut, pCur, uRowBytes );
+                break;
+            case PNG_FILTER_SUB:
+                for ( uint32_t i = 0; i < bpp; i++ )
+                    pOut[i] = pCur[i];
+                for ( uint32_t i = bpp; i < uRowBytes; i++ )
+                    pOut[i] = uint8_t( pCur[i] - pCur[i - bpp] );
+                break;
+            case PNG_FILTER_UP:
+                for ( uint32_t i = 0; i < uRowBytes; i++ )
+                    pOut[i] = uint8_t( pCur[i] - pPrev[i] );
+                break;
+            case PNG_FILTER_AVERAGE:
+                for ( uint32_t i = 0; i < bpp; i++ )
+                    pOut[i] = uint8_t( pCur[i] - ( pPrev[i] >> 1 ) );
+                for ( uint32_t i = bpp; i < uRowBytes; i++ )
+                    pOut[i] = uint8_t( pCur[i] - ( ( pCur[i - bpp] + pPrev[i] ) >> 1 ) );
+                break;
+            case PNG_FILTER_PAETH:
+                for ( uint32_t i = 0; i < bpp; i++ )
+                    pOut[i] = uint8_t( pCur[i] - pPrev[i] );
+                for ( uint32_t i = bpp; i < uRowBytes; i++ )
+                    pOut[i] = uint8_t( pCur[i] - PaethPredictor( pCur[i - bpp], pPrev[i], pPrev[i - bpp] ) );
+                break;
+        }
+    }
+
+    // Same heuristic as libpng and stb: use whichever filter gives
+    // the smallest sum of absolute (signed) values.
+    // pPrev is all zeroes for the first row of the image.
+    static void FilterRowAdaptive( const uint8_t *pCur, const uint8_t *pPrev, uint8_t *pOut, uint8_t *pScratch, uint32_t uRowBytes )
+    {
+        uint32_t uBestScore = UINT32_MAX;
+        for ( uint8_t uFilter = 0; uFilter < PNG_FILTER_COUNT; uFilter++ )
+        {
+            FilterRow( PNGFilter( uFilter ), pCur, pPrev, pScratch, uRowBytes );
+
+            uint32_t uScore = 0;
+            for ( uint32_t i = 0; i < uRowBytes; i++ )
+                uScore += uint32_t( abs( int8_t( pScratch[i] ) ) );
+
+            if ( uScore < uBestScore )
+            {
+                uBestScore = uScore;
+                pOut[0] = uFilter;
+                memcpy( &pOut[1], pScratch, uRowBytes );
+            }
+        }
+    }
+
+    struct PNGBand_t
+    {
+        std::vector<uint8_t> filtered;
+        std::vector<uint8_t> compressed;
+        uLong ulAdler = 0;
+        uLong ulCRC = 0;
+        bool bSuccess = false;
+    };
+
+    struct PNGWorker_t
+    {
+        std::vector<uint8_t> prevRow;
+        std::vector<uint8_t> curRow;
+        std::vector<uint8_t> scratch;
+    };
+
+    static void PutBE32( uint8_t *pOut, uint32_t uValue )
+    {
+        pOut[0] = uint8_t( uValue >> 24 );
+        pOut[1] = uint8_t( uValue >> 16 );
+        pOut[2] = uint8_t( uValue >> 8 );
+        pOut[3] = uint8_t( uValue >> 0 );
+    }
+
+    static bool WritePNGChunk( FILE *pFile, const char *pszType, const uint8_t *pData, uint32_t uSize, uLong ulCRC )
+    {
+        uint8_t header[8];
+        PutBE32( &header[0], uSize );
+        memcpy( &header[4], pszType, 4 );
+
+        uint8_t footer[4];
+        PutBE32( footer, uint32_t( ulCRC ) );
+
+        return fwrite( header, 1, sizeof( header ), pFile ) == sizeof( header ) &&
+               ( !uSize || fwrite( pData, 1, uSize, pFile ) == uSize ) &&
+               fwrite( footer, 1, sizeof( footer ), pFile ) == sizeof( footer );
+    }
+
+    static uLong PNGChunkCRC( const char *pszType, const uint8_t *pData, uint32_t uSize )
+    {
+        uLong ulCRC = crc32( 0, (const Bytef *)pszType, 4 );
+        // crc32 with a null buffer starts over rather than doing nothing.
+        if ( uSize )
+            ulCRC = crc32( ulCRC, pData, uSize );
+        return ulCRC;
+    }
+
+    static bool WritePNGChunk( FILE *pFile, const char *pszType, const uint8_t *pData, uint32_t uSize )
+    {
+        return WritePNGChunk( pFile, pszType, pData, uSize, PNGChunkCRC( pszType, pData, uSize ) );
+    }
+
+    // Converts, filters and deflates one band into its own IDAT.
+    //
+    // Every band is a raw deflate stream that ends on a byte boundary
+    // (Z_SYNC_FLUSH) apart from the last one (Z_FINISH), so they can
+    // be concatenated into a single zlib stream, pigz style.
+    static void EncodePNGBand( const ScreenshotImage_t &image, uint32_t uBand, uint32_t uBandCount, PNGWorker_t &worker, PNGBand_t &band )
+    {
+        band.bSuccess = false;
+
+        const uint32_t uRowBytes = image.uWidth * k_uPNGBytesPerPixel;
+        const uint32_t uFirstRow = uBand * k_uScreenshotBandRows;
+        const uint32_t uLastRow = std::min( uFirstRow + k_uScreenshotBandRows, image.uHeight );
+
+        worker.prevRow.resize( uRowBytes );
+        worker.curRow.resize( uRowBytes );
+        worker.scratch.resize( uRowBytes );
+        band.filtered.resize( size_t( uLastRow - uFirstRow ) * ( uRowBytes + 1 ) );
+
+        const uint8_t *pPrevRow = worker.prevRow.data();
+        if ( uFirstRow > 0 )
+            pPrevRow = GetRGBRow( image, uFirstRow - 1, worker.prevRow.data() );
+        else
+            std::fill( worker.prevRow.begin(), worker.prevRow.end(), 0 );
+
+        for ( uint32_t y = uFirstRow; y < uLastRow; y++ )
+        {
+            const uint8_t *pCurRow = GetRGBRow( image, y, worker.curRow.data() );
+
+            uint8_t *pOut = &band.filtered[ size_t( y - uFirstRow ) * ( uRowBytes + 1 ) ];
+            FilterRowAdaptive( pCurRow, pPrevRow, pOut, worker.scratch.data(), uRowBytes );
+
+            // Swapping the vectors keeps their storage, so pPrevRow stays
+            // valid whether it points at our copy or at the image.
+            pPrevRow = pCurRow;
+            std::swap( worker.prevRow, worker.curRow );
+        }
+
+        band.ulAdler = adler32( adler32( 0, nullptr, 0 ), band.filtered.data(), uInt( band.filtered.size() ) );
+
+        z_stream stream{};
+        if ( deflateInit2( &stream, k_nPNGCompressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+            return;
+        defer( deflateEnd( &stream ) );
+
+        // Sync flush adds a few bytes on top of the bound.
+        band.compressed.resize( deflateBound( &stream, uLong( band.filtered.size() ) ) + 16 );
+
+        stream.next_in = band.filtered.data();
+        stream.avail_in = uInt( band.filtered.size() );
+        stream.next_out = band.compressed.data();
+        stream.avail_out = uInt( band.compressed.size() );
+
+        const bool bLastBand = uBand + 1 == uBandCount;
+        int nRet = deflate( &stream, bLastBand ? Z_FINISH : Z_SYNC_FLUSH );
+        if ( bLastBand ? nRet != Z_STREAM_END : ( nRet != Z_OK || stream.avail_in != 0 ) )
+            return;
+
+        band.compressed.resize( stream.total_out );
+        band.ulCRC = PNGChunkCRC( "IDAT", band.compressed.data(), uint32_t( band.compressed.size() ) );
+        band.bSuccess = true;
+    }
+
+    bool WriteScreenshotPNG( const char *pszPath, const ScreenshotImage_t &image )
+    {
+        if ( !image.uWidth || !image.uHeight )
+            return false;
+
+        FILE *pFile = fopen( pszPath, "wb" );
+        if ( !pFile )
+            return false;
+        defer( fclose( pFile ) );
+
+        static constexpr uint8_t k_PNGSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        if ( fwrite( k_PNGSignature, 1, sizeof( k_PNGSignature ), pFile ) != sizeof( k_PNGSignature ) )
+            return false;
+
+        uint8_t ihdr[13];
+        PutBE32( &ihdr[0], image.uWidth );
+        PutBE32( &ihdr[4], image.uHeight );
+        ihdr[8]  = 8; // Bit depth
+        ihdr[9]  = 2; // Color type: RGB
+        ihdr[10] = 0; // Compression: deflate
+        ihdr[11] = 0; // Filter method: adaptive
+        ihdr[12] = 0; // Interlace: none
+        if ( !WritePNGChunk( pFile, "IHDR", ihdr, sizeof( ihdr ) ) )
+            return false;
+
+        // zlib header: 32K window, default compression.
+        static constexpr uint8_t k_ZlibHeader[2] = { 0x78, 0x9c };
+        if ( !WritePNGChunk( pFile, "IDAT", k_ZlibHeader, sizeof( k_ZlibHeader ) ) )
+            return false;
+
+        const uint32_t uThreads = GetScreenshotThreadCount();
+        const uint32_t uBandCount = ( image.uHeight + k_uScreenshotBandRows - 1 ) / k_uScreenshotBandRows;
+
+        // Bands are encoded a wave at a time and written in order,
+        // the buffers get reused for the next wave.
+        std::vector<PNGWorker_t> workers( uThreads );
+        std::vector<PNGBand_t> bands( uThreads );
+
+        uLong ulAdler = adler32( 0, nullptr, 0 );
+        for ( uint32_t uFirstBand = 0; uFirstBand < uBandCount; uFirstBand += uThreads )
+        {
+            const uint32_t uWaveBands = std::min( uThreads, uBandCount - uFirstBand );
+
+            auto encodeBand = [&]( uint32_t uBand, uint32_t uWorker )
+            {
+                EncodePNGBand( image, uBand, uBandCount, workers[ uWorker ], bands[ uBand - uFirstBand ] );
+            };
+            ParallelForBands( uFirstBand, uWaveBands, uThreads, encodeBand );
+
+            for ( uint32_t i = 0; i < uWaveBands; i++ )
+            {
+                const PNGBand_t &band = bands[i];
+                if ( !band.bSuccess )
+                    return false;
+
+                if ( !WritePNGChunk( pFile, "IDAT", band.compressed.data(), uint32_t( band.compressed.size() ), band.ulCRC ) )
+                    return false;
+
+                ulAdler = adler32_combine( ulAdler, band.ulAdler, z_off_t( band.filtered.size() ) );
+            }
+        }
+
+        uint8_t zlibTrailer[4];
+        PutBE32( zlibTrailer, uint32_t( ulAdler ) );
+        if ( !WritePNGChunk( pFile, "IDAT", zlibTrailer, sizeof( zlibTrailer ) ) )
+            return false;
+
+        if ( !WritePNGChunk( pFile, "IEND", nullptr, 0 ) )
+            return false;
+
+        return true;
+    }
+}
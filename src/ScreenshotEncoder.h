@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace gamescope
+{
+    enum EScreenshotPixelFormat
+    {
+        // B, G, R, X, converted as it is encoded.
+        k_EScreenshotPixelFormat_B8G8R8A8,
+        // R, G, B, already packed on the GPU, encoded straight from the mapping.
+        k_EScreenshotPixelFormat_R8G8B8,
+    };
+
+    // A mapped screenshot image, as read back from the GPU.
+    struct ScreenshotImage_t
+    {
+        const uint8_t *pData = nullptr;
+        uint32_t uWidth = 0;
+        uint32_t uHeight = 0;
+        uint32_t uRowPitch = 0;
+        EScreenshotPixelFormat eFormat = k_EScreenshotPixelFormat_B8G8R8A8;
+    };
+
+    // Writes a B8G8R8A8 or R8G8B8 image out as an 8-bit RGB PNG.
+    //
+    // The image is converted, filtered and deflated in bands of rows spread
+    // across a few threads, and written out as it goes, so we never hold more
+    // than a handful of bands in memory rather than a copy of the whole frame.
+    bool WriteScreenshotPNG( const char *pszPath, const ScreenshotImage_t &image );
+
+    // Splits an A2R10G10B10 image into 16-bit per-channel planes,
+    // spread across a few threads.
+    void SplitScreenshotA2R10G10B10( const ScreenshotImage_t &image,
+        uint16_t *pR, uint32_t uRRowBytes,
+        uint16_t *pG, uint32_t uGRowBytes,
+        uint16_t *pB, uint32_t uBRowBytes );
+
+    uint32_t GetScreenshotThreadCount();
+}
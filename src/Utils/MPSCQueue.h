@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace gamescope
+{
+    // Fixed-capacity multiple-producer, single-consumer queue.
+    //
+    // All of the slots are allocated up front, elements are moved in and out
+    // of them, so pushing and popping never allocate or take a lock.
+    // If the queue is full, Push fails and leaves the element with the caller.
+    //
+    // Each slot carries a sequence number that says whose turn it is:
+    // equal to the position when it is free for the producer that claims
+    // that position, and position + 1 once it has been filled in.
+    template <typename T, size_t Capacity>
+    class MPSCQueue
+    {
+        static_assert( Capacity && ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity must be a power of two." );
+        static constexpr size_t k_zMask = Capacity - 1;
+    public:
+        MPSCQueue()
+        {
+            for ( uint32_t i = 0; i < Capacity; i++ )
+                m_Slots[ i ].uSequence.store( i, std::memory_order_relaxed );
+        }
+
+        // Producer side, any thread.
+        // Returns false if the queue is full, in which case value is untouched.
+        bool Push( T &&value )
+        {
+            return Push( [&]( T &slotValue ) { slotValue = std::move( value ); } );
+        }
+
+        // Producer side, any thread.
+        // Calls fnWrite to fill in the claimed slot's element, which is whatever
+        // the consumer left behind, so anything it owns can be reused.
+        // Returns false if the queue is full, in which case fnWrite isn't called.
+        template <typename Func>
+        bool Push( Func fnWrite )
+        {
+            uint32_t uPos = m_uEnqueuePos.load( std::memory_order_relaxed );
+            for ( ;; )
+            {
+                Slot_t &slot = m_Slots[ uPos & k_zMask ];
+                const uint32_t uSequence = slot.uSequence.load( std::memory_order_acquire );
+                const int32_t nDiff = int32_t( uSequence - uPos );
+                if ( nDiff == 0 )
+                {
+                    // Free, try to claim it.
+                    if ( m_uEnqueuePos.compare_exchange_weak( uPos, uPos + 1, std::memory_order_relaxed ) )
+                    {
+                        fnWrite( slot.value );
+                        slot.uSequence.store( uPos + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( nDiff < 0 )
+                {
+                    // The consumer hasn't got to this one yet from last time around.
+                    m_uDropped.fetch_add( 1, std::memory_order_relaxed );
+                    return false;
+                }
+                else
+                {
+                    // Another producer beat us to it.
+                    uPos = m_uEnqueuePos.load( std::memory_order_relaxed );
+                }
+            }
+        }
+
+        // Consumer side.
+        // Calls fnRead on the oldest element, returns false if empty.
+        // Elements are popped in the order their producers claimed a position,
+        // so one that is still being written holds up the ones after it.
+        template <typename Func>
+        bool Pop( Func fnRead )
+        {
+            const uint32_t uPos = m_uDequeuePos;
+            Slot_t &slot = m_Slots[ uPos & k_zMask ];
+            if ( slot.uSequence.load( std::memory_order_acquire ) != uPos + 1 )
+                return false;
+
+            fnRead( slot.value );
+
+            slot.uSequence.store( uPos + uint32_t( Capacity ), std::memory_order_release );
+            m_uDequeuePos = uPos + 1;
+            return true;
+        }
+
+        uint64_t GetDroppedCount() const { return m_uDropped.load( std::memory_order_relaxed ); }
+        static constexpr size_t GetCapacity() { return Capacity; }
+
+    private:
+        struct Slot_t
+        {
+            std::atomic<uint32_t> uSequence;
+            T value;
+        };
+
+        // Keep the producer and consumer positions on separate cache lines.
+        alignas( 64 ) std::atomic<uint32_t> m_uEnqueuePos = { 0 };
+        alignas( 64 ) uint32_t m_uDequeuePos = 0;
+        alignas( 64 ) std::atomic<uint64_t> m_uDropped = { 0 };
+        std::array<Slot_t, Capacity> m_Slots;
+    };
+}
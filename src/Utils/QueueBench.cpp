@@ -0,0 +1,116 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "MPSCQueue.h"
+
+// Surface commits, handed from the wlserver thread to steamcompmgr.
+// Every producer thread is a fake surface committing as fast as it can.
+
+struct BenchCommit_t
+{
+    uintptr_t uSurface = 0;
+    uint64_t ulSequence = 0;
+    std::shared_ptr<int> pFeedback;
+    std::vector<void *> presentationFeedbacks;
+    std::optional<uint32_t> oPresentId;
+};
+
+static constexpr uint32_t k_uBenchCommitsPerSurface = 4096;
+
+static gamescope::MPSCQueue<BenchCommit_t, 256> s_BenchCommitQueue;
+
+static void Benchmark_CommitQueue_MPSC(benchmark::State &state)
+{
+    const uint32_t uSurfaces = uint32_t( state.range( 0 ) );
+    for (auto _ : state)
+    {
+        std::vector<std::thread> producers;
+        for ( uint32_t i = 0; i < uSurfaces; i++ )
+        {
+            producers.emplace_back( [i]()
+            {
+                for ( uint32_t j = 0; j < k_uBenchCommitsPerSurface; j++ )
+                {
+                    BenchCommit_t commit{ .uSurface = i + 1, .ulSequence = j, .oPresentId = j };
+                    // Gamescope spills into a list on overflow, here we just wait for room.
+                    while ( !s_BenchCommitQueue.Push( std::move( commit ) ) )
+                        std::this_thread::yield();
+                }
+            } );
+        }
+
+        BenchCommit_t commit;
+        uint32_t uReceived = 0;
+        while ( uReceived < uSurfaces * k_uBenchCommitsPerSurface )
+        {
+            if ( s_BenchCommitQueue.Pop( [&]( BenchCommit_t &entry ) { commit = std::move( entry ); } ) )
+            {
+                benchmark::DoNotOptimize( commit.ulSequence );
+                uReceived++;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        for ( auto &producer : producers )
+            producer.join();
+    }
+    state.SetItemsProcessed( state.iterations() * uSurfaces * k_uBenchCommitsPerSurface );
+}
+BENCHMARK(Benchmark_CommitQueue_MPSC)->Arg(1)->Arg(4)->Arg(8)->UseRealTime();
+
+static std::mutex s_BenchCommitLock;
+static std::vector<BenchCommit_t> s_BenchCommitVector;
+
+// The previous mutex + std::vector handoff, for comparison.
+static void Benchmark_CommitQueue_Legacy(benchmark::State &state)
+{
+    const uint32_t uSurfaces = uint32_t( state.range( 0 ) );
+    for (auto _ : state)
+    {
+        std::vector<std::thread> producers;
+        for ( uint32_t i = 0; i < uSurfaces; i++ )
+        {
+            producers.emplace_back( [i]()
+            {
+                for ( uint32_t j = 0; j < k_uBenchCommitsPerSurface; j++ )
+                {
+                    BenchCommit_t commit{ .uSurface = i + 1, .ulSequence = j, .oPresentId = j };
+                    std::lock_guard<std::mutex> lock( s_BenchCommitLock );
+                    s_BenchCommitVector.emplace_back( std::move( commit ) );
+                }
+            } );
+        }
+
+        static std::vector<BenchCommit_t> commits;
+        uint32_t uReceived = 0;
+        while ( uReceived < uSurfaces * k_uBenchCommitsPerSurface )
+        {
+            commits.clear();
+            commits.reserve( 16 );
+            {
+                std::lock_guard<std::mutex> lock( s_BenchCommitLock );
+                commits.swap( s_BenchCommitVector );
+            }
+            for ( const BenchCommit_t &commit : commits )
+                benchmark::DoNotOptimize( commit.ulSequence );
+            uReceived += uint32_t( commits.size() );
+            if ( commits.empty() )
+                std::this_thread::yield();
+        }
+
+        for ( auto &producer : producers )
+            producer.join();
+    }
+    state.SetItemsProcessed( state.iterations() * uSurfaces * k_uBenchCommitsPerSurface );
+}
+BENCHMARK(Benchmark_CommitQueue_Legacy)->Arg(1)->Arg(4)->Arg(8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gamescope
+{
+    // Fixed-capacity single-producer, single-consumer ring.
+    //
+    // The producer never allocates or takes a lock: if the ring is full the
+    // element is dropped and counted instead. The consumer can block in
+    // WaitForData, which is woken through std::atomic::notify_one.
+    template <typename T, size_t Capacity>
+    class SPSCRing
+    {
+        static_assert( Capacity && ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity must be a power of two." );
+        static constexpr size_t k_zMask = Capacity - 1;
+    public:
+        // Producer side.
+        // fnWrite is called with the slot to fill in, and returns whether
+        // the element should be published.
+        template <typename Func>
+        bool Push( Func fnWrite )
+        {
+            const uint32_t uWrite = m_uWriteIdx.load( std::memory_order_relaxed );
+            const uint32_t uRead = m_uReadIdx.load( std::memory_order_acquire );
+            if ( uWrite - uRead >= Capacity )
+            {
+                m_uDropped.fetch_add( 1, std::memory_order_relaxed );
+                return false;
+            }
+
+            if ( !fnWrite( m_Slots[ uWrite & k_zMask ] ) )
+                return false;
+
+            m_uWriteIdx.store( uWrite + 1, std::memory_order_release );
+            m_uWriteIdx.notify_one();
+            return true;
+        }
+
+        // Consumer side.
+        // Calls fnRead on the oldest element, returns false if empty.
+        template <typename Func>
+        bool Pop( Func fnRead )
+        {
+            const uint32_t uRead = m_uReadIdx.load( std::memory_order_relaxed );
+            const uint32_t uWrite = m_uWriteIdx.load( std::memory_order_acquire );
+            if ( uRead == uWrite )
+                return false;
+
+            fnRead( m_Slots[ uRead & k_zMask ] );
+
+            m_uReadIdx.store( uRead + 1, std::memory_order_release );
+            return true;
+        }
+
+        // Consumer side.
+        // Blocks until there is something to pop.
+        // To wake the consumer up for shutdown, push an element it recognizes.
+        void WaitForData()
+        {
+            const uint32_t uRead = m_uReadIdx.load( std::memory_order_relaxed );
+            m_uWriteIdx.wait( uRead, std::memory_order_acquire );
+        }
+
+        uint64_t GetDroppedCount() const { return m_uDropped.load( std::memory_order_relaxed ); }
+        static constexpr size_t GetCapacity() { return Capacity; }
+
+    private:
+        // Keep the indices on separate cache lines so the producer and
+        // consumer don't bounce each other's line on every element.
+        alignas( 64 ) std::atomic<uint32_t> m_uWriteIdx = { 0 };
+        alignas( 64 ) std::atomic<uint32_t> m_uReadIdx = { 0 };
+        alignas( 64 ) std::atomic<uint64_t> m_uDropped = { 0 };
+        std::array<T, Capacity> m_Slots;
+    };
+}
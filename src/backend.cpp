@@ -2,6 +2,8 @@
 #include "vblankmanager.hpp"
 #include "convar.h"
 #include "wlserver.hpp"
+#include "rendervulkan.hpp"
+#include "commit.h"
 
 #include "wlr_begin.hpp"
 #include <wlr/types/wlr_buffer.h>
@@ -137,6 +139,14 @@ namespace gamescope
         console_log.infof( "Total Presents Queued: %lu", this->PresentationFeedback().TotalPresentsQueued() );
         console_log.infof( "Total Presents Completed: %lu", this->PresentationFeedback().TotalPresentsCompleted() );
         console_log.infof( "Current Presents In Flight: %lu", this->PresentationFeedback().CurrentPresentsInFlight() );
+        console_log.infof( "Live Commits: %u", commit_t::GetLiveCount() );
+        console_log.infof( "Pooled Commits: %u", commit_t::GetPooledCount() );
+
+        VulkanMemoryStats_t memoryStats = vulkan_get_memory_stats();
+        console_log.infof( "Vulkan Memory Blocks: %u (%lu KiB)", memoryStats.uBlockCount, memoryStats.ulBlockBytes / 1024 );
+        console_log.infof( "Vulkan Sub-Allocations: %u (%lu KiB)", memoryStats.uSubAllocationCount, memoryStats.ulSubAllocatedBytes / 1024 );
+        console_log.infof( "Vulkan Dedicated Allocations: %u (%lu KiB)", memoryStats.uDedicatedCount, memoryStats.ulDedicatedBytes / 1024 );
+        console_log.infof( "Vulkan Memory Fragmentation: %.1f%%", memoryStats.flFragmentation * 100.0f );
     }
 
     ConCommand cc_backend_info( "backend_info", "Dump debug info about the backend state",
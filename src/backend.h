@@ -211,6 +211,11 @@ namespace gamescope
 
         virtual bool SupportsExplicitSync() const = 0;
 
+        // Whether composited frames are flipped with a fence for the composite,
+        // rather than after waiting for it on the CPU, so they don't need to
+        // be sync flips.
+        virtual bool SupportsAsyncCompositeFlips() const = 0;
+
         // Dumb helper we should remove to support multi display someday.
         gamescope::GamescopeScreenType GetScreenType()
         {
@@ -260,6 +265,8 @@ namespace gamescope
         virtual bool HackTemporarySetDynamicRefresh( int nRefresh ) override { return false; }
         virtual void HackUpdatePatchedEdid() override {}
 
+        virtual bool SupportsAsyncCompositeFlips() const override { return false; }
+
         virtual bool NeedsFrameSync() const override;
         virtual VBlankScheduleTime FrameSync() override;
 
@@ -2,7 +2,13 @@
 #include <benchmark/benchmark.h>
 
 #include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "Utils/Algorithm.h"
+#include "Utils/SPSCRing.h"
 
 #include "color_helpers_impl.h"
 
@@ -15,8 +21,10 @@ uint16_t lut3d[nLutEdgeSize3d*nLutEdgeSize3d*nLutEdgeSize3d*4];
 lut1d_t lut1d_float;
 lut3d_t lut3d_float;
 
-static void BenchmarkCalcColorTransform(EOTF inputEOTF, benchmark::State &state)
+static void BenchmarkCalcColorTransform(EOTF inputEOTF, benchmark::State &state, int nThreads = 0)
 {
+    g_nColorTransformThreads = nThreads;
+
     const primaries_t primaries = { { 0.602f, 0.355f }, { 0.340f, 0.574f }, { 0.164f, 0.121f } };
     const glm::vec2 white = { 0.3070f, 0.3220f };
     const glm::vec2 destVirtualWhite = { 0.f, 0.f };
@@ -78,6 +86,18 @@ static void BenchmarkCalcColorTransforms(benchmark::State &state)
 }
 BENCHMARK(BenchmarkCalcColorTransforms);
 
+static void BenchmarkCalcColorTransforms_G22_SingleThread(benchmark::State &state)
+{
+    BenchmarkCalcColorTransform(EOTF_Gamma22, state, 1);
+}
+BENCHMARK(BenchmarkCalcColorTransforms_G22_SingleThread);
+
+static void BenchmarkCalcColorTransforms_PQ_SingleThread(benchmark::State &state)
+{
+    BenchmarkCalcColorTransform(EOTF_PQ, state, 1);
+}
+BENCHMARK(BenchmarkCalcColorTransforms_PQ_SingleThread);
+
 static constexpr uint32_t k_uFindTestValueCountLarge = 524288;
 static constexpr uint32_t k_uFindTestValueCountMedium = 16;
 static constexpr uint32_t k_uFindTestValueCountSmall = 5;
@@ -211,4 +231,77 @@ static void Benchmark_Contains_Small_Gamescope(benchmark::State &state)
 }
 BENCHMARK(Benchmark_Contains_Small_Gamescope);
 
+// Stats events, as emitted from paint_all
+
+struct BenchStatsRecord_t
+{
+    uint32_t uLength;
+    char szText[252];
+};
+
+static gamescope::SPSCRing<BenchStatsRecord_t, 64> s_BenchStatsRing;
+
+static __attribute__((noinline)) void BenchStatsRingPrintf( const char *format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    s_BenchStatsRing.Push( [&]( BenchStatsRecord_t &record )
+    {
+        int nLength = vsnprintf( record.szText, sizeof( record.szText ), format, args );
+        if ( nLength <= 0 )
+            return false;
+        record.uLength = std::min<uint32_t>( nLength, sizeof( record.szText ) - 1 );
+        return true;
+    } );
+    va_end( args );
+}
+
+static std::mutex s_BenchStatsLock;
+static std::vector<std::string> s_BenchStatsQueue;
+
+// The previous mutex + std::vector<std::string> implementation, for comparison.
+static __attribute__((noinline)) void BenchStatsLegacyPrintf( const char *format, ... )
+{
+    static char buffer[256];
+    static std::string eventstr;
+
+    va_list args;
+    va_start( args, format );
+    vsprintf( buffer, format, args );
+    va_end( args );
+
+    eventstr = buffer;
+
+    std::unique_lock<std::mutex> lock( s_BenchStatsLock );
+    if ( s_BenchStatsQueue.size() > 50 )
+        return;
+    s_BenchStatsQueue.push_back( eventstr );
+}
+
+// Per-event cost of emitting one stats line and consuming it.
+
+static void Benchmark_StatsEvent_Ring(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        BenchStatsRingPrintf( "fps=%f\n", 59.94f );
+        s_BenchStatsRing.Pop( []( const BenchStatsRecord_t &record ) { benchmark::DoNotOptimize( record.szText[0] ); } );
+    }
+}
+BENCHMARK(Benchmark_StatsEvent_Ring);
+
+static void Benchmark_StatsEvent_Legacy(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        BenchStatsLegacyPrintf( "fps=%f\n", 59.94f );
+
+        std::unique_lock<std::mutex> lock( s_BenchStatsLock );
+        std::string event = s_BenchStatsQueue[ 0 ];
+        s_BenchStatsQueue.erase( s_BenchStatsQueue.begin() );
+        benchmark::DoNotOptimize( event );
+    }
+}
+BENCHMARK(Benchmark_StatsEvent_Legacy);
+
 BENCHMARK_MAIN();
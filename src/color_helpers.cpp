@@ -4,8 +4,15 @@
 #include <algorithm>
 #include <cstdint>
 #include <cmath>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
 
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
@@ -670,6 +677,143 @@ inline T applyShaper( const T & input, EOTF source, EOTF dest, const tonemapping
 
 bool g_bHuePreservationWhenClipping = false;
 
+// 0 = pick automatically based on hardware concurrency
+int g_nColorTransformThreads = 0;
+
+static int GetColorTransformThreadCount( int nSlices )
+{
+    static const int s_nHardwareThreads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    // Keep the pool small, this runs on the compositor thread and
+    // spinning up more workers than this is not worth it for a 17^3 cube.
+    static constexpr int k_nMaxColorTransformThreads = 4;
+
+    int nThreads = g_nColorTransformThreads > 0 ? g_nColorTransformThreads : std::min( s_nHardwareThreads, k_nMaxColorTransformThreads );
+    return std::clamp( nThreads, 1, nSlices );
+}
+
+// A few workers kept around for the life of the process, so generating
+// a LUT doesn't have to start and join threads every time.
+class CColorTransformWorkers
+{
+public:
+    static CColorTransformWorkers &Get()
+    {
+        static CColorTransformWorkers s_Workers;
+        return s_Workers;
+    }
+
+    ~CColorTransformWorkers()
+    {
+        {
+            std::unique_lock lock( m_Mutex );
+            m_bQuit = true;
+        }
+        m_WakeCV.notify_all();
+
+        for ( std::thread &worker : m_Workers )
+            worker.join();
+    }
+
+    // Calls fnWorker( n ) for every n in [0, nThreads), 0 on the calling thread
+    // and the rest on the workers, and returns once they are all done.
+    // If another thread is already using the workers, this just runs
+    // everything on the calling thread rather than waiting.
+    void Run( int nThreads, const std::function<void( int )> &fnWorker )
+    {
+        std::unique_lock runLock( m_RunMutex, std::try_to_lock );
+        if ( !runLock )
+        {
+            for ( int nWorker = 0; nWorker < nThreads; nWorker++ )
+                fnWorker( nWorker );
+            return;
+        }
+
+        {
+            std::unique_lock lock( m_Mutex );
+
+            // Spawn more workers if this run wants more than we have.
+            while ( int( m_Workers.size() ) < nThreads - 1 )
+                m_Workers.emplace_back( &CColorTransformWorkers::WorkerThread, this, int( m_Workers.size() ) + 1, m_ulGeneration );
+
+            m_pfnWorker = &fnWorker;
+            m_nJobThreads = nThreads;
+            m_nPending = nThreads - 1;
+            m_ulGeneration++;
+        }
+        m_WakeCV.notify_all();
+
+        fnWorker( 0 );
+
+        std::unique_lock lock( m_Mutex );
+        m_DoneCV.wait( lock, [&]{ return m_nPending == 0; } );
+        m_pfnWorker = nullptr;
+    }
+
+private:
+    CColorTransformWorkers() = default;
+
+    void WorkerThread( int nWorker, uint64_t ulSeenGeneration )
+    {
+        pthread_setname_np( pthread_self(), "gamescope-color" );
+
+        std::unique_lock lock( m_Mutex );
+        for ( ;; )
+        {
+            m_WakeCV.wait( lock, [&]{ return m_bQuit || m_ulGeneration != ulSeenGeneration; } );
+            if ( m_bQuit )
+                return;
+
+            ulSeenGeneration = m_ulGeneration;
+            // Not needed for this one.
+            if ( nWorker >= m_nJobThreads )
+                continue;
+
+            const std::function<void( int )> *pfnWorker = m_pfnWorker;
+            lock.unlock();
+            ( *pfnWorker )( nWorker );
+            lock.lock();
+
+            if ( --m_nPending == 0 )
+                m_DoneCV.notify_one();
+        }
+    }
+
+    // Held for a whole Run, only one caller gets the workers at a time.
+    std::mutex m_RunMutex;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCV;
+    std::condition_variable m_DoneCV;
+    std::vector<std::thread> m_Workers;
+    const std::function<void( int )> *m_pfnWorker = nullptr;
+    int m_nJobThreads = 0;
+    int m_nPending = 0;
+    uint64_t m_ulGeneration = 0;
+    bool m_bQuit = false;
+};
+
+// Calls fnSlice( i ) for every i in [0, nSlices), interleaving the slices
+// between the calling thread and a few persistent workers.
+template <typename Fn>
+static void ParallelForSlices( int nSlices, Fn &fnSlice )
+{
+    int nThreads = GetColorTransformThreadCount( nSlices );
+
+    if ( nThreads == 1 )
+    {
+        for ( int nSlice = 0; nSlice < nSlices; nSlice++ )
+            fnSlice( nSlice );
+        return;
+    }
+
+    CColorTransformWorkers::Get().Run( nThreads, [&]( int nWorker )
+    {
+        for ( int nSlice = nWorker; nSlice < nSlices; nSlice += nThreads )
+            fnSlice( nSlice );
+    } );
+}
+
 template <uint32_t lutEdgeSize3d>
 void calcColorTransform( lut1d_t * pShaper, int nLutSize1d,
 	lut3d_t * pLut3d,
@@ -752,23 +896,41 @@ void calcColorTransform( lut1d_t * pShaper, int nLutSize1d,
             }
         }
 
+        // Without a look lut, the EOTF linearization is separable per channel
+        // so we can precalculate it per-edge rather than per-texel.
+        const bool bHasLook = pLook && !pLook->data.empty();
+        glm::vec3 vSourceColorLinearEdge[nLutEdgeSize3d];
+        if ( !bHasLook )
+        {
+            for ( int nIndex = 0; nIndex < nLutEdgeSize3d; ++nIndex )
+            {
+                vSourceColorLinearEdge[nIndex] = calcEOTFToLinear( vSourceColorEOTFEncodedEdge[nIndex], sourceEOTF, tonemapping );
+            }
+        }
+
         pLut3d->resize( nLutEdgeSize3d );
-    
-        for ( int nBlue=0; nBlue<nLutEdgeSize3d; ++nBlue )
+
+        // Each blue slice is independent, and every texel is written exactly once,
+        // so the cube can be split across workers without any synchronization.
+        auto calcSlice = [&]( int nBlue )
         {
             for ( int nGreen=0; nGreen<nLutEdgeSize3d; ++nGreen )
             {
                 for ( int nRed=0; nRed<nLutEdgeSize3d; ++nRed )
                 {
-                    glm::vec3 sourceColorEOTFEncoded = glm::vec3( vSourceColorEOTFEncodedEdge[nRed].r, vSourceColorEOTFEncodedEdge[nGreen].g, vSourceColorEOTFEncodedEdge[nBlue].b );
-
-                    if ( pLook && !pLook->data.empty() )
+                    glm::vec3 sourceColorLinear;
+                    if ( bHasLook )
                     {
+                        glm::vec3 sourceColorEOTFEncoded = glm::vec3( vSourceColorEOTFEncodedEdge[nRed].r, vSourceColorEOTFEncodedEdge[nGreen].g, vSourceColorEOTFEncodedEdge[nBlue].b );
                         sourceColorEOTFEncoded = ApplyLut3D_Tetrahedral( *pLook, sourceColorEOTFEncoded );
-                    }
 
-                    // Convert to linearized display referred for source colorimetry
-                    glm::vec3 sourceColorLinear = calcEOTFToLinear( sourceColorEOTFEncoded, sourceEOTF, tonemapping );
+                        // Convert to linearized display referred for source colorimetry
+                        sourceColorLinear = calcEOTFToLinear( sourceColorEOTFEncoded, sourceEOTF, tonemapping );
+                    }
+                    else
+                    {
+                        sourceColorLinear = glm::vec3( vSourceColorLinearEdge[nRed].r, vSourceColorLinearEdge[nGreen].g, vSourceColorLinearEdge[nBlue].b );
+                    }
 
                     // Convert to dest colorimetry (linearized display referred)
                     glm::vec3 destColorLinear = dest_from_source * sourceColorLinear;
@@ -808,7 +970,9 @@ void calcColorTransform( lut1d_t * pShaper, int nLutSize1d,
                     pLut3d->data[GetLut3DIndexRedFastRGB( nRed, nGreen, nBlue, nLutEdgeSize3d )] = destColorEOTFEncoded;
                 }
             }
-        }
+        };
+
+        ParallelForSlices( nLutEdgeSize3d, calcSlice );
     }
 }
 
@@ -897,7 +1061,7 @@ void buildPQColorimetry( displaycolorimetry_t * pColorimetry, colormapping_t *pM
     *pMapping = noRemap;
 }
 
-bool approxEqual( const glm::vec3 & a, const glm::vec3 & b, float flTolerance = 1e-5f )
+bool approxEqual( const glm::vec3 & a, const glm::vec3 & b, float flTolerance )
 {
     glm::vec3 v = glm::abs(a - b);
     return ( v.x < flTolerance && v.y < flTolerance && v.z < flTolerance );
@@ -372,6 +372,12 @@ void calcColorTransform( lut1d_t * pShaper, int nLutSize1d,
 	const colormapping_t & mapping, const nightmode_t & nightmode, const tonemapping_t & tonemapping,
 	const lut3d_t * pLook, float flGain );
 
+// Number of threads calcColorTransform splits the 3D lut across.
+// 0 = automatic, 1 = single threaded.
+extern int g_nColorTransformThreads;
+
+bool approxEqual( const glm::vec3 & a, const glm::vec3 & b, float flTolerance = 1e-5f );
+
 #define REGISTER_LUT_EDGE_SIZE(size) template void calcColorTransform<(size)>( lut1d_t * pShaper, int nLutSize1d, \
 	lut3d_t * pLut3d,                                                                                                   \
 	const displaycolorimetry_t & source, EOTF sourceEOTF,                                                               \
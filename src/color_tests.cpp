@@ -230,10 +230,92 @@ void test_eetf2390_mono()
     }
 }
 
+// The 3D lut is generated across several threads, with the EOTF linearization
+// hoisted out of the per-texel loop when there is no look lut.
+// Make sure neither changes the output.
+int test_color_transform_threading()
+{
+    printf("%s\n", __func__  );
+    using ns_color_tests::nLutEdgeSize3d;
+    const int nLutSize1d = 4096;
+
+    displaycolorimetry_t inputColorimetry = displaycolorimetry_709;
+    displaycolorimetry_t outputColorimetry = displaycolorimetry_steamdeck_measured;
+    const glm::vec2 destVirtualWhite = { 0.f, 0.f };
+
+    colormapping_t colorMapping{};
+    colorMapping.blendEnableMinSat = 0.7f;
+    colorMapping.blendEnableMaxSat = 1.0f;
+    colorMapping.blendAmountMin = 0.0f;
+    colorMapping.blendAmountMax = 1.0f;
+
+    nightmode_t nightmode{};
+    tonemapping_t tonemapping{};
+    tonemapping.bUseShaper = true;
+    tonemapping.g22_luminance = 1.f;
+
+    lut3d_t identityLook;
+    identityLook.resize( nLutEdgeSize3d );
+    float flScale = 1.f / ( (float) nLutEdgeSize3d - 1.f );
+    for ( uint32_t nBlue = 0; nBlue < nLutEdgeSize3d; ++nBlue )
+        for ( uint32_t nGreen = 0; nGreen < nLutEdgeSize3d; ++nGreen )
+            for ( uint32_t nRed = 0; nRed < nLutEdgeSize3d; ++nRed )
+                identityLook.data[ nRed + nGreen * nLutEdgeSize3d + nBlue * nLutEdgeSize3d * nLutEdgeSize3d ] = glm::vec3( nRed * flScale, nGreen * flScale, nBlue * flScale );
+
+    int nFailures = 0;
+    for ( uint32_t nInputEOTF = 0; nInputEOTF < EOTF_Count; nInputEOTF++ )
+    {
+        lut1d_t lut1dReference, lut1d;
+        lut3d_t lut3dReference, lut3d, lut3dLook;
+
+        g_nColorTransformThreads = 1;
+        calcColorTransform<nLutEdgeSize3d>( &lut1dReference, nLutSize1d, &lut3dReference, inputColorimetry, (EOTF)nInputEOTF,
+            outputColorimetry, EOTF_Gamma22, destVirtualWhite, k_EChromaticAdapatationMethod_XYZ,
+            colorMapping, nightmode, tonemapping, nullptr, 1.0f );
+
+        g_nColorTransformThreads = 0;
+        calcColorTransform<nLutEdgeSize3d>( &lut1d, nLutSize1d, &lut3d, inputColorimetry, (EOTF)nInputEOTF,
+            outputColorimetry, EOTF_Gamma22, destVirtualWhite, k_EChromaticAdapatationMethod_XYZ,
+            colorMapping, nightmode, tonemapping, nullptr, 1.0f );
+        calcColorTransform<nLutEdgeSize3d>( nullptr, nLutSize1d, &lut3dLook, inputColorimetry, (EOTF)nInputEOTF,
+            outputColorimetry, EOTF_Gamma22, destVirtualWhite, k_EChromaticAdapatationMethod_XYZ,
+            colorMapping, nightmode, tonemapping, &identityLook, 1.0f );
+
+        // The look path skips the shaper here, so only compare it against an unshaped reference.
+        lut3d_t lut3dNoShaper;
+        calcColorTransform<nLutEdgeSize3d>( nullptr, nLutSize1d, &lut3dNoShaper, inputColorimetry, (EOTF)nInputEOTF,
+            outputColorimetry, EOTF_Gamma22, destVirtualWhite, k_EChromaticAdapatationMethod_XYZ,
+            colorMapping, nightmode, tonemapping, nullptr, 1.0f );
+
+        for ( size_t i = 0; i < lut3dReference.data.size(); i++ )
+        {
+            if ( lut3d.data[i] != lut3dReference.data[i] )
+            {
+                printf("  eotf %u: threaded texel %zu mismatch %s != %s\n", nInputEOTF, i,
+                    glm::to_string( lut3d.data[i] ).c_str(), glm::to_string( lut3dReference.data[i] ).c_str() );
+                nFailures++;
+            }
+
+            if ( !approxEqual( lut3dLook.data[i], lut3dNoShaper.data[i], 1e-4f ) )
+            {
+                printf("  eotf %u: identity look texel %zu mismatch %s != %s\n", nInputEOTF, i,
+                    glm::to_string( lut3dLook.data[i] ).c_str(), glm::to_string( lut3dNoShaper.data[i] ).c_str() );
+                nFailures++;
+            }
+        }
+    }
+
+    g_nColorTransformThreads = 0;
+    printf("%s: %s\n", __func__, nFailures ? "FAILED" : "passed" );
+    return nFailures;
+}
+
 int main(int argc, char* argv[])
 {
     printf("color_tests\n");
     // test_eetf2390_mono();
     color_tests();
+    if ( test_color_transform_threading() != 0 )
+        return 1;
     return 0;
 }
\ No newline at end of file
@@ -7,12 +7,86 @@
 
 extern gamescope::CAsyncWaiter<gamescope::Rc<commit_t>> g_ImageWaiter;
 
+// Enough to cover a few clients with deep swapchains,
+// anything above that is freed as usual.
+static constexpr size_t k_zMaxPooledCommits = 128;
+
+static std::mutex s_CommitPoolMutex;
+static std::vector<commit_t *> s_pCommitPool;
+static std::atomic<uint32_t> s_uLiveCommits = { 0u };
+
 commit_t::commit_t()
 {
-    static uint64_t maxCommmitID = 0;
-    commitID = ++maxCommmitID;
+    commitID = NextCommitID();
 }
 commit_t::~commit_t()
+{
+    ReleaseResources();
+}
+
+uint64_t commit_t::NextCommitID()
+{
+    static uint64_t maxCommmitID = 0;
+    return ++maxCommmitID;
+}
+
+gamescope::Rc<commit_t> commit_t::Allocate()
+{
+    commit_t *pCommit = nullptr;
+    {
+        std::unique_lock lock( s_CommitPoolMutex );
+        if ( !s_pCommitPool.empty() )
+        {
+            pCommit = s_pCommitPool.back();
+            s_pCommitPool.pop_back();
+        }
+    }
+
+    if ( pCommit )
+    {
+        pCommit->ResetRefCounts();
+        pCommit->commitID = NextCommitID();
+    }
+    else
+    {
+        pCommit = new commit_t;
+    }
+
+    s_uLiveCommits++;
+    return pCommit;
+}
+
+uint32_t commit_t::GetLiveCount()
+{
+    return s_uLiveCommits;
+}
+
+uint32_t commit_t::GetPooledCount()
+{
+    std::unique_lock lock( s_CommitPoolMutex );
+    return uint32_t( s_pCommitPool.size() );
+}
+
+void commit_t::OnAllReferencesReleased()
+{
+    s_uLiveCommits--;
+
+    ReleaseResources();
+    ResetForReuse();
+
+    {
+        std::unique_lock lock( s_CommitPoolMutex );
+        if ( s_pCommitPool.size() < k_zMaxPooledCommits )
+        {
+            s_pCommitPool.push_back( this );
+            return;
+        }
+    }
+
+    delete this;
+}
+
+void commit_t::ReleaseResources()
 {
     {
         std::unique_lock lock( m_WaitableCommitStateMutex );
@@ -22,6 +96,10 @@ commit_t::~commit_t()
     if ( vulkanTex != nullptr )
         vulkanTex = nullptr;
 
+    // Already released, eg. when an object that was pooled gets deleted.
+    if ( !buf && presentation_feedbacks.empty() && !m_oReleasePoint )
+        return;
+
     wlserver_lock();
     if (!presentation_feedbacks.empty())
     {
@@ -29,11 +107,38 @@ commit_t::~commit_t()
         // presentation_feedbacks cleared by wlserver_presentation_feedback_discard
     }
     wlr_buffer_unlock( buf );
+    buf = nullptr;
     if ( m_oReleasePoint )
         m_oReleasePoint->Release();
+    m_oReleasePoint = std::nullopt;
     wlserver_unlock();
 }
 
+void commit_t::ResetForReuse()
+{
+    // ReleaseResources already dropped buf, vulkanTex, the fence and the release point.
+    commitID = 0;
+    done = false;
+    async = false;
+    fifo = false;
+    is_steam = false;
+    feedback = std::nullopt;
+
+    win_seq = 0;
+    surf = nullptr;
+    // Keeps its capacity.
+    presentation_feedbacks.clear();
+
+    present_id = std::nullopt;
+    desired_present_time = 0;
+    earliest_present_time = 0;
+    present_margin = 0;
+    ready_time = 0;
+
+    m_bMangoNudge = false;
+    m_pDoneCommits = nullptr;
+}
+
 GamescopeAppTextureColorspace commit_t::colorspace() const
 {
     VkColorSpaceKHR colorspace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
@@ -68,6 +173,8 @@ void commit_t::OnPollIn()
 
 void commit_t::Signal()
 {
+    ready_time = get_time_in_nanos();
+
     uint64_t frametime;
     if ( m_bMangoNudge )
     {
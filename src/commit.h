@@ -5,6 +5,13 @@ struct commit_t final : public gamescope::RcObject, public gamescope::IWaitable
 	commit_t();
     ~commit_t();
 
+	// We get a commit for every surface commit of every client, so rather
+	// than hitting the heap for each one, released commits are kept around
+	// and handed out again from here.
+	static gamescope::Rc<commit_t> Allocate();
+	static uint32_t GetLiveCount();
+	static uint32_t GetPooledCount();
+
 	GamescopeAppTextureColorspace colorspace() const;
 
 	// For waitable:
@@ -37,10 +44,24 @@ struct commit_t final : public gamescope::RcObject, public gamescope::IWaitable
 	uint64_t desired_present_time = 0;
 	uint64_t earliest_present_time = 0;
 	uint64_t present_margin = 0;
+	// When the buffer's acquire fence signalled, for frame timing.
+	uint64_t ready_time = 0;
 
 	std::mutex m_WaitableCommitStateMutex;
 	int m_nCommitFence = -1;
 	bool m_bMangoNudge = false;
 	CommitDoneList_t *m_pDoneCommits = nullptr; // I hate this
 	std::optional<GamescopeTimelinePoint> m_oReleasePoint;
+
+protected:
+	void OnAllReferencesReleased() final;
+
+private:
+	static uint64_t NextCommitID();
+
+	void ReleaseResources();
+	// Puts everything back how the constructor left it, apart from the
+	// capacity of our vectors.
+	// Keep in sync with the members above.
+	void ResetForReuse();
 };
\ No newline at end of file
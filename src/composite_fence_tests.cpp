@@ -0,0 +1,347 @@
+#include "Backends/DRMCompositeFence.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace gamescope;
+
+// Only ever compared by address.
+static const CVulkanTexture *fake_texture( int nIndex )
+{
+    static char s_Textures[ 4 ];
+    return reinterpret_cast<const CVulkanTexture *>( &s_Textures[ nIndex ] );
+}
+
+static bool fd_is_open( int nFd )
+{
+    return nFd >= 0 && fcntl( nFd, F_GETFD ) != -1;
+}
+
+static bool fd_is_signalled( int nFd )
+{
+    pollfd pollFd = { .fd = nFd, .events = POLLIN };
+    return poll( &pollFd, 1, 0 ) == 1 && ( pollFd.revents & POLLIN );
+}
+
+// A pipe stands in for a sync file: polls readable once written to,
+// like a sync file does once its fence has signalled.
+// The read end is the "sync file", it's left to whoever it's handed to.
+struct FakeSyncFile_t
+{
+    int nReadFd = -1;
+    int nWriteFd = -1;
+
+    FakeSyncFile_t()
+    {
+        int fds[2];
+        if ( pipe2( fds, O_CLOEXEC ) == 0 )
+        {
+            nReadFd = fds[0];
+            nWriteFd = fds[1];
+        }
+    }
+
+    ~FakeSyncFile_t()
+    {
+        if ( nWriteFd >= 0 )
+            close( nWriteFd );
+    }
+
+    void Signal()
+    {
+        char c = 1;
+        if ( write( nWriteFd, &c, 1 ) != 1 )
+            perror( "write" );
+    }
+};
+
+// Stands in for the libliftoff/atomic commit in drm_prepare_liftoff.
+// Records the IN_FENCE_FD of each layer, and what state those fds were in
+// when the commit was applied, so we can check the kernel would have seen them.
+struct StubAtomicCommit_t
+{
+    struct LayerState_t
+    {
+        int nInFence = -1;
+        bool bFenceOpen = false;
+        bool bFenceSignalled = false;
+    };
+
+    // Fail the first commit that sets an IN_FENCE_FD with -EPERM, like the NVIDIA driver.
+    bool bRejectInFence = false;
+
+    std::map<int, int> inFences;
+    std::vector<std::map<int, LayerState_t>> appliedCommits;
+
+    void SetInFence( int nLayer, int nFence ) { inFences[ nLayer ] = nFence; }
+
+    int Apply()
+    {
+        std::map<int, LayerState_t> commit;
+        bool bUsesInFence = false;
+        for ( auto &[ nLayer, nFence ] : inFences )
+        {
+            commit[ nLayer ] = LayerState_t
+            {
+                .nInFence = nFence,
+                .bFenceOpen = fd_is_open( nFence ),
+                .bFenceSignalled = nFence >= 0 && fd_is_signalled( nFence ),
+            };
+            bUsesInFence |= nFence >= 0;
+        }
+
+        if ( bUsesInFence && bRejectInFence )
+        {
+            bRejectInFence = false;
+            return -EPERM;
+        }
+
+        appliedCommits.emplace_back( std::move( commit ) );
+        return 0;
+    }
+};
+
+// Mirrors how the DRM backend flips a composited frame:
+// set each layer's IN_FENCE_FD, and fall back to waiting without it on -EPERM.
+static int flip_layers( StubAtomicCommit_t &commit, const CDRMCompositeFence &fence, const std::vector<const CVulkanTexture *> &layers, int nDefaultFence, bool bInFenceDisabled )
+{
+    commit.inFences.clear();
+    for ( size_t i = 0; i < layers.size(); i++ )
+        commit.SetInFence( int( i ), fence.GetInFence( layers[ i ], nDefaultFence, bInFenceDisabled ) );
+
+    int ret = commit.Apply();
+    if ( ret == -EPERM && !bInFenceDisabled )
+    {
+        for ( size_t i = 0; i < layers.size(); i++ )
+            commit.SetInFence( int( i ), -1 );
+
+        fence.Wait();
+        ret = commit.Apply();
+    }
+    return ret;
+}
+
+static int test_in_fence_selection()
+{
+    int nFailures = 0;
+
+    FakeSyncFile_t alwaysSignalled;
+    alwaysSignalled.Signal();
+
+    FakeSyncFile_t composite;
+    const int nCompositeFd = composite.nReadFd;
+
+    CDRMCompositeFence fence;
+    fence.Set( nCompositeFd, fake_texture( 1 ) );
+
+    StubAtomicCommit_t commit;
+    std::vector<const CVulkanTexture *> layers = { fake_texture( 0 ), fake_texture( 1 ), fake_texture( 2 ) };
+    if ( flip_layers( commit, fence, layers, alwaysSignalled.nReadFd, false ) != 0 || commit.appliedCommits.size() != 1 )
+    {
+        printf( "  FAIL: commit was not applied\n" );
+        return 1;
+    }
+
+    const auto &applied = commit.appliedCommits[ 0 ];
+    if ( applied.at( 1 ).nInFence != nCompositeFd || !applied.at( 1 ).bFenceOpen )
+    {
+        printf( "  FAIL: composited layer got IN_FENCE_FD %d (open %d), expected %d\n", applied.at( 1 ).nInFence, applied.at( 1 ).bFenceOpen, nCompositeFd );
+        nFailures++;
+    }
+    // The point is not waiting, the kernel gets the fence before the composite is done.
+    if ( applied.at( 1 ).bFenceSignalled )
+    {
+        printf( "  FAIL: commit went out after the composite fence signalled\n" );
+        nFailures++;
+    }
+    for ( int nLayer : { 0, 2 } )
+    {
+        if ( applied.at( nLayer ).nInFence != alwaysSignalled.nReadFd )
+        {
+            printf( "  FAIL: layer %d got IN_FENCE_FD %d, expected the always signalled one\n", nLayer, applied.at( nLayer ).nInFence );
+            nFailures++;
+        }
+    }
+
+    // With IN_FENCE_FD disabled, nothing gets a fence.
+    if ( flip_layers( commit, fence, layers, alwaysSignalled.nReadFd, true ) != 0 )
+    {
+        printf( "  FAIL: commit with IN_FENCE_FD disabled was not applied\n" );
+        return nFailures + 1;
+    }
+    for ( auto &[ nLayer, state ] : commit.appliedCommits.back() )
+    {
+        if ( state.nInFence != -1 )
+        {
+            printf( "  FAIL: layer %d got IN_FENCE_FD %d with it disabled\n", nLayer, state.nInFence );
+            nFailures++;
+        }
+    }
+
+    // Nothing composited, every layer gets the default.
+    fence.Reset();
+    flip_layers( commit, fence, layers, alwaysSignalled.nReadFd, false );
+    for ( auto &[ nLayer, state ] : commit.appliedCommits.back() )
+    {
+        if ( state.nInFence != alwaysSignalled.nReadFd )
+        {
+            printf( "  FAIL: layer %d got IN_FENCE_FD %d without a composite\n", nLayer, state.nInFence );
+            nFailures++;
+        }
+    }
+
+    return nFailures;
+}
+
+static int test_fence_lifetime()
+{
+    int nFailures = 0;
+
+    // Reset closes the sync file, once the commit is out.
+    {
+        FakeSyncFile_t composite;
+        CDRMCompositeFence fence;
+        fence.Set( composite.nReadFd, fake_texture( 1 ) );
+        if ( !fence.IsSet() || !fd_is_open( composite.nReadFd ) )
+        {
+            printf( "  FAIL: sync file not held after Set\n" );
+            nFailures++;
+        }
+        fence.Reset();
+        if ( fence.IsSet() || fd_is_open( composite.nReadFd ) )
+        {
+            printf( "  FAIL: sync file still open after Reset\n" );
+            nFailures++;
+        }
+        // A second Reset must not close whatever reused the fd number.
+        int nOther = dup( STDIN_FILENO );
+        fence.Reset();
+        if ( !fd_is_open( nOther ) )
+        {
+            printf( "  FAIL: Reset closed an fd it no longer owned\n" );
+            nFailures++;
+        }
+        close( nOther );
+    }
+
+    // Setting a new one closes the old one.
+    {
+        FakeSyncFile_t first, second;
+        CDRMCompositeFence fence;
+        fence.Set( first.nReadFd, fake_texture( 1 ) );
+        fence.Set( second.nReadFd, fake_texture( 2 ) );
+        if ( fd_is_open( first.nReadFd ) || !fd_is_open( second.nReadFd ) )
+        {
+            printf( "  FAIL: replacing the sync file leaked or closed the wrong one\n" );
+            nFailures++;
+        }
+        if ( fence.GetInFence( fake_texture( 1 ), -1, false ) != -1 || fence.GetInFence( fake_texture( 2 ), -1, false ) != second.nReadFd )
+        {
+            printf( "  FAIL: replaced sync file is still matched to the old texture\n" );
+            nFailures++;
+        }
+    }
+
+    // A failed export leaves it unset, so the backend waits on the CPU instead.
+    {
+        CDRMCompositeFence fence;
+        fence.Set( -1, fake_texture( 1 ) );
+        if ( fence.IsSet() || fence.GetInFence( fake_texture( 1 ), 7, false ) != 7 )
+        {
+            printf( "  FAIL: failed export was treated as a fence\n" );
+            nFailures++;
+        }
+    }
+
+    // Destruction closes it too.
+    {
+        FakeSyncFile_t composite;
+        {
+            CDRMCompositeFence fence;
+            fence.Set( composite.nReadFd, fake_texture( 1 ) );
+        }
+        if ( fd_is_open( composite.nReadFd ) )
+        {
+            printf( "  FAIL: sync file still open after destruction\n" );
+            nFailures++;
+        }
+    }
+
+    return nFailures;
+}
+
+// When the driver rejects IN_FENCE_FD, the retried commit must not go out
+// before the composite is done.
+static int test_in_fence_rejected()
+{
+    int nFailures = 0;
+
+    FakeSyncFile_t alwaysSignalled;
+    alwaysSignalled.Signal();
+
+    FakeSyncFile_t composite;
+    CDRMCompositeFence fence;
+    fence.Set( composite.nReadFd, fake_texture( 1 ) );
+
+    std::thread signaller( [ &composite ]()
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        composite.Signal();
+    } );
+
+    StubAtomicCommit_t commit;
+    commit.bRejectInFence = true;
+    int ret = flip_layers( commit, fence, { fake_texture( 0 ), fake_texture( 1 ) }, alwaysSignalled.nReadFd, false );
+    signaller.join();
+
+    if ( ret != 0 || commit.appliedCommits.size() != 1 )
+    {
+        printf( "  FAIL: fallback commit was not applied\n" );
+        return 1;
+    }
+
+    for ( auto &[ nLayer, state ] : commit.appliedCommits[ 0 ] )
+    {
+        if ( state.nInFence != -1 )
+        {
+            printf( "  FAIL: fallback commit still set IN_FENCE_FD %d on layer %d\n", state.nInFence, nLayer );
+            nFailures++;
+        }
+    }
+
+    if ( !fd_is_signalled( composite.nReadFd ) )
+    {
+        printf( "  FAIL: fallback commit went out before the composite finished\n" );
+        nFailures++;
+    }
+
+    fence.Reset();
+    return nFailures;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("composite_fence_tests\n");
+
+    int nFailures = 0;
+    nFailures += test_in_fence_selection();
+    nFailures += test_fence_lifetime();
+    nFailures += test_in_fence_rejected();
+
+    if ( nFailures != 0 )
+    {
+        printf( "%d failures\n", nFailures );
+        return 1;
+    }
+
+    printf( "ok\n" );
+    return 0;
+}
@@ -641,6 +641,18 @@ static void UpdateCompatEnvVars()
 			gamescope::Process::CloseFd( nLimiterFd );
 		}
 	}
+
+	const char *pszFrameTimingFile = getenv( "GAMESCOPE_FRAME_TIMING_FILE" );
+	if ( !pszFrameTimingFile || !*pszFrameTimingFile )
+	{
+		char szFrameTimingPath[ PATH_MAX ];
+		int nFrameTimingFd = gamescope::MakeTempFile( szFrameTimingPath, gamescope::k_szGamescopeTempFrameTimingTemplate, true );
+		if ( nFrameTimingFd >= 0 )
+		{
+			setenv( "GAMESCOPE_FRAME_TIMING_FILE", szFrameTimingPath, 1 );
+			gamescope::Process::CloseFd( nFrameTimingFd );
+		}
+	}
 }
 
 int g_nPreferredOutputWidth = 0;
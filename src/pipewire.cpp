@@ -4,6 +4,7 @@
 #include <poll.h>
 #include <stdio.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -12,7 +13,10 @@
 
 #include "main.hpp"
 #include "pipewire.hpp"
+#include "pipewire_copy.hpp"
 #include "log.hpp"
+#include "convar.h"
+#include "Utils/Defer.h"
 
 #include <spa/debug/format.h>
 
@@ -34,20 +38,46 @@ static uint32_t s_nCaptureHeight;
 static uint32_t s_nOutputWidth;
 static uint32_t s_nOutputHeight;
 
+static gamescope::ConVar<bool> cv_pipewire_shm_host_import( "pipewire_shm_host_import", true, "Let the GPU write SHM PipeWire buffers directly if possible, instead of copying each frame on the CPU. Applies to buffers allocated after changing it." );
+
+// CPU time spent in copy_buffer on the PipeWire thread, to compare the two SHM paths on real hardware.
+static std::atomic<uint64_t> s_ulCopyBufferFrames;
+static std::atomic<uint64_t> s_ulCopyBufferCPUTime;
+static std::atomic<uint64_t> s_ulCopyBufferBytes;
+
+static gamescope::ConCommand cc_pipewire_copy_stats( "pipewire_copy_stats", "Print (and reset) the CPU time spent handing frames to PipeWire.",
+[]( std::span<std::string_view> args )
+{
+	uint64_t ulFrames = s_ulCopyBufferFrames.exchange( 0, std::memory_order_relaxed );
+	uint64_t ulCPUTime = s_ulCopyBufferCPUTime.exchange( 0, std::memory_order_relaxed );
+	uint64_t ulBytes = s_ulCopyBufferBytes.exchange( 0, std::memory_order_relaxed );
+	if ( !ulFrames )
+	{
+		pwr_log.infof( "No frames since the last reset" );
+		return;
+	}
+
+	pwr_log.infof( "%lu frames, %.1fus CPU per frame, %.2f MiB copied per frame",
+		(unsigned long) ulFrames, ulCPUTime / 1'000.0 / ulFrames, ulBytes / ( 1024.0 * 1024.0 ) / ulFrames );
+});
+
+static uint64_t get_thread_cpu_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
 static void destroy_buffer(struct pipewire_buffer *buffer) {
 	assert(buffer->buffer == nullptr);
 
 	switch (buffer->type) {
 	case SPA_DATA_MemFd:
-	{
-		off_t size = buffer->shm.stride * buffer->video_info.size.height;
-		if (buffer->video_info.format == SPA_VIDEO_FORMAT_NV12) {
-			size += buffer->shm.stride * ((buffer->video_info.size.height + 1) / 2);
-		}
-		munmap(buffer->shm.data, size);
+		// Drop the import before the memory behind it goes away.
+		buffer->shm.host_buffer = nullptr;
+		munmap(buffer->shm.data, buffer->shm.size);
 		close(buffer->shm.fd);
 		break;
-	}
 	case SPA_DATA_DmaBuf:
 		break; // nothing to do
 	default:
@@ -177,6 +207,14 @@ static void request_buffer(struct pipewire_state *state)
 
 static void copy_buffer(struct pipewire_state *state, struct pipewire_buffer *buffer)
 {
+	const uint64_t ulStartCPUTime = get_thread_cpu_time_ns();
+	uint64_t ulCopiedBytes = 0;
+	defer(
+		s_ulCopyBufferCPUTime.fetch_add( get_thread_cpu_time_ns() - ulStartCPUTime, std::memory_order_relaxed );
+		s_ulCopyBufferBytes.fetch_add( ulCopiedBytes, std::memory_order_relaxed );
+		s_ulCopyBufferFrames.fetch_add( 1, std::memory_order_relaxed );
+	);
+
 	gamescope::OwningRc<CVulkanTexture> &tex = buffer->texture;
 	assert(tex != nullptr);
 
@@ -211,35 +249,25 @@ static void copy_buffer(struct pipewire_state *state, struct pipewire_buffer *bu
 		}
 		chunk->stride = buffer->shm.stride;
 
-		if (!needs_reneg) {
+		// With an imported buffer, the GPU has already written the frame into shm.data.
+		if (!needs_reneg && !buffer->shm.host_buffer) {
 			uint8_t *pMappedData = tex->mappedData();
 
 			if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
-				for (uint32_t i = 0; i < tex->height(); i++) {
-					const uint32_t lumaPwOffset = 0;
-					memcpy(
-						&buffer->shm.data[lumaPwOffset      + i * buffer->shm.stride],
-						&pMappedData     [tex->lumaOffset() + i * tex->lumaRowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->lumaRowPitch()));
-				}
-
-				for (uint32_t i = 0; i < (tex->height() + 1) / 2; i++) {
-					const uint32_t chromaPwOffset = tex->height() * buffer->shm.stride;
-					memcpy(
-						&buffer->shm.data[chromaPwOffset      + i * buffer->shm.stride],
-						&pMappedData     [tex->chromaOffset() + i * tex->chromaRowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->chromaRowPitch()));
-				}
+				const pipewire_copy_plane planes[] = {
+					{ &pMappedData[tex->lumaOffset()],   tex->lumaRowPitch(),   tex->height() },
+					{ &pMappedData[tex->chromaOffset()], tex->chromaRowPitch(), (tex->height() + 1) / 2 },
+				};
+				pipewire_copy_planes(buffer->shm.data, buffer->shm.stride, planes);
 			}
 			else
 			{
-				for (uint32_t i = 0; i < tex->height(); i++) {
-					memcpy(
-						&buffer->shm.data[i * buffer->shm.stride],
-						&pMappedData     [i * tex->rowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->rowPitch()));
-				}
+				const pipewire_copy_plane planes[] = {
+					{ pMappedData, tex->rowPitch(), tex->height() },
+				};
+				pipewire_copy_planes(buffer->shm.data, buffer->shm.stride, planes);
 			}
+			ulCopiedBytes = chunk->size;
 		}
 		break;
 	case SPA_DATA_DmaBuf:
@@ -440,6 +468,24 @@ uint32_t spa_format_to_drm(uint32_t spa_format)
 	}
 }
 
+static bool create_buffer_texture(struct pipewire_buffer *buffer, uint32_t drmFormat, CVulkanTexture::createFlags flags, bool host_import, EStreamColorspace colorspace)
+{
+	if (host_import)
+		flags.bTransferSrc = true;
+	else
+		flags.bMappable = true;
+
+	buffer->texture = new CVulkanTexture();
+	bool bImageInitSuccess = buffer->texture->BInit( s_nCaptureWidth, s_nCaptureHeight, 1u, drmFormat, flags );
+	if ( !bImageInitSuccess )
+	{
+		pwr_log.errorf("Failed to initialize pipewire texture");
+		return false;
+	}
+	buffer->texture->setStreamColorspace(colorspace);
+	return true;
+}
+
 static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffer)
 {
 	struct pipewire_state *state = (struct pipewire_state *) user_data;
@@ -487,9 +533,11 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 
 	uint32_t drmFormat = spa_format_to_drm(state->video_info.format);
 
-	buffer->texture = new CVulkanTexture();
+	// If we can import the shared memory we hand to PipeWire, the GPU copies
+	// the frame straight into it and the texture doesn't need to be mappable.
+	bool host_import = !is_dmabuf && is_memfd && cv_pipewire_shm_host_import && vulkan_host_memory_import_alignment() != 0;
+
 	CVulkanTexture::createFlags screenshotImageFlags;
-	screenshotImageFlags.bMappable = true;
 	screenshotImageFlags.bTransferDst = true;
 	screenshotImageFlags.bStorage = true;
 	if (is_dmabuf || drmFormat == DRM_FORMAT_NV12)
@@ -497,13 +545,8 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 		screenshotImageFlags.bExportable = true;
 		screenshotImageFlags.bLinear = true; // TODO: support multi-planar DMA-BUF export via PipeWire
 	}
-	bool bImageInitSuccess = buffer->texture->BInit( s_nCaptureWidth, s_nCaptureHeight, 1u, drmFormat, screenshotImageFlags );
-	if ( !bImageInitSuccess )
-	{
-		pwr_log.errorf("Failed to initialize pipewire texture");
+	if (!create_buffer_texture(buffer, drmFormat, screenshotImageFlags, host_import, colorspace))
 		goto error;
-	}
-	buffer->texture->setStreamColorspace(colorspace);
 
 	if (is_dmabuf) {
 		const struct wlr_dmabuf_attributes dmabuf = buffer->texture->dmabuf();
@@ -538,22 +581,49 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 		if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
 			size += state->shm_stride * ((state->video_info.size.height + 1) / 2);
 		}
-		if (ftruncate(fd, size) != 0) {
+
+		// Host memory can only be imported in whole aligned chunks,
+		// so pad the file out, PipeWire still only sees size bytes of it.
+		size_t alloc_size = size;
+		size_t import_alignment = vulkan_host_memory_import_alignment();
+		if (host_import)
+			alloc_size = SPA_ROUND_UP_N(alloc_size, import_alignment);
+
+		if (ftruncate(fd, alloc_size) != 0) {
 			pwr_log.errorf_errno("ftruncate failed");
 			close(fd);
 			goto error;
 		}
 
-		void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		void *data = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 		if (data == MAP_FAILED) {
 			pwr_log.errorf_errno("mmap failed");
 			close(fd);
 			goto error;
 		}
 
+		if (host_import) {
+			if (((uintptr_t) data % import_alignment) == 0) {
+				buffer->shm.host_buffer = std::make_unique<CVulkanHostBuffer>();
+				if (!buffer->shm.host_buffer->BInit(data, alloc_size))
+					buffer->shm.host_buffer = nullptr;
+			}
+
+			if (!buffer->shm.host_buffer) {
+				pwr_log.infof("failed to import shm buffer, falling back to copying on the CPU");
+
+				if (!create_buffer_texture(buffer, drmFormat, screenshotImageFlags, false, colorspace)) {
+					munmap(data, alloc_size);
+					close(fd);
+					goto error;
+				}
+			}
+		}
+
 		buffer->type = SPA_DATA_MemFd;
 		buffer->shm.stride = state->shm_stride;
 		buffer->shm.data = (uint8_t *) data;
+		buffer->shm.size = alloc_size;
 		buffer->shm.fd = fd;
 
 		spa_data->type = SPA_DATA_MemFd;
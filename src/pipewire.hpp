@@ -39,7 +39,11 @@ struct pipewire_buffer {
 	struct {
 		int stride;
 		uint8_t *data;
+		size_t size;
 		int fd;
+		// If set, the GPU copies the texture straight into data,
+		// otherwise we copy it out of the texture's mapping.
+		std::unique_ptr<CVulkanHostBuffer> host_buffer;
 	} shm;
 
 	// The following fields are not thread-safe
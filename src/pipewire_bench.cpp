@@ -0,0 +1,103 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pipewire_copy.hpp"
+
+// The CPU copy of a captured frame into a PipeWire SHM buffer, as copy_buffer
+// does it when the buffer couldn't be imported into Vulkan.
+// The source stands in for the mapped capture texture (rows padded to 256 bytes
+// like drivers tend to), the destination is a memfd like PipeWire's.
+// On real hardware, compare against the pipewire_copy_stats command with
+// pipewire_shm_host_import on and off.
+
+static constexpr uint32_t k_uRowPitchAlignment = 256;
+
+static uint32_t align_pitch(uint32_t uPitch)
+{
+    return (uPitch + k_uRowPitchAlignment - 1) & ~(k_uRowPitchAlignment - 1);
+}
+
+struct BenchMemfd_t
+{
+    uint8_t *pData = nullptr;
+    size_t zSize = 0;
+
+    explicit BenchMemfd_t(size_t zSize)
+        : zSize(zSize)
+    {
+        int nFd = memfd_create("gamescope-pipewire-bench", MFD_CLOEXEC);
+        if (nFd < 0 || ftruncate(nFd, zSize) != 0)
+            abort();
+        void *pMapping = mmap(nullptr, zSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFd, 0);
+        close(nFd);
+        if (pMapping == MAP_FAILED)
+            abort();
+        pData = static_cast<uint8_t *>(pMapping);
+        // Fault it in up front, PipeWire reuses its buffers.
+        memset(pData, 0, zSize);
+    }
+
+    ~BenchMemfd_t()
+    {
+        munmap(pData, zSize);
+    }
+};
+
+static void Benchmark_PipeWireCopy_NV12(benchmark::State &state)
+{
+    const uint32_t uWidth = uint32_t(state.range(0));
+    const uint32_t uHeight = uint32_t(state.range(1));
+    const uint32_t uChromaHeight = (uHeight + 1) / 2;
+
+    // NV12 rows are one byte per pixel in both planes.
+    const uint32_t uSrcPitch = align_pitch(uWidth);
+    std::vector<uint8_t> src(size_t(uSrcPitch) * (uHeight + uChromaHeight), 0x80);
+
+    const uint32_t uDstStride = uWidth;
+    BenchMemfd_t dst(size_t(uDstStride) * (uHeight + uChromaHeight));
+
+    const pipewire_copy_plane planes[] = {
+        { &src[0],                          uSrcPitch, uHeight },
+        { &src[size_t(uSrcPitch) * uHeight], uSrcPitch, uChromaHeight },
+    };
+
+    for (auto _ : state)
+    {
+        pipewire_copy_planes(dst.pData, uDstStride, planes);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(dst.zSize));
+}
+BENCHMARK(Benchmark_PipeWireCopy_NV12)->Args({1920, 1080})->Args({3840, 2160});
+
+static void Benchmark_PipeWireCopy_BGRx(benchmark::State &state)
+{
+    const uint32_t uWidth = uint32_t(state.range(0));
+    const uint32_t uHeight = uint32_t(state.range(1));
+
+    const uint32_t uSrcPitch = align_pitch(uWidth * 4);
+    std::vector<uint8_t> src(size_t(uSrcPitch) * uHeight, 0x80);
+
+    const uint32_t uDstStride = uWidth * 4;
+    BenchMemfd_t dst(size_t(uDstStride) * uHeight);
+
+    const pipewire_copy_plane planes[] = {
+        { src.data(), uSrcPitch, uHeight },
+    };
+
+    for (auto _ : state)
+    {
+        pipewire_copy_planes(dst.pData, uDstStride, planes);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(dst.zSize));
+}
+BENCHMARK(Benchmark_PipeWireCopy_BGRx)->Args({1920, 1080})->Args({3840, 2160});
+
+BENCHMARK_MAIN();
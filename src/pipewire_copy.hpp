@@ -0,0 +1,26 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+// One plane of a mapped capture texture, for the CPU copy into a PipeWire SHM buffer.
+struct pipewire_copy_plane {
+	const uint8_t *src;
+	uint32_t src_row_pitch;
+	uint32_t rows;
+};
+
+// Copies the planes one after another into dst, every row dst_stride apart,
+// which is the layout PipeWire expects for SHM buffers (eg. NV12 luma then chroma).
+// This is what it costs us per frame when the GPU can't write dst itself.
+static inline void pipewire_copy_planes(uint8_t *dst, uint32_t dst_stride, std::span<const pipewire_copy_plane> planes)
+{
+	for (const pipewire_copy_plane &plane : planes) {
+		const size_t row_size = std::min<size_t>(dst_stride, plane.src_row_pitch);
+		for (uint32_t i = 0; i < plane.rows; i++)
+			memcpy(&dst[i * size_t(dst_stride)], &plane.src[i * size_t(plane.src_row_pitch)], row_size);
+		dst += plane.rows * size_t(dst_stride);
+	}
+}
@@ -39,7 +39,7 @@ namespace gamescope
             if ( !uRefPrivate )
             {
                 m_uRefPrivate += 0x80000000;
-                delete this;
+                OnAllReferencesReleased();
             }
             
             return uRefPrivate;
@@ -60,6 +60,22 @@ namespace gamescope
             return bool( m_uRefCount.load() | ( m_uRefPrivate.load() & 0x7FFFFFFF ) );
         }
 
+    protected:
+        // Called once there are no references of either kind left.
+        // Objects that are recycled through a pool rather than freed
+        // can override this, and call ResetRefCounts before handing
+        // the object out again.
+        virtual void OnAllReferencesReleased()
+        {
+            delete this;
+        }
+
+        void ResetRefCounts()
+        {
+            m_uRefCount = 0;
+            m_uRefPrivate = 0;
+        }
+
     private:
         std::atomic<uint32_t> m_uRefCount{ 0u };
         std::atomic<uint32_t> m_uRefPrivate{ 0u };
@@ -9,8 +9,11 @@
 #include <algorithm>
 #include <array>
 #include <bitset>
+#include <map>
 #include <thread>
+#include <filesystem>
 #include <dlfcn.h>
+#include <pwd.h>
 #include "vulkan_include.h"
 
 #if defined(__linux__)
@@ -35,7 +38,9 @@
 #include "main.hpp"
 #include "steamcompmgr.hpp"
 #include "log.hpp"
+#include "Utils/Defer.h"
 #include "Utils/Process.h"
+#include "gpuvis_trace_utils.h"
 
 #include "cs_composite_blit.h"
 #include "cs_composite_blur.h"
@@ -47,6 +52,7 @@
 #include "cs_nis.h"
 #include "cs_nis_fp16.h"
 #include "cs_rgb_to_nv12.h"
+#include "cs_screenshot_pack.h"
 
 #define A_CPU
 #include "shaders/ffx_a.h"
@@ -122,6 +128,288 @@ VulkanOutput_t g_output;
 uint32_t g_uCompositeDebug = 0u;
 gamescope::ConVar<uint32_t> cv_composite_debug{ "composite_debug", 0, "Debug composition flags" };
 
+///////////////////////////////
+// Composite damage tracking
+///////////////////////////////
+//
+// Keeps track of what changed between composites so the blit only has to be
+// dispatched over the parts of the output that actually changed, eg. just the
+// cursor or a notification on top of an otherwise static frame.
+//
+// The output images are recycled, so the damage for an output image is
+// everything that changed since that image was last composited into.
+// Damage is tracked per layer: a layer is damaged when its contents
+// (texture + commit) or how it is placed/blended changed, and covers where it
+// was and where it is now.
+
+gamescope::ConVar<bool> cv_composite_damage_tracking{ "composite_damage_tracking", true, "Only re-composite the parts of the output that changed since that output image was last used." };
+
+static constexpr uint32_t k_uMaxDamageRects = 4;
+static constexpr uint32_t k_uDamageHistoryLength = 8;
+static constexpr uint32_t k_uMaxDamageSlots = 3;
+
+struct DamageRect_t
+{
+	int32_t x0, y0, x1, y1;
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+	int64_t area() const { return empty() ? 0 : int64_t( x1 - x0 ) * int64_t( y1 - y0 ); }
+
+	bool overlaps( const DamageRect_t &other ) const
+	{
+		return x0 <= other.x1 && other.x0 <= x1 &&
+		       y0 <= other.y1 && other.y0 <= y1;
+	}
+
+	DamageRect_t merged( const DamageRect_t &other ) const
+	{
+		return DamageRect_t
+		{
+			std::min( x0, other.x0 ), std::min( y0, other.y0 ),
+			std::max( x1, other.x1 ), std::max( y1, other.y1 ),
+		};
+	}
+};
+
+struct DamageRegion_t
+{
+	bool bFull = false;
+	uint32_t uRectCount = 0;
+	std::array<DamageRect_t, k_uMaxDamageRects> rects;
+
+	void addFull()
+	{
+		bFull = true;
+		uRectCount = 0;
+	}
+
+	void add( DamageRect_t rect )
+	{
+		if ( bFull || rect.empty() )
+			return;
+
+		// Fold anything touching the new rect into it, so the rects we
+		// dispatch over never overlap.
+		for ( uint32_t i = 0; i < uRectCount; )
+		{
+			if ( rects[i].overlaps( rect ) )
+			{
+				rect = rect.merged( rects[i] );
+				rects[i] = rects[--uRectCount];
+				i = 0;
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		if ( uRectCount == k_uMaxDamageRects )
+		{
+			// Out of rects, grow whichever one grows the least.
+			uint32_t uBest = 0;
+			int64_t lBestGrowth = INT64_MAX;
+			for ( uint32_t i = 0; i < uRectCount; i++ )
+			{
+				int64_t lGrowth = rects[i].merged( rect ).area() - rects[i].area();
+				if ( lGrowth < lBestGrowth )
+				{
+					uBest = i;
+					lBestGrowth = lGrowth;
+				}
+			}
+			rect = rect.merged( rects[uBest] );
+			rects[uBest] = rects[--uRectCount];
+			add( rect );
+			return;
+		}
+
+		rects[uRectCount++] = rect;
+	}
+
+	void add( const DamageRegion_t &other )
+	{
+		if ( other.bFull )
+		{
+			addFull();
+			return;
+		}
+
+		for ( uint32_t i = 0; i < other.uRectCount; i++ )
+			add( other.rects[i] );
+	}
+};
+
+struct CompositeLayerState_t
+{
+	// Only used for identity, never dereferenced.
+	const CVulkanTexture *pTex;
+	uint64_t ulCommitID;
+	uint32_t uTexWidth, uTexHeight;
+	vec2_t offset;
+	vec2_t scale;
+	float flOpacity;
+	GamescopeUpscaleFilter eFilter;
+	bool bBlackBorder;
+	bool bApplyColorMgmt;
+	const gamescope::BackendBlob *pCtm;
+	GamescopeAppTextureColorspace eColorspace;
+
+	// Without a commit we can't tell if the contents changed
+	// (eg. a previous output image), so assume it did.
+	bool isVolatile() const { return ulCommitID == 0; }
+
+	bool operator == ( const CompositeLayerState_t &other ) const
+	{
+		return pTex == other.pTex &&
+		       ulCommitID == other.ulCommitID &&
+		       uTexWidth == other.uTexWidth &&
+		       uTexHeight == other.uTexHeight &&
+		       offset.x == other.offset.x && offset.y == other.offset.y &&
+		       scale.x == other.scale.x && scale.y == other.scale.y &&
+		       flOpacity == other.flOpacity &&
+		       eFilter == other.eFilter &&
+		       bBlackBorder == other.bBlackBorder &&
+		       bApplyColorMgmt == other.bApplyColorMgmt &&
+		       pCtm == other.pCtm &&
+		       eColorspace == other.eColorspace;
+	}
+
+	// Where on the output this layer can have an effect.
+	// Inverse of the mapping in sampleLayerEx: texCoord = ( outCoord + offset ) * scale.
+	DamageRect_t outputRect( uint32_t uOutputWidth, uint32_t uOutputHeight ) const
+	{
+		const DamageRect_t fullRect = { 0, 0, int32_t( uOutputWidth ), int32_t( uOutputHeight ) };
+
+		// Outside of the texture is filled with black, so this covers everything.
+		if ( bBlackBorder || scale.x <= 0.0f || scale.y <= 0.0f )
+			return fullRect;
+
+		// Pad for filtering, which can reach a texel (so 1 / scale pixels) further.
+		const float flPadX = 2.0f + 1.0f / scale.x;
+		const float flPadY = 2.0f + 1.0f / scale.y;
+
+		DamageRect_t rect =
+		{
+			int32_t( floorf( -offset.x - flPadX ) ),
+			int32_t( floorf( -offset.y - flPadY ) ),
+			int32_t( ceilf( uTexWidth  / scale.x - offset.x + flPadX ) ),
+			int32_t( ceilf( uTexHeight / scale.y - offset.y + flPadY ) ),
+		};
+
+		rect.x0 = std::clamp( rect.x0, fullRect.x0, fullRect.x1 );
+		rect.y0 = std::clamp( rect.y0, fullRect.y0, fullRect.y1 );
+		rect.x1 = std::clamp( rect.x1, fullRect.x0, fullRect.x1 );
+		rect.y1 = std::clamp( rect.y1, fullRect.y0, fullRect.y1 );
+		return rect;
+	}
+};
+
+struct CompositeState_t
+{
+	// The pipeline covers layer count, formats, colorspaces and output EOTF.
+	VkPipeline pipeline;
+	uint32_t uWidth, uHeight;
+	std::array<std::pair<const CVulkanTexture *, uint64_t>, EOTF_Count * 2> luts;
+	float flLinearToNits;
+	float flItmSdrNits;
+	float flItmTargetNits;
+
+	int nLayerCount;
+	std::array<CompositeLayerState_t, k_nMaxLayers> layers;
+
+	bool sameGlobals( const CompositeState_t &other ) const
+	{
+		return pipeline == other.pipeline &&
+		       uWidth == other.uWidth &&
+		       uHeight == other.uHeight &&
+		       luts == other.luts &&
+		       flLinearToNits == other.flLinearToNits &&
+		       flItmSdrNits == other.flItmSdrNits &&
+		       flItmTargetNits == other.flItmTargetNits &&
+		       nLayerCount == other.nLayerCount;
+	}
+};
+
+class CCompositeDamageTracker
+{
+public:
+	// Records a composite of state into output image uSlot, and returns the
+	// part of it that needs to be re-composited.
+	DamageRegion_t Update( uint32_t uSlot, const CompositeState_t &state )
+	{
+		DamageRegion_t frameDamage;
+		if ( !m_oLastState || !m_oLastState->sameGlobals( state ) )
+		{
+			frameDamage.addFull();
+		}
+		else
+		{
+			for ( int i = 0; i < state.nLayerCount; i++ )
+			{
+				const CompositeLayerState_t &oldLayer = m_oLastState->layers[i];
+				const CompositeLayerState_t &newLayer = state.layers[i];
+				if ( newLayer.isVolatile() || !( oldLayer == newLayer ) )
+				{
+					frameDamage.add( oldLayer.outputRect( state.uWidth, state.uHeight ) );
+					frameDamage.add( newLayer.outputRect( state.uWidth, state.uHeight ) );
+				}
+			}
+		}
+
+		m_ulFrame++;
+		m_History[ m_ulFrame % k_uDamageHistoryLength ] = frameDamage;
+		m_oLastState = state;
+
+		if ( uSlot >= k_uMaxDamageSlots )
+		{
+			DamageRegion_t full;
+			full.addFull();
+			return full;
+		}
+
+		const uint64_t ulSlotFrame = m_SlotFrames[ uSlot ];
+		m_SlotFrames[ uSlot ] = m_ulFrame;
+
+		DamageRegion_t damage;
+		if ( !ulSlotFrame || m_ulFrame - ulSlotFrame > k_uDamageHistoryLength )
+		{
+			damage.addFull();
+			return damage;
+		}
+
+		for ( uint64_t ulFrame = ulSlotFrame + 1; ulFrame <= m_ulFrame && !damage.bFull; ulFrame++ )
+			damage.add( m_History[ ulFrame % k_uDamageHistoryLength ] );
+
+		return damage;
+	}
+
+	// Something we don't track wrote into the output image.
+	void Invalidate( uint32_t uSlot )
+	{
+		if ( uSlot < k_uMaxDamageSlots )
+			m_SlotFrames[ uSlot ] = 0;
+	}
+
+	void Reset()
+	{
+		m_oLastState = std::nullopt;
+		m_SlotFrames = {};
+	}
+
+private:
+	std::optional<CompositeState_t> m_oLastState;
+	uint64_t m_ulFrame = 0;
+	std::array<DamageRegion_t, k_uDamageHistoryLength> m_History;
+	// Frame last composited into each output image, 0 if unknown.
+	std::array<uint64_t, k_uMaxDamageSlots> m_SlotFrames = {};
+};
+
+// Regular and partial-overlay output images are tracked separately as they
+// composite completely different things, but they alias the same memory, so
+// writing into one invalidates the other.
+static CCompositeDamageTracker s_CompositeDamage[2];
+
 template <typename T>
 static bool Contains( const std::span<const T> x, T value )
 {
@@ -185,6 +473,9 @@ struct wsi_image_create_info {
 #define DRM_FORMAT_R16F fourcc_code('R', '1', '6', 'F')
 #define DRM_FORMAT_R32F fourcc_code('R', '3', '2', 'F')
 
+// Nor plain 32bit integer ones, which we pack screenshots into
+#define DRM_FORMAT_R32UI fourcc_code('R', '3', '2', 'U')
+
 struct {
 	uint32_t DRMFormat;
 	VkFormat vkFormat;
@@ -215,6 +506,7 @@ struct {
 	{ DRM_FORMAT_ABGR32323232F, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, 16,true, true },
 	{ DRM_FORMAT_R16F, VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16_SFLOAT, 2, false, true },
 	{ DRM_FORMAT_R32F, VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32_SFLOAT, 4, false, true },
+	{ DRM_FORMAT_R32UI, VK_FORMAT_R32_UINT, VK_FORMAT_R32_UINT, 4, false, true },
 	{ DRM_FORMAT_INVALID, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, false, true },
 };
 
@@ -295,10 +587,16 @@ bool CVulkanDevice::BInit(VkInstance instance, VkSurfaceKHR surface)
 	if (!createScratchResources())
 		return false;
 
+	// Not fatal, we just compile everything from scratch.
+	createPipelineCache();
+
 	m_bInitialized = true;
 
-	std::thread piplelineThread([this](){compileAllPipelines();});
-	piplelineThread.detach();
+	m_pipelineCompileThread = std::thread([this]()
+	{
+		compileAllPipelines();
+		savePipelineCacheAsync();
+	});
 
 	g_reshadeManager.init(this);
 
@@ -410,6 +708,8 @@ bool CVulkanDevice::createDevice()
 	bool hasDrmProps = false;
 	bool supportsForeignQueue = false;
 	bool supportsHDRMetadata = false;
+	bool supportsExternalSemaphoreFd = false;
+	bool supportsExternalMemoryHost = false;
 	for ( uint32_t i = 0; i < supportedExtensionCount; ++i )
 	{
 		if ( strcmp(supportedExts[i].extensionName,
@@ -427,6 +727,45 @@ bool CVulkanDevice::createDevice()
 		if ( strcmp(supportedExts[i].extensionName,
 			 VK_EXT_HDR_METADATA_EXTENSION_NAME) == 0 )
 			 supportsHDRMetadata = true;
+
+		if ( strcmp(supportedExts[i].extensionName,
+		     VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME) == 0 )
+			supportsExternalSemaphoreFd = true;
+
+		if ( strcmp(supportedExts[i].extensionName,
+		     VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0 )
+			supportsExternalMemoryHost = true;
+	}
+
+	if ( supportsExternalMemoryHost )
+	{
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostMemoryProps = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+		};
+		VkPhysicalDeviceProperties2 props2 = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &hostMemoryProps,
+		};
+		vk.GetPhysicalDeviceProperties2( physDev(), &props2 );
+
+		m_ulHostPointerAlignment = hostMemoryProps.minImportedHostPointerAlignment;
+		m_bSupportsHostMemoryImport = m_ulHostPointerAlignment != 0;
+	}
+
+	vk_log.infof( "physical device %s host memory import", m_bSupportsHostMemoryImport ? "supports" : "does not support" );
+
+	if ( supportsExternalSemaphoreFd )
+	{
+		VkPhysicalDeviceExternalSemaphoreInfo semaphoreInfo = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+			.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+		};
+		VkExternalSemaphoreProperties semaphoreProps = {
+			.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+		};
+		vk.GetPhysicalDeviceExternalSemaphoreProperties( physDev(), &semaphoreInfo, &semaphoreProps );
+
+		m_bSupportsSyncFileExport = !!( semaphoreProps.externalSemaphoreFeatures & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT );
 	}
 
 	vk_log.infof( "physical device %s DRM format modifiers", m_bSupportsModifiers ? "supports" : "does not support" );
@@ -504,6 +843,14 @@ bool CVulkanDevice::createDevice()
 		m_bSupportsFp16 = vulkan12Features.shaderFloat16 && features2.features.shaderInt16;
 	}
 
+	{
+		// The screenshot pack pass stores into a mappable (linear) R32_UINT image,
+		// which not every driver can do.
+		VkFormatProperties r32uiProperties;
+		vk.GetPhysicalDeviceFormatProperties( physDev(), VK_FORMAT_R32_UINT, &r32uiProperties );
+		m_bSupportsLinearStorageR32UI = r32uiProperties.linearTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	}
+
 	float queuePriorities = 1.0f;
 
 	VkDeviceQueueGlobalPriorityCreateInfoEXT queueCreateInfoEXT = {
@@ -558,6 +905,12 @@ bool CVulkanDevice::createDevice()
 	if ( supportsHDRMetadata )
 		enabledExtensions.push_back( VK_EXT_HDR_METADATA_EXTENSION_NAME );
 
+	if ( m_bSupportsSyncFileExport )
+		enabledExtensions.push_back( VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME );
+
+	if ( m_bSupportsHostMemoryImport )
+		enabledExtensions.push_back( VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME );
+
 	for ( auto& extension : GetBackend()->GetDeviceExtensions( physDev() ) )
 		enabledExtensions.push_back( extension );
 
@@ -901,8 +1254,22 @@ bool CVulkanDevice::createShaders()
 		SHADER(NIS, cs_nis);
 	}
 	SHADER(RGB_TO_NV12, cs_rgb_to_nv12);
+	SHADER(SCREENSHOT_PACK, cs_screenshot_pack);
 #undef SHADER
 
+	// FNV-1a over all of our SPIR-V, so a rebuilt Gamescope never picks up
+	// a stale on-disk pipeline cache.
+	m_ulShaderHash = 0xcbf29ce484222325ull;
+	for (const auto& info : shaderInfos)
+	{
+		const uint8_t *pBytes = reinterpret_cast<const uint8_t *>(info.spirv);
+		for (uint32_t i = 0; i < info.size; i++)
+		{
+			m_ulShaderHash ^= pBytes[i];
+			m_ulShaderHash *= 0x100000001b3ull;
+		}
+	}
+
 	for (uint32_t i = 0; i < shaderInfos.size(); i++)
 	{
 		VkShaderModuleCreateInfo shaderCreateInfo = {
@@ -940,45 +1307,15 @@ bool CVulkanDevice::createScratchResources()
 		return false;
 	}
 
-	// Make and map upload buffer
-	
-	VkBufferCreateInfo bufferCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = upload_buffer_size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-	};
-
-	res = vk.CreateBuffer( device(), &bufferCreateInfo, nullptr, &m_uploadBuffer );
-	if ( res != VK_SUCCESS )
-	{
-		vk_errorf( res, "vkCreateBuffer failed" );
-		return false;
-	}
-	
-	VkMemoryRequirements memRequirements;
-	vk.GetBufferMemoryRequirements(device(), m_uploadBuffer, &memRequirements);
-	
-	uint32_t memTypeIndex =  findMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, memRequirements.memoryTypeBits );
-	if ( memTypeIndex == ~0u )
-	{
-		vk_log.errorf( "findMemoryType failed" );
-		return false;
-	}
-	
-	VkMemoryAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = memRequirements.size,
-		.memoryTypeIndex = memTypeIndex,
-	};
-	
-	vk.AllocateMemory( device(), &allocInfo, nullptr, &m_uploadBufferMemory);
-	
-	vk.BindBufferMemory( device(), m_uploadBuffer, m_uploadBufferMemory, 0 );
+	VkPhysicalDeviceProperties props;
+	vk.GetPhysicalDeviceProperties( physDev(), &props );
+	m_ulUniformBufferAlignment = std::max<VkDeviceSize>( m_ulUniformBufferAlignment, props.limits.minUniformBufferOffsetAlignment );
 
-	res = vk.MapMemory( device(), m_uploadBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_uploadBufferData );
-	if ( res != VK_SUCCESS )
+	if ( !m_uploadRing.BInit( upload_ring_size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) )
 	{
-		vk_errorf( res, "vkMapMemory failed" );
+		vk_log.errorf( "Failed to create the upload ring" );
 		return false;
 	}
 
@@ -999,9 +1336,260 @@ bool CVulkanDevice::createScratchResources()
 		return false;
 	}
 
+	if ( m_bSupportsSyncFileExport )
+	{
+		// Binary semaphore we signal after a submission to hand out
+		// sync files for it. Exporting a sync file resets it, so it can
+		// be re-used for every export.
+		VkExportSemaphoreCreateInfo exportCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+			.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+		};
+
+		VkSemaphoreCreateInfo syncFileSemCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &exportCreateInfo,
+		};
+
+		res = vk.CreateSemaphore( device(), &syncFileSemCreateInfo, NULL, &m_syncFileSemaphore );
+		if ( res != VK_SUCCESS )
+		{
+			vk_errorf( res, "vkCreateSemaphore failed for sync file export, disabling it" );
+			m_bSupportsSyncFileExport = false;
+		}
+	}
+
+	vk_log.infof( "physical device %s sync file export", m_bSupportsSyncFileExport ? "supports" : "does not support" );
+
+	return true;
+}
+
+static constexpr uint32_t k_unPipelineCacheMagic = 0x43505347; // 'GSPC'
+static constexpr uint32_t k_unPipelineCacheVersion = 1;
+
+struct PipelineCacheHeader_t
+{
+	uint32_t uMagic;
+	uint32_t uVersion;
+	uint8_t driverUUID[VK_UUID_SIZE];
+	uint64_t ulShaderHash;
+	uint64_t ulDataSize;
+};
+
+static std::string GetPipelineCacheDir()
+{
+	const char *pszCacheHome = getenv( "XDG_CACHE_HOME" );
+	if ( pszCacheHome && *pszCacheHome )
+		return std::string( pszCacheHome ) + "/gamescope";
+
+	const char *pszHome = getenv( "HOME" );
+	if ( !pszHome || !*pszHome )
+	{
+		struct passwd *pw = getpwuid( getuid() );
+		if ( !pw )
+			return "";
+		pszHome = pw->pw_dir;
+	}
+
+	return std::string( pszHome ) + "/.cache/gamescope";
+}
+
+bool CVulkanDevice::createPipelineCache()
+{
+	VkPhysicalDeviceProperties props;
+	vk.GetPhysicalDeviceProperties( physDev(), &props );
+
+	std::vector<uint8_t> initialData;
+
+	std::string sCacheDir = GetPipelineCacheDir();
+	if ( !env_to_bool( getenv( "GAMESCOPE_DISABLE_PIPELINE_CACHE" ) ) && !sCacheDir.empty() )
+	{
+		char szUUID[ VK_UUID_SIZE * 2 + 1 ] = {};
+		for ( uint32_t i = 0; i < VK_UUID_SIZE; i++ )
+			snprintf( &szUUID[ i * 2 ], 3, "%02x", props.pipelineCacheUUID[i] );
+
+		char szFileName[ 128 ];
+		snprintf( szFileName, sizeof( szFileName ), "pipelines-%s-%016" PRIx64 ".bin", szUUID, m_ulShaderHash );
+		m_pipelineCachePath = sCacheDir + "/" + szFileName;
+
+		FILE *pFile = fopen( m_pipelineCachePath.c_str(), "rb" );
+		if ( pFile )
+		{
+			PipelineCacheHeader_t header{};
+			if ( fread( &header, sizeof( header ), 1, pFile ) == 1 &&
+			     header.uMagic == k_unPipelineCacheMagic &&
+			     header.uVersion == k_unPipelineCacheVersion &&
+			     memcmp( header.driverUUID, props.pipelineCacheUUID, VK_UUID_SIZE ) == 0 &&
+			     header.ulShaderHash == m_ulShaderHash &&
+			     header.ulDataSize < ( 256ull << 20 ) )
+			{
+				initialData.resize( header.ulDataSize );
+				if ( fread( initialData.data(), 1, initialData.size(), pFile ) != initialData.size() )
+					initialData.clear();
+			}
+			fclose( pFile );
+
+			if ( initialData.empty() )
+				vk_log.infof( "ignoring stale or invalid pipeline cache '%s'", m_pipelineCachePath.c_str() );
+			else
+				vk_log.debugf( "loaded %zu bytes of pipeline cache from '%s'", initialData.size(), m_pipelineCachePath.c_str() );
+		}
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = initialData.size(),
+		.pInitialData = initialData.empty() ? nullptr : initialData.data(),
+	};
+
+	VkResult res = vk.CreatePipelineCache( device(), &pipelineCacheCreateInfo, nullptr, &m_pipelineCache );
+	if ( res != VK_SUCCESS && !initialData.empty() )
+	{
+		// The driver didn't like the blob, start over with an empty cache.
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		res = vk.CreatePipelineCache( device(), &pipelineCacheCreateInfo, nullptr, &m_pipelineCache );
+	}
+
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkCreatePipelineCache failed" );
+		m_pipelineCache = VK_NULL_HANDLE;
+		m_pipelineCachePath.clear();
+		return false;
+	}
+
 	return true;
 }
 
+void CVulkanDevice::savePipelineCache()
+{
+	if ( m_pipelineCache == VK_NULL_HANDLE || m_pipelineCachePath.empty() )
+		return;
+
+	size_t size = 0;
+	if ( vk.GetPipelineCacheData( device(), m_pipelineCache, &size, nullptr ) != VK_SUCCESS || size == 0 )
+		return;
+
+	std::vector<uint8_t> data( size );
+	if ( vk.GetPipelineCacheData( device(), m_pipelineCache, &size, data.data() ) != VK_SUCCESS )
+		return;
+	data.resize( size );
+
+	VkPhysicalDeviceProperties props;
+	vk.GetPhysicalDeviceProperties( physDev(), &props );
+
+	PipelineCacheHeader_t header = {
+		.uMagic = k_unPipelineCacheMagic,
+		.uVersion = k_unPipelineCacheVersion,
+		.ulShaderHash = m_ulShaderHash,
+		.ulDataSize = data.size(),
+	};
+	memcpy( header.driverUUID, props.pipelineCacheUUID, VK_UUID_SIZE );
+
+	std::error_code ec;
+	std::filesystem::create_directories( std::filesystem::path( m_pipelineCachePath ).parent_path(), ec );
+
+	// Write to a temporary file and rename over the old one, so a concurrent
+	// Gamescope instance never sees a partial cache.
+	std::string sTempPath = m_pipelineCachePath + ".tmp." + std::to_string( getpid() );
+	FILE *pFile = fopen( sTempPath.c_str(), "wb" );
+	if ( !pFile )
+	{
+		vk_log.debugf( "failed to open '%s' for writing pipeline cache", sTempPath.c_str() );
+		return;
+	}
+
+	bool bSuccess = fwrite( &header, sizeof( header ), 1, pFile ) == 1 &&
+	                fwrite( data.data(), 1, data.size(), pFile ) == data.size();
+	bSuccess = ( fclose( pFile ) == 0 ) && bSuccess;
+
+	if ( !bSuccess || rename( sTempPath.c_str(), m_pipelineCachePath.c_str() ) != 0 )
+	{
+		vk_log.errorf_errno( "failed to write pipeline cache '%s'", m_pipelineCachePath.c_str() );
+		unlink( sTempPath.c_str() );
+		return;
+	}
+
+	vk_log.debugf( "wrote %zu bytes of pipeline cache to '%s'", data.size(), m_pipelineCachePath.c_str() );
+}
+
+void CVulkanDevice::savePipelineCacheAsync()
+{
+	std::unique_lock lock( m_pipelineCacheSaveMutex );
+	if ( m_bPipelineCacheSaveStop || m_pipelineCache == VK_NULL_HANDLE || m_pipelineCachePath.empty() )
+		return;
+
+	// Every new pipeline bumps the generation, and the worker only ever writes
+	// out the latest one. A burst of new pipelines becomes a single write,
+	// and with one writer an older blob can never land after a newer one.
+	m_ulPipelineCacheGeneration++;
+
+	if ( !m_pipelineCacheSaveThread.joinable() )
+		m_pipelineCacheSaveThread = std::thread( [this]() { pipelineCacheSaveThread(); } );
+	else
+		m_pipelineCacheSaveCV.notify_one();
+}
+
+void CVulkanDevice::pipelineCacheSaveThread()
+{
+	pthread_setname_np( pthread_self(), "gamescope-pcache" );
+
+	std::unique_lock lock( m_pipelineCacheSaveMutex );
+	for ( ;; )
+	{
+		m_pipelineCacheSaveCV.wait( lock, [this]()
+		{
+			return m_bPipelineCacheSaveStop || m_ulPipelineCacheSavedGeneration != m_ulPipelineCacheGeneration;
+		});
+
+		// Anything still pending gets written out before stopping.
+		if ( m_ulPipelineCacheSavedGeneration != m_ulPipelineCacheGeneration )
+		{
+			uint64_t ulGeneration = m_ulPipelineCacheGeneration;
+
+			lock.unlock();
+			savePipelineCache();
+			lock.lock();
+
+			m_ulPipelineCacheSavedGeneration = ulGeneration;
+		}
+		else if ( m_bPipelineCacheSaveStop )
+		{
+			return;
+		}
+	}
+}
+
+void CVulkanDevice::destroyPipelineCache()
+{
+	// The background compile uses the cache, stop it where it is.
+	m_bStopPipelineCompiles = true;
+	if ( m_pipelineCompileThread.joinable() )
+		m_pipelineCompileThread.join();
+
+	{
+		std::unique_lock lock( m_pipelineCacheSaveMutex );
+		m_bPipelineCacheSaveStop = true;
+	}
+	m_pipelineCacheSaveCV.notify_one();
+	if ( m_pipelineCacheSaveThread.joinable() )
+		m_pipelineCacheSaveThread.join();
+
+	// Anything compiled from here on just doesn't use a cache.
+	std::lock_guard<std::mutex> lock( m_pipelineMutex );
+	if ( m_pipelineCache != VK_NULL_HANDLE )
+	{
+		vk.DestroyPipelineCache( device(), m_pipelineCache, nullptr );
+		m_pipelineCache = VK_NULL_HANDLE;
+	}
+}
+
+CVulkanDevice::~CVulkanDevice()
+{
+	destroyPipelineCache();
+}
+
 VkSampler CVulkanDevice::sampler( SamplerState key )
 {
 	if ( m_samplerCache.count(key) != 0 )
@@ -1096,6 +1684,8 @@ VkPipeline CVulkanDevice::compilePipeline(uint32_t layerCount, uint32_t ycbcrMas
 
 	VkComputePipelineCreateInfo computePipelineCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		// For dispatching over just the damaged parts of the output.
+		.flags = VK_PIPELINE_CREATE_DISPATCH_BASE_BIT,
 		.stage = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
@@ -1108,7 +1698,7 @@ VkPipeline CVulkanDevice::compilePipeline(uint32_t layerCount, uint32_t ycbcrMas
 
 	VkPipeline result;
 
-	VkResult res = vk.CreateComputePipelines(device(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &result);
+	VkResult res = vk.CreateComputePipelines(device(), m_pipelineCache, 1, &computePipelineCreateInfo, nullptr, &result);
 	if (res != VK_SUCCESS) {
 		vk_errorf( res, "vkCreateComputePipelines failed" );
 		return VK_NULL_HANDLE;
@@ -1131,12 +1721,15 @@ void CVulkanDevice::compileAllPipelines()
 	SHADER(EASU, 1, 1, 1);
 	SHADER(NIS, 1, 1, 1);
 	SHADER(RGB_TO_NV12, 1, 1, 1);
+	SHADER(SCREENSHOT_PACK, 1, 1, 1);
 #undef SHADER
 
 	for (auto& info : pipelineInfos) {
 		for (uint32_t layerCount = 1; layerCount <= info.layerCount; layerCount++) {
 			for (uint32_t ycbcrMask = 0; ycbcrMask < info.ycbcrMask; ycbcrMask++) {
 				for (uint32_t blur_layers = 1; blur_layers <= info.blurLayerCount; blur_layers++) {
+					if (m_bStopPipelineCompiles)
+						return;
 					if (ycbcrMask >= (1u << (layerCount + 1)))
 						continue;
 					if (blur_layers > layerCount)
@@ -1171,6 +1764,7 @@ VkPipeline CVulkanDevice::pipeline(ShaderType type, uint32_t layerCount, uint32_
 	{
 		VkPipeline result = compilePipeline(layerCount, ycbcrMask, type, blur_layers, effective_debug, colorspace_mask, output_eotf, itm_enable);
 		m_pipelineMap[key] = result;
+		savePipelineCacheAsync();
 		return result;
 	}
 	else
@@ -1238,13 +1832,33 @@ uint64_t CVulkanDevice::submitInternal( CVulkanCmdBuffer* cmdBuffer )
 	// This is the seq no of the command buffer we are going to submit.
 	const uint64_t nextSeqNo = lastSubmissionSeqNo + 1;
 
-	VkTimelineSemaphoreSubmitInfo timelineInfo = {
-		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
-		// no need to ensure order of cmd buffer submission, we only have one queue
-		.waitSemaphoreValueCount = 0,
-		.pWaitSemaphoreValues = nullptr,
-		.signalSemaphoreValueCount = 1,
-		.pSignalSemaphoreValues = &nextSeqNo,
+	if ( cmdBuffer->m_bUsesUploadRing )
+	{
+		cmdBuffer->m_bUsesUploadRing = false;
+		releaseUploadRing( nextSeqNo );
+	}
+
+	for ( auto &pTexture : cmdBuffer->m_textureRefs )
+		pTexture->ulLastUseSeq = nextSeqNo;
+
+	// Submissions on the same queue are already ordered, but work chained
+	// from the general queue (eg. ReShade) needs an explicit GPU-side wait.
+	// Every submission signals the same timeline, so switching queues must
+	// also wait for the previous value, otherwise the signal could land
+	// before it and move the timeline backwards.
+	if ( lastSubmissionSeqNo && m_lastSubmitQueue != cmdBuffer->queue() )
+		cmdBuffer->addDependency( lastSubmissionSeqNo );
+	m_lastSubmitQueue = cmdBuffer->queue();
+
+	const uint64_t waitSeqNo = cmdBuffer->waitSeqNo();
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = waitSeqNo ? 1u : 0u,
+		.pWaitSemaphoreValues = waitSeqNo ? &waitSeqNo : nullptr,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &nextSeqNo,
 	};
 
 	VkCommandBuffer rawCmdBuffer = cmdBuffer->rawBuffer();
@@ -1252,6 +1866,9 @@ uint64_t CVulkanDevice::submitInternal( CVulkanCmdBuffer* cmdBuffer )
 	VkSubmitInfo submitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 		.pNext = &timelineInfo,
+		.waitSemaphoreCount = waitSeqNo ? 1u : 0u,
+		.pWaitSemaphores = waitSeqNo ? &m_scratchTimelineSemaphore : nullptr,
+		.pWaitDstStageMask = waitSeqNo ? &waitStage : nullptr,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &rawCmdBuffer,
 		.signalSemaphoreCount = 1,
@@ -1270,19 +1887,27 @@ uint64_t CVulkanDevice::submit( std::unique_ptr<CVulkanCmdBuffer> cmdBuffer)
 	return nextSeqNo;
 }
 
+void CVulkanDevice::releaseUploadRing( uint64_t sequence )
+{
+	assert( m_uUploadRingUsers > 0 );
+	if ( --m_uUploadRingUsers == 0 )
+		m_uploadRing.Retire( sequence );
+}
+
 void CVulkanDevice::garbageCollect( void )
+{
+	resetCmdBuffers(completedSequence());
+}
+
+uint64_t CVulkanDevice::completedSequence( void )
 {
 	uint64_t currentSeqNo;
 	vk_check( vk.GetSemaphoreCounterValue(device(), m_scratchTimelineSemaphore, &currentSeqNo) );
-
-	resetCmdBuffers(currentSeqNo);
+	return currentSeqNo;
 }
 
 void CVulkanDevice::wait(uint64_t sequence, bool reset)
 {
-	if (m_submissionSeqNo == sequence)
-		m_uploadBufferOffset = 0;
-
 	VkSemaphoreWaitInfo waitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
 		.semaphoreCount = 1,
@@ -1296,6 +1921,60 @@ void CVulkanDevice::wait(uint64_t sequence, bool reset)
 		resetCmdBuffers(sequence);
 }
 
+int CVulkanDevice::exportSyncFile(uint64_t ulSeqNo)
+{
+	if ( !m_bSupportsSyncFileExport )
+		return -1;
+
+	// Chain a signal of the binary semaphore after the submission
+	// on the GPU, no CPU wait involved.
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	const uint64_t ulSignalValue = 0;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = 1,
+		.pWaitSemaphoreValues = &ulSeqNo,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &ulSignalValue,
+	};
+
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timelineInfo,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &m_scratchTimelineSemaphore,
+		.pWaitDstStageMask = &waitStage,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &m_syncFileSemaphore,
+	};
+
+	VkResult res = vk.QueueSubmit( queue(), 1, &submitInfo, VK_NULL_HANDLE );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkQueueSubmit failed for sync file export" );
+		return -1;
+	}
+
+	VkSemaphoreGetFdInfoKHR getFdInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+		.semaphore = m_syncFileSemaphore,
+		.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+	};
+
+	int nFd = -1;
+	res = vk.GetSemaphoreFdKHR( device(), &getFdInfo, &nFd );
+	if ( res != VK_SUCCESS )
+	{
+		// The semaphore is stuck signalled now, so stop using it.
+		vk_errorf( res, "vkGetSemaphoreFdKHR failed, disabling sync file export" );
+		m_bSupportsSyncFileExport = false;
+		return -1;
+	}
+
+	return nFd;
+}
+
 void CVulkanDevice::waitIdle(bool reset)
 {
 	wait(m_submissionSeqNo, reset);
@@ -1303,19 +1982,17 @@ void CVulkanDevice::waitIdle(bool reset)
 
 void CVulkanDevice::resetCmdBuffers(uint64_t sequence)
 {
-	auto last = m_pendingCmdBufs.find(sequence);
-	if (last == m_pendingCmdBufs.end())
-		return;
+	// Only the ones at or before the completed sequence are done with,
+	// later submissions may still be running on the GPU.
+	auto last = m_pendingCmdBufs.upper_bound(sequence);
 
-	for (auto it = m_pendingCmdBufs.begin(); ; it++)
+	for (auto it = m_pendingCmdBufs.begin(); it != last; it++)
 	{
 		it->second->reset();
 		m_unusedCmdBufs.push_back(std::move(it->second));
-		if (it == last)
-			break;
 	}
 
-	m_pendingCmdBufs.erase(m_pendingCmdBufs.begin(), ++last);
+	m_pendingCmdBufs.erase(m_pendingCmdBufs.begin(), last);
 }
 
 CVulkanCmdBuffer::CVulkanCmdBuffer(CVulkanDevice *parent, VkCommandBuffer cmdBuffer, VkQueue queue, uint32_t queueFamily)
@@ -1325,6 +2002,10 @@ CVulkanCmdBuffer::CVulkanCmdBuffer(CVulkanDevice *parent, VkCommandBuffer cmdBuf
 
 CVulkanCmdBuffer::~CVulkanCmdBuffer()
 {
+	// Never submitted, nothing will read what it uploaded.
+	if (m_bUsesUploadRing)
+		m_device->releaseUploadRing(m_device->m_submissionSeqNo);
+
 	m_device->vk.FreeCommandBuffers(m_device->device(), m_device->commandPool(), 1, &m_cmdBuffer);
 }
 
@@ -1333,6 +2014,9 @@ void CVulkanCmdBuffer::reset()
 	vk_check( m_device->vk.ResetCommandBuffer(m_cmdBuffer, 0) );
 	m_textureRefs.clear();
 	m_textureState.clear();
+	m_waitSeqNo = 0;
+	m_bPreserveTarget = false;
+	m_bFailed = false;
 }
 
 void CVulkanCmdBuffer::begin()
@@ -1386,9 +2070,10 @@ void CVulkanCmdBuffer::setSamplerUnnormalized(uint32_t slot, bool unnormalized)
 	m_samplerState[slot].bUnnormalized = unnormalized;
 }
 
-void CVulkanCmdBuffer::bindTarget(gamescope::Rc<CVulkanTexture> target)
+void CVulkanCmdBuffer::bindTarget(gamescope::Rc<CVulkanTexture> target, bool bPreserveContents)
 {
 	m_target = target.get();
+	m_bPreserveTarget = bPreserveContents;
 	if (target)
 		m_textureRefs.emplace_back(std::move(target));
 }
@@ -1410,9 +2095,28 @@ void CVulkanCmdBuffer::uploadConstants(Args&&... args)
 {
 	PushData data(std::forward<Args>(args)...);
 
-	void *ptr = m_device->uploadBufferData(sizeof(data));
-	m_renderBufferOffset = m_device->m_uploadBufferOffset - sizeof(data);
-	memcpy(ptr, &data, sizeof(data));
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation = uploadData(sizeof(data), m_device->uniformBufferAlignment());
+	if (!oAllocation)
+	{
+		vk_log.errorf("Failed to allocate space for shader constants");
+		m_bFailed = true;
+		return;
+	}
+
+	m_renderBuffer = oAllocation->vkBuffer;
+	m_renderBufferOffset = oAllocation->ulOffset;
+	memcpy(oAllocation->pData, &data, sizeof(data));
+}
+
+std::optional<CVulkanUploadRing::Allocation_t> CVulkanCmdBuffer::uploadData(VkDeviceSize size, VkDeviceSize alignment)
+{
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation = m_device->m_uploadRing.Allocate(size, alignment);
+	if (oAllocation && !m_bUsesUploadRing)
+	{
+		m_bUsesUploadRing = true;
+		m_device->m_uUploadRingUsers++;
+	}
+	return oAllocation;
 }
 
 void CVulkanCmdBuffer::bindPipeline(VkPipeline pipeline)
@@ -1422,13 +2126,27 @@ void CVulkanCmdBuffer::bindPipeline(VkPipeline pipeline)
 
 void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 {
+	dispatchInternal(0, 0, x, y, z);
+}
+
+void CVulkanCmdBuffer::dispatchBase(uint32_t baseX, uint32_t baseY, uint32_t x, uint32_t y)
+{
+	dispatchInternal(baseX, baseY, x, y, 1);
+}
+
+void CVulkanCmdBuffer::dispatchInternal(uint32_t baseX, uint32_t baseY, uint32_t x, uint32_t y, uint32_t z)
+{
+	// No constants to dispatch with, the whole thing gets thrown away.
+	if (m_bFailed)
+		return;
+
 	for (auto src : m_boundTextures)
 	{
 		if (src)
 			prepareSrcImage(src);
 	}
 	assert(m_target != nullptr);
-	prepareDestImage(m_target);
+	prepareDestImage(m_target, m_bPreserveTarget);
 	insertBarrier();
 
 	VkDescriptorSet descriptorSet = m_device->descriptorSet();
@@ -1511,7 +2229,7 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 		.pImageInfo = lut3DDescriptor.data(),
 	};
 
-	scratchDescriptor.buffer = m_device->m_uploadBuffer;
+	scratchDescriptor.buffer = m_renderBuffer;
 	scratchDescriptor.offset = m_renderBufferOffset;
 	scratchDescriptor.range = VK_WHOLE_SIZE;
 
@@ -1569,7 +2287,10 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 
 	m_device->vk.CmdBindDescriptorSets(m_cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_device->pipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
 
-	m_device->vk.CmdDispatch(m_cmdBuffer, x, y, z);
+	if (baseX || baseY)
+		m_device->vk.CmdDispatchBase(m_cmdBuffer, baseX, baseY, 0, x, y, z);
+	else
+		m_device->vk.CmdDispatch(m_cmdBuffer, x, y, z);
 
 	markDirty(m_target);
 }
@@ -1630,6 +2351,89 @@ void CVulkanCmdBuffer::copyBufferToImage(VkBuffer buffer, VkDeviceSize offset, u
 	m_textureRefs.emplace_back(std::move(dst));
 }
 
+void CVulkanCmdBuffer::copyBufferToImage(VkBuffer buffer, std::span<const VkBufferImageCopy> regions, gamescope::Rc<CVulkanTexture> dst, bool bPreserveContents)
+{
+	prepareDestImage(dst.get(), bPreserveContents);
+	insertBarrier();
+
+	m_device->vk.CmdCopyBufferToImage(m_cmdBuffer, buffer, dst->vkImage(), VK_IMAGE_LAYOUT_GENERAL, uint32_t(regions.size()), regions.data());
+
+	markDirty(dst.get());
+
+	m_textureRefs.emplace_back(std::move(dst));
+}
+
+void CVulkanCmdBuffer::copyImageToBuffer(gamescope::Rc<CVulkanTexture> src, VkBuffer buffer, VkDeviceSize offset, uint32_t stride)
+{
+	// src is usually written by an earlier submission, so order the copy
+	// after that like a target whose contents we keep.
+	prepareDestImage(src.get(), true);
+	insertBarrier();
+
+	std::array<VkBufferImageCopy, 2> regions;
+	uint32_t regionCount = 0;
+
+	if (src->isYcbcr())
+	{
+		regions[regionCount++] = {
+			.bufferOffset = offset,
+			.bufferRowLength = stride,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+				.layerCount = 1,
+			},
+			.imageExtent = {
+				.width = src->width(),
+				.height = src->height(),
+				.depth = 1,
+			},
+		};
+
+		// Chroma is R8G8 at half resolution, bufferRowLength is in texels.
+		regions[regionCount++] = {
+			.bufferOffset = offset + VkDeviceSize(stride) * src->height(),
+			.bufferRowLength = stride / 2,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+				.layerCount = 1,
+			},
+			.imageExtent = {
+				.width = (src->width() + 1) / 2,
+				.height = (src->height() + 1) / 2,
+				.depth = 1,
+			},
+		};
+	}
+	else
+	{
+		regions[regionCount++] = {
+			.bufferOffset = offset,
+			.bufferRowLength = stride / DRMFormatGetBPP(src->drmFormat()),
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.layerCount = 1,
+			},
+			.imageExtent = {
+				.width = src->width(),
+				.height = src->height(),
+				.depth = src->depth(),
+			},
+		};
+	}
+
+	m_device->vk.CmdCopyImageToBuffer(m_cmdBuffer, src->vkImage(), VK_IMAGE_LAYOUT_GENERAL, buffer, regionCount, regions.data());
+
+	VkMemoryBarrier hostBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+	m_device->vk.CmdPipelineBarrier(m_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+									0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+	m_textureRefs.emplace_back(std::move(src));
+}
+
 void CVulkanCmdBuffer::prepareSrcImage(CVulkanTexture *image)
 {
 	auto result = m_textureState.emplace(image, TextureState());
@@ -1642,13 +2446,23 @@ void CVulkanCmdBuffer::prepareSrcImage(CVulkanTexture *image)
 	result.first->second.needsExport = image->externalImage();
 }
 
-void CVulkanCmdBuffer::prepareDestImage(CVulkanTexture *image)
+void CVulkanCmdBuffer::prepareDestImage(CVulkanTexture *image, bool bPreserveContents)
 {
 	auto result = m_textureState.emplace(image, TextureState());
 	// no need to discard if the image is already image/in the correct layout
 	if (!result.second)
 		return;
-	result.first->second.discarded = true;
+	if (bPreserveContents)
+	{
+		// Keep the layout and contents, but still order our writes
+		// after whatever wrote it last.
+		result.first->second.dirty = true;
+		result.first->second.needsImport = image->externalImage();
+	}
+	else
+	{
+		result.first->second.discarded = true;
+	}
 	result.first->second.needsExport = image->externalImage();
 	result.first->second.needsPresentLayout = image->outputImage();
 }
@@ -1805,6 +2619,256 @@ static VkImageViewType VulkanImageTypeToViewType(VkImageType type)
 	}
 }
 
+struct CVulkanMemoryAllocator::Block_t
+{
+	PoolKey_t key;
+	VkDeviceMemory vkMemory = VK_NULL_HANDLE;
+	VkDeviceSize ulSize = 0;
+	uint8_t *pMappedData = nullptr;
+
+	uint32_t uAllocationCount = 0;
+	VkDeviceSize ulUsed = 0;
+	// Offset -> size of each free range, neighbours are always merged.
+	std::map<VkDeviceSize, VkDeviceSize> FreeRanges;
+};
+
+struct MemorySizeClass_t
+{
+	VkDeviceSize ulMaxAllocation;
+	VkDeviceSize ulBlockSize;
+};
+
+static constexpr MemorySizeClass_t k_MemorySizeClasses[] =
+{
+	// LUTs, cursors, small screenshots and the like.
+	{ 1 * 1024 * 1024, 8 * 1024 * 1024 },
+	// Up to a 1440p 32bpp image.
+	{ 16 * 1024 * 1024, 64 * 1024 * 1024 },
+	// Anything bigger gets a block to itself, freed as soon as it's empty.
+};
+static constexpr uint32_t k_uOversizedMemoryClass = std::size( k_MemorySizeClasses );
+
+std::optional<CVulkanMemoryAllocator::Allocation_t> CVulkanMemoryAllocator::Allocate( const VkMemoryRequirements &requirements, uint32_t uMemoryTypeIndex, bool bLinear, bool bMapped )
+{
+	uint32_t uSizeClass = 0;
+	while ( uSizeClass < k_uOversizedMemoryClass && requirements.size > k_MemorySizeClasses[ uSizeClass ].ulMaxAllocation )
+		uSizeClass++;
+
+	const PoolKey_t key = { uMemoryTypeIndex, bLinear, uSizeClass };
+
+	std::scoped_lock lock{ m_mutAllocator };
+	std::vector<Block_t *> &blocks = m_Pools[ key ];
+
+	Block_t *pBlock = nullptr;
+	std::optional<VkDeviceSize> oOffset;
+	for ( Block_t *pExistingBlock : blocks )
+	{
+		oOffset = AllocateFromBlock( pExistingBlock, requirements.size, requirements.alignment );
+		if ( oOffset )
+		{
+			pBlock = pExistingBlock;
+			break;
+		}
+	}
+
+	if ( !pBlock )
+	{
+		const VkDeviceSize ulBlockSize = uSizeClass != k_uOversizedMemoryClass
+			? k_MemorySizeClasses[ uSizeClass ].ulBlockSize
+			: requirements.size;
+
+		pBlock = CreateBlock( key, ulBlockSize );
+		if ( !pBlock )
+			return std::nullopt;
+		blocks.push_back( pBlock );
+
+		oOffset = AllocateFromBlock( pBlock, requirements.size, requirements.alignment );
+		assert( oOffset );
+	}
+
+	// Map the whole block the first time anything in it wants mapping,
+	// a VkDeviceMemory can only be mapped once.
+	if ( bMapped && !pBlock->pMappedData )
+	{
+		VkResult res = g_device.vk.MapMemory( g_device.device(), pBlock->vkMemory, 0, VK_WHOLE_SIZE, 0, (void **)&pBlock->pMappedData );
+		if ( res != VK_SUCCESS )
+		{
+			vk_errorf( res, "vkMapMemory failed" );
+			pBlock->pMappedData = nullptr;
+		}
+	}
+
+	return Allocation_t
+	{
+		.pBlock = pBlock,
+		.vkMemory = pBlock->vkMemory,
+		.ulOffset = *oOffset,
+		.ulSize = requirements.size,
+		.pMappedData = ( bMapped && pBlock->pMappedData ) ? pBlock->pMappedData + *oOffset : nullptr,
+	};
+}
+
+void CVulkanMemoryAllocator::Free( const Allocation_t &allocation )
+{
+	std::scoped_lock lock{ m_mutAllocator };
+
+	Block_t *pBlock = allocation.pBlock;
+	auto [ iter, bInserted ] = pBlock->FreeRanges.emplace( allocation.ulOffset, allocation.ulSize );
+	assert( bInserted );
+
+	auto nextIter = std::next( iter );
+	if ( nextIter != pBlock->FreeRanges.end() && iter->first + iter->second == nextIter->first )
+	{
+		iter->second += nextIter->second;
+		pBlock->FreeRanges.erase( nextIter );
+	}
+
+	if ( iter != pBlock->FreeRanges.begin() )
+	{
+		auto prevIter = std::prev( iter );
+		if ( prevIter->first + prevIter->second == iter->first )
+		{
+			prevIter->second += iter->second;
+			pBlock->FreeRanges.erase( iter );
+		}
+	}
+
+	pBlock->uAllocationCount--;
+	pBlock->ulUsed -= allocation.ulSize;
+
+	if ( pBlock->uAllocationCount != 0 )
+		return;
+
+	// Keep one empty block per pool around, so something being
+	// re-created every now and then doesn't hit the driver each time.
+	std::vector<Block_t *> &blocks = m_Pools[ pBlock->key ];
+	bool bKeep = pBlock->key.uSizeClass != k_uOversizedMemoryClass &&
+		std::none_of( blocks.begin(), blocks.end(), [ pBlock ]( Block_t *pOther ) { return pOther != pBlock && pOther->uAllocationCount == 0; } );
+	if ( bKeep )
+		return;
+
+	std::erase( blocks, pBlock );
+	DestroyBlock( pBlock );
+}
+
+void CVulkanMemoryAllocator::TrackDedicated( VkDeviceSize ulSize, bool bAllocated )
+{
+	std::scoped_lock lock{ m_mutAllocator };
+
+	if ( bAllocated )
+	{
+		m_uDedicatedCount++;
+		m_ulDedicatedBytes += ulSize;
+	}
+	else
+	{
+		m_uDedicatedCount--;
+		m_ulDedicatedBytes -= ulSize;
+	}
+}
+
+VulkanMemoryStats_t CVulkanMemoryAllocator::GetStats()
+{
+	std::scoped_lock lock{ m_mutAllocator };
+
+	VulkanMemoryStats_t stats;
+	stats.uDedicatedCount = m_uDedicatedCount;
+	stats.ulDedicatedBytes = m_ulDedicatedBytes;
+
+	VkDeviceSize ulTotalFree = 0;
+	VkDeviceSize ulTotalLargestFree = 0;
+	for ( const auto &[ key, blocks ] : m_Pools )
+	{
+		for ( const Block_t *pBlock : blocks )
+		{
+			stats.uBlockCount++;
+			stats.ulBlockBytes += pBlock->ulSize;
+			stats.uSubAllocationCount += pBlock->uAllocationCount;
+			stats.ulSubAllocatedBytes += pBlock->ulUsed;
+
+			VkDeviceSize ulLargestFree = 0;
+			for ( const auto &[ ulOffset, ulSize ] : pBlock->FreeRanges )
+			{
+				ulTotalFree += ulSize;
+				ulLargestFree = std::max( ulLargestFree, ulSize );
+			}
+			ulTotalLargestFree += ulLargestFree;
+		}
+	}
+
+	if ( ulTotalFree )
+		stats.flFragmentation = 1.0f - float( ulTotalLargestFree ) / float( ulTotalFree );
+
+	return stats;
+}
+
+CVulkanMemoryAllocator::Block_t *CVulkanMemoryAllocator::CreateBlock( const PoolKey_t &key, VkDeviceSize ulSize )
+{
+	VkMemoryAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = ulSize,
+		.memoryTypeIndex = key.uMemoryTypeIndex,
+	};
+
+	VkDeviceMemory vkMemory = VK_NULL_HANDLE;
+	VkResult res = g_device.vk.AllocateMemory( g_device.device(), &allocInfo, nullptr, &vkMemory );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkAllocateMemory failed" );
+		return nullptr;
+	}
+
+	vk_log.debugf( "Allocated a %" PRIu64 "KiB memory block, type %u, %s, size class %u",
+		uint64_t( ulSize / 1024 ), key.uMemoryTypeIndex, key.bLinear ? "linear" : "optimal", key.uSizeClass );
+
+	Block_t *pBlock = new Block_t;
+	pBlock->key = key;
+	pBlock->vkMemory = vkMemory;
+	pBlock->ulSize = ulSize;
+	pBlock->FreeRanges.emplace( 0, ulSize );
+	return pBlock;
+}
+
+void CVulkanMemoryAllocator::DestroyBlock( Block_t *pBlock )
+{
+	if ( pBlock->pMappedData )
+		g_device.vk.UnmapMemory( g_device.device(), pBlock->vkMemory );
+	g_device.vk.FreeMemory( g_device.device(), pBlock->vkMemory, nullptr );
+	delete pBlock;
+}
+
+// First fit, returns the offset.
+std::optional<VkDeviceSize> CVulkanMemoryAllocator::AllocateFromBlock( Block_t *pBlock, VkDeviceSize ulSize, VkDeviceSize ulAlignment )
+{
+	for ( auto iter = pBlock->FreeRanges.begin(); iter != pBlock->FreeRanges.end(); iter++ )
+	{
+		const auto [ ulRangeOffset, ulRangeSize ] = *iter;
+		const VkDeviceSize ulStart = align( ulRangeOffset, ulAlignment );
+		const VkDeviceSize ulPadding = ulStart - ulRangeOffset;
+		if ( ulPadding + ulSize > ulRangeSize )
+			continue;
+
+		pBlock->FreeRanges.erase( iter );
+		if ( ulPadding )
+			pBlock->FreeRanges.emplace( ulRangeOffset, ulPadding );
+		if ( ulPadding + ulSize < ulRangeSize )
+			pBlock->FreeRanges.emplace( ulStart + ulSize, ulRangeSize - ulPadding - ulSize );
+
+		pBlock->uAllocationCount++;
+		pBlock->ulUsed += ulSize;
+		return ulStart;
+	}
+
+	return std::nullopt;
+}
+
+static CVulkanMemoryAllocator s_MemoryAllocator;
+
+VulkanMemoryStats_t vulkan_get_memory_stats()
+{
+	return s_MemoryAllocator.GetStats();
+}
+
 bool CVulkanTexture::BInit( uint32_t width, uint32_t height, uint32_t depth, uint32_t drmFormat, createFlags flags, wlr_dmabuf_attributes *pDMA /* = nullptr */,  uint32_t contentWidth /* = 0 */, uint32_t contentHeight /* =  0 */, CVulkanTexture *pExistingImageToReuseMemory, gamescope::OwningRc<gamescope::IBackendFb> pBackendFb )
 {
 	m_pBackendFb = std::move( pBackendFb );
@@ -2046,8 +3110,19 @@ bool CVulkanTexture::BInit( uint32_t width, uint32_t height, uint32_t depth, uin
 		return false;
 	}
 	
-	VkMemoryRequirements memRequirements;
-	g_device.vk.GetImageMemoryRequirements(g_device.device(), m_vkImage, &memRequirements);
+	VkMemoryDedicatedRequirements dedicatedRequirements = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+	};
+	VkMemoryRequirements2 memRequirements2 = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+		.pNext = &dedicatedRequirements,
+	};
+	const VkImageMemoryRequirementsInfo2 memRequirementsInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+		.image = m_vkImage,
+	};
+	g_device.vk.GetImageMemoryRequirements2(g_device.device(), &memRequirementsInfo, &memRequirements2);
+	const VkMemoryRequirements &memRequirements = memRequirements2.memoryRequirements;
 
 	VkMemoryAllocateInfo allocInfo = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
@@ -2058,22 +3133,30 @@ bool CVulkanTexture::BInit( uint32_t width, uint32_t height, uint32_t depth, uin
 	m_size = allocInfo.allocationSize;
 
 	VkDeviceMemory memoryHandle = VK_NULL_HANDLE;
+	VkDeviceSize memoryOffset = 0;
+
+	// Only memory we share with someone else needs an allocation of its own.
+	const bool bDedicated = flags.bExportable == true || pDMA != nullptr || dedicatedRequirements.requiresDedicatedAllocation;
+
+	if ( pExistingImageToReuseMemory == nullptr && !bDedicated )
+	{
+		m_oSubAllocation = s_MemoryAllocator.Allocate( memRequirements, allocInfo.memoryTypeIndex, tiling != VK_IMAGE_TILING_OPTIMAL, flags.bMappable );
+		if ( !m_oSubAllocation )
+			return false;
 
-	if ( pExistingImageToReuseMemory == nullptr )
+		memoryHandle = m_oSubAllocation->vkMemory;
+		memoryOffset = m_oSubAllocation->ulOffset;
+	}
+	else if ( pExistingImageToReuseMemory == nullptr )
 	{
 		// Possible pNexts
 		VkImportMemoryFdInfoKHR importMemoryInfo = {};
 		VkExportMemoryAllocateInfo memory_export_info = {};
-		VkMemoryDedicatedAllocateInfo memory_dedicated_info = {};
-
-		if ( flags.bExportable == true || pDMA != nullptr )
-		{
-			memory_dedicated_info = {
-				.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
-				.pNext = std::exchange(allocInfo.pNext, &memory_dedicated_info),
-				.image = m_vkImage,
-			};
-		}
+		VkMemoryDedicatedAllocateInfo memory_dedicated_info = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+			.pNext = std::exchange(allocInfo.pNext, &memory_dedicated_info),
+			.image = m_vkImage,
+		};
 		
 		if ( flags.bExportable == true && pDMA == nullptr )
 		{
@@ -2116,17 +3199,26 @@ bool CVulkanTexture::BInit( uint32_t width, uint32_t height, uint32_t depth, uin
 		}
 
 		m_vkImageMemory = memoryHandle;
+		s_MemoryAllocator.TrackDedicated( m_size, true );
 	}
 	else
 	{
 		vk_log.infof("%d vs %d!", (int)pExistingImageToReuseMemory->m_size, (int)m_size);
 		assert(pExistingImageToReuseMemory->m_size >= m_size);
 
-		memoryHandle = pExistingImageToReuseMemory->m_vkImageMemory;
+		if ( pExistingImageToReuseMemory->m_oSubAllocation )
+		{
+			memoryHandle = pExistingImageToReuseMemory->m_oSubAllocation->vkMemory;
+			memoryOffset = pExistingImageToReuseMemory->m_oSubAllocation->ulOffset;
+		}
+		else
+		{
+			memoryHandle = pExistingImageToReuseMemory->m_vkImageMemory;
+		}
 		m_vkImageMemory = VK_NULL_HANDLE;
 	}
 	
-	res = g_device.vk.BindImageMemory( g_device.device(), m_vkImage, memoryHandle, 0 );
+	res = g_device.vk.BindImageMemory( g_device.device(), m_vkImage, memoryHandle, memoryOffset );
 	if ( res != VK_SUCCESS )
 	{
 		vk_errorf( res, "vkBindImageMemory failed" );
@@ -2344,6 +3436,12 @@ bool CVulkanTexture::BInit( uint32_t width, uint32_t height, uint32_t depth, uin
 		{
 			m_pMappedData = pExistingImageToReuseMemory->m_pMappedData;
 		}
+		else if (m_oSubAllocation)
+		{
+			m_pMappedData = m_oSubAllocation->pMappedData;
+			if ( !m_pMappedData )
+				return false;
+		}
 		else
 		{
 			void *pData = nullptr;
@@ -2469,18 +3567,28 @@ CVulkanTexture::~CVulkanTexture( void )
 	if ( m_pBackendFb != nullptr )
 		m_pBackendFb = nullptr;
 
-	if ( m_vkImageMemory != VK_NULL_HANDLE )
+	if ( m_vkImageMemory != VK_NULL_HANDLE || m_oSubAllocation )
 	{
 		if ( m_vkImage != VK_NULL_HANDLE )
 		{
 			g_device.vk.DestroyImage( g_device.device(), m_vkImage, nullptr );
 			m_vkImage = VK_NULL_HANDLE;
 		}
+	}
 
+	if ( m_vkImageMemory != VK_NULL_HANDLE )
+	{
 		g_device.vk.FreeMemory( g_device.device(), m_vkImageMemory, nullptr );
+		s_MemoryAllocator.TrackDedicated( m_size, false );
 		m_vkImageMemory = VK_NULL_HANDLE;
 	}
 
+	if ( m_oSubAllocation )
+	{
+		s_MemoryAllocator.Free( *m_oSubAllocation );
+		m_oSubAllocation = std::nullopt;
+	}
+
 	m_bInitialized = false;
 }
 
@@ -2836,26 +3944,52 @@ gamescope::Rc<CVulkanTexture> vulkan_create_3d_lut(uint32_t width, uint32_t heig
 	return texture;
 }
 
-void vulkan_update_luts(const gamescope::Rc<CVulkanTexture>& lut1d, const gamescope::Rc<CVulkanTexture>& lut3d, void* lut1d_data, void* lut3d_data)
+uint64_t vulkan_update_luts(const gamescope::Rc<CVulkanTexture>& lut1d, const gamescope::Rc<CVulkanTexture>& lut3d, void* lut1d_data, void* lut3d_data)
 {
 	size_t lut1d_size = lut1d->width() * sizeof(uint16_t) * 4;
 	size_t lut3d_size = lut3d->width() * lut3d->height() * lut3d->depth() * sizeof(uint16_t) * 4;
 
-	void* base_dst = g_device.uploadBufferData(lut1d_size + lut3d_size);
+	auto cmdBuffer = g_device.commandBuffer();
+
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation = cmdBuffer->uploadData(lut1d_size + lut3d_size);
+	if (!oAllocation)
+	{
+		vk_log.errorf("Failed to allocate upload space for LUTs");
+		return 0;
+	}
 
-	void* lut1d_dst = base_dst;
-	void *lut3d_dst = ((uint8_t*)base_dst) + lut1d_size;
+	void* lut1d_dst = oAllocation->pData;
+	void *lut3d_dst = oAllocation->pData + lut1d_size;
 	memcpy(lut1d_dst, lut1d_data, lut1d_size);
 	memcpy(lut3d_dst, lut3d_data, lut3d_size);
 
-	auto cmdBuffer = g_device.commandBuffer();
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), 0, 0, lut1d);
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), lut1d_size, 0, lut3d);
-	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle(); // TODO: Sync this better
+	cmdBuffer->copyBufferToImage(oAllocation->vkBuffer, oAllocation->ulOffset, 0, lut1d);
+	cmdBuffer->copyBufferToImage(oAllocation->vkBuffer, oAllocation->ulOffset + lut1d_size, 0, lut3d);
+
+	// No CPU wait here. The upload goes to the same queue as composition,
+	// so the timeline ordering of submissions (and the barrier at the start
+	// of the next command buffer) guarantees the next vulkan_composite sees
+	// the new LUTs. The upload ring only recycles the space once this
+	// submission has completed.
+	uint64_t ulSeq = g_device.submit(std::move(cmdBuffer));
+
+	uint64_t ulNow = get_time_in_nanos();
+	lut1d->ulPendingUploadSeq = ulSeq;
+	lut1d->ulPendingUploadTime = ulNow;
+	lut3d->ulPendingUploadSeq = ulSeq;
+	lut3d->ulPendingUploadTime = ulNow;
+
+	gpuvis_trace_printf( "vulkan_update_luts seq %" PRIu64, ulSeq );
+
+	return ulSeq;
 }
 
-gamescope::Rc<CVulkanTexture> vulkan_get_hacky_blank_texture()
+bool vulkan_texture_in_flight( const CVulkanTexture *pTexture )
+{
+	return pTexture->ulLastUseSeq > g_device.completedSequence();
+}
+
+gamescope::Rc<CVulkanTexture> vulkan_get_hacky_blank_texture()
 {
 	return g_output.temporaryHackyBlankImage.get();
 }
@@ -2871,7 +4005,13 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_flat_texture( uint32_t width,
 	bool bRes = texture->BInit( width, height, 1u, VulkanFormatToDRM( VK_FORMAT_B8G8R8A8_UNORM ), flags );
 	assert( bRes );
 
-	uint8_t* dst = (uint8_t *)g_device.uploadBufferData( width * height * 4 );
+	auto cmdBuffer = g_device.commandBuffer();
+
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation = cmdBuffer->uploadData( width * height * 4 );
+	if ( !oAllocation )
+		return nullptr;
+
+	uint8_t* dst = oAllocation->pData;
 	for ( uint32_t i = 0; i < width * height * 4; i += 4 )
 	{
 		dst[i + 0] = b;
@@ -2880,10 +4020,12 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_flat_texture( uint32_t width,
 		dst[i + 3] = a;
 	}
 
-	auto cmdBuffer = g_device.commandBuffer();
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), 0, 0, texture.get());
-	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle();
+	cmdBuffer->copyBufferToImage(oAllocation->vkBuffer, oAllocation->ulOffset, 0, texture.get());
+	uint64_t ulSeq = g_device.submit(std::move(cmdBuffer));
+
+	// This may be scanned out or handed to the host compositor, neither of
+	// which waits on our queue, so make sure just this copy has landed.
+	g_device.wait(ulSeq);
 
 	return texture;
 }
@@ -3033,6 +4175,8 @@ bool vulkan_remake_swapchain( void )
 	// Delete screenshot image to be remade if needed
 	for (auto& pScreenshotImage : pOutput->pScreenshotImages)
 		pScreenshotImage = nullptr;
+	for (auto& pScreenshotPackImage : pOutput->pScreenshotPackImages)
+		pScreenshotPackImage = nullptr;
 
 	bool bRet = vulkan_make_swapchain( pOutput );
 	assert( bRet ); // Something has gone horribly wrong!
@@ -3058,6 +4202,9 @@ static bool vulkan_make_output_images( VulkanOutput_t *pOutput )
 	pOutput->outputImagesPartialOverlay[1] = nullptr;
 	pOutput->outputImagesPartialOverlay[2] = nullptr;
 
+	for ( CCompositeDamageTracker &tracker : s_CompositeDamage )
+		tracker.Reset();
+
 	VkFormat format = pOutput->outputFormat;
 
 	pOutput->outputImages[0] = new CVulkanTexture();
@@ -3129,6 +4276,8 @@ bool vulkan_remake_output_images()
 	// Delete screenshot image to be remade if needed
 	for (auto& pScreenshotImage : pOutput->pScreenshotImages)
 		pScreenshotImage = nullptr;
+	for (auto& pScreenshotPackImage : pOutput->pScreenshotPackImages)
+		pScreenshotPackImage = nullptr;
 
 	bool bRet = vulkan_make_output_images( pOutput );
 	assert( bRet );
@@ -3346,15 +4495,23 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_bits( uint32_t wi
 		return nullptr;
 
 	size_t size = width * height * DRMFormatGetBPP(drmFormat);
-	memcpy( g_device.uploadBufferData(size), bits, size );
 
 	auto cmdBuffer = g_device.commandBuffer();
 
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), 0, 0, pTex.get());
-	// TODO: Sync this copyBufferToImage.
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation = cmdBuffer->uploadData( size );
+	if ( !oAllocation )
+		return nullptr;
+	memcpy( oAllocation->pData, bits, size );
 
-	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle();
+	cmdBuffer->copyBufferToImage(oAllocation->vkBuffer, oAllocation->ulOffset, 0, pTex.get());
+
+	uint64_t ulSeq = g_device.submit(std::move(cmdBuffer));
+
+	// Anything sampling this is submitted after it on the same queue, so the
+	// GPU orders that for us. Only wait if it might be scanned out or handed
+	// to the host compositor, neither of which waits on our queue.
+	if ( texCreateFlags.bFlippable )
+		g_device.wait(ulSeq);
 
 	return pTex;
 }
@@ -3378,6 +4535,7 @@ gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_texture(uint32_t width,
 			screenshotImageFlags.bMappable = true;
 			screenshotImageFlags.bTransferDst = true;
 			screenshotImageFlags.bStorage = true;
+			screenshotImageFlags.bSampled = true; // for the NV12 and pack passes
 			if (exportable || drmFormat == DRM_FORMAT_NV12) {
 				screenshotImageFlags.bExportable = true;
 				screenshotImageFlags.bLinear = true; // TODO: support multi-planar DMA-BUF export via PipeWire
@@ -3402,6 +4560,64 @@ gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_texture(uint32_t width,
 	return nullptr;
 }
 
+static void screenshot_pack_extent( uint32_t width, uint32_t height, EScreenshotPackLayout eLayout, uint32_t *pPackWidth, uint32_t *pPackHeight )
+{
+	// The pack image holds 32-bit words of the encoder's data.
+	switch ( eLayout )
+	{
+		default:
+		case k_EScreenshotPackLayout_RGB8:
+			*pPackWidth = div_roundup( width * 3, 4 );
+			*pPackHeight = height;
+			break;
+		case k_EScreenshotPackLayout_GBR16_Planar:
+			*pPackWidth = div_roundup( width, 2 );
+			*pPackHeight = height * 3;
+			break;
+	}
+}
+
+gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_pack_texture(uint32_t width, uint32_t height, EScreenshotPackLayout eLayout)
+{
+	// No linear storage images, let the encoders convert on the CPU instead.
+	if ( !g_device.supportsLinearStorageR32UI() )
+		return nullptr;
+
+	uint32_t uPackWidth, uPackHeight;
+	screenshot_pack_extent( width, height, eLayout, &uPackWidth, &uPackHeight );
+
+	for (auto& pPackImage : g_output.pScreenshotPackImages)
+	{
+		if (pPackImage != nullptr && pPackImage->GetRefCount() != 0)
+			continue;
+
+		// PNG and AVIF screenshots want different sizes, so rather than
+		// keeping one of each around, remake whichever one is free.
+		if (pPackImage == nullptr ||
+			uPackWidth != pPackImage->width() ||
+			uPackHeight != pPackImage->height())
+		{
+			CVulkanTexture::createFlags packImageFlags;
+			packImageFlags.bMappable = true;
+			packImageFlags.bStorage = true;
+
+			pPackImage = new CVulkanTexture();
+			if ( !pPackImage->BInit( uPackWidth, uPackHeight, 1u, DRM_FORMAT_R32UI, packImageFlags ) )
+			{
+				// Not fatal, the screenshot can still be converted on the CPU.
+				vk_log.errorf("Failed to create screenshot pack texture.");
+				pPackImage = nullptr;
+				return nullptr;
+			}
+		}
+
+		return pPackImage.get();
+	}
+
+	vk_log.errorf("Unable to acquire screenshot pack texture. Out of textures.");
+	return nullptr;
+}
+
 // Internal display's native brightness.
 float g_flInternalDisplayBrightnessNits = 500.0f;
 
@@ -3695,6 +4911,63 @@ std::optional<uint64_t> vulkan_screenshot( const struct FrameInfo_t *frameInfo,
 		cmdBuffer->dispatch(div_roundup(pYUVOutTexture->width(), dispatchSize), div_roundup(pYUVOutTexture->height(), dispatchSize));
 	}
 
+	if (cmdBuffer->failed())
+		return std::nullopt;
+
+	uint64_t sequence = g_device.submit(std::move(cmdBuffer));
+	return sequence;
+}
+
+struct ScreenshotPackData_t
+{
+	uint32_t layout;
+	uint32_t extent[2];
+	float maxValue;
+
+	ScreenshotPackData_t(EScreenshotPackLayout eLayout, uint32_t width, uint32_t height, float flMaxValue)
+		: layout(eLayout)
+		, extent{ width, height }
+		, maxValue(flMaxValue)
+	{
+	}
+};
+
+std::optional<uint64_t> vulkan_pack_screenshot( gamescope::Rc<CVulkanTexture> pScreenshotTexture, uint32_t width, uint32_t height, gamescope::Rc<CVulkanTexture> pPackTexture, EScreenshotPackLayout eLayout )
+{
+	uint32_t uPackWidth, uPackHeight;
+	screenshot_pack_extent( width, height, eLayout, &uPackWidth, &uPackHeight );
+	assert( pPackTexture->width() == uPackWidth && pPackTexture->height() == uPackHeight );
+	assert( width <= pScreenshotTexture->width() && height <= pScreenshotTexture->height() );
+
+	float flMaxValue = 255.0f;
+	if ( eLayout == k_EScreenshotPackLayout_GBR16_Planar && pScreenshotTexture->format() == VK_FORMAT_A2R10G10B10_UNORM_PACK32 )
+		flMaxValue = 1023.0f;
+
+	auto cmdBuffer = g_device.commandBuffer();
+
+	for (uint32_t i = 0; i < EOTF_Count; i++)
+		cmdBuffer->bindColorMgmtLuts(i, nullptr, nullptr);
+
+	cmdBuffer->bindPipeline(g_device.pipeline( SHADER_TYPE_SCREENSHOT_PACK ));
+	// Raw values, the composite already did any encoding.
+	cmdBuffer->bindTexture(0, pScreenshotTexture);
+	cmdBuffer->setTextureSrgb(0, true);
+	cmdBuffer->setSamplerNearest(0, true);
+	cmdBuffer->setSamplerUnnormalized(0, true);
+	for (uint32_t i = 1; i < VKR_SAMPLER_SLOTS; i++)
+	{
+		cmdBuffer->bindTexture(i, nullptr);
+	}
+	cmdBuffer->bindTarget(pPackTexture);
+	cmdBuffer->uploadConstants<ScreenshotPackData_t>(eLayout, width, height, flMaxValue);
+
+	const int pixelsPerGroup = 8;
+
+	cmdBuffer->dispatch(div_roundup(uPackWidth, pixelsPerGroup), div_roundup(uPackHeight, pixelsPerGroup));
+
+	if (cmdBuffer->failed())
+		return std::nullopt;
+
 	uint64_t sequence = g_device.submit(std::move(cmdBuffer));
 	return sequence;
 }
@@ -3708,6 +4981,7 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 	if (!frameInfo->applyOutputColorMgmt)
 		outputTF = EOTF_Count; //Disable blending stuff.
 
+	uint64_t reshadeSeq = 0;
 	if (!g_reshade_effect.empty())
 	{
 		if (frameInfo->layers[0].tex)
@@ -3722,12 +4996,11 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 				.techniqueIdx     = g_reshade_technique_idx,
 			};
 
+			// Don't block the CPU on the effect, the composite below waits
+			// for it on the GPU through the timeline semaphore instead.
 			ReshadeEffectPipeline* pipeline = g_reshadeManager.pipeline(key);
 			if (pipeline != nullptr)
-			{
-				uint64_t seq = pipeline->execute(frameInfo->layers[0].tex, &frameInfo->layers[0].tex);
-				g_device.wait(seq);
-			}
+				reshadeSeq = pipeline->execute(frameInfo->layers[0].tex, &frameInfo->layers[0].tex);
 		}
 	}
 	else
@@ -3741,10 +5014,33 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 	else
 		compositeImage = partial ? g_output.outputImagesPartialOverlay[ g_output.nOutImage ] : g_output.outputImages[ g_output.nOutImage ];
 
+	// Damage tracking relies on the output image still holding what we last
+	// composited into it, so only our own DRM output images qualify.
+	// Debug flags change the output every frame.
+	const bool bTrackDamage = cv_composite_damage_tracking &&
+		pOutputOverride == nullptr &&
+		!GetBackend()->UsesVulkanSwapchain() &&
+		GetBackend()->GetPresentLayout() == VK_IMAGE_LAYOUT_GENERAL &&
+		g_reshade_effect.empty() &&
+		g_uCompositeDebug == 0;
+	const uint32_t uDamageSlot = g_output.nOutImage;
+
 	auto cmdBuffer = g_device.commandBuffer();
+	if (reshadeSeq)
+		cmdBuffer->addDependency(reshadeSeq);
 
 	for (uint32_t i = 0; i < EOTF_Count; i++)
+	{
+		CVulkanTexture *pLut3D = frameInfo->lut3D[i].get();
+		if ( pLut3D && pLut3D->ulPendingUploadTime )
+		{
+			gpuvis_trace_printf( "lut upload seq %" PRIu64 " -> first use: %.3fms", pLut3D->ulPendingUploadSeq,
+				( get_time_in_nanos() - pLut3D->ulPendingUploadTime ) / 1'000'000.0 );
+			pLut3D->ulPendingUploadTime = 0;
+		}
+
 		cmdBuffer->bindColorMgmtLuts(i, frameInfo->shaperLut[i], frameInfo->lut3D[i]);
+	}
 
 	if ( frameInfo->useFSRLayer0 )
 	{
@@ -3865,14 +5161,88 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 	}
 	else
 	{
-		cmdBuffer->bindPipeline( g_device.pipeline(SHADER_TYPE_BLIT, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF ));
-		bind_all_layers(cmdBuffer.get(), frameInfo);
-		cmdBuffer->bindTarget(compositeImage);
-		cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
+		VkPipeline pipeline = g_device.pipeline(SHADER_TYPE_BLIT, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF );
 
 		const int pixelsPerGroup = 8;
 
-		cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
+		DamageRegion_t damage;
+		damage.addFull();
+		if ( bTrackDamage )
+		{
+			CompositeState_t state = {};
+			state.pipeline = pipeline;
+			state.uWidth = currentOutputWidth;
+			state.uHeight = currentOutputHeight;
+			for ( uint32_t i = 0; i < EOTF_Count; i++ )
+			{
+				const CVulkanTexture *pShaper = frameInfo->shaperLut[i].get();
+				const CVulkanTexture *pLut3D = frameInfo->lut3D[i].get();
+				state.luts[i * 2 + 0] = { pShaper, pShaper ? pShaper->ulPendingUploadSeq : 0 };
+				state.luts[i * 2 + 1] = { pLut3D, pLut3D ? pLut3D->ulPendingUploadSeq : 0 };
+			}
+			state.flLinearToNits = g_flInternalDisplayBrightnessNits;
+			state.flItmSdrNits = g_flHDRItmSdrNits;
+			state.flItmTargetNits = g_flHDRItmTargetNits;
+			state.nLayerCount = frameInfo->layerCount;
+			for ( int i = 0; i < frameInfo->layerCount; i++ )
+			{
+				const FrameInfo_t::Layer_t *layer = &frameInfo->layers[i];
+				state.layers[i] = CompositeLayerState_t
+				{
+					.pTex            = layer->tex.get(),
+					.ulCommitID      = layer->commitID,
+					.uTexWidth       = layer->tex ? layer->tex->width() : 0,
+					.uTexHeight      = layer->tex ? layer->tex->height() : 0,
+					.offset          = layer->offset,
+					.scale           = layer->scale,
+					.flOpacity       = layer->opacity,
+					.eFilter         = layer->filter,
+					.bBlackBorder    = layer->blackBorder,
+					.bApplyColorMgmt = layer->applyColorMgmt,
+					.pCtm            = layer->ctm.get(),
+					.eColorspace     = layer->colorspace,
+				};
+			}
+
+			damage = s_CompositeDamage[ partial ].Update( uDamageSlot, state );
+			s_CompositeDamage[ !partial ].Invalidate( uDamageSlot );
+		}
+
+		if ( damage.bFull )
+		{
+			cmdBuffer->bindPipeline( pipeline );
+			bind_all_layers(cmdBuffer.get(), frameInfo);
+			cmdBuffer->bindTarget(compositeImage);
+			cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
+
+			cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
+		}
+		else if ( damage.uRectCount )
+		{
+			cmdBuffer->bindPipeline( pipeline );
+			bind_all_layers(cmdBuffer.get(), frameInfo);
+			cmdBuffer->bindTarget(compositeImage, true);
+			cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
+
+			for ( uint32_t i = 0; i < damage.uRectCount; i++ )
+			{
+				const DamageRect_t &rect = damage.rects[i];
+				const uint32_t uGroupX0 = uint32_t( rect.x0 ) / pixelsPerGroup;
+				const uint32_t uGroupY0 = uint32_t( rect.y0 ) / pixelsPerGroup;
+				const uint32_t uGroupX1 = div_roundup( uint32_t( rect.x1 ), pixelsPerGroup );
+				const uint32_t uGroupY1 = div_roundup( uint32_t( rect.y1 ), pixelsPerGroup );
+
+				cmdBuffer->dispatchBase( uGroupX0, uGroupY0, uGroupX1 - uGroupX0, uGroupY1 - uGroupY0 );
+			}
+		}
+		// Otherwise, nothing changed since this output image was last
+		// composited, so it's already good to go.
+	}
+
+	if ( !bTrackDamage || frameInfo->useFSRLayer0 || frameInfo->useNISLayer0 || frameInfo->blurLayer0 )
+	{
+		for ( CCompositeDamageTracker &tracker : s_CompositeDamage )
+			tracker.Invalidate( uDamageSlot );
 	}
 
 	if ( pPipewireTexture != nullptr )
@@ -3922,6 +5292,9 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 		}
 	}
 
+	if ( cmdBuffer->failed() )
+		return std::nullopt;
+
 	uint64_t sequence = g_device.submit(std::move(cmdBuffer));
 
 	if ( !GetBackend()->UsesVulkanSwapchain() && pOutputOverride == nullptr && increment )
@@ -3937,6 +5310,11 @@ void vulkan_wait( uint64_t ulSeqNo, bool bReset )
 	return g_device.wait( ulSeqNo, bReset );
 }
 
+int vulkan_export_sync_file( uint64_t ulSeqNo )
+{
+	return g_device.exportSyncFile( ulSeqNo );
+}
+
 gamescope::Rc<CVulkanTexture> vulkan_get_last_output_image( bool partial, bool defer )
 {
 	// Get previous image ( +2 )
@@ -3964,6 +5342,20 @@ gamescope::Rc<CVulkanTexture> vulkan_get_last_output_image( bool partial, bool d
 	return g_output.outputImages[ nOutImage ];
 }
 
+gamescope::Rc<CVulkanTexture> vulkan_get_next_output_image( bool partial )
+{
+	if ( partial )
+		return g_output.outputImagesPartialOverlay[ g_output.nOutImage ];
+
+	return g_output.outputImages[ g_output.nOutImage ];
+}
+
+void vulkan_skip_output_image()
+{
+	assert( !GetBackend()->UsesVulkanSwapchain() );
+	g_output.nOutImage = ( g_output.nOutImage + 1 ) % 3;
+}
+
 bool vulkan_primary_dev_id(dev_t *id)
 {
 	*id = g_device.primaryDevId();
@@ -3975,6 +5367,305 @@ bool vulkan_supports_modifiers(void)
 	return g_device.supportsModifiers();
 }
 
+size_t vulkan_host_memory_import_alignment(void)
+{
+	return g_device.supportsHostMemoryImport() ? g_device.hostPointerAlignment() : 0;
+}
+
+CVulkanHostBuffer::~CVulkanHostBuffer()
+{
+	if ( m_vkBuffer != VK_NULL_HANDLE )
+		g_device.vk.DestroyBuffer( g_device.device(), m_vkBuffer, nullptr );
+	if ( m_vkMemory != VK_NULL_HANDLE )
+		g_device.vk.FreeMemory( g_device.device(), m_vkMemory, nullptr );
+}
+
+bool CVulkanHostBuffer::BInit( void *pData, size_t size )
+{
+	const size_t alignment = vulkan_host_memory_import_alignment();
+	if ( !alignment )
+		return false;
+
+	assert( ( uintptr_t( pData ) % alignment ) == 0 );
+	assert( ( size % alignment ) == 0 );
+
+	VkMemoryHostPointerPropertiesEXT hostPointerProps = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+	};
+	VkResult res = g_device.vk.GetMemoryHostPointerPropertiesEXT( g_device.device(), VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pData, &hostPointerProps );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkGetMemoryHostPointerPropertiesEXT failed" );
+		return false;
+	}
+
+	VkExternalMemoryBufferCreateInfo externalBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+	};
+
+	VkBufferCreateInfo bufferCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &externalBufferInfo,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	};
+
+	res = g_device.vk.CreateBuffer( g_device.device(), &bufferCreateInfo, nullptr, &m_vkBuffer );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkCreateBuffer failed" );
+		return false;
+	}
+
+	VkMemoryRequirements memRequirements;
+	g_device.vk.GetBufferMemoryRequirements( g_device.device(), m_vkBuffer, &memRequirements );
+
+	int32_t memTypeIndex = g_device.findMemoryType( VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		memRequirements.memoryTypeBits & hostPointerProps.memoryTypeBits );
+	if ( memTypeIndex == -1 )
+	{
+		vk_log.errorf( "Unable to find a memory type to import host memory into" );
+		return false;
+	}
+
+	VkImportMemoryHostPointerInfoEXT importInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+		.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+		.pHostPointer = pData,
+	};
+
+	VkMemoryAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = &importInfo,
+		.allocationSize = size,
+		.memoryTypeIndex = uint32_t( memTypeIndex ),
+	};
+
+	res = g_device.vk.AllocateMemory( g_device.device(), &allocInfo, nullptr, &m_vkMemory );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkAllocateMemory failed" );
+		return false;
+	}
+
+	res = g_device.vk.BindBufferMemory( g_device.device(), m_vkBuffer, m_vkMemory, 0 );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkBindBufferMemory failed" );
+		return false;
+	}
+
+	m_size = size;
+	return true;
+}
+
+std::optional<uint64_t> vulkan_copy_to_host_buffer( gamescope::Rc<CVulkanTexture> pTexture, CVulkanHostBuffer *pBuffer, uint32_t uStride )
+{
+	auto cmdBuffer = g_device.commandBuffer();
+	cmdBuffer->copyImageToBuffer( pTexture, pBuffer->vkBuffer(), 0, uStride );
+	return g_device.submit( std::move( cmdBuffer ) );
+}
+
+CVulkanUploadRing::~CVulkanUploadRing()
+{
+	DestroyBacking( m_Backing );
+	for ( OldBacking_t &old : m_OldBackings )
+		DestroyBacking( old.backing );
+}
+
+bool CVulkanUploadRing::BInit( VkDeviceSize ulSize, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties )
+{
+	m_usage = usage;
+	m_properties = properties;
+
+	return CreateBacking( ulSize, &m_Backing );
+}
+
+bool CVulkanUploadRing::CreateBacking( VkDeviceSize ulSize, Backing_t *pOutBacking )
+{
+	Backing_t backing;
+	defer( DestroyBacking( backing ) );
+
+	VkBufferCreateInfo bufferCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = ulSize,
+		.usage = m_usage,
+	};
+
+	VkResult res = g_device.vk.CreateBuffer( g_device.device(), &bufferCreateInfo, nullptr, &backing.vkBuffer );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkCreateBuffer failed" );
+		return false;
+	}
+
+	VkMemoryRequirements memRequirements;
+	g_device.vk.GetBufferMemoryRequirements( g_device.device(), backing.vkBuffer, &memRequirements );
+
+	int32_t memTypeIndex = g_device.findMemoryType( m_properties, memRequirements.memoryTypeBits );
+	// eg. no host-visible VRAM, plain host memory will do.
+	if ( memTypeIndex == -1 )
+		memTypeIndex = g_device.findMemoryType( VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memRequirements.memoryTypeBits );
+	if ( memTypeIndex == -1 )
+	{
+		vk_log.errorf( "findMemoryType failed" );
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = memRequirements.size,
+		.memoryTypeIndex = uint32_t( memTypeIndex ),
+	};
+
+	res = g_device.vk.AllocateMemory( g_device.device(), &allocInfo, nullptr, &backing.vkMemory );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkAllocateMemory failed" );
+		return false;
+	}
+
+	res = g_device.vk.BindBufferMemory( g_device.device(), backing.vkBuffer, backing.vkMemory, 0 );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkBindBufferMemory failed" );
+		return false;
+	}
+
+	res = g_device.vk.MapMemory( g_device.device(), backing.vkMemory, 0, VK_WHOLE_SIZE, 0, (void **)&backing.pData );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkMapMemory failed" );
+		return false;
+	}
+
+	backing.ulSize = ulSize;
+	*pOutBacking = std::exchange( backing, Backing_t{} );
+	return true;
+}
+
+void CVulkanUploadRing::DestroyBacking( Backing_t &backing )
+{
+	if ( backing.vkBuffer != VK_NULL_HANDLE )
+		g_device.vk.DestroyBuffer( g_device.device(), backing.vkBuffer, nullptr );
+	if ( backing.vkMemory != VK_NULL_HANDLE )
+		g_device.vk.FreeMemory( g_device.device(), backing.vkMemory, nullptr );
+	backing = Backing_t{};
+}
+
+bool CVulkanUploadRing::Grow( VkDeviceSize ulMinSize )
+{
+	VkDeviceSize ulNewSize = std::max<VkDeviceSize>( m_Backing.ulSize, 1 ) * 2;
+	while ( ulNewSize < ulMinSize )
+		ulNewSize *= 2;
+
+	Backing_t newBacking;
+	if ( !CreateBacking( ulNewSize, &newBacking ) )
+		return false;
+
+	vk_log.infof( "Growing upload ring from %" PRIu64 "KiB to %" PRIu64 "KiB",
+		uint64_t( m_Backing.ulSize / 1024 ), uint64_t( ulNewSize / 1024 ) );
+
+	// Anything already handed out still points into the old buffer,
+	// keep it until the GPU is done with it.
+	if ( m_ulHead != m_ulRetired )
+		m_OldBackings.push_back( OldBacking_t{ m_Backing, 0 } );
+	else if ( !m_InFlight.empty() )
+		m_OldBackings.push_back( OldBacking_t{ m_Backing, m_InFlight.back().ulSequence } );
+	else
+		DestroyBacking( m_Backing );
+
+	m_Backing = newBacking;
+	m_InFlight.clear();
+	m_ulHead = 0;
+	m_ulRetired = 0;
+	m_ulTail = 0;
+	return true;
+}
+
+std::optional<CVulkanUploadRing::Allocation_t> CVulkanUploadRing::Allocate( VkDeviceSize ulSize, VkDeviceSize ulAlignment )
+{
+	if ( ulSize > m_Backing.ulSize && !Grow( ulSize ) )
+		return std::nullopt;
+
+	for ( ;; )
+	{
+		Reclaim();
+
+		const VkDeviceSize ulRingSize = m_Backing.ulSize;
+		VkDeviceSize ulStart = align( m_ulHead, ulAlignment );
+		// Allocations don't wrap, if it doesn't fit before the end, start over at the front.
+		if ( ulStart % ulRingSize + ulSize > ulRingSize )
+			ulStart += ulRingSize - ulStart % ulRingSize;
+
+		if ( ulStart + ulSize - m_ulTail <= ulRingSize )
+		{
+			m_ulHead = ulStart + ulSize;
+			const VkDeviceSize ulOffset = ulStart % ulRingSize;
+			return Allocation_t{ m_Backing.vkBuffer, ulOffset, m_Backing.pData + ulOffset };
+		}
+
+		// Everything in the way hasn't been submitted yet, waiting won't help.
+		if ( m_InFlight.empty() )
+		{
+			if ( !Grow( ulSize ) )
+				return std::nullopt;
+			continue;
+		}
+
+		gpuvis_trace_printf( "CVulkanUploadRing waiting on seq %" PRIu64, m_InFlight.front().ulSequence );
+		g_device.wait( m_InFlight.front().ulSequence );
+	}
+}
+
+void CVulkanUploadRing::Retire( uint64_t ulSequence )
+{
+	for ( OldBacking_t &old : m_OldBackings )
+	{
+		if ( !old.ulSequence )
+			old.ulSequence = ulSequence;
+	}
+
+	if ( m_ulHead == m_ulRetired )
+		return;
+
+	m_InFlight.push_back( InFlight_t{ ulSequence, m_ulHead } );
+	m_ulRetired = m_ulHead;
+}
+
+void CVulkanUploadRing::Reclaim()
+{
+	if ( !m_InFlight.empty() || !m_OldBackings.empty() )
+	{
+		const uint64_t ulCompleted = g_device.completedSequence();
+		while ( !m_InFlight.empty() && m_InFlight.front().ulSequence <= ulCompleted )
+		{
+			m_ulTail = m_InFlight.front().ulEnd;
+			m_InFlight.pop_front();
+		}
+
+		std::erase_if( m_OldBackings, [ ulCompleted ]( OldBacking_t &old )
+		{
+			if ( !old.ulSequence || old.ulSequence > ulCompleted )
+				return false;
+
+			DestroyBacking( old.backing );
+			return true;
+		});
+	}
+
+	// Nothing is using any of it, start again from the front
+	// so big uploads don't have to skip over the end.
+	if ( m_InFlight.empty() && m_ulRetired == m_ulHead )
+	{
+		const VkDeviceSize ulRingSize = m_Backing.ulSize;
+		m_ulHead += ( ulRingSize - m_ulHead % ulRingSize ) % ulRingSize;
+		m_ulRetired = m_ulHead;
+		m_ulTail = m_ulHead;
+	}
+}
+
 static void texture_destroy( struct wlr_texture *wlr_texture )
 {
 	VulkanWlrTexture_t *tex = (VulkanWlrTexture_t *)wlr_texture;
@@ -4048,95 +5739,182 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_wlr_buffer( struc
 		return vulkan_create_texture_from_dmabuf( &dmabuf, pBackendFb );
 	}
 
-	VkResult result;
+	gamescope::OwningRc<CVulkanTexture> pTex;
+	if ( !vulkan_update_texture_from_shm( pTex, buf, {} ) )
+		return nullptr;
 
+	return pTex;
+}
+
+// Enough for a couple of full 4K frames to be in flight.
+static constexpr VkDeviceSize k_ulShmUploadRingSize = 64 * 1024 * 1024;
+// Any more rects than this and we just upload their bounding box.
+static constexpr size_t k_zMaxShmUploadRects = 16;
+
+static CVulkanUploadRing s_ShmUploadRing;
+
+bool vulkan_update_texture_from_shm( gamescope::OwningRc<CVulkanTexture> &pTexture, struct wlr_buffer *buf, std::span<const pixman_box32_t> damage, CVulkanTexture *pPrevious )
+{
 	void *src;
 	uint32_t drmFormat;
 	size_t stride;
 	if ( !wlr_buffer_begin_data_ptr_access( buf, WLR_BUFFER_DATA_PTR_ACCESS_READ, &src, &drmFormat, &stride ) )
 	{
-		return nullptr;
+		return false;
 	}
+	defer( wlr_buffer_end_data_ptr_access( buf ) );
 
-	uint32_t width = buf->width;
-	uint32_t height = buf->height;
-
-	VkBufferCreateInfo bufferCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = stride * height,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	};
-	VkBuffer buffer;
-	result = g_device.vk.CreateBuffer( g_device.device(), &bufferCreateInfo, nullptr, &buffer );
-	if ( result != VK_SUCCESS )
+	if ( !s_ShmUploadRing.IsInitialized() && !s_ShmUploadRing.BInit( k_ulShmUploadRingSize ) )
 	{
-		wlr_buffer_end_data_ptr_access( buf );
-		return nullptr;
+		vk_log.errorf( "Failed to create the wl_shm upload ring" );
+		return false;
 	}
 
-	VkMemoryRequirements memRequirements;
-	g_device.vk.GetBufferMemoryRequirements(g_device.device(), buffer, &memRequirements);
+	const int32_t width = buf->width;
+	const int32_t height = buf->height;
 
-	uint32_t memTypeIndex =  g_device.findMemoryType(VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, memRequirements.memoryTypeBits );
-	if ( memTypeIndex == ~0u )
+	bool bPreserveContents = !damage.empty();
+	if ( !pTexture || int32_t( pTexture->width() ) != width || int32_t( pTexture->height() ) != height || pTexture->drmFormat() != drmFormat )
 	{
-		wlr_buffer_end_data_ptr_access( buf );
-		return nullptr;
+		gamescope::OwningRc<CVulkanTexture> pNewTexture = new CVulkanTexture();
+		CVulkanTexture::createFlags texCreateFlags;
+		texCreateFlags.bSampled = true;
+		texCreateFlags.bTransferDst = true;
+		if ( pNewTexture->BInit( width, height, 1u, drmFormat, texCreateFlags ) == false )
+			return false;
+
+		pTexture = std::move( pNewTexture );
+		if ( !pPrevious )
+			bPreserveContents = false;
 	}
 
-	VkMemoryAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = memRequirements.size,
-		.memoryTypeIndex = memTypeIndex,
-	};
+	if ( pPrevious == pTexture.get() )
+		pPrevious = nullptr;
 
-	VkDeviceMemory bufferMemory;
-	result = g_device.vk.AllocateMemory( g_device.device(), &allocInfo, nullptr, &bufferMemory);
-	if ( result != VK_SUCCESS )
+	if ( pPrevious && ( int32_t( pPrevious->width() ) != width || int32_t( pPrevious->height() ) != height || pPrevious->drmFormat() != drmFormat ) )
 	{
-		wlr_buffer_end_data_ptr_access( buf );
-		return nullptr;
+		pPrevious = nullptr;
+		bPreserveContents = false;
 	}
 
-	result = g_device.vk.BindBufferMemory( g_device.device(), buffer, bufferMemory, 0 );
-	if ( result != VK_SUCCESS )
+	if ( !bPreserveContents )
+		pPrevious = nullptr;
+
+	std::array<pixman_box32_t, k_zMaxShmUploadRects> rects;
+	size_t zRectCount = 0;
+	if ( !bPreserveContents )
 	{
-		wlr_buffer_end_data_ptr_access( buf );
-		return nullptr;
+		rects[ zRectCount++ ] = pixman_box32_t{ 0, 0, width, height };
 	}
-
-	void *dst;
-	result = g_device.vk.MapMemory( g_device.device(), bufferMemory, 0, VK_WHOLE_SIZE, 0, &dst );
-	if ( result != VK_SUCCESS )
+	else
 	{
-		wlr_buffer_end_data_ptr_access( buf );
-		return nullptr;
+		pixman_box32_t extents = { width, height, 0, 0 };
+		for ( const pixman_box32_t &box : damage )
+		{
+			pixman_box32_t clipped =
+			{
+				std::max( box.x1, 0 ), std::max( box.y1, 0 ),
+				std::min( box.x2, width ), std::min( box.y2, height ),
+			};
+			if ( clipped.x1 >= clipped.x2 || clipped.y1 >= clipped.y2 )
+				continue;
+
+			extents.x1 = std::min( extents.x1, clipped.x1 );
+			extents.y1 = std::min( extents.y1, clipped.y1 );
+			extents.x2 = std::max( extents.x2, clipped.x2 );
+			extents.y2 = std::max( extents.y2, clipped.y2 );
+
+			if ( zRectCount < rects.size() )
+				rects[ zRectCount ] = clipped;
+			zRectCount++;
+		}
+
+		if ( zRectCount > rects.size() )
+		{
+			rects[ 0 ] = extents;
+			zRectCount = 1;
+		}
 	}
 
-	memcpy( dst, src, stride * height );
+	// Nothing changed.
+	if ( zRectCount == 0 && !pPrevious )
+		return true;
 
-	g_device.vk.UnmapMemory( g_device.device(), bufferMemory );
+	const uint32_t uBPP = DRMFormatGetBPP( drmFormat );
 
-	wlr_buffer_end_data_ptr_access( buf );
+	VkDeviceSize ulUploadSize = 0;
+	for ( size_t i = 0; i < zRectCount; i++ )
+		ulUploadSize += align<VkDeviceSize>( VkDeviceSize( rects[ i ].x2 - rects[ i ].x1 ) * ( rects[ i ].y2 - rects[ i ].y1 ) * uBPP, 16 );
 
-	gamescope::OwningRc<CVulkanTexture> pTex = new CVulkanTexture();
-	CVulkanTexture::createFlags texCreateFlags;
-	texCreateFlags.bSampled = true;
-	texCreateFlags.bTransferDst = true;
-	if ( pTex->BInit( width, height, 1u, drmFormat, texCreateFlags, nullptr, 0, 0, nullptr, pBackendFb ) == false )
-		return nullptr;
+	std::optional<CVulkanUploadRing::Allocation_t> oAllocation;
+	if ( zRectCount != 0 )
+	{
+		oAllocation = s_ShmUploadRing.Allocate( ulUploadSize );
+		if ( !oAllocation )
+		{
+			vk_log.errorf( "Failed to make room for a %" PRIu64 " byte wl_shm upload", uint64_t( ulUploadSize ) );
+			return false;
+		}
+	}
 
 	auto cmdBuffer = g_device.commandBuffer();
+	if ( pPrevious )
+		cmdBuffer->copyImage( pPrevious, pTexture.get() );
 
-	cmdBuffer->copyBufferToImage( buffer, 0, stride / DRMFormatGetBPP(drmFormat), pTex);
-	// TODO: Sync this copyBufferToImage
+	// Undamaged, just carry the previous contents over.
+	if ( zRectCount == 0 )
+	{
+		g_device.submit( std::move( cmdBuffer ) );
+		return true;
+	}
 
-	uint64_t sequence = g_device.submit(std::move(cmdBuffer));
+	std::array<VkBufferImageCopy, k_zMaxShmUploadRects> regions;
+	VkDeviceSize ulOffset = 0;
+	for ( size_t i = 0; i < zRectCount; i++ )
+	{
+		const pixman_box32_t &rect = rects[ i ];
+		const uint32_t uRectWidth = rect.x2 - rect.x1;
+		const uint32_t uRectHeight = rect.y2 - rect.y1;
+		const size_t zRowSize = size_t( uRectWidth ) * uBPP;
 
-	g_device.wait(sequence);
+		const uint8_t *pSrc = (const uint8_t *)src + rect.y1 * stride + rect.x1 * uBPP;
+		uint8_t *pDst = oAllocation->pData + ulOffset;
+		if ( zRowSize == stride )
+		{
+			memcpy( pDst, pSrc, zRowSize * uRectHeight );
+		}
+		else
+		{
+			for ( uint32_t y = 0; y < uRectHeight; y++ )
+				memcpy( pDst + y * zRowSize, pSrc + y * stride, zRowSize );
+		}
 
-	g_device.vk.DestroyBuffer(g_device.device(), buffer, nullptr);
-	g_device.vk.FreeMemory(g_device.device(), bufferMemory, nullptr);
+		regions[ i ] = VkBufferImageCopy{
+			.bufferOffset = oAllocation->ulOffset + ulOffset,
+			.bufferRowLength = uRectWidth,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.layerCount = 1,
+			},
+			.imageOffset = {
+				.x = rect.x1,
+				.y = rect.y1,
+			},
+			.imageExtent = {
+				.width = uRectWidth,
+				.height = uRectHeight,
+				.depth = 1,
+			},
+		};
 
-	return pTex;
+		ulOffset += align<VkDeviceSize>( zRowSize * uRectHeight, 16 );
+	}
+
+	cmdBuffer->copyBufferToImage( oAllocation->vkBuffer, std::span{ regions.data(), zRectCount }, pTexture.get(), bPreserveContents );
+	uint64_t ulSeq = g_device.submit( std::move( cmdBuffer ) );
+	s_ShmUploadRing.Retire( ulSeq );
+
+	gpuvis_trace_printf( "wl_shm upload of %zu rects, %" PRIu64 " bytes, seq %" PRIu64, zRectCount, uint64_t( ulUploadSize ), ulSeq );
+
+	return true;
 }
@@ -5,11 +5,15 @@
 #include <atomic>
 #include <stdint.h>
 #include <memory>
+#include <map>
 #include <unordered_map>
 #include <array>
 #include <bitset>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <optional>
+#include <string>
 
 #include "main.hpp"
 
@@ -58,11 +62,14 @@ enum EStreamColorspace : int
 	k_EStreamColorspace_BT709_Full = 4
 };
 
+#include <deque>
 #include <memory>
+#include <span>
 #include <unordered_map>
 #include <vector>
 #include <atomic>
 #include <wayland-server-core.h>
+#include <pixman-1/pixman.h>
 
 #include "wlr_begin.hpp"
 #include <wlr/render/dmabuf.h>
@@ -123,6 +130,78 @@ inline GamescopeAppTextureColorspace VkColorSpaceToGamescopeAppTextureColorSpace
 	}
 }
 
+struct VulkanMemoryStats_t
+{
+	uint32_t uBlockCount = 0;
+	uint64_t ulBlockBytes = 0;
+	uint32_t uSubAllocationCount = 0;
+	uint64_t ulSubAllocatedBytes = 0;
+	uint32_t uDedicatedCount = 0;
+	uint64_t ulDedicatedBytes = 0;
+	// 0 when the free space in each block is all in one piece,
+	// heading towards 1 the more it's split up.
+	float flFragmentation = 0.0f;
+};
+
+// Hands out pieces of bigger VkDeviceMemory blocks for our own images,
+// so every LUT, screenshot and intermediate doesn't need an allocation of its own.
+// Anything imported or exported still needs a dedicated allocation.
+//
+// Blocks are pooled by memory type, tiling (so we don't have to care about
+// bufferImageGranularity) and size class, so small things don't fragment
+// the blocks big images live in.
+class CVulkanMemoryAllocator
+{
+public:
+	struct Block_t;
+
+	struct Allocation_t
+	{
+		Block_t *pBlock = nullptr;
+		VkDeviceMemory vkMemory = VK_NULL_HANDLE;
+		VkDeviceSize ulOffset = 0;
+		VkDeviceSize ulSize = 0;
+		// Only if asked for, the block's mapping is shared by everything in it.
+		uint8_t *pMappedData = nullptr;
+	};
+
+	std::optional<Allocation_t> Allocate( const VkMemoryRequirements &requirements, uint32_t uMemoryTypeIndex, bool bLinear, bool bMapped );
+	void Free( const Allocation_t &allocation );
+
+	// Dedicated allocations are made by the caller, but counted here.
+	void TrackDedicated( VkDeviceSize ulSize, bool bAllocated );
+
+	VulkanMemoryStats_t GetStats();
+
+private:
+	struct PoolKey_t
+	{
+		uint32_t uMemoryTypeIndex;
+		bool bLinear;
+		uint32_t uSizeClass;
+
+		bool operator == ( const PoolKey_t &other ) const = default;
+	};
+
+	struct PoolKeyHash_t
+	{
+		size_t operator () ( const PoolKey_t &key ) const
+		{
+			return ( size_t( key.uMemoryTypeIndex ) << 8 ) | ( size_t( key.uSizeClass ) << 1 ) | size_t( key.bLinear );
+		}
+	};
+
+	Block_t *CreateBlock( const PoolKey_t &key, VkDeviceSize ulSize );
+	void DestroyBlock( Block_t *pBlock );
+	static std::optional<VkDeviceSize> AllocateFromBlock( Block_t *pBlock, VkDeviceSize ulSize, VkDeviceSize ulAlignment );
+
+	std::mutex m_mutAllocator;
+	std::unordered_map<PoolKey_t, std::vector<Block_t *>, PoolKeyHash_t> m_Pools;
+
+	uint32_t m_uDedicatedCount = 0;
+	uint64_t m_ulDedicatedBytes = 0;
+};
+
 class CVulkanTexture : public gamescope::RcObject
 {
 public:
@@ -203,6 +282,14 @@ public:
 
 	uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED;
 
+	// Set by non-blocking uploads (eg. LUTs) so we can trace the
+	// latency from upload submission to the first composite using it.
+	uint64_t ulPendingUploadSeq = 0;
+	uint64_t ulPendingUploadTime = 0;
+
+	// Sequence of the last submission that referenced this texture.
+	uint64_t ulLastUseSeq = 0;
+
 private:
 	bool m_bInitialized = false;
 	bool m_bExternal = false;
@@ -211,7 +298,9 @@ private:
 	uint32_t m_drmFormat = DRM_FORMAT_INVALID;
 
 	VkImage m_vkImage = VK_NULL_HANDLE;
+	// A dedicated allocation, otherwise m_oSubAllocation.
 	VkDeviceMemory m_vkImageMemory = VK_NULL_HANDLE;
+	std::optional<CVulkanMemoryAllocator::Allocation_t> m_oSubAllocation;
 	
 	VkImageView m_srgbView = VK_NULL_HANDLE;
 	VkImageView m_linearView = VK_NULL_HANDLE;
@@ -246,6 +335,105 @@ private:
 	struct wlr_dmabuf_attributes m_dmabuf = {};
 };
 
+// Memory we don't own (eg. the mapping of a file shared with another process)
+// imported as a VkBuffer with VK_EXT_external_memory_host, so the GPU can write
+// into it directly. The memory has to stay mapped for as long as this exists.
+class CVulkanHostBuffer
+{
+public:
+	CVulkanHostBuffer() = default;
+	~CVulkanHostBuffer();
+	CVulkanHostBuffer(const CVulkanHostBuffer& other) = delete;
+	CVulkanHostBuffer& operator=(const CVulkanHostBuffer& other) = delete;
+
+	// pData and size must be aligned to vulkan_host_memory_import_alignment().
+	bool BInit( void *pData, size_t size );
+
+	inline VkBuffer vkBuffer() const { return m_vkBuffer; }
+	inline size_t size() const { return m_size; }
+
+private:
+	VkBuffer m_vkBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_vkMemory = VK_NULL_HANDLE;
+	size_t m_size = 0;
+};
+
+// Host-visible staging memory for uploads, handed out front to back,
+// wrapping around at the end.
+// Space is only given back once the timeline semaphore has passed the
+// submission that read it, so uploads don't need to wait on the CPU
+// unless the GPU falls a whole ring behind.
+//
+// If an upload can't fit even once everything in flight has finished,
+// the ring moves to a new buffer twice the size. The old one is kept
+// until the submissions using it are done.
+class CVulkanUploadRing
+{
+public:
+	struct Allocation_t
+	{
+		VkBuffer vkBuffer;
+		VkDeviceSize ulOffset;
+		uint8_t *pData;
+	};
+
+	CVulkanUploadRing() = default;
+	~CVulkanUploadRing();
+	CVulkanUploadRing(const CVulkanUploadRing& other) = delete;
+	CVulkanUploadRing& operator=(const CVulkanUploadRing& other) = delete;
+
+	bool BInit( VkDeviceSize ulSize,
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+	bool IsInitialized() const { return m_Backing.vkBuffer != VK_NULL_HANDLE; }
+
+	// Returns std::nullopt if we couldn't grow to fit ulSize.
+	std::optional<Allocation_t> Allocate( VkDeviceSize ulSize, VkDeviceSize ulAlignment = 16 );
+	// Everything allocated since the last call is read by submission ulSequence.
+	void Retire( uint64_t ulSequence );
+
+	inline VkDeviceSize size() const { return m_Backing.ulSize; }
+
+private:
+	struct Backing_t
+	{
+		VkBuffer vkBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory vkMemory = VK_NULL_HANDLE;
+		uint8_t *pData = nullptr;
+		VkDeviceSize ulSize = 0;
+	};
+
+	bool CreateBacking( VkDeviceSize ulSize, Backing_t *pOutBacking );
+	static void DestroyBacking( Backing_t &backing );
+	bool Grow( VkDeviceSize ulMinSize );
+	void Reclaim();
+
+	struct InFlight_t
+	{
+		uint64_t ulSequence;
+		VkDeviceSize ulEnd;
+	};
+
+	struct OldBacking_t
+	{
+		Backing_t backing;
+		// 0 until the submission that reads the last of it is known.
+		uint64_t ulSequence;
+	};
+
+	VkBufferUsageFlags m_usage = 0;
+	VkMemoryPropertyFlags m_properties = 0;
+
+	Backing_t m_Backing;
+	std::vector<OldBacking_t> m_OldBackings;
+
+	// These only ever go up, the offset in the buffer is them modulo its size.
+	VkDeviceSize m_ulHead = 0;
+	VkDeviceSize m_ulRetired = 0;
+	VkDeviceSize m_ulTail = 0;
+	std::deque<InFlight_t> m_InFlight;
+};
+
 struct vec2_t
 {
 	float x, y;
@@ -298,6 +486,11 @@ struct FrameInfo_t
 
 		GamescopeAppTextureColorspace colorspace;
 
+		// Commit the contents of tex came from, 0 if it's not a client buffer.
+		// Used to tell whether the layer changed for damage tracking, as
+		// client buffers (and so tex) get re-used with new contents.
+		uint64_t commitID = 0;
+
 		bool isYcbcr() const
 		{
 			if ( !tex )
@@ -387,12 +580,37 @@ bool vulkan_make_output();
 gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_dmabuf( struct wlr_dmabuf_attributes *pDMA, gamescope::OwningRc<gamescope::IBackendFb> pBackendFb );
 gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_bits( uint32_t width, uint32_t height, uint32_t contentWidth, uint32_t contentHeight, uint32_t drmFormat, CVulkanTexture::createFlags texCreateFlags, void *bits );
 gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_wlr_buffer( struct wlr_buffer *buf, gamescope::OwningRc<gamescope::IBackendFb> pBackendFb );
+// For wl_shm buffers, uploads the damaged parts of buf into pTexture, (re)creating it
+// if buf's size or format changed. No rects means the whole buffer.
+// Nothing waits for the upload, it is ordered before any later composite by the queue.
+// If pPrevious is given, the rects are relative to its contents instead, and it is
+// copied into pTexture first.
+bool vulkan_update_texture_from_shm( gamescope::OwningRc<CVulkanTexture> &pTexture, struct wlr_buffer *buf, std::span<const pixman_box32_t> damage, CVulkanTexture *pPrevious = nullptr );
 
 std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamescope::Rc<CVulkanTexture> pScreenshotTexture, bool partial, gamescope::Rc<CVulkanTexture> pOutputOverride = nullptr, bool increment = true );
 void vulkan_wait( uint64_t ulSeqNo, bool bReset );
+int vulkan_export_sync_file( uint64_t ulSeqNo );
 gamescope::Rc<CVulkanTexture> vulkan_get_last_output_image( bool partial, bool defer );
+// The output image the next vulkan_composite will write into.
+gamescope::Rc<CVulkanTexture> vulkan_get_next_output_image( bool partial );
+// Leaves the next output image alone and moves on to the one after it.
+void vulkan_skip_output_image();
 gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_texture(uint32_t width, uint32_t height, bool exportable, uint32_t drmFormat, EStreamColorspace colorspace = k_EStreamColorspace_Unknown);
 
+// Layouts vulkan_pack_screenshot can write a screenshot out in,
+// matching what the encoders take so they can read it straight from the mapping.
+enum EScreenshotPackLayout : uint32_t
+{
+	// 8-bit R, G, B, one row per row of the screenshot.
+	k_EScreenshotPackLayout_RGB8 = 0,
+	// 16-bit planes of G, then B, then R, at the screenshot's bit depth.
+	// Ready to be used as the Y, U and V planes of an identity matrix YUV444 image.
+	k_EScreenshotPackLayout_GBR16_Planar = 1,
+};
+
+gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_pack_texture(uint32_t width, uint32_t height, EScreenshotPackLayout eLayout);
+std::optional<uint64_t> vulkan_pack_screenshot( gamescope::Rc<CVulkanTexture> pScreenshotTexture, uint32_t width, uint32_t height, gamescope::Rc<CVulkanTexture> pPackTexture, EScreenshotPackLayout eLayout );
+
 void vulkan_present_to_window( void );
 
 void vulkan_garbage_collect( void );
@@ -402,10 +620,18 @@ bool acquire_next_image( void );
 
 bool vulkan_primary_dev_id(dev_t *id);
 bool vulkan_supports_modifiers(void);
+VulkanMemoryStats_t vulkan_get_memory_stats(void);
+// 0 if host memory can't be imported.
+size_t vulkan_host_memory_import_alignment(void);
+// Copies pTexture into pBuffer with rows uStride bytes apart, see CVulkanCmdBuffer::copyImageToBuffer.
+std::optional<uint64_t> vulkan_copy_to_host_buffer( gamescope::Rc<CVulkanTexture> pTexture, CVulkanHostBuffer *pBuffer, uint32_t uStride );
 
 gamescope::Rc<CVulkanTexture> vulkan_create_1d_lut(uint32_t size);
 gamescope::Rc<CVulkanTexture> vulkan_create_3d_lut(uint32_t width, uint32_t height, uint32_t depth);
-void vulkan_update_luts(const gamescope::Rc<CVulkanTexture>& lut1d, const gamescope::Rc<CVulkanTexture>& lut3d, void* lut1d_data, void* lut3d_data);
+// Returns 0 if nothing was uploaded, in which case the LUTs keep their old contents.
+uint64_t vulkan_update_luts(const gamescope::Rc<CVulkanTexture>& lut1d, const gamescope::Rc<CVulkanTexture>& lut3d, void* lut1d_data, void* lut3d_data);
+// Whether a submission that referenced the texture hasn't completed yet.
+bool vulkan_texture_in_flight( const CVulkanTexture *pTexture );
 
 gamescope::Rc<CVulkanTexture> vulkan_get_hacky_blank_texture();
 
@@ -467,6 +693,11 @@ struct gamescope_color_mgmt_luts
 	gamescope::Rc<CVulkanTexture> vk_lut3d;
 	gamescope::Rc<CVulkanTexture> vk_lut1d;
 
+	// Back buffers, so we never have to overwrite LUTs that an
+	// in-flight composite is still reading from.
+	gamescope::Rc<CVulkanTexture> vk_lut3d_back;
+	gamescope::Rc<CVulkanTexture> vk_lut1d_back;
+
 	bool HasLuts() const
 	{
 		return bHasLut3D && bHasLut1D;
@@ -510,6 +741,7 @@ struct VulkanOutput_t
 	VkFormat outputFormatOverlay = VK_FORMAT_UNDEFINED;
 
 	std::array<gamescope::OwningRc<CVulkanTexture>, 2> pScreenshotImages;
+	std::array<gamescope::OwningRc<CVulkanTexture>, 2> pScreenshotPackImages;
 
 	// NIS and FSR
 	gamescope::OwningRc<CVulkanTexture> tmpOutput;
@@ -529,6 +761,7 @@ enum ShaderType {
 	SHADER_TYPE_RCAS,
 	SHADER_TYPE_NIS,
 	SHADER_TYPE_RGB_TO_NV12,
+	SHADER_TYPE_SCREENSHOT_PACK,
 
 	SHADER_TYPE_COUNT
 };
@@ -627,6 +860,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(EnumerateDeviceExtensionProperties) \
 	VK_FUNC(EnumeratePhysicalDevices) \
 	VK_FUNC(GetDeviceProcAddr) \
+	VK_FUNC(GetPhysicalDeviceExternalSemaphoreProperties) \
 	VK_FUNC(GetPhysicalDeviceFeatures2) \
 	VK_FUNC(GetPhysicalDeviceFormatProperties) \
 	VK_FUNC(GetPhysicalDeviceFormatProperties2) \
@@ -654,7 +888,9 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(CmdClearColorImage) \
 	VK_FUNC(CmdCopyBufferToImage) \
 	VK_FUNC(CmdCopyImage) \
+	VK_FUNC(CmdCopyImageToBuffer) \
 	VK_FUNC(CmdDispatch) \
+	VK_FUNC(CmdDispatchBase) \
 	VK_FUNC(CmdDraw) \
 	VK_FUNC(CmdEndRendering) \
 	VK_FUNC(CmdPipelineBarrier) \
@@ -668,6 +904,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(CreateGraphicsPipelines) \
 	VK_FUNC(CreateImage) \
 	VK_FUNC(CreateImageView) \
+	VK_FUNC(CreatePipelineCache) \
 	VK_FUNC(CreatePipelineLayout) \
 	VK_FUNC(CreateSampler) \
 	VK_FUNC(CreateSamplerYcbcrConversion) \
@@ -680,6 +917,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(DestroyImage) \
 	VK_FUNC(DestroyImageView) \
 	VK_FUNC(DestroyPipeline) \
+	VK_FUNC(DestroyPipelineCache) \
 	VK_FUNC(DestroyPipelineLayout) \
 	VK_FUNC(DestroySampler) \
 	VK_FUNC(DestroySwapchainKHR) \
@@ -691,9 +929,13 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(GetDeviceQueue) \
 	VK_FUNC(GetImageDrmFormatModifierPropertiesEXT) \
 	VK_FUNC(GetImageMemoryRequirements) \
+	VK_FUNC(GetImageMemoryRequirements2) \
 	VK_FUNC(GetImageSubresourceLayout) \
 	VK_FUNC(GetMemoryFdKHR) \
+	VK_FUNC(GetMemoryHostPointerPropertiesEXT) \
+	VK_FUNC(GetPipelineCacheData) \
 	VK_FUNC(GetSemaphoreCounterValue) \
+	VK_FUNC(GetSemaphoreFdKHR) \
 	VK_FUNC(GetSwapchainImagesKHR) \
 	VK_FUNC(MapMemory) \
 	VK_FUNC(QueuePresentKHR) \
@@ -716,6 +958,8 @@ return (what + to - 1) & ~(to - 1);
 class CVulkanDevice
 {
 public:
+	~CVulkanDevice();
+
 	bool BInit(VkInstance instance, VkSurfaceKHR surface);
 
 	VkSampler sampler(SamplerState key);
@@ -727,6 +971,11 @@ public:
 	void wait(uint64_t sequence, bool reset = true);
 	void waitIdle(bool reset = true);
 	void garbageCollect();
+	// The last submission the GPU has finished with.
+	uint64_t completedSequence();
+	// Returns a sync file that signals once submission ulSeqNo has completed,
+	// or -1 if that isn't supported.
+	int exportSyncFile(uint64_t ulSeqNo);
 	inline VkDescriptorSet descriptorSet()
 	{
 		VkDescriptorSet ret = m_descriptorSets[m_currentDescriptorSet];
@@ -734,7 +983,8 @@ public:
 		return ret;
 	}
 
-	static const uint32_t upload_buffer_size = 1920 * 1080 * 4;
+	// Starting size of the upload ring, it grows from there if needed.
+	static const uint32_t upload_ring_size = 1920 * 1080 * 4;
 
 	inline VkDevice device() { return m_device; }
 	inline VkPhysicalDevice physDev() {return m_physDev; }
@@ -745,29 +995,17 @@ public:
 	inline VkCommandPool generalCommandPool() {return m_generalCommandPool;}
 	inline uint32_t queueFamily() {return m_queueFamily;}
 	inline uint32_t generalQueueFamily() {return m_generalQueueFamily;}
-	inline VkBuffer uploadBuffer() {return m_uploadBuffer;}
 	inline VkPipelineLayout pipelineLayout() {return m_pipelineLayout;}
 	inline int drmRenderFd() {return m_drmRendererFd;}
 	inline bool supportsModifiers() {return m_bSupportsModifiers;}
 	inline bool hasDrmPrimaryDevId() {return m_bHasDrmPrimaryDevId;}
 	inline dev_t primaryDevId() {return m_drmPrimaryDevId;}
 	inline bool supportsFp16() {return m_bSupportsFp16;}
-
-	inline void *uploadBufferData(uint32_t size)
-	{
-		assert(size <= upload_buffer_size);
-
-		m_uploadBufferOffset = align(m_uploadBufferOffset, 16);
-		if (m_uploadBufferOffset + size > upload_buffer_size)
-		{
-			fprintf(stderr, "Exceeded uploadBufferData\n");
-			waitIdle(false);
-		}
-
-		uint8_t *ptr = ((uint8_t*)m_uploadBufferData) + m_uploadBufferOffset;
-		m_uploadBufferOffset += size;
-		return ptr;
-	}
+	inline bool supportsSyncFileExport() {return m_bSupportsSyncFileExport;}
+	inline bool supportsHostMemoryImport() {return m_bSupportsHostMemoryImport;}
+	inline bool supportsLinearStorageR32UI() {return m_bSupportsLinearStorageR32UI;}
+	inline VkDeviceSize hostPointerAlignment() {return m_ulHostPointerAlignment;}
+	inline VkDeviceSize uniformBufferAlignment() {return m_ulUniformBufferAlignment;}
 
 	#define VK_FUNC(x) PFN_vk##x x = nullptr;
 	struct
@@ -788,8 +1026,14 @@ protected:
 	bool createPools();
 	bool createShaders();
 	bool createScratchResources();
+	bool createPipelineCache();
+	void savePipelineCache();
+	void savePipelineCacheAsync();
+	void pipelineCacheSaveThread();
+	void destroyPipelineCache();
 	VkPipeline compilePipeline(uint32_t layerCount, uint32_t ycbcrMask, ShaderType type, uint32_t blur_layer_count, uint32_t composite_debug, uint32_t colorspace_mask, uint32_t output_eotf, bool itm_enable);
 	void compileAllPipelines();
+	void releaseUploadRing(uint64_t sequence);
 
 	VkDevice m_device = nullptr;
 	VkPhysicalDevice m_physDev = nullptr;
@@ -811,10 +1055,15 @@ protected:
 	dev_t m_drmPrimaryDevId = 0;
 
 	bool m_bSupportsFp16 = false;
+	bool m_bSupportsSyncFileExport = false;
+	bool m_bSupportsHostMemoryImport = false;
+	bool m_bSupportsLinearStorageR32UI = false;
 	bool m_bHasDrmPrimaryDevId = false;
 	bool m_bSupportsModifiers = false;
 	bool m_bInitialized = false;
 
+	VkDeviceSize m_ulHostPointerAlignment = 0;
+	VkDeviceSize m_ulUniformBufferAlignment = 16;
 
 	VkPhysicalDeviceMemoryProperties m_memoryProperties;
 
@@ -823,21 +1072,44 @@ protected:
 	std::unordered_map<PipelineInfo_t, VkPipeline> m_pipelineMap;
 	std::mutex m_pipelineMutex;
 
+	// Persistent on-disk cache, keyed by the driver's pipelineCacheUUID
+	// and a hash of all of our SPIR-V.
+	VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+	std::string m_pipelineCachePath;
+	uint64_t m_ulShaderHash = 0;
+	std::thread m_pipelineCompileThread;
+	std::atomic<bool> m_bStopPipelineCompiles = { false };
+
+	// A single worker writes the cache out, only ever the latest generation.
+	std::thread m_pipelineCacheSaveThread;
+	std::mutex m_pipelineCacheSaveMutex;
+	std::condition_variable m_pipelineCacheSaveCV;
+	uint64_t m_ulPipelineCacheGeneration = 0;
+	uint64_t m_ulPipelineCacheSavedGeneration = 0;
+	bool m_bPipelineCacheSaveStop = false;
+
 	// currently just one set, no need to double buffer because we
 	// vkQueueWaitIdle after each submit.
 	// should be moved to the output if we are going to support multiple outputs
 	std::array<VkDescriptorSet, 3> m_descriptorSets;
 	uint32_t m_currentDescriptorSet = 0;
 
-	VkBuffer m_uploadBuffer;
-	VkDeviceMemory m_uploadBufferMemory;
-	void *m_uploadBufferData;
-	uint32_t m_uploadBufferOffset = 0;
+	// Staging memory for uploads and per-dispatch constants.
+	// Command buffers that allocated from it and haven't been submitted yet
+	// are counted in m_uUploadRingUsers, the space is only retired once the
+	// last of them is, so it's never tied to a submission that runs before one
+	// still reading it.
+	CVulkanUploadRing m_uploadRing;
+	uint32_t m_uUploadRingUsers = 0;
 
 	VkSemaphore m_scratchTimelineSemaphore;
+	VkSemaphore m_syncFileSemaphore = VK_NULL_HANDLE;
 	std::atomic<uint64_t> m_submissionSeqNo = { 0 };
+	// Queue of the last submission, see submitInternal.
+	VkQueue m_lastSubmitQueue = VK_NULL_HANDLE;
 	std::vector<std::unique_ptr<CVulkanCmdBuffer>> m_unusedCmdBufs;
-	std::unordered_map<uint64_t, std::unique_ptr<CVulkanCmdBuffer>> m_pendingCmdBufs;
+	// Ordered by sequence, so everything up to a completed one can be reclaimed.
+	std::map<uint64_t, std::unique_ptr<CVulkanCmdBuffer>> m_pendingCmdBufs;
 };
 
 struct TextureState
@@ -878,26 +1150,49 @@ public:
 	void setTextureSrgb(uint32_t slot, bool srgb);
 	void setSamplerNearest(uint32_t slot, bool nearest);
 	void setSamplerUnnormalized(uint32_t slot, bool unnormalized);
-	void bindTarget(gamescope::Rc<CVulkanTexture> target);
+	// If bPreserveContents is set, the target's existing contents are kept
+	// instead of being discarded, for dispatches that only cover part of it.
+	void bindTarget(gamescope::Rc<CVulkanTexture> target, bool bPreserveContents = false);
 	void clearState();
+	// If there's no room for the constants, the command buffer is marked failed,
+	// later dispatches are skipped and it must not be submitted.
 	template<class PushData, class... Args>
 	void uploadConstants(Args&&... args);
+	bool failed() const { return m_bFailed; }
+	// Staging memory that stays valid until this command buffer has executed.
+	std::optional<CVulkanUploadRing::Allocation_t> uploadData(VkDeviceSize size, VkDeviceSize alignment = 16);
 	void bindPipeline(VkPipeline pipeline);
 	void dispatch(uint32_t x, uint32_t y = 1, uint32_t z = 1);
+	// Dispatch starting at workgroup (baseX, baseY).
+	void dispatchBase(uint32_t baseX, uint32_t baseY, uint32_t x, uint32_t y);
 	void copyImage(gamescope::Rc<CVulkanTexture> src, gamescope::Rc<CVulkanTexture> dst);
 	void copyBufferToImage(VkBuffer buffer, VkDeviceSize offset, uint32_t stride, gamescope::Rc<CVulkanTexture> dst);
+	// For partial updates, pass bPreserveContents to keep what's outside of the regions.
+	void copyBufferToImage(VkBuffer buffer, std::span<const VkBufferImageCopy> regions, gamescope::Rc<CVulkanTexture> dst, bool bPreserveContents);
+	// Copies src into buffer with rows stride bytes apart, for the host to read.
+	// NV12 is written as a single plane, luma followed by chroma.
+	void copyImageToBuffer(gamescope::Rc<CVulkanTexture> src, VkBuffer buffer, VkDeviceSize offset, uint32_t stride);
 
 
 	void prepareSrcImage(CVulkanTexture *image);
-	void prepareDestImage(CVulkanTexture *image);
+	void prepareDestImage(CVulkanTexture *image, bool bPreserveContents = false);
 	void discardImage(CVulkanTexture *image);
 	void markDirty(CVulkanTexture *image);
 	void insertBarrier(bool flush = false);
 
+	// Make the GPU wait for an earlier submission before executing this one.
+	// Needed when the dependency was submitted to a different queue.
+	void addDependency(uint64_t sequence) { m_waitSeqNo = std::max(m_waitSeqNo, sequence); }
+	uint64_t waitSeqNo() const { return m_waitSeqNo; }
+
 	VkQueue queue() { return m_queue; }
 	uint32_t queueFamily() { return m_queueFamily; }
 
 private:
+	friend class CVulkanDevice;
+
+	void dispatchInternal(uint32_t baseX, uint32_t baseY, uint32_t x, uint32_t y, uint32_t z);
+
 	VkCommandBuffer m_cmdBuffer;
 	CVulkanDevice *m_device;
 
@@ -913,11 +1208,17 @@ private:
 	std::bitset<VKR_SAMPLER_SLOTS> m_useSrgb;
 	std::array<SamplerState, VKR_SAMPLER_SLOTS> m_samplerState;
 	CVulkanTexture *m_target;
+	bool m_bPreserveTarget = false;
 
 	std::array<CVulkanTexture *, VKR_LUT3D_COUNT> m_shaperLut;
 	std::array<CVulkanTexture *, VKR_LUT3D_COUNT> m_lut3D;
 
-	uint32_t m_renderBufferOffset = 0;
+	VkBuffer m_renderBuffer = VK_NULL_HANDLE;
+	VkDeviceSize m_renderBufferOffset = 0;
+	bool m_bUsesUploadRing = false;
+	bool m_bFailed = false;
+
+	uint64_t m_waitSeqNo = 0;
 };
 
 uint32_t VulkanFormatToDRM( VkFormat vkFormat );
@@ -3,6 +3,8 @@
 
 #include "reshade_effect_manager.hpp"
 #include "log.hpp"
+#include "Utils/Defer.h"
+#include "convar.h"
 
 #include "steamcompmgr.hpp"
 
@@ -19,6 +21,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <pthread.h>
 
 const char *homedir;
 
@@ -172,6 +175,14 @@ public:
     virtual ~DepthUniform();
 };
 
+class SDROnHDRNitsUniform : public ReshadeUniform
+{
+public:
+    SDROnHDRNitsUniform(reshadefx::uniform_info uniformInfo);
+    virtual void update(void* mappedBuffer) override;
+    virtual ~SDROnHDRNitsUniform();
+};
+
 class DataUniform : public ReshadeUniform
 {
 public:
@@ -470,6 +481,20 @@ DepthUniform::~DepthUniform()
 {
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+SDROnHDRNitsUniform::SDROnHDRNitsUniform(reshadefx::uniform_info uniformInfo)
+    : ReshadeUniform(uniformInfo)
+{
+}
+void SDROnHDRNitsUniform::update(void* mappedBuffer)
+{
+    float nits = g_ColorMgmt.pending.flSDROnHDRBrightness;
+    copy(mappedBuffer, &nits);
+}
+SDROnHDRNitsUniform::~SDROnHDRNitsUniform()
+{
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 DataUniform::DataUniform(reshadefx::uniform_info uniformInfo)
     : ReshadeUniform(uniformInfo)
@@ -541,6 +566,10 @@ static std::vector<std::shared_ptr<ReshadeUniform>> createReshadeUniforms(const
             {
                 uniforms.push_back(std::make_shared<DepthUniform>(uniform));
             }
+            else if (source == "gamescope_sdr_on_hdr_nits")
+            {
+                uniforms.push_back(std::make_shared<SDROnHDRNitsUniform>(uniform));
+            }
             else
             {
                 reshade_log.errorf("Unknown uniform source: %s", source.c_str());
@@ -797,7 +826,10 @@ bool ReshadeEffectPipeline::init(CVulkanDevice *device, const ReshadeEffectKey &
 	pp.add_macro_definition("BUFFER_COLOR_SPACE", std::to_string(static_cast<uint32_t>(ConvertToReshadeColorSpace(key.bufferColorSpace))));
 	pp.add_macro_definition("BUFFER_COLOR_BIT_DEPTH", std::to_string(GetFormatBitDepth(key.bufferFormat)));
     pp.add_macro_definition("GAMESCOPE", "1");
-    pp.add_macro_definition("GAMESCOPE_SDR_ON_HDR_NITS", std::to_string(g_ColorMgmt.pending.flSDROnHDRBrightness));
+    // The brightness can change every frame while its slider is dragged,
+    // so it is read from a uniform rather than baked into the effect.
+    pp.add_macro_definition("GAMESCOPE_SDR_ON_HDR_NITS", "GamescopeSDROnHDRNits");
+    pp.append_string("uniform float GamescopeSDROnHDRNits < source = \"gamescope_sdr_on_hdr_nits\"; >;\n");
 
     std::string gamescope_reshade_share_path = "/share/gamescope/reshade";
 
@@ -857,27 +889,6 @@ bool ReshadeEffectPipeline::init(CVulkanDevice *device, const ReshadeEffectKey &
 	auto& technique = m_module->techniques[key.techniqueIdx];
 	reshade_log.infof("Using technique: %s\n", technique.name.c_str());
 
-    // Allocate command buffers
-    {
-		VkCommandBufferAllocateInfo commandBufferAllocateInfo =
-        {
-			.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.commandPool        = device->generalCommandPool(),
-			.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1
-		};
-
-        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
-		VkResult result = device->vk.AllocateCommandBuffers(device->device(), &commandBufferAllocateInfo, &cmdBuffer);
-		if (result != VK_SUCCESS)
-		{
-			reshade_log.errorf("vkAllocateCommandBuffers failed");
-			return false;
-		}
-
-        m_cmdBuffer.emplace(device, cmdBuffer, device->generalQueue(), device->generalQueueFamily());
-    }
-
     // Create Uniform Buffer
     {
         VkBufferCreateInfo bufferCreateInfo =
@@ -993,85 +1004,15 @@ bool ReshadeEffectPipeline::init(CVulkanDevice *device, const ReshadeEffectKey &
 
                 size_t size = w * h * 4;
 
-                VkBufferCreateInfo bufferCreateInfo =
-                {
-                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                    .size  = size,
-                    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                };
-                VkBuffer scratchBuffer = VK_NULL_HANDLE;
-                VkResult result = device->vk.CreateBuffer(device->device(), &bufferCreateInfo, nullptr, &scratchBuffer);
-                if (result != VK_SUCCESS)
-                {
-                    reshade_log.errorf("Failed to create scratch buffer");
-                    return false;
-                }
-
-                VkMemoryRequirements memRequirements;
-                device->vk.GetBufferMemoryRequirements(device->device(), scratchBuffer, &memRequirements);
-
-                uint32_t memTypeIndex = device->findMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, memRequirements.memoryTypeBits);
-                assert(memTypeIndex != ~0u);
-                VkMemoryAllocateInfo allocInfo =
-                {
-                    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                    .allocationSize  = memRequirements.size,
-                    .memoryTypeIndex = memTypeIndex,
-                };
-                VkDeviceMemory scratchMemory = VK_NULL_HANDLE;
-                result = device->vk.AllocateMemory(device->device(), &allocInfo, nullptr, &scratchMemory);
-                if (result != VK_SUCCESS)
-                {
-                    reshade_log.errorf("vkAllocateMemory failed");
-                    return false;
-                }
-                device->vk.BindBufferMemory(device->device(), scratchBuffer, scratchMemory, 0);
-                if (result != VK_SUCCESS)
-                {
-                    reshade_log.errorf("vkBindBufferMemory failed");
-                    return false;
-                }
-
-                void *scratchPtr = nullptr;
-                result = device->vk.MapMemory(device->device(), scratchMemory, 0, VK_WHOLE_SIZE, 0, &scratchPtr);
-                if (result != VK_SUCCESS)
-                {
-                    reshade_log.errorf("vkMapMemory failed");
-                    return false;
-                }
-
-                memcpy(scratchPtr, pixels, size);
-
-                m_cmdBuffer->reset();
-                m_cmdBuffer->begin();
-                m_cmdBuffer->copyBufferToImage(scratchBuffer, 0, 0, texture);
-                device->submitInternal(&*m_cmdBuffer);
-                device->waitIdle(false);
+                // The copy itself is recorded in finalize() on the compositor thread.
+                m_pendingUploads.push_back(ReshadePendingUpload{ texture, std::vector<uint8_t>(pixels, pixels + size) });
 
                 free(data);
-                device->vk.DestroyBuffer(device->device(), scratchBuffer, nullptr);
-                device->vk.FreeMemory(device->device(), scratchMemory, nullptr);
             }
         }
         else if (texture)
         {
-            m_cmdBuffer->reset();
-            m_cmdBuffer->begin();
-            VkClearColorValue clearColor{};
-            VkImageSubresourceRange range =
-            {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            };
-            m_cmdBuffer->prepareDestImage(texture.get());
-            m_cmdBuffer->insertBarrier();
-            device->vk.CmdClearColorImage(m_cmdBuffer->rawBuffer(), texture->vkImage(), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &range);
-            m_cmdBuffer->markDirty(texture.get());
-            device->submitInternal(&*m_cmdBuffer);
-            device->waitIdle(false);
+            m_pendingClears.push_back(texture);
         }
 
         m_textures.emplace_back(std::move(texture));
@@ -1532,6 +1473,133 @@ bool ReshadeEffectPipeline::init(CVulkanDevice *device, const ReshadeEffectKey &
     return true;
 }
 
+bool ReshadeEffectPipeline::finalize()
+{
+    CVulkanDevice *device = m_device;
+
+    // Allocate command buffers
+    {
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo =
+        {
+			.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool        = device->generalCommandPool(),
+			.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1
+		};
+
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+		VkResult result = device->vk.AllocateCommandBuffers(device->device(), &commandBufferAllocateInfo, &cmdBuffer);
+		if (result != VK_SUCCESS)
+		{
+			reshade_log.errorf("vkAllocateCommandBuffers failed");
+			return false;
+		}
+
+        // submitInternal orders this after the previous compute queue
+        // submission, as both signal the same timeline.
+        m_cmdBuffer.emplace(device, cmdBuffer, device->generalQueue(), device->generalQueueFamily());
+    }
+
+    // Upload source textures and clear the rest.
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> scratchBuffers;
+    auto destroyScratchBuffers = [&]()
+    {
+        for (auto& [scratchBuffer, scratchMemory] : scratchBuffers)
+        {
+            device->vk.DestroyBuffer(device->device(), scratchBuffer, nullptr);
+            device->vk.FreeMemory(device->device(), scratchMemory, nullptr);
+        }
+    };
+    defer( destroyScratchBuffers() );
+
+    m_cmdBuffer->reset();
+    m_cmdBuffer->begin();
+
+    for (auto& upload : m_pendingUploads)
+    {
+        VkBufferCreateInfo bufferCreateInfo =
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size  = upload.pixels.size(),
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        };
+        VkBuffer scratchBuffer = VK_NULL_HANDLE;
+        VkResult result = device->vk.CreateBuffer(device->device(), &bufferCreateInfo, nullptr, &scratchBuffer);
+        if (result != VK_SUCCESS)
+        {
+            reshade_log.errorf("Failed to create scratch buffer");
+            return false;
+        }
+
+        VkMemoryRequirements memRequirements;
+        device->vk.GetBufferMemoryRequirements(device->device(), scratchBuffer, &memRequirements);
+
+        uint32_t memTypeIndex = device->findMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, memRequirements.memoryTypeBits);
+        assert(memTypeIndex != ~0u);
+        VkMemoryAllocateInfo allocInfo =
+        {
+            .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize  = memRequirements.size,
+            .memoryTypeIndex = memTypeIndex,
+        };
+        VkDeviceMemory scratchMemory = VK_NULL_HANDLE;
+        result = device->vk.AllocateMemory(device->device(), &allocInfo, nullptr, &scratchMemory);
+        if (result != VK_SUCCESS)
+        {
+            device->vk.DestroyBuffer(device->device(), scratchBuffer, nullptr);
+            reshade_log.errorf("vkAllocateMemory failed");
+            return false;
+        }
+        scratchBuffers.emplace_back(scratchBuffer, scratchMemory);
+
+        result = device->vk.BindBufferMemory(device->device(), scratchBuffer, scratchMemory, 0);
+        if (result != VK_SUCCESS)
+        {
+            reshade_log.errorf("vkBindBufferMemory failed");
+            return false;
+        }
+
+        void *scratchPtr = nullptr;
+        result = device->vk.MapMemory(device->device(), scratchMemory, 0, VK_WHOLE_SIZE, 0, &scratchPtr);
+        if (result != VK_SUCCESS)
+        {
+            reshade_log.errorf("vkMapMemory failed");
+            return false;
+        }
+
+        memcpy(scratchPtr, upload.pixels.data(), upload.pixels.size());
+
+        m_cmdBuffer->copyBufferToImage(scratchBuffer, 0, 0, upload.texture);
+    }
+
+    for (auto& texture : m_pendingClears)
+    {
+        VkClearColorValue clearColor{};
+        VkImageSubresourceRange range =
+        {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        };
+        m_cmdBuffer->prepareDestImage(texture.get());
+        m_cmdBuffer->insertBarrier();
+        device->vk.CmdClearColorImage(m_cmdBuffer->rawBuffer(), texture->vkImage(), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &range);
+        m_cmdBuffer->markDirty(texture.get());
+    }
+
+    m_lastSubmitSeq = device->submitInternal(&*m_cmdBuffer);
+
+    m_pendingUploads.clear();
+    m_pendingClears.clear();
+
+    // The scratch buffers need to outlive the copy.
+    device->wait(m_lastSubmitSeq, false);
+
+    return true;
+}
+
 void ReshadeEffectPipeline::update()
 {
     for (auto& uniform : m_uniforms)
@@ -1541,6 +1609,14 @@ void ReshadeEffectPipeline::update()
 uint64_t ReshadeEffectPipeline::execute(gamescope::Rc<CVulkanTexture> inImage, gamescope::Rc<CVulkanTexture> *outImage)
 {
     CVulkanDevice *device = m_device;
+
+    // We are about to rewrite the uniforms, descriptor sets and command buffer
+    // the previous execution used. That was submitted a frame ago, so this
+    // should practically never block.
+    if (m_lastSubmitSeq)
+        device->wait(m_lastSubmitSeq);
+    m_lastInputImage = inImage;
+
     this->update();
 
     // Update descriptor sets.
@@ -1743,7 +1819,8 @@ uint64_t ReshadeEffectPipeline::execute(gamescope::Rc<CVulkanTexture> inImage, g
     if (lastRT)
         *outImage = lastRT;
 
-    return device->submitInternal(&*m_cmdBuffer);
+    m_lastSubmitSeq = device->submitInternal(&*m_cmdBuffer);
+    return m_lastSubmitSeq;
 }
 
 gamescope::Rc<CVulkanTexture> ReshadeEffectPipeline::findTexture(std::string_view name)
@@ -1772,23 +1849,113 @@ void ReshadeEffectManager::init(CVulkanDevice *device)
 
 void ReshadeEffectManager::clear()
 {
-    m_lastKey = ReshadeEffectKey{};
-    m_lastPipeline = nullptr;
+    // Drop the cache too, so turning an effect back on after editing it
+    // picks up the changes.
+    m_cache.clear();
+    m_activePipeline = nullptr;
+    m_queuedKey = std::nullopt;
+    if (m_compilingKey)
+        m_bDiscardCompile = true;
+}
+
+static gamescope::ConVar<int> cv_reshade_effect_cache_size{ "reshade_effect_cache_size", 4, "How many compiled ReShade effects to keep around for quick switching." };
+
+std::list<ReshadeEffectManager::CachedEffect>::iterator ReshadeEffectManager::findCached(const ReshadeEffectKey &key)
+{
+    for (auto iter = m_cache.begin(); iter != m_cache.end(); iter++)
+    {
+        if (iter->key == key)
+        {
+            m_cache.splice(m_cache.begin(), m_cache, iter);
+            return m_cache.begin();
+        }
+    }
+
+    return m_cache.end();
+}
+
+void ReshadeEffectManager::startCompile(const ReshadeEffectKey &key)
+{
+    m_compilingKey = key;
+
+    CVulkanDevice *device = m_device;
+    m_compileFuture = std::async(std::launch::async, [device, key]() -> CompileResult
+    {
+        pthread_setname_np(pthread_self(), "gamescope-rshde");
+
+        auto pipeline = std::make_unique<ReshadeEffectPipeline>();
+        bool bSuccess = pipeline->init(device, key);
+        // Even on failure, the pipeline gets destroyed on the compositor thread,
+        // its destructor waits on the device.
+        return CompileResult{ std::move(pipeline), bSuccess };
+    });
+}
+
+void ReshadeEffectManager::pollCompile()
+{
+    if (!m_compileFuture.valid())
+        return;
+
+    if (m_compileFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    CompileResult result = m_compileFuture.get();
+    if (!std::exchange(m_bDiscardCompile, false))
+    {
+        if (result.bSuccess && !result.pipeline->finalize())
+            result.bSuccess = false;
+
+        if (!result.bSuccess)
+            result.pipeline = nullptr;
+
+        m_cache.push_front(CachedEffect{ *m_compilingKey, std::move(result.pipeline) });
+
+        size_t zMaxEntries = std::max(1, cv_reshade_effect_cache_size.Get());
+        while (m_cache.size() > zMaxEntries)
+        {
+            if (m_cache.back().pipeline.get() == m_activePipeline)
+                m_activePipeline = nullptr;
+            m_cache.pop_back();
+        }
+    }
+    m_compilingKey = std::nullopt;
+
+    if (m_queuedKey)
+    {
+        ReshadeEffectKey key = *std::exchange(m_queuedKey, std::nullopt);
+        if (findCached(key) == m_cache.end())
+            startCompile(key);
+    }
 }
 
 ReshadeEffectPipeline* ReshadeEffectManager::pipeline(const ReshadeEffectKey &key)
 {
-    if (m_lastKey == key)
-        return m_lastPipeline.get();
+    pollCompile();
 
-    m_lastKey = key;
-    m_lastPipeline = nullptr;
-    auto pipeline = std::make_unique<ReshadeEffectPipeline>();
-    if (!pipeline->init(m_device, key))
-        return nullptr;
-    m_lastPipeline = std::move(pipeline);
+    if (auto iter = findCached(key); iter != m_cache.end())
+    {
+        m_activePipeline = iter->pipeline.get();
+        return m_activePipeline;
+    }
 
-    return m_lastPipeline.get();
+    if (!m_compilingKey)
+        startCompile(key);
+    else if (*m_compilingKey != key)
+        m_queuedKey = key;
+
+    // Keep presenting the previous effect until the new one is ready,
+    // as long as it was built for the same kind of buffer.
+    if (m_activePipeline)
+    {
+        const ReshadeEffectKey &activeKey = m_activePipeline->key();
+        if (activeKey.bufferWidth == key.bufferWidth &&
+            activeKey.bufferHeight == key.bufferHeight &&
+            activeKey.bufferFormat == key.bufferFormat &&
+            activeKey.bufferColorSpace == key.bufferColorSpace)
+            return m_activePipeline;
+    }
+
+    return nullptr;
 }
 
 ReshadeEffectManager g_reshadeManager;
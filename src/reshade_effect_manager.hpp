@@ -1,6 +1,8 @@
 #pragma once
 
 #include "rendervulkan.hpp"
+#include <future>
+#include <list>
 #include <optional>
 
 namespace reshadefx
@@ -31,6 +33,12 @@ struct ReshadeEffectKey
     bool operator!=(const ReshadeEffectKey& other) const = default;
 };
 
+struct ReshadePendingUpload
+{
+    gamescope::Rc<CVulkanTexture> texture;
+    std::vector<uint8_t> pixels;
+};
+
 enum ReshadeDescriptorSets
 {
     GAMESCOPE_RESHADE_DESCRIPTOR_SET_UBO = 0,
@@ -46,7 +54,12 @@ public:
     ReshadeEffectPipeline();
     ~ReshadeEffectPipeline();
 
+    // Compiles the effect and creates its resources.
+    // Does not touch any queues, so it can run on a worker thread.
     bool init(CVulkanDevice *device, const ReshadeEffectKey &key);
+    // Allocates the command buffer and uploads initial texture contents.
+    // Must be called from the thread that calls execute().
+    bool finalize();
     void update();
     uint64_t execute(gamescope::Rc<CVulkanTexture> inImage, gamescope::Rc<CVulkanTexture> *outImage);
 
@@ -66,7 +79,14 @@ private:
     std::vector<ReshadeCombinedImageSampler> m_samplers;
     std::vector<std::shared_ptr<ReshadeUniform>> m_uniforms;
 
+    std::vector<ReshadePendingUpload> m_pendingUploads;
+    std::vector<gamescope::Rc<CVulkanTexture>> m_pendingClears;
+
     std::optional<CVulkanCmdBuffer> m_cmdBuffer = std::nullopt;
+    // Sequence of the last execute() submission and the input it sampled,
+    // kept alive until the next execute() knows the GPU is done with them.
+    uint64_t m_lastSubmitSeq = 0;
+    gamescope::Rc<CVulkanTexture> m_lastInputImage;
     VkBuffer m_buffer = VK_NULL_HANDLE;
     VkDeviceMemory m_bufferMemory = VK_NULL_HANDLE;
     void* m_mappedPtr = nullptr;
@@ -88,8 +108,35 @@ public:
     ReshadeEffectPipeline* pipeline(const ReshadeEffectKey &key);
 
 private:
-    ReshadeEffectKey m_lastKey{};
-    std::unique_ptr<ReshadeEffectPipeline> m_lastPipeline;
+    struct CachedEffect
+    {
+        ReshadeEffectKey key;
+        // nullptr if the effect failed to compile, so we don't retry every frame.
+        std::unique_ptr<ReshadeEffectPipeline> pipeline;
+    };
+
+    struct CompileResult
+    {
+        std::unique_ptr<ReshadeEffectPipeline> pipeline;
+        bool bSuccess;
+    };
+
+    void pollCompile();
+    void startCompile(const ReshadeEffectKey &key);
+    std::list<CachedEffect>::iterator findCached(const ReshadeEffectKey &key);
+
+    // Most recently used at the front.
+    std::list<CachedEffect> m_cache;
+    ReshadeEffectPipeline *m_activePipeline = nullptr;
+
+    std::optional<ReshadeEffectKey> m_compilingKey;
+    std::future<CompileResult> m_compileFuture;
+    // Latest key requested while another one was compiling.
+    std::optional<ReshadeEffectKey> m_queuedKey;
+    // Set by clear() while a compile is running, its result is thrown away
+    // as the file may have changed since it was read.
+    bool m_bDiscardCompile = false;
+
     CVulkanDevice *m_device;
 };
 
@@ -0,0 +1,755 @@
+// Runs the screenshot pack shader on whatever Vulkan device is around
+// (lavapipe on CI) and checks it gives the encoders the same data
+// as converting the raw capture on the CPU.
+
+#include "ScreenshotEncoder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "shaders/descriptor_set_constants.h"
+#include "cs_screenshot_pack.h"
+
+using namespace gamescope;
+
+#define VK_CHECK( x ) \
+    do { \
+        VkResult res_ = ( x ); \
+        if ( res_ != VK_SUCCESS ) \
+        { \
+            printf("  %s failed: %d\n", #x, res_); \
+            return false; \
+        } \
+    } while ( 0 )
+
+// Must match EScreenshotPackLayout and ScreenshotPackData_t in rendervulkan.
+enum EPackLayout : uint32_t
+{
+    k_EPackLayout_RGB8 = 0,
+    k_EPackLayout_GBR16_Planar = 1,
+};
+
+struct PackData_t
+{
+    uint32_t layout;
+    uint32_t extent[2];
+    float maxValue;
+};
+
+static uint32_t div_roundup( uint32_t x, uint32_t y )
+{
+    return ( x + y - 1 ) / y;
+}
+
+struct TestImage_t
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    uint8_t *pMapped = nullptr;
+    uint32_t uRowPitch = 0;
+};
+
+struct TestContext_t
+{
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physDev = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t uQueueFamily = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    ~TestContext_t()
+    {
+        if ( device )
+        {
+            vkDeviceWaitIdle( device );
+            vkDestroySampler( device, sampler, nullptr );
+            vkDestroyDescriptorPool( device, descriptorPool, nullptr );
+            vkDestroyPipeline( device, pipeline, nullptr );
+            vkDestroyPipelineLayout( device, pipelineLayout, nullptr );
+            vkDestroyDescriptorSetLayout( device, descriptorSetLayout, nullptr );
+            vkDestroyCommandPool( device, commandPool, nullptr );
+            vkDestroyDevice( device, nullptr );
+        }
+        if ( instance )
+            vkDestroyInstance( instance, nullptr );
+    }
+};
+
+static bool find_memory_type( const TestContext_t &ctx, uint32_t uTypeBits, VkMemoryPropertyFlags flags, uint32_t *pIndex )
+{
+    for ( uint32_t i = 0; i < ctx.memoryProperties.memoryTypeCount; i++ )
+    {
+        if ( ( uTypeBits & ( 1u << i ) ) && ( ctx.memoryProperties.memoryTypes[i].propertyFlags & flags ) == flags )
+        {
+            *pIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns false with a message if there is no device we can run the test on.
+static bool init_context( TestContext_t &ctx )
+{
+    VkApplicationInfo appInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "gamescope_screenshot_pack_tests",
+        .apiVersion = VK_API_VERSION_1_3,
+    };
+
+    VkInstanceCreateInfo instanceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo,
+    };
+
+    VK_CHECK( vkCreateInstance( &instanceCreateInfo, nullptr, &ctx.instance ) );
+
+    uint32_t uDeviceCount = 0;
+    VK_CHECK( vkEnumeratePhysicalDevices( ctx.instance, &uDeviceCount, nullptr ) );
+    std::vector<VkPhysicalDevice> physDevs( uDeviceCount );
+    VK_CHECK( vkEnumeratePhysicalDevices( ctx.instance, &uDeviceCount, physDevs.data() ) );
+
+    // Prefer lavapipe so results don't depend on the machine's GPU.
+    for ( VkPhysicalDevice physDev : physDevs )
+    {
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties( physDev, &props );
+        if ( props.apiVersion < VK_API_VERSION_1_2 )
+            continue;
+        if ( !ctx.physDev || props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+            ctx.physDev = physDev;
+    }
+
+    if ( !ctx.physDev )
+    {
+        printf("  no Vulkan 1.2 device\n");
+        return false;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties( ctx.physDev, &props );
+    printf("  using %s\n", props.deviceName);
+
+    vkGetPhysicalDeviceMemoryProperties( ctx.physDev, &ctx.memoryProperties );
+
+    uint32_t uQueueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties( ctx.physDev, &uQueueFamilyCount, nullptr );
+    std::vector<VkQueueFamilyProperties> queueFamilies( uQueueFamilyCount );
+    vkGetPhysicalDeviceQueueFamilyProperties( ctx.physDev, &uQueueFamilyCount, queueFamilies.data() );
+
+    bool bFoundQueue = false;
+    for ( uint32_t i = 0; i < uQueueFamilyCount && !bFoundQueue; i++ )
+    {
+        if ( queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT )
+        {
+            ctx.uQueueFamily = i;
+            bFoundQueue = true;
+        }
+    }
+
+    if ( !bFoundQueue )
+    {
+        printf("  no compute queue\n");
+        return false;
+    }
+
+    float flQueuePriority = 1.0f;
+    VkDeviceQueueCreateInfo queueCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = ctx.uQueueFamily,
+        .queueCount = 1,
+        .pQueuePriorities = &flQueuePriority,
+    };
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .scalarBlockLayout = VK_TRUE,
+    };
+
+    VkDeviceCreateInfo deviceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &vulkan12Features,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = &queueCreateInfo,
+    };
+
+    VK_CHECK( vkCreateDevice( ctx.physDev, &deviceCreateInfo, nullptr, &ctx.device ) );
+    vkGetDeviceQueue( ctx.device, ctx.uQueueFamily, 0, &ctx.queue );
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = ctx.uQueueFamily,
+    };
+    VK_CHECK( vkCreateCommandPool( ctx.device, &commandPoolCreateInfo, nullptr, &ctx.commandPool ) );
+
+    // Same bindings as the compositor's layout, minus the ones the pack pass doesn't touch.
+    VkDescriptorSetLayoutBinding bindings[] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = VKR_SAMPLER_SLOTS,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+    };
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = (uint32_t)std::size( bindings ),
+        .pBindings = bindings,
+    };
+    VK_CHECK( vkCreateDescriptorSetLayout( ctx.device, &descriptorSetLayoutCreateInfo, nullptr, &ctx.descriptorSetLayout ) );
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &ctx.descriptorSetLayout,
+    };
+    VK_CHECK( vkCreatePipelineLayout( ctx.device, &pipelineLayoutCreateInfo, nullptr, &ctx.pipelineLayout ) );
+
+    VkShaderModuleCreateInfo shaderCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = sizeof( cs_screenshot_pack ),
+        .pCode = cs_screenshot_pack,
+    };
+    VkShaderModule shaderModule;
+    VK_CHECK( vkCreateShaderModule( ctx.device, &shaderCreateInfo, nullptr, &shaderModule ) );
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main",
+        },
+        .layout = ctx.pipelineLayout,
+    };
+    VkResult res = vkCreateComputePipelines( ctx.device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &ctx.pipeline );
+    vkDestroyShaderModule( ctx.device, shaderModule, nullptr );
+    VK_CHECK( res );
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VKR_SAMPLER_SLOTS },
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = 1,
+        .poolSizeCount = (uint32_t)std::size( poolSizes ),
+        .pPoolSizes = poolSizes,
+    };
+    VK_CHECK( vkCreateDescriptorPool( ctx.device, &descriptorPoolCreateInfo, nullptr, &ctx.descriptorPool ) );
+
+    VkSamplerCreateInfo samplerCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+    VK_CHECK( vkCreateSampler( ctx.device, &samplerCreateInfo, nullptr, &ctx.sampler ) );
+
+    return true;
+}
+
+// Mappable (linear) image, like the compositor's screenshot and pack textures.
+static bool create_image( TestContext_t &ctx, uint32_t uWidth, uint32_t uHeight, VkFormat format, VkImageUsageFlags usage, TestImage_t *pImage )
+{
+    VkImageCreateInfo imageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { uWidth, uHeight, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_LINEAR,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+    };
+    VK_CHECK( vkCreateImage( ctx.device, &imageCreateInfo, nullptr, &pImage->image ) );
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements( ctx.device, pImage->image, &memRequirements );
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+    };
+    if ( !find_memory_type( ctx, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocInfo.memoryTypeIndex ) )
+    {
+        printf("  no host visible memory for a linear image\n");
+        return false;
+    }
+    VK_CHECK( vkAllocateMemory( ctx.device, &allocInfo, nullptr, &pImage->memory ) );
+    VK_CHECK( vkBindImageMemory( ctx.device, pImage->image, pImage->memory, 0 ) );
+    VK_CHECK( vkMapMemory( ctx.device, pImage->memory, 0, VK_WHOLE_SIZE, 0, (void **)&pImage->pMapped ) );
+
+    VkImageSubresource subresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT };
+    VkSubresourceLayout layout;
+    vkGetImageSubresourceLayout( ctx.device, pImage->image, &subresource, &layout );
+    pImage->pMapped += layout.offset;
+    pImage->uRowPitch = layout.rowPitch;
+
+    VkImageViewCreateInfo viewCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = pImage->image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = 1,
+            .layerCount = 1,
+        },
+    };
+    VK_CHECK( vkCreateImageView( ctx.device, &viewCreateInfo, nullptr, &pImage->view ) );
+
+    return true;
+}
+
+static void destroy_image( TestContext_t &ctx, TestImage_t &image )
+{
+    vkDestroyImageView( ctx.device, image.view, nullptr );
+    vkDestroyImage( ctx.device, image.image, nullptr );
+    vkFreeMemory( ctx.device, image.memory, nullptr );
+    image = TestImage_t{};
+}
+
+// Records and runs the pack pass from source into packed, and waits for it.
+static bool run_pack( TestContext_t &ctx, const TestImage_t &source, const TestImage_t &packed,
+    uint32_t uPackWidth, uint32_t uPackHeight, const PackData_t &packData )
+{
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = sizeof( PackData_t ),
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkBuffer buffer;
+    VK_CHECK( vkCreateBuffer( ctx.device, &bufferCreateInfo, nullptr, &buffer ) );
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements( ctx.device, buffer, &memRequirements );
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+    };
+    if ( !find_memory_type( ctx, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocInfo.memoryTypeIndex ) )
+    {
+        printf("  no host visible memory for the constants\n");
+        vkDestroyBuffer( ctx.device, buffer, nullptr );
+        return false;
+    }
+
+    VkDeviceMemory bufferMemory;
+    VK_CHECK( vkAllocateMemory( ctx.device, &allocInfo, nullptr, &bufferMemory ) );
+    VK_CHECK( vkBindBufferMemory( ctx.device, buffer, bufferMemory, 0 ) );
+
+    void *pConstants;
+    VK_CHECK( vkMapMemory( ctx.device, bufferMemory, 0, VK_WHOLE_SIZE, 0, &pConstants ) );
+    memcpy( pConstants, &packData, sizeof( packData ) );
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = ctx.descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &ctx.descriptorSetLayout,
+    };
+    VkDescriptorSet descriptorSet;
+    VK_CHECK( vkAllocateDescriptorSets( ctx.device, &descriptorSetAllocInfo, &descriptorSet ) );
+
+    VkDescriptorBufferInfo bufferInfo = { buffer, 0, sizeof( PackData_t ) };
+    VkDescriptorImageInfo targetInfo = { VK_NULL_HANDLE, packed.view, VK_IMAGE_LAYOUT_GENERAL };
+    VkDescriptorImageInfo samplerInfos[ VKR_SAMPLER_SLOTS ];
+    for ( auto &samplerInfo : samplerInfos )
+        samplerInfo = { ctx.sampler, source.view, VK_IMAGE_LAYOUT_GENERAL };
+
+    VkWriteDescriptorSet writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSet,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .pBufferInfo = &bufferInfo,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSet,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = &targetInfo,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSet,
+            .dstBinding = 3,
+            .descriptorCount = VKR_SAMPLER_SLOTS,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = samplerInfos,
+        },
+    };
+    vkUpdateDescriptorSets( ctx.device, (uint32_t)std::size( writes ), writes, 0, nullptr );
+
+    VkCommandBufferAllocateInfo cmdBufferAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VkCommandBuffer cmdBuffer;
+    VK_CHECK( vkAllocateCommandBuffers( ctx.device, &cmdBufferAllocInfo, &cmdBuffer ) );
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VK_CHECK( vkBeginCommandBuffer( cmdBuffer, &beginInfo ) );
+
+    const VkImageSubresourceRange subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = 1,
+        .layerCount = 1,
+    };
+
+    VkImageMemoryBarrier preBarriers[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_HOST_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = source.image,
+            .subresourceRange = subresourceRange,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = packed.image,
+            .subresourceRange = subresourceRange,
+        },
+    };
+    vkCmdPipelineBarrier( cmdBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, (uint32_t)std::size( preBarriers ), preBarriers );
+
+    vkCmdBindPipeline( cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.pipeline );
+    vkCmdBindDescriptorSets( cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.pipelineLayout, 0, 1, &descriptorSet, 0, nullptr );
+
+    const uint32_t pixelsPerGroup = 8;
+    vkCmdDispatch( cmdBuffer, div_roundup( uPackWidth, pixelsPerGroup ), div_roundup( uPackHeight, pixelsPerGroup ), 1 );
+
+    VkImageMemoryBarrier postBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = packed.image,
+        .subresourceRange = subresourceRange,
+    };
+    vkCmdPipelineBarrier( cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &postBarrier );
+
+    VK_CHECK( vkEndCommandBuffer( cmdBuffer ) );
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdBuffer,
+    };
+    VK_CHECK( vkQueueSubmit( ctx.queue, 1, &submitInfo, VK_NULL_HANDLE ) );
+    VK_CHECK( vkQueueWaitIdle( ctx.queue ) );
+
+    vkFreeCommandBuffers( ctx.device, ctx.commandPool, 1, &cmdBuffer );
+    vkFreeDescriptorSets( ctx.device, ctx.descriptorPool, 1, &descriptorSet );
+    vkDestroyBuffer( ctx.device, buffer, nullptr );
+    vkFreeMemory( ctx.device, bufferMemory, nullptr );
+
+    return true;
+}
+
+static void fill_test_image( const TestImage_t &image, uint32_t uWidth, uint32_t uHeight )
+{
+    uint32_t uState = 0x12345678u ^ ( uWidth * 31 + uHeight );
+    for ( uint32_t y = 0; y < uHeight; y++ )
+    {
+        uint32_t *pRow = (uint32_t *)( image.pMapped + size_t( y ) * image.uRowPitch );
+        for ( uint32_t x = 0; x < uWidth; x++ )
+        {
+            uState ^= uState << 13;
+            uState ^= uState >> 17;
+            uState ^= uState << 5;
+            pRow[x] = uState;
+        }
+    }
+}
+
+static bool read_file( const char *pszPath, std::vector<uint8_t> *pData )
+{
+    FILE *pFile = fopen( pszPath, "rb" );
+    if ( !pFile )
+        return false;
+
+    uint8_t buffer[ 64 * 1024 ];
+    size_t zRead;
+    while ( ( zRead = fread( buffer, 1, sizeof( buffer ), pFile ) ) > 0 )
+        pData->insert( pData->end(), buffer, buffer + zRead );
+
+    fclose( pFile );
+    return true;
+}
+
+// Writes both images out with WriteScreenshotPNG and compares the files.
+static int compare_png_output( const ScreenshotImage_t &rawImage, const ScreenshotImage_t &packedImage )
+{
+    char szRawPath[] = "/tmp/gamescope_pack_test_raw_XXXXXX";
+    char szPackedPath[] = "/tmp/gamescope_pack_test_packed_XXXXXX";
+    int nRawFd = mkstemp( szRawPath );
+    int nPackedFd = mkstemp( szPackedPath );
+    if ( nRawFd < 0 || nPackedFd < 0 )
+    {
+        printf("  mkstemp failed\n");
+        return 1;
+    }
+    close( nRawFd );
+    close( nPackedFd );
+
+    std::vector<uint8_t> rawPNG, packedPNG;
+    const bool bWritten =
+        WriteScreenshotPNG( szRawPath, rawImage ) &&
+        WriteScreenshotPNG( szPackedPath, packedImage ) &&
+        read_file( szRawPath, &rawPNG ) &&
+        read_file( szPackedPath, &packedPNG );
+    unlink( szRawPath );
+    unlink( szPackedPath );
+
+    if ( !bWritten )
+    {
+        printf("  %ux%u: failed to write PNGs\n", rawImage.uWidth, rawImage.uHeight);
+        return 1;
+    }
+
+    if ( rawPNG != packedPNG )
+    {
+        printf("  %ux%u: PNG from the packed image differs from the CPU conversion\n", rawImage.uWidth, rawImage.uHeight);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_pack_rgb8( TestContext_t &ctx, uint32_t uWidth, uint32_t uHeight )
+{
+    const uint32_t uPackWidth = div_roundup( uWidth * 3, 4 );
+    const uint32_t uPackHeight = uHeight;
+
+    TestImage_t source, packed;
+    if ( !create_image( ctx, uWidth, uHeight, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, &source ) ||
+         !create_image( ctx, uPackWidth, uPackHeight, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_STORAGE_BIT, &packed ) )
+    {
+        destroy_image( ctx, source );
+        destroy_image( ctx, packed );
+        return 1;
+    }
+
+    fill_test_image( source, uWidth, uHeight );
+
+    int nFailures = 0;
+    if ( run_pack( ctx, source, packed, uPackWidth, uPackHeight, PackData_t{ k_EPackLayout_RGB8, { uWidth, uHeight }, 255.0f } ) )
+    {
+        ScreenshotImage_t rawImage;
+        rawImage.pData = source.pMapped;
+        rawImage.uWidth = uWidth;
+        rawImage.uHeight = uHeight;
+        rawImage.uRowPitch = source.uRowPitch;
+        rawImage.eFormat = k_EScreenshotPixelFormat_B8G8R8A8;
+
+        ScreenshotImage_t packedImage = rawImage;
+        packedImage.pData = packed.pMapped;
+        packedImage.uRowPitch = packed.uRowPitch;
+        packedImage.eFormat = k_EScreenshotPixelFormat_R8G8B8;
+
+        nFailures += compare_png_output( rawImage, packedImage );
+    }
+    else
+    {
+        nFailures++;
+    }
+
+    destroy_image( ctx, source );
+    destroy_image( ctx, packed );
+    return nFailures;
+}
+
+static int test_pack_gbr16_planar( TestContext_t &ctx, uint32_t uWidth, uint32_t uHeight )
+{
+    const uint32_t uPackWidth = div_roundup( uWidth, 2 );
+    const uint32_t uPackHeight = uHeight * 3;
+
+    TestImage_t source, packed;
+    if ( !create_image( ctx, uWidth, uHeight, VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_IMAGE_USAGE_SAMPLED_BIT, &source ) ||
+         !create_image( ctx, uPackWidth, uPackHeight, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_STORAGE_BIT, &packed ) )
+    {
+        destroy_image( ctx, source );
+        destroy_image( ctx, packed );
+        return 1;
+    }
+
+    fill_test_image( source, uWidth, uHeight );
+
+    int nFailures = 0;
+    if ( run_pack( ctx, source, packed, uPackWidth, uPackHeight, PackData_t{ k_EPackLayout_GBR16_Planar, { uWidth, uHeight }, 1023.0f } ) )
+    {
+        ScreenshotImage_t rawImage;
+        rawImage.pData = source.pMapped;
+        rawImage.uWidth = uWidth;
+        rawImage.uHeight = uHeight;
+        rawImage.uRowPitch = source.uRowPitch;
+
+        const uint32_t uRowBytes = uWidth * sizeof( uint16_t );
+        std::vector<uint16_t> r( size_t( uWidth ) * uHeight ), g( r.size() ), b( r.size() );
+        SplitScreenshotA2R10G10B10( rawImage, r.data(), uRowBytes, g.data(), uRowBytes, b.data(), uRowBytes );
+
+        // G, B, R planes, one after another.
+        const std::vector<uint16_t> *pPlanes[] = { &g, &b, &r };
+        const char *pszPlaneNames[] = { "G", "B", "R" };
+
+        for ( uint32_t uPlane = 0; uPlane < 3 && nFailures < 8; uPlane++ )
+        {
+            for ( uint32_t y = 0; y < uHeight && nFailures < 8; y++ )
+            {
+                const uint16_t *pPackedRow = (const uint16_t *)( packed.pMapped + size_t( uPlane * uHeight + y ) * packed.uRowPitch );
+                const uint16_t *pExpectedRow = &( *pPlanes[ uPlane ] )[ size_t( y ) * uWidth ];
+                for ( uint32_t x = 0; x < uWidth && nFailures < 8; x++ )
+                {
+                    if ( pPackedRow[x] != pExpectedRow[x] )
+                    {
+                        printf("  %ux%u: %s plane (%u, %u) mismatch %u != %u\n", uWidth, uHeight, pszPlaneNames[ uPlane ],
+                            x, y, pPackedRow[x], pExpectedRow[x]);
+                        nFailures++;
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        nFailures++;
+    }
+
+    destroy_image( ctx, source );
+    destroy_image( ctx, packed );
+    return nFailures;
+}
+
+int test_screenshot_pack()
+{
+    printf("%s\n", __func__  );
+
+    TestContext_t ctx;
+    if ( !init_context( ctx ) )
+    {
+        printf("%s: skipped\n", __func__ );
+        return 0;
+    }
+
+    VkFormatProperties r32uiProperties;
+    vkGetPhysicalDeviceFormatProperties( ctx.physDev, VK_FORMAT_R32_UINT, &r32uiProperties );
+    if ( !( r32uiProperties.linearTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT ) )
+    {
+        // gamescope sticks to the CPU conversion here too.
+        printf("  no linear R32_UINT storage images\n");
+        printf("%s: skipped\n", __func__ );
+        return 0;
+    }
+
+    for ( VkFormat format : { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_A2R10G10B10_UNORM_PACK32 } )
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties( ctx.physDev, format, &formatProperties );
+        if ( !( formatProperties.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT ) )
+        {
+            printf("  no linear sampled images for format %d\n", format);
+            printf("%s: skipped\n", __func__ );
+            return 0;
+        }
+    }
+
+    struct
+    {
+        uint32_t uWidth;
+        uint32_t uHeight;
+    } sizes[] =
+    {
+        { 1, 1 },
+        // Words straddling pixels, and a half-filled last word
+        { 2, 1 },
+        { 3, 3 },
+        { 17, 5 },
+        { 333, 129 },
+        { 1920, 1080 },
+    };
+
+    int nFailures = 0;
+    for ( const auto &size : sizes )
+    {
+        nFailures += test_pack_rgb8( ctx, size.uWidth, size.uHeight );
+        nFailures += test_pack_gbr16_planar( ctx, size.uWidth, size.uHeight );
+    }
+
+    printf("%s: %s\n", __func__, nFailures ? "FAILED" : "passed" );
+    return nFailures;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("screenshot_pack_tests\n");
+    if ( test_screenshot_pack() != 0 )
+        return 1;
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "ScreenshotEncoder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+using namespace gamescope;
+
+// Mix of noise and flat runs, so every PNG filter gets picked somewhere.
+static std::vector<uint8_t> make_test_image( uint32_t uWidth, uint32_t uHeight, uint32_t uRowPitch, uint32_t uBytesPerPixel )
+{
+    std::vector<uint8_t> image( size_t( uRowPitch ) * uHeight, 0xcd );
+
+    uint32_t uState = 0x12345678u ^ ( uWidth * 31 + uHeight );
+    for ( uint32_t y = 0; y < uHeight; y++ )
+    {
+        uint8_t *pRow = &image[ size_t( y ) * uRowPitch ];
+        for ( uint32_t x = 0; x < uWidth; x++ )
+        {
+            uState ^= uState << 13;
+            uState ^= uState >> 17;
+            uState ^= uState << 5;
+
+            uint8_t *pPixel = &pRow[ x * uBytesPerPixel ];
+            if ( ( y / 8 + x / 16 ) % 3 == 0 )
+            {
+                pPixel[0] = uint8_t( x );
+                pPixel[1] = uint8_t( y );
+                pPixel[2] = uint8_t( x + y );
+            }
+            else
+            {
+                pPixel[0] = uint8_t( uState );
+                pPixel[1] = uint8_t( uState >> 8 );
+                pPixel[2] = uint8_t( uState >> 16 );
+            }
+            if ( uBytesPerPixel == 4 )
+                pPixel[3] = uint8_t( uState >> 24 );
+        }
+    }
+
+    return image;
+}
+
+// Encodes a test image, decodes it again with stb_image and compares the pixels.
+static int test_png_round_trip( uint32_t uWidth, uint32_t uHeight, EScreenshotPixelFormat eFormat )
+{
+    const bool bBGRA = eFormat == k_EScreenshotPixelFormat_B8G8R8A8;
+    const uint32_t uBytesPerPixel = bBGRA ? 4 : 3;
+    // Pad the rows like a mapped image would be.
+    const uint32_t uRowPitch = ( uWidth * uBytesPerPixel + 63 ) & ~63u;
+
+    std::vector<uint8_t> pixels = make_test_image( uWidth, uHeight, uRowPitch, uBytesPerPixel );
+
+    ScreenshotImage_t image;
+    image.pData = pixels.data();
+    image.uWidth = uWidth;
+    image.uHeight = uHeight;
+    image.uRowPitch = uRowPitch;
+    image.eFormat = eFormat;
+
+    char szPath[] = "/tmp/gamescope_screenshot_test_XXXXXX";
+    int nFd = mkstemp( szPath );
+    if ( nFd < 0 )
+    {
+        printf("  %ux%u: mkstemp failed\n", uWidth, uHeight);
+        return 1;
+    }
+    close( nFd );
+
+    int nFailures = 0;
+    if ( !WriteScreenshotPNG( szPath, image ) )
+    {
+        printf("  %ux%u %s: WriteScreenshotPNG failed\n", uWidth, uHeight, bBGRA ? "BGRA" : "RGB");
+        unlink( szPath );
+        return 1;
+    }
+
+    int nDecodedWidth = 0, nDecodedHeight = 0, nComponents = 0;
+    uint8_t *pDecoded = stbi_load( szPath, &nDecodedWidth, &nDecodedHeight, &nComponents, 3 );
+    unlink( szPath );
+
+    if ( !pDecoded )
+    {
+        printf("  %ux%u %s: stb_image failed to decode: %s\n", uWidth, uHeight, bBGRA ? "BGRA" : "RGB", stbi_failure_reason());
+        return 1;
+    }
+
+    if ( uint32_t( nDecodedWidth ) != uWidth || uint32_t( nDecodedHeight ) != uHeight || nComponents != 3 )
+    {
+        printf("  %ux%u %s: decoded as %dx%d with %d components\n", uWidth, uHeight, bBGRA ? "BGRA" : "RGB",
+            nDecodedWidth, nDecodedHeight, nComponents);
+        stbi_image_free( pDecoded );
+        return 1;
+    }
+
+    for ( uint32_t y = 0; y < uHeight && nFailures < 8; y++ )
+    {
+        for ( uint32_t x = 0; x < uWidth && nFailures < 8; x++ )
+        {
+            const uint8_t *pIn = &pixels[ size_t( y ) * uRowPitch + x * uBytesPerPixel ];
+            const uint8_t *pOut = &pDecoded[ ( size_t( y ) * uWidth + x ) * 3 ];
+
+            const uint8_t expected[3] =
+            {
+                pIn[ bBGRA ? 2 : 0 ],
+                pIn[ 1 ],
+                pIn[ bBGRA ? 0 : 2 ],
+            };
+
+            if ( memcmp( expected, pOut, 3 ) != 0 )
+            {
+                printf("  %ux%u %s: pixel (%u, %u) mismatch %02x%02x%02x != %02x%02x%02x\n", uWidth, uHeight, bBGRA ? "BGRA" : "RGB",
+                    x, y, pOut[0], pOut[1], pOut[2], expected[0], expected[1], expected[2]);
+                nFailures++;
+            }
+        }
+    }
+
+    stbi_image_free( pDecoded );
+    return nFailures;
+}
+
+int test_screenshot_png()
+{
+    printf("%s\n", __func__  );
+
+    struct
+    {
+        uint32_t uWidth;
+        uint32_t uHeight;
+    } sizes[] =
+    {
+        { 1, 1 },
+        // One row
+        { 17, 1 },
+        { 1, 17 },
+        // Odd sizes, band boundaries falling mid-image
+        { 333, 129 },
+        { 127, 64 },
+        { 65, 65 },
+        // More bands than threads
+        { 3840, 2160 },
+    };
+
+    int nFailures = 0;
+    for ( const auto &size : sizes )
+    {
+        nFailures += test_png_round_trip( size.uWidth, size.uHeight, k_EScreenshotPixelFormat_B8G8R8A8 );
+        nFailures += test_png_round_trip( size.uWidth, size.uHeight, k_EScreenshotPixelFormat_R8G8B8 );
+    }
+
+    printf("%s: %s\n", __func__, nFailures ? "FAILED" : "passed" );
+    return nFailures;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("screenshot_tests\n");
+    if ( test_screenshot_png() != 0 )
+        return 1;
+    return 0;
+}
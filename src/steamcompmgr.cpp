@@ -32,6 +32,7 @@
 #include "xwayland_ctx.hpp"
 #include <X11/X.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xcursor/Xcursor.h>
 #include <X11/extensions/xfixeswire.h>
 #include <X11/extensions/XInput2.h>
@@ -48,6 +49,7 @@
 #include <fstream>
 #include <string>
 #include <queue>
+#include <list>
 #include <filesystem>
 #include <variant>
 #include <unordered_set>
@@ -61,6 +63,7 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #if defined(__linux__)
 #include <sys/prctl.h>
 #elif defined(__DragonFly__) || defined(__FreeBSD__)
@@ -75,6 +78,8 @@
 #include <signal.h>
 #include <linux/input-event-codes.h>
 #include <X11/Xmu/CurUtil.h>
+#include <xcb/xcb.h>
+#include <xcb/res.h>
 #include "waitable.h"
 
 #include "main.hpp"
@@ -91,8 +96,11 @@
 #include "refresh_rate.h"
 #include "commit.h"
 #include "BufferMemo.h"
+#include "ScreenshotEncoder.h"
 #include "Utils/Process.h"
 #include "Utils/Algorithm.h"
+#include "Utils/SPSCRing.h"
+#include "FrameTiming.h"
 
 #include "wlr_begin.hpp"
 #include "wlr/types/wlr_pointer_constraints_v1.h"
@@ -217,6 +225,163 @@ static const gamescope_color_mgmt_t k_ScreenshotColorMgmtHDR =
 //#define COLOR_MGMT_MICROBENCH
 // sudo cpupower frequency-set --governor performance
 
+// Bumped whenever a look lut is (re)loaded, so cached luts generated
+// with an older look are never handed back out.
+static uint32_t s_uColorMgmtLookGeneration[ EOTF_Count ]{};
+
+// Only the parts of gamescope_color_mgmt_t that feed into calcColorTransform.
+struct ColorMgmtLutCacheKey_t
+{
+	uint32_t nInputEOTF;
+	uint32_t uLookGeneration;
+	nightmode_t nightmode;
+	float sdrGamutWideness;
+	float flInternalDisplayBrightness;
+	float flSDROnHDRBrightness;
+	float flHDRInputGain;
+	float flSDRInputGain;
+	ETonemapOperator hdrTonemapOperator;
+	tonemap_info_t hdrTonemapDisplayMetadata;
+	tonemap_info_t hdrTonemapSourceMetadata;
+	displaycolorimetry_t displayColorimetry;
+	displaycolorimetry_t outputEncodingColorimetry;
+	EOTF outputEncodingEOTF;
+	glm::vec2 outputVirtualWhite;
+	EChromaticAdaptationMethod chromaticAdaptationMode;
+
+	ColorMgmtLutCacheKey_t( const gamescope_color_mgmt_t &colorMgmt, uint32_t nInputEOTF_ )
+		: nInputEOTF{ nInputEOTF_ }
+		, uLookGeneration{ s_uColorMgmtLookGeneration[ nInputEOTF_ ] }
+		, nightmode{ colorMgmt.nightmode }
+		, sdrGamutWideness{ colorMgmt.sdrGamutWideness }
+		, flInternalDisplayBrightness{ colorMgmt.flInternalDisplayBrightness }
+		, flSDROnHDRBrightness{ colorMgmt.flSDROnHDRBrightness }
+		, flHDRInputGain{ colorMgmt.flHDRInputGain }
+		, flSDRInputGain{ colorMgmt.flSDRInputGain }
+		, hdrTonemapOperator{ colorMgmt.hdrTonemapOperator }
+		, hdrTonemapDisplayMetadata{ colorMgmt.hdrTonemapDisplayMetadata }
+		, hdrTonemapSourceMetadata{ colorMgmt.hdrTonemapSourceMetadata }
+		, displayColorimetry{ colorMgmt.displayColorimetry }
+		, outputEncodingColorimetry{ colorMgmt.outputEncodingColorimetry }
+		, outputEncodingEOTF{ colorMgmt.outputEncodingEOTF }
+		, outputVirtualWhite{ colorMgmt.outputVirtualWhite }
+		, chromaticAdaptationMode{ colorMgmt.chromaticAdaptationMode }
+	{
+	}
+
+	bool operator == (const ColorMgmtLutCacheKey_t&) const = default;
+	bool operator != (const ColorMgmtLutCacheKey_t&) const = default;
+
+	// FNV-1a over each field individually, so padding never leaks into the hash.
+	uint64_t Hash() const
+	{
+		uint64_t ulHash = 0xcbf29ce484222325ull;
+		auto mix = [&]( const auto &value )
+		{
+			const uint8_t *pBytes = reinterpret_cast<const uint8_t *>( &value );
+			for ( size_t i = 0; i < sizeof( value ); i++ )
+			{
+				ulHash ^= pBytes[i];
+				ulHash *= 0x100000001b3ull;
+			}
+		};
+
+		mix( nInputEOTF );
+		mix( uLookGeneration );
+		mix( nightmode.amount ); mix( nightmode.hue ); mix( nightmode.saturation );
+		mix( sdrGamutWideness );
+		mix( flInternalDisplayBrightness );
+		mix( flSDROnHDRBrightness );
+		mix( flHDRInputGain );
+		mix( flSDRInputGain );
+		mix( hdrTonemapOperator );
+		mix( hdrTonemapDisplayMetadata.flBlackPointNits ); mix( hdrTonemapDisplayMetadata.flWhitePointNits );
+		mix( hdrTonemapSourceMetadata.flBlackPointNits ); mix( hdrTonemapSourceMetadata.flWhitePointNits );
+		for ( const displaycolorimetry_t *pColorimetry : { &displayColorimetry, &outputEncodingColorimetry } )
+		{
+			mix( pColorimetry->primaries.r.x ); mix( pColorimetry->primaries.r.y );
+			mix( pColorimetry->primaries.g.x ); mix( pColorimetry->primaries.g.y );
+			mix( pColorimetry->primaries.b.x ); mix( pColorimetry->primaries.b.y );
+			mix( pColorimetry->white.x ); mix( pColorimetry->white.y );
+		}
+		mix( outputEncodingEOTF );
+		mix( outputVirtualWhite.x ); mix( outputVirtualWhite.y );
+		mix( chromaticAdaptationMode );
+		return ulHash;
+	}
+};
+
+struct ColorMgmtLutCacheEntry_t
+{
+	ColorMgmtLutCacheKey_t key;
+	uint64_t ulHash;
+	uint16_t lut3d[s_nLutEdgeSize3d*s_nLutEdgeSize3d*s_nLutEdgeSize3d*4];
+	uint16_t lut1d[s_nLutSize1d*4];
+};
+
+gamescope::ConVar<int> cv_color_lut_cache_size{ "color_lut_cache_size", 16, "Number of generated color management LUT pairs to keep around, so toggling back to a previous color setting skips regeneration. 0 = disabled." };
+
+// Most recently used at the front.
+static std::list<ColorMgmtLutCacheEntry_t> s_ColorMgmtLutCache;
+static uint64_t s_ulColorMgmtLutCacheHits = 0;
+static uint64_t s_ulColorMgmtLutCacheMisses = 0;
+
+static const ColorMgmtLutCacheEntry_t *
+find_cached_color_mgmt_luts( const ColorMgmtLutCacheKey_t &key, uint64_t ulHash )
+{
+	for ( auto iter = s_ColorMgmtLutCache.begin(); iter != s_ColorMgmtLutCache.end(); iter++ )
+	{
+		if ( iter->ulHash == ulHash && iter->key == key )
+		{
+			s_ColorMgmtLutCache.splice( s_ColorMgmtLutCache.begin(), s_ColorMgmtLutCache, iter );
+			s_ulColorMgmtLutCacheHits++;
+			return &s_ColorMgmtLutCache.front();
+		}
+	}
+
+	s_ulColorMgmtLutCacheMisses++;
+	return nullptr;
+}
+
+static void
+insert_cached_color_mgmt_luts( const ColorMgmtLutCacheKey_t &key, uint64_t ulHash, const gamescope_color_mgmt_luts &luts )
+{
+	size_t zMaxEntries = (size_t) std::max( 0, cv_color_lut_cache_size.Get() );
+	if ( zMaxEntries == 0 )
+	{
+		s_ColorMgmtLutCache.clear();
+		return;
+	}
+
+	// Reuse the least recently used node when full to avoid reallocating ~70KiB each miss.
+	if ( s_ColorMgmtLutCache.size() >= zMaxEntries )
+	{
+		while ( s_ColorMgmtLutCache.size() > zMaxEntries )
+			s_ColorMgmtLutCache.pop_back();
+		s_ColorMgmtLutCache.splice( s_ColorMgmtLutCache.begin(), s_ColorMgmtLutCache, std::prev( s_ColorMgmtLutCache.end() ) );
+		s_ColorMgmtLutCache.front().key = key;
+	}
+	else
+	{
+		s_ColorMgmtLutCache.emplace_front( ColorMgmtLutCacheEntry_t{ .key = key } );
+	}
+
+	ColorMgmtLutCacheEntry_t &entry = s_ColorMgmtLutCache.front();
+	entry.ulHash = ulHash;
+	memcpy( entry.lut1d, luts.lut1d, sizeof( entry.lut1d ) );
+	memcpy( entry.lut3d, luts.lut3d, sizeof( entry.lut3d ) );
+}
+
+static gamescope::ConCommand cc_color_lut_cache_stats( "color_lut_cache_stats", "Print color management LUT cache statistics.",
+[]( std::span<std::string_view> args )
+{
+	uint64_t ulTotal = s_ulColorMgmtLutCacheHits + s_ulColorMgmtLutCacheMisses;
+	console_log.infof( "Color LUT cache: %zu/%d entries, %lu hits, %lu misses (%.1f%% hit rate)",
+		s_ColorMgmtLutCache.size(), cv_color_lut_cache_size.Get(),
+		(unsigned long) s_ulColorMgmtLutCacheHits, (unsigned long) s_ulColorMgmtLutCacheMisses,
+		ulTotal ? 100.0 * s_ulColorMgmtLutCacheHits / ulTotal : 0.0 );
+});
+
 static void
 create_color_mgmt_luts(const gamescope_color_mgmt_t& newColorMgmt, gamescope_color_mgmt_luts outColorMgmtLuts[ EOTF_Count ])
 {
@@ -231,11 +396,41 @@ create_color_mgmt_luts(const gamescope_color_mgmt_t& newColorMgmt, gamescope_col
 		if (!outColorMgmtLuts[nInputEOTF].vk_lut3d)
 			outColorMgmtLuts[nInputEOTF].vk_lut3d = vulkan_create_3d_lut(s_nLutEdgeSize3d, s_nLutEdgeSize3d, s_nLutEdgeSize3d);
 
+		// If an in-flight submission still reads the current LUTs, upload
+		// into the back set instead so the copy doesn't have to wait behind
+		// the composite that is reading them. The upload's own submission
+		// counts too, until it has completed.
+		gamescope::Rc<CVulkanTexture> pLut1D = outColorMgmtLuts[nInputEOTF].vk_lut1d;
+		gamescope::Rc<CVulkanTexture> pLut3D = outColorMgmtLuts[nInputEOTF].vk_lut3d;
+		const bool bUseBackLuts = vulkan_texture_in_flight( pLut1D.get() ) || vulkan_texture_in_flight( pLut3D.get() );
+		if ( bUseBackLuts )
+		{
+			// An older composite may still be reading the back set too (eg. quick
+			// slider changes), never write into a LUT the GPU may be reading.
+			// Whoever holds it keeps it alive, we just move on to a fresh one.
+			if (!outColorMgmtLuts[nInputEOTF].vk_lut1d_back || vulkan_texture_in_flight( outColorMgmtLuts[nInputEOTF].vk_lut1d_back.get() ))
+				outColorMgmtLuts[nInputEOTF].vk_lut1d_back = vulkan_create_1d_lut(s_nLutSize1d);
+
+			if (!outColorMgmtLuts[nInputEOTF].vk_lut3d_back || vulkan_texture_in_flight( outColorMgmtLuts[nInputEOTF].vk_lut3d_back.get() ))
+				outColorMgmtLuts[nInputEOTF].vk_lut3d_back = vulkan_create_3d_lut(s_nLutEdgeSize3d, s_nLutEdgeSize3d, s_nLutEdgeSize3d);
+
+			pLut1D = outColorMgmtLuts[nInputEOTF].vk_lut1d_back;
+			pLut3D = outColorMgmtLuts[nInputEOTF].vk_lut3d_back;
+		}
+
+		const ColorMgmtLutCacheKey_t cacheKey{ newColorMgmt, nInputEOTF };
+		const uint64_t ulCacheHash = cacheKey.Hash();
+
 		if ( g_ColorMgmtLutsOverride[nInputEOTF].HasLuts() )
 		{
 			memcpy(g_ColorMgmtLuts[nInputEOTF].lut1d, g_ColorMgmtLutsOverride[nInputEOTF].lut1d, sizeof(g_ColorMgmtLutsOverride[nInputEOTF].lut1d));
 			memcpy(g_ColorMgmtLuts[nInputEOTF].lut3d, g_ColorMgmtLutsOverride[nInputEOTF].lut3d, sizeof(g_ColorMgmtLutsOverride[nInputEOTF].lut3d));
 		}
+		else if ( const ColorMgmtLutCacheEntry_t *pCached = find_cached_color_mgmt_luts( cacheKey, ulCacheHash ) )
+		{
+			memcpy( outColorMgmtLuts[nInputEOTF].lut1d, pCached->lut1d, sizeof( pCached->lut1d ) );
+			memcpy( outColorMgmtLuts[nInputEOTF].lut3d, pCached->lut3d, sizeof( pCached->lut3d ) );
+		}
 		else
 		{
 			displaycolorimetry_t inputColorimetry{};
@@ -336,12 +531,22 @@ create_color_mgmt_luts(const gamescope_color_mgmt_t& newColorMgmt, gamescope_col
 				outColorMgmtLuts[nInputEOTF].lut3d[4*i+2] = quantize_lut_value_16bit( g_tmpLut3d.data[i].b );
 				outColorMgmtLuts[nInputEOTF].lut3d[4*i+3] = 0;
 			}
+
+			insert_cached_color_mgmt_luts( cacheKey, ulCacheHash, outColorMgmtLuts[nInputEOTF] );
+		}
+
+		// If the upload failed, keep using whatever set we had.
+		if ( vulkan_update_luts(pLut1D, pLut3D, outColorMgmtLuts[nInputEOTF].lut1d, outColorMgmtLuts[nInputEOTF].lut3d) == 0 )
+			continue;
+
+		if ( bUseBackLuts )
+		{
+			std::swap( outColorMgmtLuts[nInputEOTF].vk_lut1d, outColorMgmtLuts[nInputEOTF].vk_lut1d_back );
+			std::swap( outColorMgmtLuts[nInputEOTF].vk_lut3d, outColorMgmtLuts[nInputEOTF].vk_lut3d_back );
 		}
 
 		outColorMgmtLuts[nInputEOTF].bHasLut1D = true;
 		outColorMgmtLuts[nInputEOTF].bHasLut3D = true;
-
-		vulkan_update_luts(outColorMgmtLuts[nInputEOTF].vk_lut1d, outColorMgmtLuts[nInputEOTF].vk_lut3d, outColorMgmtLuts[nInputEOTF].lut1d, outColorMgmtLuts[nInputEOTF].lut3d);
 	}
 }
 
@@ -667,6 +872,7 @@ bool set_color_shaperlut_override(const char *path)
 bool set_color_look_pq(const char *path)
 {
 	LoadCubeLut( &g_ColorMgmtLooks[EOTF_PQ], path );
+	s_uColorMgmtLookGeneration[EOTF_PQ]++;
 	g_ColorMgmt.pending.externalDirtyCtr++;
 	return true;
 }
@@ -674,6 +880,7 @@ bool set_color_look_pq(const char *path)
 bool set_color_look_g22(const char *path)
 {
 	LoadCubeLut( &g_ColorMgmtLooks[EOTF_Gamma22], path );
+	s_uColorMgmtLookGeneration[EOTF_Gamma22]++;
 	g_ColorMgmt.pending.externalDirtyCtr++;
 	return true;
 }
@@ -781,6 +988,7 @@ std::mutex g_SteamCompMgrXWaylandServerMutex;
 gamescope::VBlankTime g_SteamCompMgrVBlankTime = {};
 
 uint64_t g_uCurrentBasePlaneCommitID = 0;
+uint64_t g_ulCurrentBasePlaneReadyTime = 0;
 bool g_bCurrentBasePlaneIsFifo = false;
 
 static int g_nSteamCompMgrTargetFPS = 0;
@@ -1007,41 +1215,19 @@ static std::atomic<bool> g_bForceRepaint{false};
 
 extern int g_nCursorScaleHeight;
 
-// poor man's semaphore
-class sem
+struct StatsRecord_t
 {
-public:
-	void wait( void )
-	{
-		std::unique_lock<std::mutex> lock(mtx);
-
-		while(count == 0){
-			cv.wait(lock);
-		}
-		count--;
-	}
-
-	void signal( void )
-	{
-		std::unique_lock<std::mutex> lock(mtx);
-		count++;
-		cv.notify_one();
-	}
-
-private:
-	std::mutex mtx;
-	std::condition_variable cv;
-	int count = 0;
+	uint32_t uLength;
+	char szText[252];
 };
 
-sem statsThreadSem;
-std::mutex statsEventQueueLock;
-std::vector< std::string > statsEventQueue;
+// Written from the compositor thread only, drained by statsThreadMain.
+static gamescope::SPSCRing<StatsRecord_t, 64> s_StatsRing;
 
 std::string statsThreadPath;
 int			statsPipeFD = -1;
 
-bool statsThreadRun;
+std::atomic<bool> statsThreadRun;
 
 void statsThreadMain( void )
 {
@@ -1058,61 +1244,57 @@ void statsThreadMain( void )
 		}
 	}
 
-wait:
-	statsThreadSem.wait();
-
-	if ( statsThreadRun == false )
-	{
-		return;
-	}
-
-	std::string event;
-
-retry:
+	uint64_t ulLastDropped = 0;
+	while ( statsThreadRun )
 	{
-		std::unique_lock< std::mutex > lock( statsEventQueueLock );
+		s_StatsRing.WaitForData();
 
-		if( statsEventQueue.empty() )
+		while ( s_StatsRing.Pop( []( const StatsRecord_t &record )
+		{
+			if ( record.uLength )
+				(void) !write( statsPipeFD, record.szText, record.uLength );
+		} ) )
 		{
-			goto wait;
 		}
 
-		event = statsEventQueue[ 0 ];
-		statsEventQueue.erase( statsEventQueue.begin() );
+		uint64_t ulDropped = s_StatsRing.GetDroppedCount();
+		if ( ulDropped != ulLastDropped )
+		{
+			xwm_log.warnf( "stats: reader is falling behind, dropped %lu events so far", (unsigned long) ulDropped );
+			ulLastDropped = ulDropped;
+		}
 	}
+}
 
-	dprintf( statsPipeFD, "%s", event.c_str() );
-
-	goto retry;
+static void stats_shutdown()
+{
+	if ( statsThreadRun == true )
+	{
+		statsThreadRun = false;
+		// An empty record just wakes the stats thread up.
+		s_StatsRing.Push( []( StatsRecord_t &record ) { record.uLength = 0; return true; } );
+	}
 }
 
 static inline void stats_printf( const char* format, ...)
 {
-	static char buffer[256];
-	static std::string eventstr;
+	if ( !statsThreadRun )
+		return;
 
 	va_list args;
 	va_start(args, format);
-	vsprintf(buffer,format, args);
-	va_end(args);
-
-	eventstr = buffer;
-
+	// Formats straight into the ring slot. If the ring is full, the event is
+	// dropped and counted instead of blocking the paint path.
+	s_StatsRing.Push( [&]( StatsRecord_t &record )
 	{
-		{
-			std::unique_lock< std::mutex > lock( statsEventQueueLock );
-
-			if( statsEventQueue.size() > 50 )
-			{
-				// overflow, drop event
-				return;
-			}
-
-			statsEventQueue.push_back( eventstr );
+		int nLength = vsnprintf( record.szText, sizeof( record.szText ), format, args );
+		if ( nLength <= 0 )
+			return false;
 
-			statsThreadSem.signal();
-		}
-	}
+		record.uLength = std::min<uint32_t>( nLength, sizeof( record.szText ) - 1 );
+		return true;
+	} );
+	va_end(args);
 }
 
 uint64_t get_time_in_nanos()
@@ -1150,37 +1332,62 @@ bool xwayland_ctx_t::HasQueuedEvents()
 	return XEventsQueued( dpy, QueuedAlready ) != 0;
 }
 
+// Cap on cached parents, just so a client churning through child windows
+// can't grow this forever. It's all rebuilt on demand anyway.
+static constexpr size_t k_zMaxParentCacheSize = 4096;
+
 static steamcompmgr_win_t *
 find_win(xwayland_ctx_t *ctx, Window id, bool find_children = true)
 {
-	steamcompmgr_win_t	*w;
-
 	if (id == None)
 	{
 		return NULL;
 	}
 
-	for (w = ctx->list; w; w = w->xwayland().next)
-	{
-		if (w->xwayland().id == id)
-		{
-			return w;
-		}
-	}
+	auto iter = ctx->windowsByID.find( id );
+	if ( iter != ctx->windowsByID.end() )
+		return iter->second;
 
 	if ( !find_children )
 		return nullptr;
 
 	// Didn't find, must be a children somewhere; try again with parent.
-	Window root = None;
+	// X does hand out the same IDs again: Xwayland recycles a disconnected
+	// client's ID range, and clients reuse freed IDs through XC-MISC.
+	// So we ask for structure events on every child we cache a parent for,
+	// and forget it on DestroyNotify (or ReparentNotify) before its ID can
+	// come back.
 	Window parent = None;
-	Window *children = NULL;
-	unsigned int childrenCount;
-	XQueryTree(ctx->dpy, id, &root, &parent, &children, &childrenCount);
-	if (children)
-		XFree(children);
+	{
+		std::unique_lock lock( ctx->parentCacheMutex );
+		auto parentIter = ctx->parentCache.find( id );
+		if ( parentIter != ctx->parentCache.end() )
+			parent = parentIter->second;
+	}
+
+	if ( parent == None )
+	{
+		Window root = None;
+		Window *children = NULL;
+		unsigned int childrenCount;
+		XQueryTree(ctx->dpy, id, &root, &parent, &children, &childrenCount);
+		if (children)
+			XFree(children);
+
+		if (parent == None)
+		{
+			return NULL;
+		}
 
-	if (root == parent || parent == None)
+		XSelectInput( ctx->dpy, id, StructureNotifyMask );
+
+		std::unique_lock lock( ctx->parentCacheMutex );
+		if ( ctx->parentCache.size() >= k_zMaxParentCacheSize )
+			ctx->parentCache.clear();
+		ctx->parentCache[ id ] = parent;
+	}
+
+	if (parent == ctx->root)
 	{
 		return NULL;
 	}
@@ -1190,26 +1397,120 @@ find_win(xwayland_ctx_t *ctx, Window id, bool find_children = true)
 
 static steamcompmgr_win_t * find_win( xwayland_ctx_t *ctx, struct wlr_surface *surf )
 {
-	steamcompmgr_win_t	*w = nullptr;
-
-	for (w = ctx->list; w; w = w->xwayland().next)
+	auto iter = ctx->windowsBySurface.find( surf );
+	if ( iter != ctx->windowsBySurface.end() )
 	{
-		if ( w->xwayland().surface.main_surface == surf )
+		// The surface may have gone away and something else been allocated
+		// at the same address since, so make sure it's still ours.
+		steamcompmgr_win_t *w = iter->second;
+		if ( w->xwayland().surface.main_surface == surf || w->xwayland().surface.override_surface == surf )
 			return w;
 
-		if ( w->xwayland().surface.override_surface == surf )
+		ctx->windowsBySurface.erase( iter );
+	}
+
+	for (steamcompmgr_win_t *w = ctx->list; w; w = w->xwayland().next)
+	{
+		if ( w->xwayland().surface.main_surface == surf ||
+			 w->xwayland().surface.override_surface == surf )
+		{
+			ctx->windowsBySurface[ surf ] = w;
 			return w;
+		}
 	}
 
 	return nullptr;
 }
 
+// The list can (rarely) hold more than one window with the same ID,
+// eg. if something got re-added before its destroy was processed.
+// Keep the index pointing at the first one, like a list walk would find.
+static void
+reindex_win_id(xwayland_ctx_t *ctx, Window id)
+{
+	ctx->windowsByID.erase( id );
+	for (steamcompmgr_win_t *w = ctx->list; w; w = w->xwayland().next)
+	{
+		if (w->xwayland().id == id)
+		{
+			ctx->windowsByID[ id ] = w;
+			break;
+		}
+	}
+}
+
 static gamescope::CBufferMemoizer s_BufferMemos;
 
+// Enough for the texture being displayed, one queued behind it and one to upload into.
+static constexpr size_t k_zMaxShmSpareTextures = 2;
+
+// wl_shm buffers get copied into a texture rather than imported.
+// A texture that an older commit or an in-flight command buffer still
+// references is never written to, the commit gets a fresh one instead.
+// If the latest texture is up to date with the commit before this one,
+// only what this commit damaged needs uploading on top of it.
+static gamescope::Rc<CVulkanTexture>
+import_shm_commit( steamcompmgr_win_t *w, struct wlr_buffer *buf, const BufferDamage_t &damage )
+{
+	const bool bPartial = w->shmTexture != nullptr && damage.ulPrevSerial != 0 && damage.ulPrevSerial == w->shmTextureSerial;
+
+	// A partial update with no damage, nothing to upload, and
+	// sharing the same contents with the older commit is fine.
+	std::span<const pixman_box32_t> rects{ damage.rects.data(), damage.uRectCount };
+	if ( bPartial && rects.empty() )
+	{
+		w->shmTextureSerial = damage.ulSerial;
+		return w->shmTexture;
+	}
+
+	// Commits and command buffers hold public references,
+	// only our own private one means nothing else can see it.
+	auto BTextureIsFree = []( const gamescope::OwningRc<CVulkanTexture> &pTexture )
+	{
+		return pTexture->GetRefCount() == 0;
+	};
+
+	if ( w->shmTexture != nullptr && BTextureIsFree( w->shmTexture ) )
+	{
+		if ( !vulkan_update_texture_from_shm( w->shmTexture, buf, bPartial ? rects : std::span<const pixman_box32_t>{} ) )
+		{
+			w->shmTexture = nullptr;
+			w->shmTextureSerial = 0;
+			return nullptr;
+		}
+
+		w->shmTextureSerial = damage.ulSerial;
+		return w->shmTexture;
+	}
+
+	gamescope::OwningRc<CVulkanTexture> pTexture;
+	auto iter = std::find_if( w->shmSpareTextures.begin(), w->shmSpareTextures.end(), BTextureIsFree );
+	if ( iter != w->shmSpareTextures.end() )
+	{
+		pTexture = std::move( *iter );
+		w->shmSpareTextures.erase( iter );
+	}
+
+	// The latest texture is busy, so a partial update starts from a GPU copy of it.
+	if ( !vulkan_update_texture_from_shm( pTexture, buf, bPartial ? rects : std::span<const pixman_box32_t>{}, bPartial ? w->shmTexture.get() : nullptr ) )
+		return nullptr;
+
+	if ( w->shmTexture != nullptr )
+	{
+		if ( w->shmSpareTextures.size() >= k_zMaxShmSpareTextures )
+			w->shmSpareTextures.erase( w->shmSpareTextures.begin() );
+		w->shmSpareTextures.emplace_back( std::move( w->shmTexture ) );
+	}
+
+	w->shmTexture = std::move( pTexture );
+	w->shmTextureSerial = damage.ulSerial;
+	return w->shmTexture;
+}
+
 static gamescope::Rc<commit_t>
-import_commit ( steamcompmgr_win_t *w, struct wlr_surface *surf, struct wlr_buffer *buf, bool async, std::shared_ptr<wlserver_vk_swapchain_feedback> swapchain_feedback, std::vector<struct wl_resource*> presentation_feedbacks, std::optional<uint32_t> present_id, uint64_t desired_present_time, bool fifo )
+import_commit ( steamcompmgr_win_t *w, struct wlr_surface *surf, struct wlr_buffer *buf, const BufferDamage_t &damage, bool async, std::shared_ptr<wlserver_vk_swapchain_feedback> swapchain_feedback, std::vector<struct wl_resource*> &presentation_feedbacks, std::optional<uint32_t> present_id, uint64_t desired_present_time, bool fifo )
 {
-	gamescope::Rc<commit_t> commit = new commit_t;
+	gamescope::Rc<commit_t> commit = commit_t::Allocate();
 
 	commit->win_seq = w->seq;
 	commit->surf = surf;
@@ -1217,12 +1518,24 @@ import_commit ( steamcompmgr_win_t *w, struct wlr_surface *surf, struct wlr_buff
 	commit->async = async;
 	commit->fifo = fifo;
 	commit->is_steam = window_is_steam( w );
-	commit->presentation_feedbacks = std::move(presentation_feedbacks);
+	// Copy rather than move, so both the recycled commit and the queue entry
+	// keep their vector's capacity.
+	commit->presentation_feedbacks.assign( presentation_feedbacks.begin(), presentation_feedbacks.end() );
+	presentation_feedbacks.clear();
 	if (swapchain_feedback)
 		commit->feedback = *swapchain_feedback;
 	commit->present_id = present_id;
 	commit->desired_present_time = desired_present_time;
 
+	struct wlr_dmabuf_attributes dmabuf = {0};
+	if ( !wlr_buffer_get_dmabuf( buf, &dmabuf ) )
+	{
+		// The same wl_shm buffer can come back with new contents,
+		// so these are never memoized.
+		commit->vulkanTex = import_shm_commit( w, buf, damage );
+		return commit;
+	}
+
 	if ( gamescope::OwningRc<CVulkanTexture> pTexture = s_BufferMemos.LookupVulkanTexture( buf ) )
 	{
 		// Going from OwningRc -> Rc now.
@@ -1230,12 +1543,7 @@ import_commit ( steamcompmgr_win_t *w, struct wlr_surface *surf, struct wlr_buff
 		return commit;
 	}
 
-	struct wlr_dmabuf_attributes dmabuf = {0};
-	gamescope::OwningRc<gamescope::IBackendFb> pBackendFb;
-	if ( wlr_buffer_get_dmabuf( buf, &dmabuf ) )
-	{
-		pBackendFb = GetBackend()->ImportDmabufToBackend( buf, &dmabuf );
-	}
+	gamescope::OwningRc<gamescope::IBackendFb> pBackendFb = GetBackend()->ImportDmabufToBackend( buf, &dmabuf );
 	gamescope::OwningRc<CVulkanTexture> pOwnedTexture = vulkan_create_texture_from_wlr_buffer( buf, std::move( pBackendFb ) );
 	commit->vulkanTex = pOwnedTexture;
 
@@ -1450,6 +1758,13 @@ void MouseCursor::setDirty()
 	// We can't prove it's empty until checking again
 	m_imageEmpty = false;
 	m_dirty = true;
+	m_ulPendingSerial = std::nullopt;
+}
+
+void MouseCursor::setDirty( unsigned long ulCursorSerial )
+{
+	setDirty();
+	m_ulPendingSerial = ulCursorSerial;
 }
 
 bool MouseCursor::setCursorImage(char *data, int w, int h, int hx, int hy)
@@ -1549,17 +1864,67 @@ int MouseCursor::y() const
 	return m_y;
 }
 
+MouseCursor::CachedCursor_t *MouseCursor::findCachedCursor( unsigned long ulSerial )
+{
+	auto iter = std::find_if( m_CursorCache.begin(), m_CursorCache.end(), [&]( const CachedCursor_t &cursor )
+	{
+		return cursor.ulSerial == ulSerial &&
+			cursor.nScaleHeight == g_nCursorScaleHeight &&
+			cursor.uOutputHeight == g_nOutputHeight;
+	});
+
+	if ( iter == m_CursorCache.end() )
+		return nullptr;
+
+	// Move to the front.
+	std::rotate( m_CursorCache.begin(), iter, iter + 1 );
+	return &m_CursorCache.front();
+}
+
+void MouseCursor::useCachedCursor( const CachedCursor_t &cursor )
+{
+	m_texture = cursor.pTexture;
+	m_hotspotX = cursor.nHotspotX;
+	m_hotspotY = cursor.nHotspotY;
+	m_imageEmpty = cursor.bEmpty;
+
+	m_dirty = false;
+	updateCursorFeedback();
+
+	if ( !m_imageEmpty && cursor.pNestedCursorInfo && GetBackend()->GetNestedHints() )
+		GetBackend()->GetNestedHints()->SetCursorImage( cursor.pNestedCursorInfo );
+}
+
 bool MouseCursor::getTexture()
 {
 	if (!m_dirty) {
 		return !m_imageEmpty;
 	}
 
+	if ( m_ulPendingSerial )
+	{
+		CachedCursor_t *pCached = findCachedCursor( *m_ulPendingSerial );
+		m_ulPendingSerial = std::nullopt;
+
+		if ( pCached )
+		{
+			useCachedCursor( *pCached );
+			return !m_imageEmpty;
+		}
+	}
+
 	auto *image = XFixesGetCursorImage(m_ctx->dpy);
 
 	if (!image) {
 		return false;
 	}
+	defer( XFree( image ) );
+
+	if ( CachedCursor_t *pCached = findCachedCursor( image->cursor_serial ) )
+	{
+		useCachedCursor( *pCached );
+		return !m_imageEmpty;
+	}
 
 	m_hotspotX = image->xhot;
 	m_hotspotY = image->yhot;
@@ -1579,9 +1944,6 @@ bool MouseCursor::getTexture()
 
 	m_texture = nullptr;
 
-	// Assume the cursor is fully translucent unless proven otherwise.
-	bool bNoCursor = true;
-
 	std::vector<uint32_t> cursorBuffer;
 
 	int nContentWidth = image->width;
@@ -1589,30 +1951,20 @@ bool MouseCursor::getTexture()
 
 	if (image->width && image->height)
 	{
+		cursorBuffer = std::vector<uint32_t>(surfaceWidth * surfaceHeight);
+
+		// XFixes hands us pixels as unsigned longs, so this has to narrow
+		// rather than being a straight memcpy.
 		if ( nDesiredWidth < image->width || nDesiredHeight < image->height )
 		{
 			std::vector<uint32_t> pixels(image->width * image->height);
-			for (int i = 0; i < image->height; i++)
-			{
-				for (int j = 0; j < image->width; j++)
-				{
-					pixels[i * image->width + j] = image->pixels[i * image->width + j];
-				}
-			} 
-			std::vector<uint32_t> resizeBuffer( nDesiredWidth * nDesiredHeight );
+			std::copy_n( image->pixels, pixels.size(), pixels.begin() );
+
+			// Resize straight into the surface sized buffer.
 			stbir_resize_uint8_srgb( (unsigned char *)pixels.data(),       image->width,  image->height,  0,
-									 (unsigned char *)resizeBuffer.data(), nDesiredWidth, nDesiredHeight, 0,
+									 (unsigned char *)cursorBuffer.data(), nDesiredWidth, nDesiredHeight, surfaceWidth * sizeof( uint32_t ),
 									 4, 3, STBIR_FLAG_ALPHA_PREMULTIPLIED );
 
-			cursorBuffer = std::vector<uint32_t>(surfaceWidth * surfaceHeight);
-			for (int i = 0; i < nDesiredHeight; i++)
-			{
-				for (int j = 0; j < nDesiredWidth; j++)
-				{
-					cursorBuffer[i * surfaceWidth + j] = resizeBuffer[i * nDesiredWidth + j];
-				}
-			}
-
 			m_hotspotX = ( m_hotspotX * nDesiredWidth ) / image->width;
 			m_hotspotY = ( m_hotspotY * nDesiredHeight ) / image->height;
 
@@ -1621,28 +1973,15 @@ bool MouseCursor::getTexture()
 		}
 		else
 		{
-			cursorBuffer = std::vector<uint32_t>(surfaceWidth * surfaceHeight);
 			for (int i = 0; i < image->height; i++)
 			{
-				for (int j = 0; j < image->width; j++)
-				{
-					cursorBuffer[i * surfaceWidth + j] = image->pixels[i * image->width + j];
-				}
+				std::copy_n( &image->pixels[i * image->width], image->width, &cursorBuffer[i * surfaceWidth] );
 			}
 		}
 	}
 
-	for (uint32_t i = 0; i < surfaceHeight; i++)
-	{
-		for (uint32_t j = 0; j < surfaceWidth; j++)
-		{
-			if ( cursorBuffer[i * surfaceWidth + j] & 0xff000000 )
-			{
-				bNoCursor = false;
-				break;
-			}
-		}
-	}
+	// Assume the cursor is fully translucent unless proven otherwise.
+	bool bNoCursor = std::none_of( cursorBuffer.begin(), cursorBuffer.end(), []( uint32_t uPixel ) { return uPixel & 0xff000000; } );
 
 	if (bNoCursor)
 		cursorBuffer.clear();
@@ -1652,38 +1991,51 @@ bool MouseCursor::getTexture()
 	m_dirty = false;
 	updateCursorFeedback();
 
-	if (m_imageEmpty) {
-
-		return false;
-	}
-
-	CVulkanTexture::createFlags texCreateFlags;
-	texCreateFlags.bFlippable = true;
-	if ( GetBackend()->SupportsPlaneHardwareCursor() )
+	CachedCursor_t newCursor =
 	{
-		texCreateFlags.bLinear = true; // cursor buffer needs to be linear
-		// TODO: choose format & modifiers from cursor plane
-	}
+		.ulSerial       = image->cursor_serial,
+		.nScaleHeight   = g_nCursorScaleHeight,
+		.uOutputHeight  = g_nOutputHeight,
+		.nHotspotX      = m_hotspotX,
+		.nHotspotY      = m_hotspotY,
+		.bEmpty         = m_imageEmpty,
+	};
 
-	m_texture = vulkan_create_texture_from_bits(surfaceWidth, surfaceHeight, nContentWidth, nContentHeight, DRM_FORMAT_ARGB8888, texCreateFlags, cursorBuffer.data());
-	if ( GetBackend()->GetNestedHints() )
+	if ( !m_imageEmpty )
 	{
-		auto info = std::make_shared<gamescope::INestedHints::CursorInfo>(
-			gamescope::INestedHints::CursorInfo
-			{
-				.pPixels   = std::move( cursorBuffer ),
-				.uWidth    = (uint32_t) nDesiredWidth,
-				.uHeight   = (uint32_t) nDesiredHeight,
-				.uXHotspot = image->xhot,
-				.uYHotspot = image->yhot,
-			});
-		GetBackend()->GetNestedHints()->SetCursorImage( std::move( info ) );
+		CVulkanTexture::createFlags texCreateFlags;
+		texCreateFlags.bFlippable = true;
+		if ( GetBackend()->SupportsPlaneHardwareCursor() )
+		{
+			texCreateFlags.bLinear = true; // cursor buffer needs to be linear
+			// TODO: choose format & modifiers from cursor plane
+		}
+
+		m_texture = vulkan_create_texture_from_bits(surfaceWidth, surfaceHeight, nContentWidth, nContentHeight, DRM_FORMAT_ARGB8888, texCreateFlags, cursorBuffer.data());
+		assert(m_texture);
+		newCursor.pTexture = m_texture;
+
+		if ( GetBackend()->GetNestedHints() )
+		{
+			auto info = std::make_shared<gamescope::INestedHints::CursorInfo>(
+				gamescope::INestedHints::CursorInfo
+				{
+					.pPixels   = std::move( cursorBuffer ),
+					.uWidth    = (uint32_t) nDesiredWidth,
+					.uHeight   = (uint32_t) nDesiredHeight,
+					.uXHotspot = image->xhot,
+					.uYHotspot = image->yhot,
+				});
+			newCursor.pNestedCursorInfo = info;
+			GetBackend()->GetNestedHints()->SetCursorImage( std::move( info ) );
+		}
 	}
 
-	assert(m_texture);
-	XFree(image);
+	if ( m_CursorCache.size() >= k_zCursorCacheSize )
+		m_CursorCache.pop_back();
+	m_CursorCache.insert( m_CursorCache.begin(), std::move( newCursor ) );
 
-	return true;
+	return !m_imageEmpty;
 }
 
 void MouseCursor::GetDesiredSize( int& nWidth, int &nHeight )
@@ -1828,6 +2180,7 @@ paint_cached_base_layer(const gamescope::Rc<commit_t>& commit, const BaseLayerIn
 	if (layer->colorspace == GAMESCOPE_APP_TEXTURE_COLORSPACE_SCRGB)
 		layer->ctm = s_scRGB709To2020Matrix;
 	layer->tex = commit->vulkanTex;
+	layer->commitID = commit->commitID;
 
 	layer->filter = base.filter;
 	layer->blackBorder = true;
@@ -2026,6 +2379,7 @@ paint_window(steamcompmgr_win_t *w, steamcompmgr_win_t *scaleW, struct FrameInfo
 	}
 
 	layer->tex = lastCommit->vulkanTex;
+	layer->commitID = lastCommit->commitID;
 
 	layer->filter = ( flags & PaintWindowFlag::NoFilter ) ? GamescopeUpscaleFilter::LINEAR : g_upscaleFilter;
 	layer->colorspace = lastCommit->colorspace();
@@ -2061,6 +2415,7 @@ paint_window(steamcompmgr_win_t *w, steamcompmgr_win_t *scaleW, struct FrameInfo
 			g_CachedPlanes[ HELD_COMMIT_FADE ] = basePlane;
 
 		g_uCurrentBasePlaneCommitID = lastCommit->commitID;
+		g_ulCurrentBasePlaneReadyTime = lastCommit->ready_time;
 		g_bCurrentBasePlaneIsFifo = lastCommit->IsPerfOverlayFIFO();
 	}
 }
@@ -2178,6 +2533,16 @@ static void paint_pipewire()
 
 	g_uCompositeDebug = uCompositeDebugBackup;
 
+	// If the PipeWire side imported its shared memory, have the GPU write the frame
+	// straight into it rather than copying it out of the texture on the CPU.
+	// If the size is stale, the buffer gets marked corrupted anyway, so don't bother.
+	if ( oPipewireSequence && s_pPipewireBuffer->shm.host_buffer &&
+		 s_pPipewireBuffer->video_info.size.width == s_pPipewireBuffer->texture->width() &&
+		 s_pPipewireBuffer->video_info.size.height == s_pPipewireBuffer->texture->height() )
+	{
+		oPipewireSequence = vulkan_copy_to_host_buffer( s_pPipewireBuffer->texture, s_pPipewireBuffer->shm.host_buffer.get(), s_pPipewireBuffer->shm.stride );
+	}
+
 	if ( oPipewireSequence )
 	{
 		vulkan_wait( *oPipewireSequence, true );
@@ -2200,18 +2565,104 @@ bool ShouldDrawCursor()
 	return g_bForceRelativeMouse || !GetBackend()->GetNestedHints();
 }
 
+static gamescope::FrameTimingHeader_t *g_pFrameTiming = nullptr;
+
 static void
-paint_all(bool async)
+init_frame_timing()
 {
-	gamescope_xwayland_server_t *root_server = wlserver_get_xwayland_server(0);
-	xwayland_ctx_t *root_ctx = root_server->ctx.get();
+	const char *path = getenv( "GAMESCOPE_FRAME_TIMING_FILE" );
+	if ( !path || !*path )
+		return;
 
-	static long long int paintID = 0;
+	int fd = open( path, O_CREAT | O_RDWR | O_CLOEXEC, 0644 );
+	if ( fd < 0 )
+	{
+		xwm_log.errorf_errno( "Failed to open frame timing file %s", path );
+		return;
+	}
+	defer( close( fd ) );
 
-	update_color_mgmt();
+	// Truncate first so any records from a previous run are zeroed.
+	if ( ftruncate( fd, 0 ) != 0 || ftruncate( fd, gamescope::k_zFrameTimingFileSize ) != 0 )
+	{
+		xwm_log.errorf_errno( "Failed to size frame timing file %s", path );
+		return;
+	}
 
-	paintID++;
-	gpuvis_trace_begin_ctx_printf( paintID, "paint_all" );
+	void *pMapping = mmap( nullptr, gamescope::k_zFrameTimingFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( pMapping == MAP_FAILED )
+	{
+		xwm_log.errorf_errno( "Failed to map frame timing file %s", path );
+		return;
+	}
+
+	g_pFrameTiming = reinterpret_cast<gamescope::FrameTimingHeader_t *>( pMapping );
+	g_pFrameTiming->uVersion = gamescope::k_uFrameTimingVersion;
+	g_pFrameTiming->uHeaderSize = gamescope::k_zFrameTimingHeaderSize;
+	g_pFrameTiming->uRecordSize = sizeof( gamescope::FrameTimingRecord_t );
+	g_pFrameTiming->uRecordCount = gamescope::k_uFrameTimingRecordCount;
+	g_pFrameTiming->ulWriteCount.store( 0, std::memory_order_relaxed );
+	g_pFrameTiming->uMagic.store( gamescope::k_uFrameTimingMagic, std::memory_order_release );
+}
+
+static void
+write_frame_timing( const struct FrameInfo_t *frameInfo, bool async )
+{
+	if ( !g_pFrameTiming )
+		return;
+
+	static uint64_t s_ulLastBaseCommitID = 0;
+
+	const uint64_t ulFrame = g_pFrameTiming->ulWriteCount.load( std::memory_order_relaxed );
+	gamescope::FrameTimingRecord_t &record = gamescope::GetFrameTimingRecords( g_pFrameTiming )[ ulFrame % gamescope::k_uFrameTimingRecordCount ];
+
+	// Seqlock: odd while we are writing.
+	const uint64_t ulSequence = record.ulSequence.load( std::memory_order_relaxed );
+	record.ulSequence.store( ulSequence + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	const uint64_t ulPresentTime = get_time_in_nanos();
+
+	uint32_t uFlags = 0;
+	if ( GetVBlankTimer().WasCompositing() )
+		uFlags |= gamescope::FRAME_TIMING_FLAG_COMPOSITED;
+	if ( async )
+		uFlags |= gamescope::FRAME_TIMING_FLAG_ASYNC;
+	if ( g_uCurrentBasePlaneCommitID != s_ulLastBaseCommitID )
+		uFlags |= gamescope::FRAME_TIMING_FLAG_NEW_COMMIT;
+	if ( g_bCurrentBasePlaneIsFifo )
+		uFlags |= gamescope::FRAME_TIMING_FLAG_FIFO;
+	s_ulLastBaseCommitID = g_uCurrentBasePlaneCommitID;
+
+	record.ulFrame = ulFrame;
+	record.ulTargetVBlank = g_SteamCompMgrVBlankTime.schedule.ulTargetVBlank;
+	record.ulWakeupTime = g_SteamCompMgrVBlankTime.ulWakeupTime;
+	record.ulPresentTime = ulPresentTime;
+	record.ulDrawTime = GetVBlankTimer().GetLastDrawTime();
+	record.ulBaseCommitID = g_uCurrentBasePlaneCommitID;
+	record.ulBaseCommitReadyTime = g_ulCurrentBasePlaneReadyTime;
+	record.ulPresentLatency = g_ulCurrentBasePlaneReadyTime && g_ulCurrentBasePlaneReadyTime <= ulPresentTime
+		? ulPresentTime - g_ulCurrentBasePlaneReadyTime
+		: 0;
+	record.uLayerCount = frameInfo->layerCount;
+	record.uFlags = uFlags;
+
+	record.ulSequence.store( ulSequence + 2, std::memory_order_release );
+	g_pFrameTiming->ulWriteCount.store( ulFrame + 1, std::memory_order_release );
+}
+
+static void
+paint_all(bool async)
+{
+	gamescope_xwayland_server_t *root_server = wlserver_get_xwayland_server(0);
+	xwayland_ctx_t *root_ctx = root_server->ctx.get();
+
+	static long long int paintID = 0;
+
+	update_color_mgmt();
+
+	paintID++;
+	gpuvis_trace_begin_ctx_printf( paintID, "paint_all" );
 	steamcompmgr_win_t	*w;
 	steamcompmgr_win_t	*overlay;
 	steamcompmgr_win_t *externalOverlay;
@@ -2520,6 +2971,8 @@ paint_all(bool async)
 		return;
 	}
 
+	write_frame_timing( &frameInfo, async );
+
 	std::optional<gamescope::GamescopeScreenshotInfo> oScreenshotInfo =
 		gamescope::CScreenshotManager::Get().ProcessPendingScreenshot();
 
@@ -2618,6 +3071,24 @@ paint_all(bool async)
 				return;
 			}
 
+			// AVIF has always been encoded at the full output size,
+			// PNG at the current output size.
+			const bool bAVIFScreenshot = drmCaptureFormat == DRM_FORMAT_XRGB2101010;
+			const uint32_t uScreenshotWidth = bAVIFScreenshot ? g_nOutputWidth : currentOutputWidth;
+			const uint32_t uScreenshotHeight = bAVIFScreenshot ? g_nOutputHeight : currentOutputHeight;
+
+			// Have the GPU write out exactly what the encoder takes, so all that's
+			// left on the CPU is compressing it. If we can't get a texture for that,
+			// the encoders still know how to convert the raw capture themselves.
+			gamescope::Rc<CVulkanTexture> pPackTexture;
+			if ( drmCaptureFormat != DRM_FORMAT_NV12 )
+			{
+				const EScreenshotPackLayout ePackLayout = bAVIFScreenshot ? k_EScreenshotPackLayout_GBR16_Planar : k_EScreenshotPackLayout_RGB8;
+				pPackTexture = vulkan_acquire_screenshot_pack_texture( uScreenshotWidth, uScreenshotHeight, ePackLayout );
+				if ( pPackTexture )
+					oScreenshotSeq = vulkan_pack_screenshot( pScreenshotTexture, uScreenshotWidth, uScreenshotHeight, pPackTexture, ePackLayout );
+			}
+
 			vulkan_wait( *oScreenshotSeq, false );
 
 			uint16_t maxCLLNits = 0;
@@ -2659,28 +3130,11 @@ paint_all(bool async)
 
 				if ( pScreenshotTexture->format() == VK_FORMAT_A2R10G10B10_UNORM_PACK32 )
 				{
-					// Make our own copy of the image to remove the alpha channel.
-					constexpr uint32_t kCompCnt = 3;
-					auto imageData = std::vector<uint16_t>( g_nOutputWidth * g_nOutputHeight * kCompCnt );
-
-					for (uint32_t y = 0; y < g_nOutputHeight; y++)
-					{
-						for (uint32_t x = 0; x < g_nOutputWidth; x++)
-						{
-							uint32_t *pInPixel = (uint32_t *)&mappedData[(y * pScreenshotTexture->rowPitch()) + x * (32 / 8)];
-							uint32_t uInPixel = *pInPixel;
-
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 0] = (uInPixel & (0b1111111111 << 20)) >> 20;
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 1] = (uInPixel & (0b1111111111 << 10)) >> 10;
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 2] = (uInPixel & (0b1111111111 << 0))  >> 0;
-						}
-					}
-
 					assert( HAVE_AVIF );
 #if HAVE_AVIF
 					avifResult avifResult = AVIF_RESULT_OK;
 
-					avifImage *pAvifImage = avifImageCreate( g_nOutputWidth, g_nOutputHeight, 10, AVIF_PIXEL_FORMAT_YUV444 );
+					avifImage *pAvifImage = avifImageCreate( uScreenshotWidth, uScreenshotHeight, 10, AVIF_PIXEL_FORMAT_YUV444 );
 					defer( avifImageDestroy( pAvifImage ) );
 					pAvifImage->yuvRange = AVIF_RANGE_FULL;
 					pAvifImage->colorPrimaries = bHDRScreenshot ? AVIF_COLOR_PRIMARIES_BT2020 : AVIF_COLOR_PRIMARIES_BT709;
@@ -2704,18 +3158,44 @@ paint_all(bool async)
 						pAvifImage->clli.maxPALL = maxFALLNits;
 					}
 
-					avifRGBImage rgbAvifImage{};
-					avifRGBImageSetDefaults( &rgbAvifImage, pAvifImage );
-					rgbAvifImage.format = AVIF_RGB_FORMAT_RGB;
-					rgbAvifImage.ignoreAlpha = AVIF_TRUE;
+					// With identity matrix coefficients, Y, U and V are just G, B and R.
+					if ( pPackTexture )
+					{
+						// The GPU already wrote out the G, B and R planes,
+						// so just point the image at them.
+						uint8_t *pPlanes = pPackTexture->mappedData();
+						const size_t zPlaneSize = size_t( pPackTexture->rowPitch() ) * uScreenshotHeight;
 
-					rgbAvifImage.pixels = (uint8_t *)imageData.data();
-					rgbAvifImage.rowBytes = g_nOutputWidth * kCompCnt * sizeof( uint16_t );
+						static constexpr int k_nPackedChannels[] = { AVIF_CHAN_Y, AVIF_CHAN_U, AVIF_CHAN_V };
 
-					if ( ( avifResult = avifImageRGBToYUV( pAvifImage, &rgbAvifImage ) ) != AVIF_RESULT_OK ) // Not really! See Matrix Coefficients IDENTITY above.
+						pAvifImage->imageOwnsYUVPlanes = AVIF_FALSE;
+						for ( size_t i = 0; i < std::size( k_nPackedChannels ); i++ )
+						{
+							pAvifImage->yuvPlanes[ k_nPackedChannels[ i ] ] = pPlanes + i * zPlaneSize;
+							pAvifImage->yuvRowBytes[ k_nPackedChannels[ i ] ] = pPackTexture->rowPitch();
+						}
+					}
+					else
 					{
-						xwm_log.errorf( "Failed to convert RGB to YUV: %u", avifResult );
-						return;
+						if ( ( avifResult = avifImageAllocatePlanes( pAvifImage, AVIF_PLANES_YUV ) ) != AVIF_RESULT_OK )
+						{
+							xwm_log.errorf( "Failed to allocate avif planes: %u", avifResult );
+							return;
+						}
+
+						// Split the mapped image straight into the planes rather than
+						// going through an RGB copy of the image and avifImageRGBToYUV.
+						gamescope::SplitScreenshotA2R10G10B10(
+							gamescope::ScreenshotImage_t
+							{
+								.pData     = mappedData,
+								.uWidth    = uScreenshotWidth,
+								.uHeight   = uScreenshotHeight,
+								.uRowPitch = pScreenshotTexture->rowPitch(),
+							},
+							(uint16_t *)pAvifImage->yuvPlanes[ AVIF_CHAN_V ], pAvifImage->yuvRowBytes[ AVIF_CHAN_V ],
+							(uint16_t *)pAvifImage->yuvPlanes[ AVIF_CHAN_Y ], pAvifImage->yuvRowBytes[ AVIF_CHAN_Y ],
+							(uint16_t *)pAvifImage->yuvPlanes[ AVIF_CHAN_U ], pAvifImage->yuvRowBytes[ AVIF_CHAN_U ] );
 					}
 
 					avifEncoder *pEncoder = avifEncoderCreate();
@@ -2723,6 +3203,7 @@ paint_all(bool async)
 					pEncoder->quality = AVIF_QUALITY_LOSSLESS;
 					pEncoder->qualityAlpha = AVIF_QUALITY_LOSSLESS;
 					pEncoder->speed = AVIF_SPEED_FASTEST;
+					pEncoder->maxThreads = gamescope::GetScreenshotThreadCount();
 
 					if ( ( avifResult = avifEncoderAddImage( pEncoder, pAvifImage, 1, AVIF_ADD_IMAGE_FLAG_SINGLE ) ) != AVIF_RESULT_OK )
 					{
@@ -2754,22 +3235,22 @@ paint_all(bool async)
 				}
 				else if (pScreenshotTexture->format() == VK_FORMAT_B8G8R8A8_UNORM)
 				{
-					// Make our own copy of the image to remove the alpha channel.
-					auto imageData = std::vector<uint8_t>(currentOutputWidth * currentOutputHeight * 4);
-					const uint32_t comp = 4;
-					const uint32_t pitch = currentOutputWidth * comp;
-					for (uint32_t y = 0; y < currentOutputHeight; y++)
+					gamescope::ScreenshotImage_t image =
 					{
-						for (uint32_t x = 0; x < currentOutputWidth; x++)
-						{
-							// BGR...
-							imageData[y * pitch + x * comp + 0] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 2];
-							imageData[y * pitch + x * comp + 1] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 1];
-							imageData[y * pitch + x * comp + 2] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 0];
-							imageData[y * pitch + x * comp + 3] = 255;
-						}
+						.pData     = mappedData,
+						.uWidth    = uScreenshotWidth,
+						.uHeight   = uScreenshotHeight,
+						.uRowPitch = pScreenshotTexture->rowPitch(),
+					};
+
+					if ( pPackTexture )
+					{
+						image.pData     = pPackTexture->mappedData();
+						image.uRowPitch = pPackTexture->rowPitch();
+						image.eFormat   = gamescope::k_EScreenshotPixelFormat_R8G8B8;
 					}
-					if ( stbi_write_png( oScreenshotInfo->szScreenshotPath.c_str(), currentOutputWidth, currentOutputHeight, 4, imageData.data(), pitch ) )
+
+					if ( gamescope::WriteScreenshotPNG( oScreenshotInfo->szScreenshotPath.c_str(), image ) )
 					{
 						xwm_log.infof( "Screenshot saved to %s", oScreenshotInfo->szScreenshotPath.c_str() );
 						bScreenshotSuccess = true;
@@ -2912,6 +3393,349 @@ std::string get_string_prop( xwayland_ctx_t *ctx, Window win, Atom prop )
 	return value;
 }
 
+// Fetches a window's attributes, properties and owner PID over XCB.
+//
+// Xlib waits for each reply before sending the next request, so looking
+// over a new window one property at a time costs a round trip to Xwayland
+// apiece. Here requests are sent as soon as they are made and replies are
+// only waited on when read, so requesting everything up front costs about
+// one round trip for the lot.
+//
+// Reading something that wasn't requested sends it there and then,
+// and replies that are never read are discarded along with the batch.
+// The getters match the Xlib calls they replace.
+class CXPropertyBatch
+{
+public:
+	CXPropertyBatch( xwayland_ctx_t *ctx, Window window )
+		: m_ctx( ctx )
+		, m_pConnection( XGetXCBConnection( ctx->dpy ) )
+		, m_window( window )
+	{
+	}
+
+	~CXPropertyBatch()
+	{
+		for ( PropertyRequest_t &request : m_PropertyRequests )
+			Discard( request );
+		Discard( m_AttributesRequest );
+		Discard( m_GeometryRequest );
+		Discard( m_PidRequest );
+	}
+
+	CXPropertyBatch( const CXPropertyBatch & ) = delete;
+	CXPropertyBatch &operator=( const CXPropertyBatch & ) = delete;
+
+	Window GetWindow() const { return m_window; }
+
+	// get_prop
+	void RequestCardinal( Atom atom ) { RequestProperty( atom, XA_CARDINAL, 1 ); }
+	uint32_t GetCardinal( Atom atom, uint32_t uDefault )
+	{
+		const xcb_get_property_reply_t *pReply = GetProperty( atom, XA_CARDINAL, 1 );
+		if ( !pReply || pReply->format != 32 || pReply->value_len < 1 )
+			return uDefault;
+
+		return *(const uint32_t *)xcb_get_property_value( pReply );
+	}
+
+	// Vectored get_prop
+	void RequestCardinals( Atom atom ) { RequestProperty( atom, XA_CARDINAL, ~0u ); }
+	bool GetCardinals( Atom atom, std::vector<uint32_t> &vecResult )
+	{
+		vecResult.clear();
+
+		const xcb_get_property_reply_t *pReply = GetProperty( atom, XA_CARDINAL, ~0u );
+		if ( !pReply || pReply->type == XCB_NONE )
+			return false;
+
+		if ( pReply->format == 32 )
+		{
+			const uint32_t *pValues = (const uint32_t *)xcb_get_property_value( pReply );
+			vecResult.assign( pValues, pValues + pReply->value_len );
+		}
+		return true;
+	}
+
+	// XGetWindowProperty of a list of atoms, eg. _NET_WM_STATE
+	void RequestAtoms( Atom atom ) { RequestProperty( atom, AnyPropertyType, k_uAtomListLength ); }
+	void GetAtoms( Atom atom, std::vector<Atom> &vecResult )
+	{
+		vecResult.clear();
+
+		const xcb_get_property_reply_t *pReply = GetProperty( atom, AnyPropertyType, k_uAtomListLength );
+		if ( !pReply || pReply->format != 32 )
+			return;
+
+		const uint32_t *pValues = (const uint32_t *)xcb_get_property_value( pReply );
+		vecResult.assign( pValues, pValues + pReply->value_len );
+	}
+
+	// XGetTextProperty
+	// The encoding is the reply's type, the text its value.
+	void RequestText( Atom atom ) { RequestProperty( atom, AnyPropertyType, k_uTextLength ); }
+	const xcb_get_property_reply_t *GetText( Atom atom ) { return GetProperty( atom, AnyPropertyType, k_uTextLength ); }
+
+	// XGetTransientForHint
+	void RequestTransientFor() { RequestProperty( XA_WM_TRANSIENT_FOR, XA_WINDOW, 1 ); }
+	Window GetTransientFor()
+	{
+		const xcb_get_property_reply_t *pReply = GetProperty( XA_WM_TRANSIENT_FOR, XA_WINDOW, 1 );
+		if ( !pReply || pReply->type != XA_WINDOW || pReply->format != 32 || pReply->value_len < 1 )
+			return None;
+
+		return *(const uint32_t *)xcb_get_property_value( pReply );
+	}
+
+	// XGetWMNormalHints
+	void RequestSizeHints() { RequestProperty( XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, k_uSizeHintsLength ); }
+	bool GetSizeHints( XSizeHints *pHints, long *pSupplied )
+	{
+		const xcb_get_property_reply_t *pReply = GetProperty( XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, k_uSizeHintsLength );
+		if ( !pReply || pReply->type != XA_WM_SIZE_HINTS || pReply->format != 32 || pReply->value_len < k_uOldSizeHintsLength )
+			return false;
+
+		const int32_t *pValues = (const int32_t *)xcb_get_property_value( pReply );
+		const long lFlags = (uint32_t)pValues[ 0 ];
+
+		*pHints = XSizeHints{};
+		pHints->flags = lFlags & ( USPosition | USSize | PAllHints );
+		pHints->x = pValues[ 1 ];
+		pHints->y = pValues[ 2 ];
+		pHints->width = pValues[ 3 ];
+		pHints->height = pValues[ 4 ];
+		pHints->min_width = pValues[ 5 ];
+		pHints->min_height = pValues[ 6 ];
+		pHints->max_width = pValues[ 7 ];
+		pHints->max_height = pValues[ 8 ];
+		pHints->width_inc = pValues[ 9 ];
+		pHints->height_inc = pValues[ 10 ];
+		pHints->min_aspect.x = pValues[ 11 ];
+		pHints->min_aspect.y = pValues[ 12 ];
+		pHints->max_aspect.x = pValues[ 13 ];
+		pHints->max_aspect.y = pValues[ 14 ];
+		*pSupplied = USPosition | USSize | PAllHints;
+
+		// Old clients don't send the base size and gravity.
+		if ( pReply->value_len >= k_uSizeHintsLength )
+		{
+			pHints->flags |= lFlags & ( PBaseSize | PWinGravity );
+			pHints->base_width = pValues[ 15 ];
+			pHints->base_height = pValues[ 16 ];
+			pHints->win_gravity = pValues[ 17 ];
+			*pSupplied |= PBaseSize | PWinGravity;
+		}
+		return true;
+	}
+
+	// XGetWMHints
+	void RequestWMHints() { RequestProperty( XA_WM_HINTS, XA_WM_HINTS, k_uWMHintsLength ); }
+	bool GetWMHints( XWMHints *pHints )
+	{
+		const xcb_get_property_reply_t *pReply = GetProperty( XA_WM_HINTS, XA_WM_HINTS, k_uWMHintsLength );
+		if ( !pReply || pReply->type != XA_WM_HINTS || pReply->format != 32 || pReply->value_len < k_uWMHintsLength - 1 )
+			return false;
+
+		const int32_t *pValues = (const int32_t *)xcb_get_property_value( pReply );
+
+		*pHints = XWMHints{};
+		pHints->flags = (uint32_t)pValues[ 0 ];
+		pHints->input = pValues[ 1 ] ? True : False;
+		pHints->initial_state = pValues[ 2 ];
+		pHints->icon_pixmap = (uint32_t)pValues[ 3 ];
+		pHints->icon_window = (uint32_t)pValues[ 4 ];
+		pHints->icon_x = pValues[ 5 ];
+		pHints->icon_y = pValues[ 6 ];
+		pHints->icon_mask = (uint32_t)pValues[ 7 ];
+		if ( pReply->value_len >= k_uWMHintsLength )
+			pHints->window_group = (uint32_t)pValues[ 8 ];
+		return true;
+	}
+
+	// XGetWindowAttributes
+	void RequestAttributes()
+	{
+		if ( !m_AttributesRequest.bSent )
+		{
+			m_AttributesRequest.cookie = xcb_get_window_attributes( m_pConnection, m_window );
+			m_AttributesRequest.bSent = true;
+		}
+
+		if ( !m_GeometryRequest.bSent )
+		{
+			m_GeometryRequest.cookie = xcb_get_geometry( m_pConnection, m_window );
+			m_GeometryRequest.bSent = true;
+		}
+	}
+	bool GetAttributes( XWindowAttributes *pAttributes )
+	{
+		RequestAttributes();
+
+		const xcb_get_window_attributes_reply_t *pReply = Wait( m_AttributesRequest, xcb_get_window_attributes_reply );
+		const xcb_get_geometry_reply_t *pGeometry = Wait( m_GeometryRequest, xcb_get_geometry_reply );
+		if ( !pReply || !pGeometry )
+			return false;
+
+		*pAttributes = XWindowAttributes{};
+		pAttributes->x = pGeometry->x;
+		pAttributes->y = pGeometry->y;
+		pAttributes->width = pGeometry->width;
+		pAttributes->height = pGeometry->height;
+		pAttributes->border_width = pGeometry->border_width;
+		pAttributes->depth = pGeometry->depth;
+		pAttributes->root = pGeometry->root;
+		pAttributes->c_class = pReply->_class;
+		pAttributes->bit_gravity = pReply->bit_gravity;
+		pAttributes->win_gravity = pReply->win_gravity;
+		pAttributes->backing_store = pReply->backing_store;
+		pAttributes->backing_planes = pReply->backing_planes;
+		pAttributes->backing_pixel = pReply->backing_pixel;
+		pAttributes->save_under = pReply->save_under;
+		pAttributes->colormap = pReply->colormap;
+		pAttributes->map_installed = pReply->map_is_installed;
+		pAttributes->map_state = pReply->map_state;
+		pAttributes->all_event_masks = pReply->all_event_masks;
+		pAttributes->your_event_mask = pReply->your_event_mask;
+		pAttributes->do_not_propagate_mask = pReply->do_not_propagate_mask;
+		pAttributes->override_redirect = pReply->override_redirect;
+
+		for ( int i = 0; i < ScreenCount( m_ctx->dpy ); i++ )
+		{
+			Screen *pScreen = ScreenOfDisplay( m_ctx->dpy, i );
+			if ( RootWindowOfScreen( pScreen ) == pAttributes->root )
+				pAttributes->screen = pScreen;
+
+			for ( int j = 0; j < pScreen->ndepths; j++ )
+			{
+				const Depth &depth = pScreen->depths[ j ];
+				for ( int k = 0; k < depth.nvisuals; k++ )
+				{
+					if ( depth.visuals[ k ].visualid == pReply->visual )
+						pAttributes->visual = &depth.visuals[ k ];
+				}
+			}
+		}
+		return true;
+	}
+
+	// XResQueryClientIds
+	void RequestPid()
+	{
+		if ( m_PidRequest.bSent )
+			return;
+
+		xcb_res_client_id_spec_t spec =
+		{
+			.client = uint32_t( m_window ),
+			.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID,
+		};
+		m_PidRequest.cookie = xcb_res_query_client_ids( m_pConnection, 1, &spec );
+		m_PidRequest.bSent = true;
+	}
+	pid_t GetPid()
+	{
+		RequestPid();
+
+		pid_t pid = -1;
+		if ( const xcb_res_query_client_ids_reply_t *pReply = Wait( m_PidRequest, xcb_res_query_client_ids_reply ) )
+		{
+			xcb_res_client_id_value_iterator_t iter = xcb_res_query_client_ids_ids_iterator( pReply );
+			for ( ; iter.rem; xcb_res_client_id_value_next( &iter ) )
+			{
+				if ( ( iter.data->spec.mask & XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID ) && iter.data->length == sizeof( uint32_t ) )
+				{
+					pid = *xcb_res_client_id_value_value( iter.data );
+					if ( pid > 0 )
+						break;
+				}
+			}
+		}
+
+		if ( pid <= 0 )
+			xwm_log.errorf( "Failed to find PID for window 0x%lx", m_window );
+		return pid;
+	}
+
+private:
+	// Long lengths match what Xlib asks for.
+	static constexpr uint32_t k_uAtomListLength = 2048;
+	static constexpr uint32_t k_uTextLength = 1'000'000;
+	static constexpr uint32_t k_uSizeHintsLength = 18;
+	static constexpr uint32_t k_uOldSizeHintsLength = 15;
+	static constexpr uint32_t k_uWMHintsLength = 9;
+
+	template <typename Cookie, typename Reply>
+	struct Request_t
+	{
+		Cookie cookie{};
+		Reply *pReply = nullptr;
+		bool bSent = false;
+		bool bWaited = false;
+	};
+
+	struct PropertyRequest_t : Request_t<xcb_get_property_cookie_t, xcb_get_property_reply_t>
+	{
+		Atom atom = None;
+	};
+
+	void RequestProperty( Atom atom, Atom type, uint32_t uLength )
+	{
+		FindOrRequestProperty( atom, type, uLength );
+	}
+
+	const xcb_get_property_reply_t *GetProperty( Atom atom, Atom type, uint32_t uLength )
+	{
+		return Wait( FindOrRequestProperty( atom, type, uLength ), xcb_get_property_reply );
+	}
+
+	PropertyRequest_t &FindOrRequestProperty( Atom atom, Atom type, uint32_t uLength )
+	{
+		for ( PropertyRequest_t &request : m_PropertyRequests )
+		{
+			if ( request.atom == atom )
+				return request;
+		}
+
+		PropertyRequest_t &request = m_PropertyRequests.emplace_back();
+		request.atom = atom;
+		request.cookie = xcb_get_property( m_pConnection, false, m_window, atom, type, 0, uLength );
+		request.bSent = true;
+		return request;
+	}
+
+	// Errors, eg. BadWindow if it has already gone away,
+	// come back as a null reply rather than through the Xlib error handler.
+	template <typename Cookie, typename Reply>
+	Reply *Wait( Request_t<Cookie, Reply> &request, Reply *(*pfnReply)( xcb_connection_t *, Cookie, xcb_generic_error_t ** ) )
+	{
+		if ( !request.bWaited )
+		{
+			xcb_generic_error_t *pError = nullptr;
+			request.pReply = pfnReply( m_pConnection, request.cookie, &pError );
+			request.bWaited = true;
+			free( pError );
+		}
+		return request.pReply;
+	}
+
+	template <typename Cookie, typename Reply>
+	void Discard( Request_t<Cookie, Reply> &request )
+	{
+		if ( request.bSent && !request.bWaited )
+			xcb_discard_reply( m_pConnection, request.cookie.sequence );
+		free( request.pReply );
+	}
+
+	xwayland_ctx_t *m_ctx;
+	xcb_connection_t *m_pConnection;
+	Window m_window;
+
+	std::vector<PropertyRequest_t> m_PropertyRequests;
+	Request_t<xcb_get_window_attributes_cookie_t, xcb_get_window_attributes_reply_t> m_AttributesRequest;
+	Request_t<xcb_get_geometry_cookie_t, xcb_get_geometry_reply_t> m_GeometryRequest;
+	Request_t<xcb_res_query_client_ids_cookie_t, xcb_res_query_client_ids_reply_t> m_PidRequest;
+};
+
 static bool
 win_has_game_id( steamcompmgr_win_t *w )
 {
@@ -3906,12 +4730,12 @@ determine_and_apply_focus()
 }
 
 static void
-get_win_type(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
+get_win_type(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, CXPropertyBatch &batch)
 {
 	w->is_dialog = !!w->xwayland().transientFor;
 
-	std::vector<unsigned int> atoms;
-	if ( get_prop( ctx, w->xwayland().id, ctx->atoms.winTypeAtom, atoms ) )
+	std::vector<uint32_t> atoms;
+	if ( batch.GetCardinals( ctx->atoms.winTypeAtom, atoms ) )
 	{
 		for ( unsigned int atom : atoms )
 		{
@@ -3928,12 +4752,19 @@ get_win_type(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 }
 
 static void
-get_size_hints(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
+get_win_type(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
+{
+	CXPropertyBatch batch( ctx, w->xwayland().id );
+	get_win_type( ctx, w, batch );
+}
+
+static void
+get_size_hints(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, CXPropertyBatch &batch)
 {
 	XSizeHints hints;
 	long hintsSpecified = 0;
 
-	XGetWMNormalHints(ctx->dpy, w->xwayland().id, &hints, &hintsSpecified);
+	batch.GetSizeHints(&hints, &hintsSpecified);
 
 	const bool bHasPositionAndGravityHints = ( hintsSpecified & ( PPosition | PWinGravity ) ) == ( PPosition | PWinGravity );
 	if ( bHasPositionAndGravityHints &&
@@ -4000,19 +4831,25 @@ get_size_hints(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 }
 
 static void
-get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
+get_size_hints(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
+{
+	CXPropertyBatch batch( ctx, w->xwayland().id );
+	get_size_hints( ctx, w, batch );
+}
+
+static void
+get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom, CXPropertyBatch &batch)
 {
 	assert(atom == XA_WM_NAME || atom == ctx->atoms.netWMNameAtom);
 
-	// Allocates a title we are meant to free,
-	// let's re-use this allocation for w->title :)
-	XTextProperty tp;
-	XGetTextProperty( ctx->dpy, w->xwayland().id, &tp, atom );
+	const xcb_get_property_reply_t *tp = batch.GetText( atom );
+	if (!tp)
+		return;
 
 	bool is_utf8;
-	if (tp.encoding == ctx->atoms.utf8StringAtom) {
+	if (tp->type == ctx->atoms.utf8StringAtom) {
 		is_utf8 = true;
-	} else if (tp.encoding == XA_STRING) {
+	} else if (tp->type == XA_STRING) {
 		is_utf8 = false;
 	} else {
 		return;
@@ -4025,9 +4862,9 @@ get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 		return;
 	}
 
-	if (tp.nitems > 0) {
-		// Ride off the allocation from XGetTextProperty.
-		w->title = std::make_shared<std::string>((const char *)tp.value);
+	if (tp->value_len > 0) {
+		const char *value = (const char *)xcb_get_property_value(tp);
+		w->title = std::make_shared<std::string>(value, strnlen(value, xcb_get_property_value_length(tp)));
 	} else {
 		w->title = NULL;
 	}
@@ -4035,39 +4872,43 @@ get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 }
 
 static void
-get_net_wm_state(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
+get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 {
-	Atom type;
-	int format;
-	unsigned long nitems;
-	unsigned long bytesAfter;
-	unsigned char *data;
-	if (XGetWindowProperty(ctx->dpy, w->xwayland().id, ctx->atoms.netWMStateAtom, 0, 2048, false,
-			AnyPropertyType, &type, &format, &nitems, &bytesAfter, &data) != Success) {
-		return;
-	}
+	CXPropertyBatch batch( ctx, w->xwayland().id );
+	get_win_title( ctx, w, atom, batch );
+}
 
-	Atom *props = (Atom *)data;
-	for (size_t i = 0; i < nitems; i++) {
-		if (props[i] == ctx->atoms.netWMStateFullscreenAtom) {
+static void
+get_net_wm_state(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, CXPropertyBatch &batch)
+{
+	std::vector<Atom> props;
+	batch.GetAtoms(ctx->atoms.netWMStateAtom, props);
+
+	for (Atom prop : props) {
+		if (prop == ctx->atoms.netWMStateFullscreenAtom) {
 			w->isFullscreen = true;
-		} else if (props[i] == ctx->atoms.netWMStateSkipTaskbarAtom) {
+		} else if (prop == ctx->atoms.netWMStateSkipTaskbarAtom) {
 			w->skipTaskbar = true;
-		} else if (props[i] == ctx->atoms.netWMStateSkipPagerAtom) {
+		} else if (prop == ctx->atoms.netWMStateSkipPagerAtom) {
 			w->skipPager = true;
 		} else {
-			xwm_log.debugf("Unhandled initial NET_WM_STATE property: %s", XGetAtomName(ctx->dpy, props[i]));
+			xwm_log.debugf("Unhandled initial NET_WM_STATE property: %s", XGetAtomName(ctx->dpy, prop));
 		}
 	}
+}
 
-	XFree(data);
+static void
+get_win_icon(xwayland_ctx_t* ctx, steamcompmgr_win_t* w, CXPropertyBatch &batch)
+{
+	w->icon = std::make_shared<std::vector<uint32_t>>();
+	batch.GetCardinals(ctx->atoms.netWMIcon, *w->icon.get());
 }
 
 static void
 get_win_icon(xwayland_ctx_t* ctx, steamcompmgr_win_t* w)
 {
-	w->icon = std::make_shared<std::vector<uint32_t>>();
-	get_prop(ctx, w->xwayland().id, ctx->atoms.netWMIcon, *w->icon.get());
+	CXPropertyBatch batch( ctx, w->xwayland().id );
+	get_win_icon( ctx, w, batch );
 }
 
 static void
@@ -4086,24 +4927,45 @@ map_win(xwayland_ctx_t* ctx, Window id, unsigned long sequence)
 
 	XFlush(ctx->dpy);
 
+	/* Send everything we want to know about the window up front,
+	 * so we only wait on Xwayland once rather than once per property. */
+	CXPropertyBatch batch( ctx, w->xwayland().id );
+	batch.RequestCardinal( ctx->atoms.opacityAtom );
+	batch.RequestCardinal( ctx->atoms.steamAtom );
+	batch.RequestText( ctx->atoms.netWMNameAtom );
+	batch.RequestText( XA_WM_NAME );
+	batch.RequestCardinals( ctx->atoms.netWMIcon );
+	batch.RequestCardinal( ctx->atoms.steamInputFocusAtom );
+	batch.RequestCardinal( ctx->atoms.steamStreamingClientAtom );
+	batch.RequestCardinal( ctx->atoms.steamStreamingClientVideoAtom );
+	if ( steamMode == true )
+		batch.RequestCardinal( ctx->atoms.gameAtom );
+	batch.RequestCardinal( ctx->atoms.overlayAtom );
+	batch.RequestCardinal( ctx->atoms.externalOverlayAtom );
+	batch.RequestSizeHints();
+	batch.RequestAtoms( ctx->atoms.netWMStateAtom );
+	batch.RequestWMHints();
+	batch.RequestTransientFor();
+	batch.RequestCardinals( ctx->atoms.winTypeAtom );
+
 	/* This needs to be here since we don't get PropertyNotify when unmapped */
-	w->opacity = get_prop(ctx, w->xwayland().id, ctx->atoms.opacityAtom, OPAQUE);
+	w->opacity = batch.GetCardinal( ctx->atoms.opacityAtom, OPAQUE );
 
-	w->isSteamLegacyBigPicture = get_prop(ctx, w->xwayland().id, ctx->atoms.steamAtom, 0);
+	w->isSteamLegacyBigPicture = batch.GetCardinal( ctx->atoms.steamAtom, 0 );
 
 	/* First try to read the UTF8 title prop, then fallback to the non-UTF8 one */
-	get_win_title( ctx, w, ctx->atoms.netWMNameAtom );
-	get_win_title( ctx, w, XA_WM_NAME );
-	get_win_icon( ctx, w );
+	get_win_title( ctx, w, ctx->atoms.netWMNameAtom, batch );
+	get_win_title( ctx, w, XA_WM_NAME, batch );
+	get_win_icon( ctx, w, batch );
 
-	w->inputFocusMode = get_prop(ctx, w->xwayland().id, ctx->atoms.steamInputFocusAtom, 0);
+	w->inputFocusMode = batch.GetCardinal( ctx->atoms.steamInputFocusAtom, 0 );
 
-	w->isSteamStreamingClient = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientAtom, 0);
-	w->isSteamStreamingClientVideo = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientVideoAtom, 0);
+	w->isSteamStreamingClient = batch.GetCardinal( ctx->atoms.steamStreamingClientAtom, 0 );
+	w->isSteamStreamingClientVideo = batch.GetCardinal( ctx->atoms.steamStreamingClientVideoAtom, 0 );
 
 	if ( steamMode == true )
 	{
-		uint32_t appID = get_prop(ctx, w->xwayland().id, ctx->atoms.gameAtom, 0);
+		uint32_t appID = batch.GetCardinal( ctx->atoms.gameAtom, 0 );
 
 		if ( w->appID != 0 && appID != 0 && w->appID != appID )
 		{
@@ -4119,36 +4981,25 @@ map_win(xwayland_ctx_t* ctx, Window id, unsigned long sequence)
 	{
 		w->appID = w->xwayland().id;
 	}
-	w->isOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.overlayAtom, 0);
-	w->isExternalOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.externalOverlayAtom, 0);
-
-	get_size_hints(ctx, w);
+	w->isOverlay = batch.GetCardinal( ctx->atoms.overlayAtom, 0 );
+	w->isExternalOverlay = batch.GetCardinal( ctx->atoms.externalOverlayAtom, 0 );
 
-	get_net_wm_state(ctx, w);
+	get_size_hints(ctx, w, batch);
 
-	XWMHints *wmHints = XGetWMHints( ctx->dpy, w->xwayland().id );
+	get_net_wm_state(ctx, w, batch);
 
-	if ( wmHints != nullptr )
+	XWMHints wmHints;
+	if ( batch.GetWMHints( &wmHints ) )
 	{
-		if ( wmHints->flags & (InputHint | StateHint ) && wmHints->input == true && wmHints->initial_state == NormalState )
+		if ( wmHints.flags & (InputHint | StateHint ) && wmHints.input == true && wmHints.initial_state == NormalState )
 		{
 			XRaiseWindow( ctx->dpy, w->xwayland().id );
 		}
-
-		XFree( wmHints );
 	}
 
-	Window transientFor = None;
-	if ( XGetTransientForHint( ctx->dpy, w->xwayland().id, &transientFor ) )
-	{
-		w->xwayland().transientFor = transientFor;
-	}
-	else
-	{
-		w->xwayland().transientFor = None;
-	}
+	w->xwayland().transientFor = batch.GetTransientFor();
 
-	get_win_type( ctx, w );
+	get_win_type( ctx, w, batch );
 
 	w->xwayland().damage_sequence = 0;
 	w->xwayland().map_sequence = sequence;
@@ -4277,29 +5128,6 @@ get_appid_from_pid( pid_t pid )
 	return unFoundAppId;
 }
 
-static pid_t
-get_win_pid(xwayland_ctx_t *ctx, Window id)
-{
-	XResClientIdSpec client_spec = {
-		.client = id,
-		.mask = XRES_CLIENT_ID_PID_MASK,
-	};
-	long num_ids = 0;
-	XResClientIdValue *client_ids = NULL;
-	XResQueryClientIds(ctx->dpy, 1, &client_spec, &num_ids, &client_ids);
-
-	pid_t pid = -1;
-	for (long i = 0; i < num_ids; i++) {
-		pid = XResGetClientPid(&client_ids[i]);
-		if (pid > 0)
-			break;
-	}
-	XResClientIdsDestroy(num_ids, client_ids);
-	if (pid <= 0)
-		xwm_log.errorf("Failed to find PID for window 0x%lx", id);
-	return pid;
-}
-
 static void
 add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 {
@@ -4322,7 +5150,15 @@ add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 	else
 		p = &ctx->list;
 	new_win->xwayland().id = id;
-	if (!XGetWindowAttributes(ctx->dpy, id, &new_win->xwayland().a))
+
+	CXPropertyBatch batch( ctx, id );
+	batch.RequestAttributes();
+	if ( useXRes == true )
+		batch.RequestPid();
+	batch.RequestTransientFor();
+	batch.RequestCardinals( ctx->atoms.winTypeAtom );
+
+	if (!batch.GetAttributes(&new_win->xwayland().a))
 	{
 		delete new_win;
 		return;
@@ -4341,7 +5177,7 @@ add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 
 	if ( useXRes == true )
 	{
-		new_win->pid = get_win_pid(ctx, id);
+		new_win->pid = batch.GetPid();
 	}
 	else
 	{
@@ -4378,17 +5214,9 @@ add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 		new_win->appID = id;
 	}
 
-	Window transientFor = None;
-	if ( XGetTransientForHint( ctx->dpy, id, &transientFor ) )
-	{
-		new_win->xwayland().transientFor = transientFor;
-	}
-	else
-	{
-		new_win->xwayland().transientFor = None;
-	}
+	new_win->xwayland().transientFor = batch.GetTransientFor();
 
-	get_win_type( ctx, new_win );
+	get_win_type( ctx, new_win, batch );
 
 	new_win->title = NULL;
 	new_win->utf8_title = false;
@@ -4409,6 +5237,14 @@ add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 		std::unique_lock lock( ctx->list_mutex );
 		new_win->xwayland().next = *p;
 		*p = new_win;
+
+		if ( !ctx->windowsByID.emplace( id, new_win ).second )
+			reindex_win_id( ctx, id );
+	}
+
+	{
+		std::unique_lock lock( ctx->parentCacheMutex );
+		ctx->parentCache.erase( id );
 	}
 	if (new_win->xwayland().a.map_state == IsViewable)
 		map_win(ctx, id, sequence);
@@ -4541,7 +5377,12 @@ finish_destroy_win(xwayland_ctx_t *ctx, Window id, bool gone)
 			{
 				std::unique_lock lock( ctx->list_mutex );
 				*prev = w->xwayland().next;
+
+				auto iter = ctx->windowsByID.find( id );
+				if ( iter != ctx->windowsByID.end() && iter->second == w )
+					reindex_win_id( ctx, id );
 			}
+			std::erase_if( ctx->windowsBySurface, [w]( const auto &entry ) { return entry.second == w; } );
 			if (w->xwayland().damage != None)
 			{
 				XDamageDestroy(ctx->dpy, w->xwayland().damage);
@@ -5036,351 +5877,408 @@ static inline float santitize_float( float f )
 #endif
 }
 
+// Property handlers, looked up by atom in handle_property_notify.
+// Each subsystem registers the atoms it cares about below, when
+// the xwayland_ctx_t is set up.
+
 static void
-handle_property_notify(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+handle_prop_net_wm_window_opacity(xwayland_ctx_t *ctx, XPropertyEvent *ev)
 {
-	/* check if Trans property was changed */
-	if (ev->atom == ctx->atoms.opacityAtom)
+	/* reset mode and redraw window */
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if ( w != nullptr )
 	{
-		/* reset mode and redraw window */
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if ( w != nullptr )
+		unsigned int newOpacity = get_prop(ctx, w->xwayland().id, ctx->atoms.opacityAtom, OPAQUE);
+
+		if (newOpacity != w->opacity)
 		{
-			unsigned int newOpacity = get_prop(ctx, w->xwayland().id, ctx->atoms.opacityAtom, OPAQUE);
+			w->opacity = newOpacity;
 
-			if (newOpacity != w->opacity)
+			if ( gameFocused && ( w == ctx->focus.overlayWindow || w == ctx->focus.notificationWindow ) )
 			{
-				w->opacity = newOpacity;
-
-				if ( gameFocused && ( w == ctx->focus.overlayWindow || w == ctx->focus.notificationWindow ) )
-				{
-					hasRepaintNonBasePlane = true;
-				}
-				if ( w == ctx->focus.externalOverlayWindow )
-				{
-					hasRepaint = true;
-				}
+				hasRepaintNonBasePlane = true;
 			}
+			if ( w == ctx->focus.externalOverlayWindow )
+			{
+				hasRepaint = true;
+			}
+		}
 
-			unsigned int maxOpacity = 0;
-			unsigned int maxOpacityExternal = 0;
+		unsigned int maxOpacity = 0;
+		unsigned int maxOpacityExternal = 0;
 
-			for (w = ctx->list; w; w = w->xwayland().next)
+		for (w = ctx->list; w; w = w->xwayland().next)
+		{
+			if (w->isOverlay)
 			{
-				if (w->isOverlay)
+				if (w->GetGeometry().nWidth > 1200 && w->opacity >= maxOpacity)
 				{
-					if (w->GetGeometry().nWidth > 1200 && w->opacity >= maxOpacity)
-					{
-						ctx->focus.overlayWindow = w;
-						maxOpacity = w->opacity;
-					}
+					ctx->focus.overlayWindow = w;
+					maxOpacity = w->opacity;
 				}
-				if (w->isExternalOverlay)
+			}
+			if (w->isExternalOverlay)
+			{
+				if (w->opacity >= maxOpacityExternal)
 				{
-					if (w->opacity >= maxOpacityExternal)
-					{
-						ctx->focus.externalOverlayWindow = w;
-						maxOpacityExternal = w->opacity;
-					}
+					ctx->focus.externalOverlayWindow = w;
+					maxOpacityExternal = w->opacity;
 				}
 			}
 		}
 	}
-	if (ev->atom == ctx->atoms.steamAtom)
+}
+
+static void
+handle_prop_steam_bigpicture(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			w->isSteamLegacyBigPicture = get_prop(ctx, w->xwayland().id, ctx->atoms.steamAtom, 0);
-			MakeFocusDirty();
-		}
+		w->isSteamLegacyBigPicture = get_prop(ctx, w->xwayland().id, ctx->atoms.steamAtom, 0);
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.steamInputFocusAtom )
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			w->inputFocusMode = get_prop(ctx, w->xwayland().id, ctx->atoms.steamInputFocusAtom, 0);
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == ctx->atoms.steamTouchClickModeAtom )
-	{
-		gamescope::cv_touch_click_mode = (gamescope::TouchClickMode) get_prop(ctx, ctx->root, ctx->atoms.steamTouchClickModeAtom, 0u );
-	}
-	if (ev->atom == ctx->atoms.steamStreamingClientAtom)
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			w->isSteamStreamingClient = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientAtom, 0);
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == ctx->atoms.steamStreamingClientVideoAtom)
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			w->isSteamStreamingClientVideo = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientVideoAtom, 0);
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == ctx->atoms.gamescopeCtrlAppIDAtom )
+}
+
+static void
+handle_prop_steam_input_focus(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		get_prop( ctx, ctx->root, ctx->atoms.gamescopeCtrlAppIDAtom, vecFocuscontrolAppIDs );
+		w->inputFocusMode = get_prop(ctx, w->xwayland().id, ctx->atoms.steamInputFocusAtom, 0);
 		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.gamescopeCtrlWindowAtom )
+}
+
+static void
+handle_prop_steam_touch_click_mode(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	gamescope::cv_touch_click_mode = (gamescope::TouchClickMode) get_prop(ctx, ctx->root, ctx->atoms.steamTouchClickModeAtom, 0u );
+}
+
+static void
+handle_prop_steam_streaming_client(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		ctx->focusControlWindow = get_prop( ctx, ctx->root, ctx->atoms.gamescopeCtrlWindowAtom, None );
+		w->isSteamStreamingClient = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientAtom, 0);
 		MakeFocusDirty();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeScreenShotAtom )
+}
+
+static void
+handle_prop_steam_streaming_client_video(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		if ( ev->state == PropertyNewValue )
-		{
-			gamescope::CScreenshotManager::Get().TakeScreenshot( gamescope::GamescopeScreenshotInfo
-			{
-				.szScreenshotPath = "/tmp/gamescope.png",
-				.eScreenshotType = (gamescope_control_screenshot_type) get_prop( ctx, ctx->root, ctx->atoms.gamescopeScreenShotAtom, None ),
-				.uScreenshotFlags = 0,
-				.bX11PropertyRequested = true,
-			} );
-		}
+		w->isSteamStreamingClientVideo = get_prop(ctx, w->xwayland().id, ctx->atoms.steamStreamingClientVideoAtom, 0);
+		MakeFocusDirty();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDebugScreenShotAtom )
+}
+
+static void
+handle_prop_gamescopectrl_baselayer_appid(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	get_prop( ctx, ctx->root, ctx->atoms.gamescopeCtrlAppIDAtom, vecFocuscontrolAppIDs );
+	MakeFocusDirty();
+}
+
+static void
+handle_prop_gamescopectrl_baselayer_window(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	ctx->focusControlWindow = get_prop( ctx, ctx->root, ctx->atoms.gamescopeCtrlWindowAtom, None );
+	MakeFocusDirty();
+}
+
+static void
+handle_prop_gamescopectrl_request_screenshot(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	if ( ev->state == PropertyNewValue )
 	{
-		if ( ev->state == PropertyNewValue )
+		gamescope::CScreenshotManager::Get().TakeScreenshot( gamescope::GamescopeScreenshotInfo
 		{
-			gamescope::CScreenshotManager::Get().TakeScreenshot( gamescope::GamescopeScreenshotInfo
-			{
-				.szScreenshotPath = "/tmp/gamescope.png",
-				.eScreenshotType = (gamescope_control_screenshot_type) get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugScreenShotAtom, None ),
-				.uScreenshotFlags = 0,
-				.bX11PropertyRequested = true,
-			} );
-		}
+			.szScreenshotPath = "/tmp/gamescope.png",
+			.eScreenshotType = (gamescope_control_screenshot_type) get_prop( ctx, ctx->root, ctx->atoms.gamescopeScreenShotAtom, None ),
+			.uScreenshotFlags = 0,
+			.bX11PropertyRequested = true,
+		} );
 	}
-	if (ev->atom == ctx->atoms.gameAtom)
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			uint32_t appID = get_prop(ctx, w->xwayland().id, ctx->atoms.gameAtom, 0);
-
-			if ( w->appID != 0 && appID != 0 && w->appID != appID )
-			{
-				xwm_log.errorf( "appid clash was %u now %u", w->appID, appID );
-			}
-			w->appID = appID;
+}
 
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == ctx->atoms.overlayAtom)
+static void
+handle_prop_gamescopectrl_debug_request_screenshot(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	if ( ev->state == PropertyNewValue )
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
+		gamescope::CScreenshotManager::Get().TakeScreenshot( gamescope::GamescopeScreenshotInfo
 		{
-			w->isOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.overlayAtom, 0);
-			MakeFocusDirty();
-		}
+			.szScreenshotPath = "/tmp/gamescope.png",
+			.eScreenshotType = (gamescope_control_screenshot_type) get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugScreenShotAtom, None ),
+			.uScreenshotFlags = 0,
+			.bX11PropertyRequested = true,
+		} );
 	}
-	if (ev->atom == ctx->atoms.externalOverlayAtom)
+}
+
+static void
+handle_prop_steam_game(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
+		uint32_t appID = get_prop(ctx, w->xwayland().id, ctx->atoms.gameAtom, 0);
+
+		if ( w->appID != 0 && appID != 0 && w->appID != appID )
 		{
-			w->isExternalOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.externalOverlayAtom, 0);
-			MakeFocusDirty();
+			xwm_log.errorf( "appid clash was %u now %u", w->appID, appID );
 		}
+		w->appID = appID;
+
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.winTypeAtom)
+}
+
+static void
+handle_prop_steam_overlay(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			get_win_type(ctx, w);
-			MakeFocusDirty();
-		}		
+		w->isOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.overlayAtom, 0);
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.sizeHintsAtom)
+}
+
+static void
+handle_prop_gamescope_external_overlay(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			get_size_hints(ctx, w);
-			MakeFocusDirty();
-		}
+		w->isExternalOverlay = get_prop(ctx, w->xwayland().id, ctx->atoms.externalOverlayAtom, 0);
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.gamesRunningAtom)
+}
+
+static void
+handle_prop_net_wm_window_type(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		gamesRunningCount = get_prop(ctx, ctx->root, ctx->atoms.gamesRunningAtom, 0);
+		get_win_type(ctx, w);
+		MakeFocusDirty();
+	}		
+}
 
+static void
+handle_prop_wm_normal_hints(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
+	{
+		get_size_hints(ctx, w);
 		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.screenScaleAtom)
-	{
-		overscanScaleRatio = get_prop(ctx, ctx->root, ctx->atoms.screenScaleAtom, 0xFFFFFFFF) / (double)0xFFFFFFFF;
+}
 
-		globalScaleRatio = overscanScaleRatio * zoomScaleRatio;
+static void
+handle_prop_steam_games_running(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	gamesRunningCount = get_prop(ctx, ctx->root, ctx->atoms.gamesRunningAtom, 0);
 
-		if (global_focus.focusWindow)
-		{
-			hasRepaint = true;
-		}
+	MakeFocusDirty();
+}
 
-		MakeFocusDirty();
+static void
+handle_prop_steam_screen_scale(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	overscanScaleRatio = get_prop(ctx, ctx->root, ctx->atoms.screenScaleAtom, 0xFFFFFFFF) / (double)0xFFFFFFFF;
+
+	globalScaleRatio = overscanScaleRatio * zoomScaleRatio;
+
+	if (global_focus.focusWindow)
+	{
+		hasRepaint = true;
 	}
-	if (ev->atom == ctx->atoms.screenZoomAtom)
+
+	MakeFocusDirty();
+}
+
+static void
+handle_prop_steam_screen_magnification(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	zoomScaleRatio = get_prop(ctx, ctx->root, ctx->atoms.screenZoomAtom, 0xFFFF) / (double)0xFFFF;
+
+	globalScaleRatio = overscanScaleRatio * zoomScaleRatio;
+
+	if (global_focus.focusWindow)
 	{
-		zoomScaleRatio = get_prop(ctx, ctx->root, ctx->atoms.screenZoomAtom, 0xFFFF) / (double)0xFFFF;
+		hasRepaint = true;
+	}
 
-		globalScaleRatio = overscanScaleRatio * zoomScaleRatio;
+	MakeFocusDirty();
+}
 
-		if (global_focus.focusWindow)
+static void
+handle_prop_wm_transient_for(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
+	{
+		Window transientFor = None;
+		if ( XGetTransientForHint( ctx->dpy, ev->window, &transientFor ) )
 		{
-			hasRepaint = true;
+			w->xwayland().transientFor = transientFor;
+		}
+		else
+		{
+			w->xwayland().transientFor = None;
 		}
+		get_win_type( ctx, w );
 
 		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.WMTransientForAtom)
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
-		{
-			Window transientFor = None;
-			if ( XGetTransientForHint( ctx->dpy, ev->window, &transientFor ) )
-			{
-				w->xwayland().transientFor = transientFor;
-			}
-			else
-			{
-				w->xwayland().transientFor = None;
-			}
-			get_win_type( ctx, w );
+}
 
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == XA_WM_NAME || ev->atom == ctx->atoms.netWMNameAtom)
+static void
+handle_prop_wm_name(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t *w = find_win(ctx, ev->window);
+
+	if (w)
 	{
-		steamcompmgr_win_t *w = find_win(ctx, ev->window);
+		get_win_title(ctx, w, ev->atom);
 
-		if (w)
+		if (ev->window == x11_win(global_focus.focusWindow))
 		{
-			get_win_title(ctx, w, ev->atom);
-
-			if (ev->window == x11_win(global_focus.focusWindow))
-			{
-				if ( GetBackend()->GetNestedHints() )
-					GetBackend()->GetNestedHints()->SetTitle( w->title );
-			}
+			if ( GetBackend()->GetNestedHints() )
+				GetBackend()->GetNestedHints()->SetTitle( w->title );
 		}
 	}
-	if (ev->atom == ctx->atoms.netWMIcon)
+}
+
+static void
+handle_prop_net_wm_icon(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t *w = find_win(ctx, ev->window);
+
+	if (w)
 	{
-		steamcompmgr_win_t *w = find_win(ctx, ev->window);
+		get_win_icon(ctx, w);
 
-		if (w)
+		if (ev->window == x11_win(global_focus.focusWindow))
 		{
-			get_win_icon(ctx, w);
-
-			if (ev->window == x11_win(global_focus.focusWindow))
-			{
-				if ( GetBackend()->GetNestedHints() )
-					GetBackend()->GetNestedHints()->SetIcon( w->icon );
-			}
+			if ( GetBackend()->GetNestedHints() )
+				GetBackend()->GetNestedHints()->SetIcon( w->icon );
 		}
 	}
+}
+
 #if 0
-	if ( ev->atom == ctx->atoms.gamescopeTuneableVBlankRedZone )
-	{
-		g_uVblankDrawBufferRedZoneNS = (uint64_t)get_prop( ctx, ctx->root, ctx->atoms.gamescopeTuneableVBlankRedZone, g_uDefaultVBlankRedZone );
-	}
-	if ( ev->atom == ctx->atoms.gamescopeTuneableRateOfDecay )
+static void
+handle_prop_gamescope_tuneable_vblank_redzone(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_uVblankDrawBufferRedZoneNS = (uint64_t)get_prop( ctx, ctx->root, ctx->atoms.gamescopeTuneableVBlankRedZone, g_uDefaultVBlankRedZone );
+}
+
+static void
+handle_prop_gamescope_tuneable_vblank_rate_of_decay_percentage(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_uVBlankRateOfDecayPercentage = (uint64_t)get_prop( ctx, ctx->root, ctx->atoms.gamescopeTuneableRateOfDecay, g_uDefaultVBlankRateOfDecayPercentage );
+}
+#endif
+
+static void
+handle_prop_gamescope_scaling_filter(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	int nScalingMode = get_prop( ctx, ctx->root, ctx->atoms.gamescopeScalingFilter, 0 );
+	switch ( nScalingMode )
 	{
-		g_uVBlankRateOfDecayPercentage = (uint64_t)get_prop( ctx, ctx->root, ctx->atoms.gamescopeTuneableRateOfDecay, g_uDefaultVBlankRateOfDecayPercentage );
+	default:
+	case 0:
+		g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
+		g_wantedUpscaleFilter = GamescopeUpscaleFilter::LINEAR;
+		break;
+	case 1:
+		g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
+		g_wantedUpscaleFilter = GamescopeUpscaleFilter::NEAREST;
+		break;
+	case 2:
+		g_wantedUpscaleScaler = GamescopeUpscaleScaler::INTEGER;
+		g_wantedUpscaleFilter = GamescopeUpscaleFilter::NEAREST;
+		break;
+	case 3:
+		g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
+		g_wantedUpscaleFilter = GamescopeUpscaleFilter::FSR;
+		break;
+	case 4:
+		g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
+		g_wantedUpscaleFilter = GamescopeUpscaleFilter::NIS;
+		break;
 	}
-#endif
-	if ( ev->atom == ctx->atoms.gamescopeScalingFilter )
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_sharpness(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_upscaleFilterSharpness = (int)clamp( get_prop( ctx, ctx->root, ev->atom, 2 ), 0u, 20u );
+	if ( g_upscaleFilter == GamescopeUpscaleFilter::FSR || g_upscaleFilter == GamescopeUpscaleFilter::NIS )
+		hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_xwayland_mode_control(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::vector< uint32_t > xwayland_mode_ctl;
+	bool hasModeCtrl = get_prop( ctx, ctx->root, ctx->atoms.gamescopeXWaylandModeControl, xwayland_mode_ctl );
+	if ( hasModeCtrl && xwayland_mode_ctl.size() == 4 )
 	{
-		int nScalingMode = get_prop( ctx, ctx->root, ctx->atoms.gamescopeScalingFilter, 0 );
-		switch ( nScalingMode )
+		size_t server_idx = size_t{ xwayland_mode_ctl[ 0 ] };
+		int width = xwayland_mode_ctl[ 1 ];
+		int height = xwayland_mode_ctl[ 2 ];
+		bool allowSuperRes = !!xwayland_mode_ctl[ 3 ];
+
+		if ( !allowSuperRes )
 		{
-		default:
-		case 0:
-			g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
-			g_wantedUpscaleFilter = GamescopeUpscaleFilter::LINEAR;
-			break;
-		case 1:
-			g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
-			g_wantedUpscaleFilter = GamescopeUpscaleFilter::NEAREST;
-			break;
-		case 2:
-			g_wantedUpscaleScaler = GamescopeUpscaleScaler::INTEGER;
-			g_wantedUpscaleFilter = GamescopeUpscaleFilter::NEAREST;
-			break;
-		case 3:
-			g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
-			g_wantedUpscaleFilter = GamescopeUpscaleFilter::FSR;
-			break;
-		case 4:
-			g_wantedUpscaleScaler = GamescopeUpscaleScaler::AUTO;
-			g_wantedUpscaleFilter = GamescopeUpscaleFilter::NIS;
-			break;
+			width = std::min<int>(width, currentOutputWidth);
+			height = std::min<int>(height, currentOutputHeight);
 		}
-		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeFSRSharpness || ev->atom == ctx->atoms.gamescopeSharpness )
-	{
-		g_upscaleFilterSharpness = (int)clamp( get_prop( ctx, ctx->root, ev->atom, 2 ), 0u, 20u );
-		if ( g_upscaleFilter == GamescopeUpscaleFilter::FSR || g_upscaleFilter == GamescopeUpscaleFilter::NIS )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeXWaylandModeControl )
-	{
-		std::vector< uint32_t > xwayland_mode_ctl;
-		bool hasModeCtrl = get_prop( ctx, ctx->root, ctx->atoms.gamescopeXWaylandModeControl, xwayland_mode_ctl );
-		if ( hasModeCtrl && xwayland_mode_ctl.size() == 4 )
+
+		gamescope_xwayland_server_t *server = wlserver_get_xwayland_server( server_idx );
+		if ( server )
 		{
-			size_t server_idx = size_t{ xwayland_mode_ctl[ 0 ] };
-			int width = xwayland_mode_ctl[ 1 ];
-			int height = xwayland_mode_ctl[ 2 ];
-			bool allowSuperRes = !!xwayland_mode_ctl[ 3 ];
+			bool root_size_identical = server->ctx->root_width == width && server->ctx->root_height == height;
 
-			if ( !allowSuperRes )
-			{
-				width = std::min<int>(width, currentOutputWidth);
-				height = std::min<int>(height, currentOutputHeight);
-			}
+			wlserver_lock();
+			wlserver_set_xwayland_server_mode( server_idx, width, height, g_nOutputRefresh );
+			wlserver_unlock();
 
-			gamescope_xwayland_server_t *server = wlserver_get_xwayland_server( server_idx );
-			if ( server )
+			if ( root_size_identical )
 			{
-				bool root_size_identical = server->ctx->root_width == width && server->ctx->root_height == height;
-
-				wlserver_lock();
-				wlserver_set_xwayland_server_mode( server_idx, width, height, g_nOutputRefresh );
-				wlserver_unlock();
-
-				if ( root_size_identical )
-				{
-					gamescope_xwayland_server_t *root_server = wlserver_get_xwayland_server(0);
-					xwayland_ctx_t *root_ctx = root_server->ctx.get();
-					XDeleteProperty( root_ctx->dpy, root_ctx->root, root_ctx->atoms.gamescopeXWaylandModeControl );
-					XFlush( root_ctx->dpy );
-				}
+				gamescope_xwayland_server_t *root_server = wlserver_get_xwayland_server(0);
+				xwayland_ctx_t *root_ctx = root_server->ctx.get();
+				XDeleteProperty( root_ctx->dpy, root_ctx->root, root_ctx->atoms.gamescopeXWaylandModeControl );
+				XFlush( root_ctx->dpy );
 			}
 		}
 	}
-	if ( ev->atom == ctx->atoms.gamescopeFPSLimit )
-	{
-		g_nSteamCompMgrTargetFPS = get_prop( ctx, ctx->root, ctx->atoms.gamescopeFPSLimit, 0 );
-		update_runtime_info();
-	}
+}
+
+static void
+handle_prop_gamescope_fps_limit(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_nSteamCompMgrTargetFPS = get_prop( ctx, ctx->root, ctx->atoms.gamescopeFPSLimit, 0 );
+	update_runtime_info();
+}
+
+static void
+handle_prop_gamescope_dynamic_refresh(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
 	for (int i = 0; i < gamescope::GAMESCOPE_SCREEN_TYPE_COUNT; i++)
 	{
 		if ( ev->atom == ctx->atoms.gamescopeDynamicRefresh[i] )
@@ -5388,424 +6286,692 @@ handle_property_notify(xwayland_ctx_t *ctx, XPropertyEvent *ev)
 			g_nDynamicRefreshRate[i] = get_prop( ctx, ctx->root, ctx->atoms.gamescopeDynamicRefresh[i], 0 );
 		}
 	}
-	if ( ev->atom == ctx->atoms.gamescopeLowLatency )
-	{
-		g_bLowLatency = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeLowLatency, 0 );
-	}
-	if ( ev->atom == ctx->atoms.gamescopeBlurMode )
-	{
-		BlurMode newBlur = (BlurMode)get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurMode, 0 );
-		if (newBlur < BLUR_MODE_OFF || newBlur > BLUR_MODE_ALWAYS)
-			newBlur = BLUR_MODE_OFF;
+}
 
-		if (newBlur != g_BlurMode) {
-			g_BlurFadeStartTime = get_time_in_milliseconds();
-			g_BlurModeOld = g_BlurMode;
-			g_BlurMode = newBlur;
-			hasRepaint = true;
-		}
-	}
-	if ( ev->atom == ctx->atoms.gamescopeBlurRadius )
-	{
-		unsigned int pixel = get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurRadius, 0 );
-		g_BlurRadius = (int)clamp((pixel / 2) + 1, 1u, kMaxBlurRadius - 1);
-		if ( g_BlurMode )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeBlurFadeDuration )
-	{
-		g_BlurFadeDuration = get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurFadeDuration, 0 );
-	}
-	if ( ev->atom == ctx->atoms.gamescopeCompositeForce )
-	{
-		cv_composite_force = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeCompositeForce, 0 );
+static void
+handle_prop_gamescope_low_latency(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bLowLatency = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeLowLatency, 0 );
+}
+
+static void
+handle_prop_gamescope_blur_mode(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	BlurMode newBlur = (BlurMode)get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurMode, 0 );
+	if (newBlur < BLUR_MODE_OFF || newBlur > BLUR_MODE_ALWAYS)
+		newBlur = BLUR_MODE_OFF;
+
+	if (newBlur != g_BlurMode) {
+		g_BlurFadeStartTime = get_time_in_milliseconds();
+		g_BlurModeOld = g_BlurMode;
+		g_BlurMode = newBlur;
 		hasRepaint = true;
 	}
-	if ( ev->atom == ctx->atoms.gamescopeCompositeDebug )
-	{
-		cv_composite_debug = get_prop( ctx, ctx->root, ctx->atoms.gamescopeCompositeDebug, 0 );
+}
 
+static void
+handle_prop_gamescope_blur_radius(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	unsigned int pixel = get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurRadius, 0 );
+	g_BlurRadius = (int)clamp((pixel / 2) + 1, 1u, kMaxBlurRadius - 1);
+	if ( g_BlurMode )
 		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeAllowTearing )
-	{
-		g_nAsyncFlipsEnabled = get_prop( ctx, ctx->root, ctx->atoms.gamescopeAllowTearing, 0 );
-	}
-	if ( ev->atom == ctx->atoms.gamescopeSteamMaxHeight )
+}
+
+static void
+handle_prop_gamescope_blur_fade_duration(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_BlurFadeDuration = get_prop( ctx, ctx->root, ctx->atoms.gamescopeBlurFadeDuration, 0 );
+}
+
+static void
+handle_prop_gamescope_composite_force(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	cv_composite_force = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeCompositeForce, 0 );
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_composite_debug(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	cv_composite_debug = get_prop( ctx, ctx->root, ctx->atoms.gamescopeCompositeDebug, 0 );
+
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_allow_tearing(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_nAsyncFlipsEnabled = get_prop( ctx, ctx->root, ctx->atoms.gamescopeAllowTearing, 0 );
+}
+
+static void
+handle_prop_gamescope_steam_max_height(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_nSteamMaxHeight = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSteamMaxHeight, 0 );
+	MakeFocusDirty();
+}
+
+static void
+handle_prop_gamescope_vrr_enabled(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	bool enabled = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeVRREnabled, 0 );
+	cv_adaptive_sync = enabled;
+}
+
+static void
+handle_prop_gamescope_display_force_internal(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bForceInternal = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDisplayForceInternal, 0 );
+	GetBackend()->DirtyState();
+}
+
+static void
+handle_prop_gamescope_display_mode_nudge(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	GetBackend()->DirtyState( true );
+	XDeleteProperty( ctx->dpy, ctx->root, ctx->atoms.gamescopeDisplayModeNudge );
+}
+
+static void
+handle_prop_gamescope_new_scaling_filter(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	GamescopeUpscaleFilter nScalingFilter = ( GamescopeUpscaleFilter ) get_prop( ctx, ctx->root, ctx->atoms.gamescopeNewScalingFilter, 0 );
+	if (g_wantedUpscaleFilter != nScalingFilter)
 	{
-		g_nSteamMaxHeight = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSteamMaxHeight, 0 );
-		MakeFocusDirty();
+		g_wantedUpscaleFilter = nScalingFilter;
+		hasRepaint = true;
 	}
-	if ( ev->atom == ctx->atoms.gamescopeVRREnabled )
+}
+
+static void
+handle_prop_gamescope_new_scaling_scaler(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	GamescopeUpscaleScaler nScalingScaler = ( GamescopeUpscaleScaler ) get_prop( ctx, ctx->root, ctx->atoms.gamescopeNewScalingScaler, 0 );
+	if (g_wantedUpscaleScaler != nScalingScaler)
 	{
-		bool enabled = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeVRREnabled, 0 );
-		cv_adaptive_sync = enabled;
+		g_wantedUpscaleScaler = nScalingScaler;
+		hasRepaint = true;
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDisplayForceInternal )
+}
+
+static void
+handle_prop_gamescope_display_hdr_enabled(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	cv_hdr_enabled = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDisplayHDREnabled, 0 );
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_debug_force_hdr10_pq_output(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bForceHDR10OutputDebug = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugForceHDR10Output, 0 );
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_debug_force_hdr_support(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bForceHDRSupportDebug = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugForceHDRSupport, 0 );
+	GetBackend()->HackUpdatePatchedEdid();
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_debug_hdr_heatmap(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t heatmap = get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugHDRHeatmap, 0 );
+	cv_composite_debug &= ~CompositeDebugFlag::Heatmap;
+	cv_composite_debug &= ~CompositeDebugFlag::Heatmap_MSWCG;
+	cv_composite_debug &= ~CompositeDebugFlag::Heatmap_Hard;
+	if (heatmap != 0)
+		cv_composite_debug |= CompositeDebugFlag::Heatmap;
+	if (heatmap == 2)
+		cv_composite_debug |= CompositeDebugFlag::Heatmap_MSWCG;
+	if (heatmap == 3)
+		cv_composite_debug |= CompositeDebugFlag::Heatmap_Hard;
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_tonemap_operator(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_ColorMgmt.pending.hdrTonemapOperator = (ETonemapOperator) get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapOperator, 0 );
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_tonemap_display_metadata(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::vector< uint32_t > user_vec;
+	if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapDisplayMetadata, user_vec ) && user_vec.size() >= 2 )
 	{
-		g_bForceInternal = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDisplayForceInternal, 0 );
-		GetBackend()->DirtyState();
+		g_ColorMgmt.pending.hdrTonemapDisplayMetadata.flBlackPointNits = bit_cast<float>( user_vec[0] );
+		g_ColorMgmt.pending.hdrTonemapDisplayMetadata.flWhitePointNits = bit_cast<float>( user_vec[1] );
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDisplayModeNudge )
+	else
 	{
-		GetBackend()->DirtyState( true );
-		XDeleteProperty( ctx->dpy, ctx->root, ctx->atoms.gamescopeDisplayModeNudge );
+		g_ColorMgmt.pending.hdrTonemapDisplayMetadata.reset();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeNewScalingFilter )
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_tonemap_source_metadata(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::vector< uint32_t > user_vec;
+	if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapSourceMetadata, user_vec ) && user_vec.size() >= 2 )
 	{
-		GamescopeUpscaleFilter nScalingFilter = ( GamescopeUpscaleFilter ) get_prop( ctx, ctx->root, ctx->atoms.gamescopeNewScalingFilter, 0 );
-		if (g_wantedUpscaleFilter != nScalingFilter)
-		{
-			g_wantedUpscaleFilter = nScalingFilter;
-			hasRepaint = true;
-		}
+		g_ColorMgmt.pending.hdrTonemapSourceMetadata.flBlackPointNits = bit_cast<float>( user_vec[0] );
+		g_ColorMgmt.pending.hdrTonemapSourceMetadata.flWhitePointNits = bit_cast<float>( user_vec[1] );
 	}
-	if ( ev->atom == ctx->atoms.gamescopeNewScalingScaler )
+	else
 	{
-		GamescopeUpscaleScaler nScalingScaler = ( GamescopeUpscaleScaler ) get_prop( ctx, ctx->root, ctx->atoms.gamescopeNewScalingScaler, 0 );
-		if (g_wantedUpscaleScaler != nScalingScaler)
-		{
-			g_wantedUpscaleScaler = nScalingScaler;
-			hasRepaint = true;
-		}
+		g_ColorMgmt.pending.hdrTonemapSourceMetadata.reset();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDisplayHDREnabled )
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_sdr_on_hdr_content_brightness(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSDROnHDRContentBrightness, 0 );
+	if ( set_sdr_on_hdr_brightness( bit_cast<float>(val) ) )
+		hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_itm_enable(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bHDRItmEnable = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmEnable, 0 );
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_itm_sdr_nits(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_flHDRItmSdrNits = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmSDRNits, 0 );
+	if ( g_flHDRItmSdrNits < 1.f )
+		g_flHDRItmSdrNits = 100.f;
+	else if ( g_flHDRItmSdrNits > 1000.f)
+		g_flHDRItmSdrNits = 1000.f;
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_itm_target_nits(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_flHDRItmTargetNits = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmTargetNits, 0 );
+	if ( g_flHDRItmTargetNits < 1.f )
+		g_flHDRItmTargetNits = 1000.f;
+	else if ( g_flHDRItmTargetNits > 10000.f)
+		g_flHDRItmTargetNits = 10000.f;
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_color_look_pq(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLookPQ );
+	if ( set_color_look_pq( path.c_str() ) )
+		hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_color_look_g22(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLookG22 );
+	if ( set_color_look_g22( path.c_str() ) )
+		hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_display_virtual_white(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::vector< uint32_t > user_vec;
+	if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeColorOutputVirtualWhite, user_vec ) && user_vec.size() >= 2 )
 	{
-		cv_hdr_enabled = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDisplayHDREnabled, 0 );
-		hasRepaint = true;
+		g_ColorMgmt.pending.outputVirtualWhite.x = santitize_float( bit_cast<float>( user_vec[0] ) );
+		g_ColorMgmt.pending.outputVirtualWhite.y = santitize_float( bit_cast<float>( user_vec[1] ) );
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDebugForceHDR10Output )
+	else
 	{
-		g_bForceHDR10OutputDebug = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugForceHDR10Output, 0 );
-		hasRepaint = true;
+		g_ColorMgmt.pending.outputVirtualWhite.x = 0.f;
+		g_ColorMgmt.pending.outputVirtualWhite.y = 0.f;
 	}
-	if ( ev->atom == ctx->atoms.gamescopeDebugForceHDRSupport )
-	{
-		g_bForceHDRSupportDebug = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugForceHDRSupport, 0 );
-		GetBackend()->HackUpdatePatchedEdid();
+	hasRepaint = true;
+}
+
+static void
+handle_prop_gamescope_hdr_input_gain(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRInputGain, 0 );
+	if ( set_hdr_input_gain( bit_cast<float>(val) ) )
 		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeDebugHDRHeatmap )
-	{
-		uint32_t heatmap = get_prop( ctx, ctx->root, ctx->atoms.gamescopeDebugHDRHeatmap, 0 );
-		cv_composite_debug &= ~CompositeDebugFlag::Heatmap;
-		cv_composite_debug &= ~CompositeDebugFlag::Heatmap_MSWCG;
-		cv_composite_debug &= ~CompositeDebugFlag::Heatmap_Hard;
-		if (heatmap != 0)
-			cv_composite_debug |= CompositeDebugFlag::Heatmap;
-		if (heatmap == 2)
-			cv_composite_debug |= CompositeDebugFlag::Heatmap_MSWCG;
-		if (heatmap == 3)
-			cv_composite_debug |= CompositeDebugFlag::Heatmap_Hard;
+}
+
+static void
+handle_prop_gamescope_sdr_input_gain(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSDRInputGain, 0 );
+	if ( set_sdr_input_gain( bit_cast<float>(val) ) )
 		hasRepaint = true;
-	}
+}
 
-	if ( ev->atom == ctx->atoms.gamescopeHDRTonemapOperator )
-	{
-		g_ColorMgmt.pending.hdrTonemapOperator = (ETonemapOperator) get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapOperator, 0 );
+static void
+handle_prop_gamescope_force_windows_fullscreen(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	ctx->force_windows_fullscreen = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeForceWindowsFullscreen, 0 );
+	MakeFocusDirty();
+}
+
+static void
+handle_prop_gamescope_color_3dlut_override(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLut3DOverride );
+	if ( set_color_3dlut_override( path.c_str() ) )
 		hasRepaint = true;
-	}
+}
 
-	if ( ev->atom == ctx->atoms.gamescopeHDRTonemapDisplayMetadata )
-	{
-		std::vector< uint32_t > user_vec;
-		if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapDisplayMetadata, user_vec ) && user_vec.size() >= 2 )
-		{
-			g_ColorMgmt.pending.hdrTonemapDisplayMetadata.flBlackPointNits = bit_cast<float>( user_vec[0] );
-			g_ColorMgmt.pending.hdrTonemapDisplayMetadata.flWhitePointNits = bit_cast<float>( user_vec[1] );
-		}
-		else
-		{
-			g_ColorMgmt.pending.hdrTonemapDisplayMetadata.reset();
-		}
+static void
+handle_prop_gamescope_color_shaperlut_override(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorShaperLutOverride );
+	if ( set_color_shaperlut_override( path.c_str() ) )
 		hasRepaint = true;
-	}
+}
 
-	if ( ev->atom == ctx->atoms.gamescopeHDRTonemapSourceMetadata )
-	{
-		std::vector< uint32_t > user_vec;
-		if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRTonemapSourceMetadata, user_vec ) && user_vec.size() >= 2 )
-		{
-			g_ColorMgmt.pending.hdrTonemapSourceMetadata.flBlackPointNits = bit_cast<float>( user_vec[0] );
-			g_ColorMgmt.pending.hdrTonemapSourceMetadata.flWhitePointNits = bit_cast<float>( user_vec[1] );
-		}
-		else
-		{
-			g_ColorMgmt.pending.hdrTonemapSourceMetadata.reset();
-		}
+static void
+handle_prop_gamescope_color_sdr_gamut_wideness(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorSDRGamutWideness, 0);
+	if ( set_color_sdr_gamut_wideness( bit_cast<float>(val) ) )
 		hasRepaint = true;
-	}
+}
+
+static void
+handle_prop_gamescope_color_night_mode(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::vector< uint32_t > user_vec;
+	bool bHasVec = get_prop( ctx, ctx->root, ctx->atoms.gamescopeColorNightMode, user_vec );
 
-	if ( ev->atom == ctx->atoms.gamescopeSDROnHDRContentBrightness )
+	// identity
+	float vec[3] = { 0.0f, 0.0f, 0.0f };
+	if ( bHasVec && user_vec.size() == 3 )
 	{
-		uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSDROnHDRContentBrightness, 0 );
-		if ( set_sdr_on_hdr_brightness( bit_cast<float>(val) ) )
-			hasRepaint = true;
+		for (int i = 0; i < 3; i++)
+			vec[i] = bit_cast<float>( user_vec[i] );
 	}
-	if ( ev->atom == ctx->atoms.gamescopeHDRItmEnable )
-	{
-		g_bHDRItmEnable = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmEnable, 0 );
+
+	nightmode_t nightmode;
+	nightmode.amount = vec[0];
+	nightmode.hue = vec[1];
+	nightmode.saturation = vec[2];
+
+	if ( set_color_nightmode( nightmode ) )
 		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeHDRItmSDRNits )
-	{
-		g_flHDRItmSdrNits = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmSDRNits, 0 );
-		if ( g_flHDRItmSdrNits < 1.f )
-			g_flHDRItmSdrNits = 100.f;
-		else if ( g_flHDRItmSdrNits > 1000.f)
-			g_flHDRItmSdrNits = 1000.f;
+}
+
+static void
+handle_prop_gamescope_color_management_disable(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorManagementDisable, 0);
+	if ( set_color_mgmt_enabled( !val ) )
 		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeHDRItmTargetNits )
-	{
-		g_flHDRItmTargetNits = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRItmTargetNits, 0 );
-		if ( g_flHDRItmTargetNits < 1.f )
-			g_flHDRItmTargetNits = 1000.f;
-		else if ( g_flHDRItmTargetNits > 10000.f)
-			g_flHDRItmTargetNits = 10000.f;
+}
+
+static void
+handle_prop_gamescope_color_management_changing_hint(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorSliderInUse, 0);
+	g_bColorSliderInUse = !!val;
+}
+
+static void
+handle_prop_gamescope_color_chromatic_adaptation_mode(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorChromaticAdaptationMode, 0);
+	g_ColorMgmt.pending.chromaticAdaptationMode = ( EChromaticAdaptationMethod ) val;
+}
+
+// TODO: Hook up gamescopeColorMuraCorrectionImage for external.
+static void
+handle_prop_gamescope_color_mura_correction_image(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorMuraCorrectionImage[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL] );
+	if ( set_mura_overlay( path.c_str() ) )
 		hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorLookPQ )
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLookPQ );
-		if ( set_color_look_pq( path.c_str() ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorLookG22 )
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLookG22 );
-		if ( set_color_look_g22( path.c_str() ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorOutputVirtualWhite )
-	{
-		std::vector< uint32_t > user_vec;
-		if ( get_prop( ctx, ctx->root, ctx->atoms.gamescopeColorOutputVirtualWhite, user_vec ) && user_vec.size() >= 2 )
-		{
-			g_ColorMgmt.pending.outputVirtualWhite.x = santitize_float( bit_cast<float>( user_vec[0] ) );
-			g_ColorMgmt.pending.outputVirtualWhite.y = santitize_float( bit_cast<float>( user_vec[1] ) );
-		}
-		else
-		{
-			g_ColorMgmt.pending.outputVirtualWhite.x = 0.f;
-			g_ColorMgmt.pending.outputVirtualWhite.y = 0.f;
-		}
+}
+
+// TODO: Hook up gamescopeColorMuraScale for external.
+static void
+handle_prop_gamescope_color_mura_scale(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorMuraScale[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], 0);
+	float new_scale = bit_cast<float>(val);
+	if ( set_mura_scale( new_scale ) )
+		hasRepaint = true;
+}
+
+// TODO: Hook up gamescopeColorMuraCorrectionDisabled for external.
+static void
+handle_prop_gamescope_color_mura_correction_disabled(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	bool disabled = !!get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorMuraCorrectionDisabled[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], 0);
+	if ( g_bMuraCompensationDisabled != disabled ) {
+		g_bMuraCompensationDisabled = disabled;
 		hasRepaint = true;
 	}
-	if ( ev->atom == ctx->atoms.gamescopeHDRInputGain )
-	{
-		uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeHDRInputGain, 0 );
-		if ( set_hdr_input_gain( bit_cast<float>(val) ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeSDRInputGain )
+}
+
+static void
+handle_prop_gamescope_create_xwayland_server(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t identifier = get_prop(ctx, ctx->root, ctx->atoms.gamescopeCreateXWaylandServer, 0);
+	if (identifier)
 	{
-		uint32_t val = get_prop( ctx, ctx->root, ctx->atoms.gamescopeSDRInputGain, 0 );
-		if ( set_sdr_input_gain( bit_cast<float>(val) ) )
-			hasRepaint = true;
+		wlserver_lock();
+		uint32_t server_id = (uint32_t)wlserver_make_new_xwayland_server();
+		assert(server_id != ~0u);
+		gamescope_xwayland_server_t *server = wlserver_get_xwayland_server(server_id);
+		init_xwayland_ctx(server_id, server);
+		char propertyString[256];
+		snprintf(propertyString, sizeof(propertyString), "%u %u %s", identifier, server_id, server->get_nested_display_name());
+		XTextProperty text_property =
+		{
+			.value = (unsigned char *)propertyString,
+			.encoding = ctx->atoms.utf8StringAtom,
+			.format = 8,
+			.nitems = strlen(propertyString),
+		};
+		g_SteamCompMgrWaiter.AddWaitable( server->ctx.get() );
+		XSetTextProperty( ctx->dpy, ctx->root, &text_property, ctx->atoms.gamescopeCreateXWaylandServerFeedback );
+		wlserver_unlock();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeForceWindowsFullscreen )
+}
+
+static void
+handle_prop_gamescope_destroy_xwayland_server(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t server_id = get_prop(ctx, ctx->root, ctx->atoms.gamescopeDestroyXWaylandServer, 0);
+
+	gamescope_xwayland_server_t *server = wlserver_get_xwayland_server(server_id);
+	if (server)
 	{
-		ctx->force_windows_fullscreen = !!get_prop( ctx, ctx->root, ctx->atoms.gamescopeForceWindowsFullscreen, 0 );
+		if (global_focus.focusWindow &&
+			global_focus.focusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.focusWindow->xwayland().ctx == server->ctx.get())
+			global_focus.focusWindow = nullptr;
+
+		if (global_focus.inputFocusWindow &&
+			global_focus.inputFocusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.inputFocusWindow->xwayland().ctx == server->ctx.get())
+			global_focus.inputFocusWindow = nullptr;
+
+		if (global_focus.overlayWindow &&
+			global_focus.overlayWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.overlayWindow->xwayland().ctx == server->ctx.get())
+			global_focus.overlayWindow = nullptr;
+
+		if (global_focus.externalOverlayWindow &&
+			global_focus.externalOverlayWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.externalOverlayWindow->xwayland().ctx == server->ctx.get())
+			global_focus.externalOverlayWindow = nullptr;
+
+		if (global_focus.notificationWindow &&
+			global_focus.notificationWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.notificationWindow->xwayland().ctx == server->ctx.get())
+			global_focus.notificationWindow = nullptr;
+
+		if (global_focus.overrideWindow &&
+			global_focus.overrideWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.overrideWindow->xwayland().ctx == server->ctx.get())
+			global_focus.overrideWindow = nullptr;
+
+		if (global_focus.keyboardFocusWindow &&
+			global_focus.keyboardFocusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.keyboardFocusWindow->xwayland().ctx == server->ctx.get())
+			global_focus.keyboardFocusWindow = nullptr;
+
+		if (global_focus.fadeWindow &&
+			global_focus.fadeWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
+			global_focus.fadeWindow->xwayland().ctx == server->ctx.get())
+			global_focus.fadeWindow = nullptr;
+
+		if (global_focus.cursor &&
+			global_focus.cursor->getCtx() == server->ctx.get())
+			global_focus.cursor = nullptr;
+
+		wlserver_lock();
+		g_SteamCompMgrWaiter.RemoveWaitable( server->ctx.get() );
+		wlserver_destroy_xwayland_server(server);
+		wlserver_unlock();
+
 		MakeFocusDirty();
 	}
-	if ( ev->atom == ctx->atoms.gamescopeColorLut3DOverride )
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorLut3DOverride );
-		if ( set_color_3dlut_override( path.c_str() ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorShaperLutOverride )
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorShaperLutOverride );
-		if ( set_color_shaperlut_override( path.c_str() ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorSDRGamutWideness )
-	{
-		uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorSDRGamutWideness, 0);
-		if ( set_color_sdr_gamut_wideness( bit_cast<float>(val) ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorNightMode )
-	{
-		std::vector< uint32_t > user_vec;
-		bool bHasVec = get_prop( ctx, ctx->root, ctx->atoms.gamescopeColorNightMode, user_vec );
+}
 
-		// identity
-		float vec[3] = { 0.0f, 0.0f, 0.0f };
-		if ( bHasVec && user_vec.size() == 3 )
-		{
-			for (int i = 0; i < 3; i++)
-				vec[i] = bit_cast<float>( user_vec[i] );
-		}
+static void
+handle_prop_gamescope_reshade_technique_idx(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	uint32_t technique_idx = get_prop(ctx, ctx->root, ctx->atoms.gamescopeReshadeTechniqueIdx, 0);
+	g_reshade_technique_idx = technique_idx;
+}
 
-		nightmode_t nightmode;
-		nightmode.amount = vec[0];
-		nightmode.hue = vec[1];
-		nightmode.saturation = vec[2];
+static void
+handle_prop_gamescope_reshade_effect(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeReshadeEffect );
+	g_reshade_effect = path;
+}
 
-		if ( set_color_nightmode( nightmode ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorManagementDisable )
-	{
-		uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorManagementDisable, 0);
-		if ( set_color_mgmt_enabled( !val ) )
-			hasRepaint = true;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorSliderInUse )
-	{
-		uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorSliderInUse, 0);
-		g_bColorSliderInUse = !!val;
-	}
-	if ( ev->atom == ctx->atoms.gamescopeColorChromaticAdaptationMode )
-	{
-		uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorChromaticAdaptationMode, 0);
-		g_ColorMgmt.pending.chromaticAdaptationMode = ( EChromaticAdaptationMethod ) val;
-	}
-	// TODO: Hook up gamescopeColorMuraCorrectionImage for external.
-	if ( ev->atom == ctx->atoms.gamescopeColorMuraCorrectionImage[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL] )
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeColorMuraCorrectionImage[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL] );
-		if ( set_mura_overlay( path.c_str() ) )
-			hasRepaint = true;
-	}
-	// TODO: Hook up gamescopeColorMuraScale for external.
-	if ( ev->atom == ctx->atoms.gamescopeColorMuraScale[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL] )
-	{
-		uint32_t val = get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorMuraScale[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], 0);
-		float new_scale = bit_cast<float>(val);
-		if ( set_mura_scale( new_scale ) )
-			hasRepaint = true;
-	}
-	// TODO: Hook up gamescopeColorMuraCorrectionDisabled for external.
-	if ( ev->atom == ctx->atoms.gamescopeColorMuraCorrectionDisabled[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL] )
+static void
+handle_prop_gamescope_display_dynamic_refresh_based_on_game_presence(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	g_bChangeDynamicRefreshBasedOnGameOpenRatherThanActive = !!get_prop(ctx, ctx->root, ctx->atoms.gamescopeDisplayDynamicRefreshBasedOnGamePresence, 0);
+}
+
+static void
+handle_prop_wine_hwnd_style(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		bool disabled = !!get_prop(ctx, ctx->root, ctx->atoms.gamescopeColorMuraCorrectionDisabled[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], 0);
-		if ( g_bMuraCompensationDisabled != disabled ) {
-			g_bMuraCompensationDisabled = disabled;
-			hasRepaint = true;
-		}
+		w->hasHwndStyle = true;
+		w->hwndStyle = get_prop(ctx, w->xwayland().id, ctx->atoms.wineHwndStyle, 0);
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.gamescopeCreateXWaylandServer)
+}
+
+static void
+handle_prop_wine_hwnd_exstyle(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	steamcompmgr_win_t * w = find_win(ctx, ev->window);
+	if (w)
 	{
-		uint32_t identifier = get_prop(ctx, ctx->root, ctx->atoms.gamescopeCreateXWaylandServer, 0);
-		if (identifier)
-		{
-			wlserver_lock();
-			uint32_t server_id = (uint32_t)wlserver_make_new_xwayland_server();
-			assert(server_id != ~0u);
-			gamescope_xwayland_server_t *server = wlserver_get_xwayland_server(server_id);
-			init_xwayland_ctx(server_id, server);
-			char propertyString[256];
-			snprintf(propertyString, sizeof(propertyString), "%u %u %s", identifier, server_id, server->get_nested_display_name());
-			XTextProperty text_property =
-			{
-				.value = (unsigned char *)propertyString,
-				.encoding = ctx->atoms.utf8StringAtom,
-				.format = 8,
-				.nitems = strlen(propertyString),
-			};
-			g_SteamCompMgrWaiter.AddWaitable( server->ctx.get() );
-			XSetTextProperty( ctx->dpy, ctx->root, &text_property, ctx->atoms.gamescopeCreateXWaylandServerFeedback );
-			wlserver_unlock();
-		}
+		w->hasHwndStyleEx = true;
+		w->hwndStyleEx = get_prop(ctx, w->xwayland().id, ctx->atoms.wineHwndStyleEx, 0);
+		MakeFocusDirty();
 	}
-	if (ev->atom == ctx->atoms.gamescopeDestroyXWaylandServer)
-	{
-		uint32_t server_id = get_prop(ctx, ctx->root, ctx->atoms.gamescopeDestroyXWaylandServer, 0);
+}
 
-		gamescope_xwayland_server_t *server = wlserver_get_xwayland_server(server_id);
-		if (server)
-		{
-			if (global_focus.focusWindow &&
-				global_focus.focusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.focusWindow->xwayland().ctx == server->ctx.get())
-				global_focus.focusWindow = nullptr;
-
-			if (global_focus.inputFocusWindow &&
-				global_focus.inputFocusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.inputFocusWindow->xwayland().ctx == server->ctx.get())
-				global_focus.inputFocusWindow = nullptr;
-
-			if (global_focus.overlayWindow &&
-				global_focus.overlayWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.overlayWindow->xwayland().ctx == server->ctx.get())
-				global_focus.overlayWindow = nullptr;
-
-			if (global_focus.externalOverlayWindow &&
-				global_focus.externalOverlayWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.externalOverlayWindow->xwayland().ctx == server->ctx.get())
-				global_focus.externalOverlayWindow = nullptr;
-
-			if (global_focus.notificationWindow &&
-				global_focus.notificationWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.notificationWindow->xwayland().ctx == server->ctx.get())
-				global_focus.notificationWindow = nullptr;
-
-			if (global_focus.overrideWindow &&
-				global_focus.overrideWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.overrideWindow->xwayland().ctx == server->ctx.get())
-				global_focus.overrideWindow = nullptr;
-
-			if (global_focus.keyboardFocusWindow &&
-				global_focus.keyboardFocusWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.keyboardFocusWindow->xwayland().ctx == server->ctx.get())
-				global_focus.keyboardFocusWindow = nullptr;
-
-			if (global_focus.fadeWindow &&
-				global_focus.fadeWindow->type == steamcompmgr_win_type_t::XWAYLAND &&
-				global_focus.fadeWindow->xwayland().ctx == server->ctx.get())
-				global_focus.fadeWindow = nullptr;
-
-			if (global_focus.cursor &&
-				global_focus.cursor->getCtx() == server->ctx.get())
-				global_focus.cursor = nullptr;
+// Per-window state.
+static void
+register_window_property_handlers(xwayland_ctx_t *ctx)
+{
+	ctx->RegisterPropertyHandler( ctx->atoms.opacityAtom, "_NET_WM_WINDOW_OPACITY", handle_prop_net_wm_window_opacity );
+	ctx->RegisterPropertyHandler( ctx->atoms.steamAtom, "STEAM_BIGPICTURE", handle_prop_steam_bigpicture );
+	ctx->RegisterPropertyHandler( ctx->atoms.steamInputFocusAtom, "STEAM_INPUT_FOCUS", handle_prop_steam_input_focus );
+	ctx->RegisterPropertyHandler( ctx->atoms.steamStreamingClientAtom, "STEAM_STREAMING_CLIENT", handle_prop_steam_streaming_client );
+	ctx->RegisterPropertyHandler( ctx->atoms.steamStreamingClientVideoAtom, "STEAM_STREAMING_CLIENT_VIDEO", handle_prop_steam_streaming_client_video );
+	ctx->RegisterPropertyHandler( ctx->atoms.gameAtom, "STEAM_GAME", handle_prop_steam_game );
+	ctx->RegisterPropertyHandler( ctx->atoms.overlayAtom, "STEAM_OVERLAY", handle_prop_steam_overlay );
+	ctx->RegisterPropertyHandler( ctx->atoms.externalOverlayAtom, "GAMESCOPE_EXTERNAL_OVERLAY", handle_prop_gamescope_external_overlay );
+	ctx->RegisterPropertyHandler( ctx->atoms.winTypeAtom, "_NET_WM_WINDOW_TYPE", handle_prop_net_wm_window_type );
+	ctx->RegisterPropertyHandler( ctx->atoms.sizeHintsAtom, "WM_NORMAL_HINTS", handle_prop_wm_normal_hints );
+	ctx->RegisterPropertyHandler( ctx->atoms.WMTransientForAtom, "WM_TRANSIENT_FOR", handle_prop_wm_transient_for );
+	ctx->RegisterPropertyHandler( XA_WM_NAME, "WM_NAME", handle_prop_wm_name );
+	ctx->RegisterPropertyHandler( ctx->atoms.netWMNameAtom, "_NET_WM_NAME", handle_prop_wm_name );
+	ctx->RegisterPropertyHandler( ctx->atoms.netWMIcon, "_NET_WM_ICON", handle_prop_net_wm_icon );
+	ctx->RegisterPropertyHandler( ctx->atoms.wineHwndStyle, "_WINE_HWND_STYLE", handle_prop_wine_hwnd_style );
+	ctx->RegisterPropertyHandler( ctx->atoms.wineHwndStyleEx, "_WINE_HWND_EXSTYLE", handle_prop_wine_hwnd_exstyle );
+}
+
+// Focus control and input.
+static void
+register_focus_property_handlers(xwayland_ctx_t *ctx)
+{
+	ctx->RegisterPropertyHandler( ctx->atoms.steamTouchClickModeAtom, "STEAM_TOUCH_CLICK_MODE", handle_prop_steam_touch_click_mode );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeCtrlAppIDAtom, "GAMESCOPECTRL_BASELAYER_APPID", handle_prop_gamescopectrl_baselayer_appid );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeCtrlWindowAtom, "GAMESCOPECTRL_BASELAYER_WINDOW", handle_prop_gamescopectrl_baselayer_window );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamesRunningAtom, "STEAM_GAMES_RUNNING", handle_prop_steam_games_running );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeSteamMaxHeight, "GAMESCOPE_STEAM_MAX_HEIGHT", handle_prop_gamescope_steam_max_height );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeForceWindowsFullscreen, "GAMESCOPE_FORCE_WINDOWS_FULLSCREEN", handle_prop_gamescope_force_windows_fullscreen );
+}
 
-			wlserver_lock();
-			g_SteamCompMgrWaiter.RemoveWaitable( server->ctx.get() );
-			wlserver_destroy_xwayland_server(server);
-			wlserver_unlock();
+// Display, scaling and frame pacing.
+static void
+register_display_property_handlers(xwayland_ctx_t *ctx)
+{
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeScreenShotAtom, "GAMESCOPECTRL_REQUEST_SCREENSHOT", handle_prop_gamescopectrl_request_screenshot );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDebugScreenShotAtom, "GAMESCOPECTRL_DEBUG_REQUEST_SCREENSHOT", handle_prop_gamescopectrl_debug_request_screenshot );
+	ctx->RegisterPropertyHandler( ctx->atoms.screenScaleAtom, "STEAM_SCREEN_SCALE", handle_prop_steam_screen_scale );
+	ctx->RegisterPropertyHandler( ctx->atoms.screenZoomAtom, "STEAM_SCREEN_MAGNIFICATION", handle_prop_steam_screen_magnification );
+#if 0
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeTuneableVBlankRedZone, "GAMESCOPE_TUNEABLE_VBLANK_REDZONE", handle_prop_gamescope_tuneable_vblank_redzone );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeTuneableRateOfDecay, "GAMESCOPE_TUNEABLE_VBLANK_RATE_OF_DECAY_PERCENTAGE", handle_prop_gamescope_tuneable_vblank_rate_of_decay_percentage );
+#endif
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeScalingFilter, "GAMESCOPE_SCALING_FILTER", handle_prop_gamescope_scaling_filter );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeFSRSharpness, "GAMESCOPE_FSR_SHARPNESS", handle_prop_gamescope_sharpness );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeSharpness, "GAMESCOPE_SHARPNESS", handle_prop_gamescope_sharpness );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeXWaylandModeControl, "GAMESCOPE_XWAYLAND_MODE_CONTROL", handle_prop_gamescope_xwayland_mode_control );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeFPSLimit, "GAMESCOPE_FPS_LIMIT", handle_prop_gamescope_fps_limit );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDynamicRefresh[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], "GAMESCOPE_DYNAMIC_REFRESH", handle_prop_gamescope_dynamic_refresh );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDynamicRefresh[gamescope::GAMESCOPE_SCREEN_TYPE_EXTERNAL], "GAMESCOPE_DYNAMIC_REFRESH_EXTERNAL", handle_prop_gamescope_dynamic_refresh );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeLowLatency, "GAMESCOPE_LOW_LATENCY", handle_prop_gamescope_low_latency );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeBlurMode, "GAMESCOPE_BLUR_MODE", handle_prop_gamescope_blur_mode );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeBlurRadius, "GAMESCOPE_BLUR_RADIUS", handle_prop_gamescope_blur_radius );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeBlurFadeDuration, "GAMESCOPE_BLUR_FADE_DURATION", handle_prop_gamescope_blur_fade_duration );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeCompositeForce, "GAMESCOPE_COMPOSITE_FORCE", handle_prop_gamescope_composite_force );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeCompositeDebug, "GAMESCOPE_COMPOSITE_DEBUG", handle_prop_gamescope_composite_debug );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeAllowTearing, "GAMESCOPE_ALLOW_TEARING", handle_prop_gamescope_allow_tearing );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeVRREnabled, "GAMESCOPE_VRR_ENABLED", handle_prop_gamescope_vrr_enabled );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDisplayForceInternal, "GAMESCOPE_DISPLAY_FORCE_INTERNAL", handle_prop_gamescope_display_force_internal );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDisplayModeNudge, "GAMESCOPE_DISPLAY_MODE_NUDGE", handle_prop_gamescope_display_mode_nudge );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeNewScalingFilter, "GAMESCOPE_NEW_SCALING_FILTER", handle_prop_gamescope_new_scaling_filter );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeNewScalingScaler, "GAMESCOPE_NEW_SCALING_SCALER", handle_prop_gamescope_new_scaling_scaler );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeReshadeTechniqueIdx, "GAMESCOPE_RESHADE_TECHNIQUE_IDX", handle_prop_gamescope_reshade_technique_idx );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeReshadeEffect, "GAMESCOPE_RESHADE_EFFECT", handle_prop_gamescope_reshade_effect );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDisplayDynamicRefreshBasedOnGamePresence, "GAMESCOPE_DISPLAY_DYNAMIC_REFRESH_BASED_ON_GAME_PRESENCE", handle_prop_gamescope_display_dynamic_refresh_based_on_game_presence );
+}
+
+// Color management.
+static void
+register_color_property_handlers(xwayland_ctx_t *ctx)
+{
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDisplayHDREnabled, "GAMESCOPE_DISPLAY_HDR_ENABLED", handle_prop_gamescope_display_hdr_enabled );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDebugForceHDR10Output, "GAMESCOPE_DEBUG_FORCE_HDR10_PQ_OUTPUT", handle_prop_gamescope_debug_force_hdr10_pq_output );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDebugForceHDRSupport, "GAMESCOPE_DEBUG_FORCE_HDR_SUPPORT", handle_prop_gamescope_debug_force_hdr_support );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDebugHDRHeatmap, "GAMESCOPE_DEBUG_HDR_HEATMAP", handle_prop_gamescope_debug_hdr_heatmap );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRTonemapOperator, "GAMESCOPE_HDR_TONEMAP_OPERATOR", handle_prop_gamescope_hdr_tonemap_operator );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRTonemapDisplayMetadata, "GAMESCOPE_HDR_TONEMAP_DISPLAY_METADATA", handle_prop_gamescope_hdr_tonemap_display_metadata );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRTonemapSourceMetadata, "GAMESCOPE_HDR_TONEMAP_SOURCE_METADATA", handle_prop_gamescope_hdr_tonemap_source_metadata );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeSDROnHDRContentBrightness, "GAMESCOPE_SDR_ON_HDR_CONTENT_BRIGHTNESS", handle_prop_gamescope_sdr_on_hdr_content_brightness );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRItmEnable, "GAMESCOPE_HDR_ITM_ENABLE", handle_prop_gamescope_hdr_itm_enable );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRItmSDRNits, "GAMESCOPE_HDR_ITM_SDR_NITS", handle_prop_gamescope_hdr_itm_sdr_nits );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRItmTargetNits, "GAMESCOPE_HDR_ITM_TARGET_NITS", handle_prop_gamescope_hdr_itm_target_nits );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorLookPQ, "GAMESCOPE_COLOR_LOOK_PQ", handle_prop_gamescope_color_look_pq );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorLookG22, "GAMESCOPE_COLOR_LOOK_G22", handle_prop_gamescope_color_look_g22 );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorOutputVirtualWhite, "GAMESCOPE_DISPLAY_VIRTUAL_WHITE", handle_prop_gamescope_display_virtual_white );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeHDRInputGain, "GAMESCOPE_HDR_INPUT_GAIN", handle_prop_gamescope_hdr_input_gain );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeSDRInputGain, "GAMESCOPE_SDR_INPUT_GAIN", handle_prop_gamescope_sdr_input_gain );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorLut3DOverride, "GAMESCOPE_COLOR_3DLUT_OVERRIDE", handle_prop_gamescope_color_3dlut_override );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorShaperLutOverride, "GAMESCOPE_COLOR_SHAPERLUT_OVERRIDE", handle_prop_gamescope_color_shaperlut_override );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorSDRGamutWideness, "GAMESCOPE_COLOR_SDR_GAMUT_WIDENESS", handle_prop_gamescope_color_sdr_gamut_wideness );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorNightMode, "GAMESCOPE_COLOR_NIGHT_MODE", handle_prop_gamescope_color_night_mode );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorManagementDisable, "GAMESCOPE_COLOR_MANAGEMENT_DISABLE", handle_prop_gamescope_color_management_disable );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorSliderInUse, "GAMESCOPE_COLOR_MANAGEMENT_CHANGING_HINT", handle_prop_gamescope_color_management_changing_hint );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorChromaticAdaptationMode, "GAMESCOPE_COLOR_CHROMATIC_ADAPTATION_MODE", handle_prop_gamescope_color_chromatic_adaptation_mode );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorMuraCorrectionImage[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], "GAMESCOPE_COLOR_MURA_CORRECTION_IMAGE", handle_prop_gamescope_color_mura_correction_image );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorMuraScale[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], "GAMESCOPE_COLOR_MURA_SCALE", handle_prop_gamescope_color_mura_scale );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeColorMuraCorrectionDisabled[gamescope::GAMESCOPE_SCREEN_TYPE_INTERNAL], "GAMESCOPE_COLOR_MURA_CORRECTION_DISABLED", handle_prop_gamescope_color_mura_correction_disabled );
+}
+
+// Nested Xwayland servers.
+static void
+register_xwayland_server_property_handlers(xwayland_ctx_t *ctx)
+{
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeCreateXWaylandServer, "GAMESCOPE_CREATE_XWAYLAND_SERVER", handle_prop_gamescope_create_xwayland_server );
+	ctx->RegisterPropertyHandler( ctx->atoms.gamescopeDestroyXWaylandServer, "GAMESCOPE_DESTROY_XWAYLAND_SERVER", handle_prop_gamescope_destroy_xwayland_server );
+}
 
-			MakeFocusDirty();
-		}
-	}
-	if (ev->atom == ctx->atoms.gamescopeReshadeTechniqueIdx)
-	{
-		uint32_t technique_idx = get_prop(ctx, ctx->root, ctx->atoms.gamescopeReshadeTechniqueIdx, 0);
-		g_reshade_technique_idx = technique_idx;
-	}
-	if (ev->atom == ctx->atoms.gamescopeReshadeEffect)
-	{
-		std::string path = get_string_prop( ctx, ctx->root, ctx->atoms.gamescopeReshadeEffect );
-		g_reshade_effect = path;
-	}
-	if (ev->atom == ctx->atoms.gamescopeDisplayDynamicRefreshBasedOnGamePresence)
-	{
-		g_bChangeDynamicRefreshBasedOnGameOpenRatherThanActive = !!get_prop(ctx, ctx->root, ctx->atoms.gamescopeDisplayDynamicRefreshBasedOnGamePresence, 0);
-	}
-	if (ev->atom == ctx->atoms.wineHwndStyle)
+static void
+register_property_handlers(xwayland_ctx_t *ctx)
+{
+	register_window_property_handlers(ctx);
+	register_focus_property_handlers(ctx);
+	register_display_property_handlers(ctx);
+	register_color_property_handlers(ctx);
+	register_xwayland_server_property_handlers(ctx);
+}
+
+void xwayland_ctx_t::RegisterPropertyHandler( Atom atom, const char *pszName, PropertyHandlerFn_t pfnHandler )
+{
+	auto [ iter, bInserted ] = propertyHandlers.try_emplace( atom, pszName, pfnHandler );
+	if ( !bInserted )
+		xwm_log.errorf( "%s already has a property handler (%s)", pszName, iter->second.pszName );
+}
+
+static void
+handle_property_notify(xwayland_ctx_t *ctx, XPropertyEvent *ev)
+{
+	auto iter = ctx->propertyHandlers.find(ev->atom);
+	if (iter == ctx->propertyHandlers.end())
+		return;
+
+	xwayland_ctx_t::PropertyHandler_t &handler = iter->second;
+
+	uint64_t ulStartTime = get_time_in_nanos();
+	handler.pfnHandler(ctx, ev);
+	handler.ulCalls.fetch_add( 1, std::memory_order_relaxed );
+	handler.ulTotalTime.fetch_add( get_time_in_nanos() - ulStartTime, std::memory_order_relaxed );
+}
+
+static gamescope::ConCommand cc_xwm_property_stats( "xwm_property_stats", "Print how often each X property handler ran and how long it took.",
+[]( std::span<std::string_view> args )
+{
+	gamescope_xwayland_server_t *server = NULL;
+	for (size_t i = 0; (server = wlserver_get_xwayland_server(i)); i++)
 	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
+		if ( !server->ctx )
+			continue;
+
+		// The counters keep going on the steamcompmgr thread, so take a copy
+		// to sort and print. Calls and time may be one handler call apart.
+		struct HandlerStats_t
 		{
-			w->hasHwndStyle = true;
-			w->hwndStyle = get_prop(ctx, w->xwayland().id, ctx->atoms.wineHwndStyle, 0);
-			MakeFocusDirty();
+			const char *pszName;
+			uint64_t ulCalls;
+			uint64_t ulTotalTime;
+		};
+		std::vector<HandlerStats_t> handlers;
+		for ( const auto &[ atom, handler ] : server->ctx->propertyHandlers )
+		{
+			uint64_t ulCalls = handler.ulCalls.load( std::memory_order_relaxed );
+			if ( ulCalls )
+				handlers.push_back( HandlerStats_t{ handler.pszName, ulCalls, handler.ulTotalTime.load( std::memory_order_relaxed ) } );
 		}
-	}
-	if (ev->atom == ctx->atoms.wineHwndStyleEx)
-	{
-		steamcompmgr_win_t * w = find_win(ctx, ev->window);
-		if (w)
+		std::sort( handlers.begin(), handlers.end(), []( const auto &a, const auto &b ) { return a.ulTotalTime > b.ulTotalTime; } );
+
+		console_log.infof( "Xwayland server %zu:", i );
+		for ( const HandlerStats_t &stats : handlers )
 		{
-			w->hasHwndStyleEx = true;
-			w->hwndStyleEx = get_prop(ctx, w->xwayland().id, ctx->atoms.wineHwndStyleEx, 0);
-			MakeFocusDirty();
+			console_log.infof( "  %s: %lu calls, %.3fms total, %.1fus avg",
+				stats.pszName, (unsigned long) stats.ulCalls,
+				stats.ulTotalTime / 1'000'000.0, stats.ulTotalTime / 1'000.0 / stats.ulCalls );
 		}
 	}
-}
+});
 
 static int
 error(Display *dpy, XErrorEvent *ev)
@@ -5832,11 +6998,7 @@ steamcompmgr_exit(void)
 	g_HeldCommits[ HELD_COMMIT_BASE ] = nullptr;
 	g_HeldCommits[ HELD_COMMIT_FADE ] = nullptr;
 
-	if ( statsThreadRun == true )
-	{
-		statsThreadRun = false;
-		statsThreadSem.signal();
-	}
+	stats_shutdown();
 
 	{
 		g_ColorMgmt.pending.appHDRMetadata = nullptr;
@@ -6261,7 +7423,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 		return;
 	}
 
-	gamescope::Rc<commit_t> newCommit = import_commit( w, reslistentry.surf, buf, reslistentry.async, std::move(reslistentry.feedback), std::move(reslistentry.presentation_feedbacks), reslistentry.present_id, reslistentry.desired_present_time, reslistentry.fifo );
+	gamescope::Rc<commit_t> newCommit = import_commit( w, reslistentry.surf, buf, reslistentry.damage, reslistentry.async, std::move(reslistentry.feedback), reslistentry.presentation_feedbacks, reslistentry.present_id, reslistentry.desired_present_time, reslistentry.fifo );
 
 	int fence = -1;
 	if ( newCommit != nullptr )
@@ -6292,7 +7454,10 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 			}
 			else
 			{
-				fence = newCommit->vulkanTex->memoryFence();
+				// wl_shm, the upload is ordered before anything that
+				// samples it on the GPU, so there is nothing to wait for.
+				fence = -1;
+				bKnownReady = true;
 			}
 		}
 
@@ -6312,28 +7477,26 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 
 void check_new_xwayland_res(xwayland_ctx_t *ctx)
 {
-	// When importing buffer, we'll potentially need to perform operations with
-	// a wlserver lock (e.g. wlr_buffer_lock). We can't do this with a
-	// wayland_commit_queue lock because that causes deadlocks.
-	std::vector<ResListEntry_t>& tmp_queue = ctx->xwayland_server->retrieve_commits();
-
-	for ( uint32_t i = 0; i < tmp_queue.size(); i++ )
+	// Move each commit out of the queue before handling it, importing
+	// can take the wlserver lock and we shouldn't hold up the producer's slot.
+	ResListEntry_t entry;
+	while ( ctx->xwayland_server->retrieve_commit( entry ) )
 	{
-		steamcompmgr_win_t	*w = find_win( ctx, tmp_queue[ i ].surf );
-		update_wayland_res( &ctx->doneCommits, w, tmp_queue[ i ]);
+		steamcompmgr_win_t	*w = find_win( ctx, entry.surf );
+		update_wayland_res( &ctx->doneCommits, w, entry );
 	}
 }
 
 void check_new_xdg_res()
 {
-	std::vector<ResListEntry_t> tmp_queue = wlserver_xdg_commit_queue();
-	for ( uint32_t i = 0; i < tmp_queue.size(); i++ )
+	ResListEntry_t entry;
+	while ( wlserver_xdg_retrieve_commit( entry ) )
 	{
 		for ( const auto& xdg_win : g_steamcompmgr_xdg_wins )
 		{
-			if ( xdg_win->xdg().surface.main_surface == tmp_queue[ i ].surf )
+			if ( xdg_win->xdg().surface.main_surface == entry.surf )
 			{
-				update_wayland_res( &g_steamcompmgr_xdg_done_commits, xdg_win.get(), tmp_queue[ i ] );
+				update_wayland_res( &g_steamcompmgr_xdg_done_commits, xdg_win.get(), entry );
 				break;
 			}
 		}
@@ -6388,6 +7551,11 @@ void xwayland_ctx_t::Dispatch()
 
 				if (w && w->xwayland().id == ev.xdestroywindow.window)
 					destroy_win(ctx, ev.xdestroywindow.window, true, true);
+
+				// Children we cached a parent for report their own destruction,
+				// forget them before the ID can be handed out again.
+				std::unique_lock lock( ctx->parentCacheMutex );
+				ctx->parentCache.erase( ev.xdestroywindow.window );
 				break;
 			}
 			case MapNotify:
@@ -6438,6 +7606,11 @@ void xwayland_ctx_t::Dispatch()
 				break;
 			}
 			case ReparentNotify:
+				{
+					std::unique_lock lock( ctx->parentCacheMutex );
+					ctx->parentCache.erase( ev.xreparent.window );
+				}
+
 				if (ev.xreparent.parent == ctx->root)
 					add_win(ctx, ev.xreparent.window, 0, ev.xreparent.serial);
 				else
@@ -6497,7 +7670,7 @@ void xwayland_ctx_t::Dispatch()
 				}
 				else if (ev.type == ctx->xfixes_event + XFixesCursorNotify)
 				{
-					cursor->setDirty();
+					cursor->setDirty( ((XFixesCursorNotifyEvent *) &ev)->cursor_serial );
 				}
 				else if (ev.type == ctx->xfixes_event + XFixesSelectionNotify)
 				{
@@ -6796,6 +7969,8 @@ void init_xwayland_ctx(uint32_t serverId, gamescope_xwayland_server_t *xwayland_
 	ctx->atoms.primarySelection = XInternAtom(ctx->dpy, "PRIMARY", false);
 	ctx->atoms.targets = XInternAtom(ctx->dpy, "TARGETS", false);
 
+	register_property_handlers(ctx);
+
 	ctx->root_width = DisplayWidth(ctx->dpy, ctx->scr);
 	ctx->root_height = DisplayHeight(ctx->dpy, ctx->scr);
 
@@ -7259,6 +8434,7 @@ steamcompmgr_main(int argc, char **argv)
 	currentOutputHeight = g_nPreferredOutputHeight;
 
 	init_runtime_info();
+	init_frame_timing();
 
 	std::unique_lock<std::mutex> xwayland_server_guard(g_SteamCompMgrXWaylandServerMutex);
 
@@ -7652,16 +8828,17 @@ steamcompmgr_main(int argc, char **argv)
 
 		const bool bForceRepaint = g_bForceRepaint.exchange(false);
 		const bool bForceSyncFlip = bForceRepaint || is_fading_out();
-		// If we are compositing, always force sync flips because we currently wait
-		// for composition to finish before submitting.
-		// If we want to do async + composite, we should set up syncfile stuff and have DRM wait on it.
-		const bool bNeedsSyncFlip = bForceSyncFlip || GetVBlankTimer().WasCompositing() || nIgnoredOverlayRepaints;
+		// If we are compositing, force sync flips unless the backend can have the
+		// display wait on the composite, as otherwise we wait for composition
+		// to finish before submitting.
+		const bool bCompositeNeedsSyncFlip = GetVBlankTimer().WasCompositing() && !GetBackend()->SupportsAsyncCompositeFlips();
+		const bool bNeedsSyncFlip = bForceSyncFlip || bCompositeNeedsSyncFlip || nIgnoredOverlayRepaints;
 		const bool bDoAsyncFlip   = ( ((g_nAsyncFlipsEnabled >= 1) && GetBackend()->SupportsTearing() && bSurfaceWantsAsync && !bHasOverlay) || bVRR ) && !bSteamOverlayOpen && !bNeedsSyncFlip;
 
 		bool bShouldPaint = false;
 		if ( bDoAsyncFlip )
 		{
-			if ( hasRepaint && !GetVBlankTimer().WasCompositing() )
+			if ( hasRepaint && !bCompositeNeedsSyncFlip )
 				bShouldPaint = true;
 		}
 		else
@@ -67,6 +67,9 @@ public:
 
 	void paint(steamcompmgr_win_t *window, steamcompmgr_win_t *fit, FrameInfo_t *frameInfo);
 	void setDirty();
+	// Same as above, but we already know which cursor is going to be
+	// displayed, so a cached texture can be used without asking the X server.
+	void setDirty( unsigned long ulCursorSerial );
 
 	// Will take ownership of data.
 	bool setCursorImage(char *data, int w, int h, int hx, int hy);
@@ -101,6 +104,23 @@ private:
 
 	bool getTexture();
 
+	// A cursor image, ready to be displayed.
+	struct CachedCursor_t
+	{
+		// Key
+		unsigned long ulSerial = 0;
+		int nScaleHeight = 0;
+		uint32_t uOutputHeight = 0;
+
+		gamescope::OwningRc<CVulkanTexture> pTexture;
+		int nHotspotX = 0, nHotspotY = 0;
+		bool bEmpty = true;
+		std::shared_ptr<gamescope::INestedHints::CursorInfo> pNestedCursorInfo;
+	};
+
+	CachedCursor_t *findCachedCursor( unsigned long ulSerial );
+	void useCachedCursor( const CachedCursor_t &cursor );
+
 	void updateCursorFeedback( bool bForce = false );
 
 	int m_x = 0, m_y = 0;
@@ -110,6 +130,12 @@ private:
 	gamescope::OwningRc<CVulkanTexture> m_texture;
 	bool m_dirty;
 	bool m_imageEmpty;
+	std::optional<unsigned long> m_ulPendingSerial;
+
+	// Most recently used first.
+	// Games tend to flip between a handful of cursors, so keep those around.
+	static constexpr size_t k_zCursorCacheSize = 8;
+	std::vector<CachedCursor_t> m_CursorCache;
 
 	xwayland_ctx_t *m_ctx;
 
@@ -11,6 +11,7 @@
 
 struct commit_t;
 struct wlserver_vk_swapchain_feedback;
+class CVulkanTexture;
 
 struct wlserver_x11_surface_info
 {
@@ -141,6 +142,13 @@ struct steamcompmgr_win_t {
 	std::vector< gamescope::Rc<commit_t> > commit_queue;
 	std::shared_ptr<std::vector< uint32_t >> icon;
 
+	// For wl_shm buffers, the texture holding the latest commit's contents,
+	// and the BufferDamage_t serial of that commit. Textures the window used
+	// before are kept in shmSpareTextures for reuse once nothing references them.
+	gamescope::OwningRc<CVulkanTexture> shmTexture;
+	uint64_t shmTextureSerial = 0;
+	std::vector< gamescope::OwningRc<CVulkanTexture> > shmSpareTextures;
+
 	steamcompmgr_win_type_t		type;
 
 	steamcompmgr_xwayland_win_t& xwayland() { return std::get<steamcompmgr_xwayland_win_t>(_window_types); }
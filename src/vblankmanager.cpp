@@ -215,6 +215,11 @@ namespace gamescope
 		m_ulLastDrawTime = ulNanos;
 	}
 
+	uint64_t CVBlankTimer::GetLastDrawTime() const
+	{
+		return m_ulLastDrawTime;
+	}
+
 	void CVBlankTimer::WaitToBeArmed()
 	{
 		// Wait for m_bArmed to change *from* false.
@@ -55,6 +55,7 @@ namespace gamescope
         bool WasCompositing() const;
         void UpdateWasCompositing( bool bCompositing );
         void UpdateLastDrawTime( uint64_t ulNanos );
+        uint64_t GetLastDrawTime() const;
 
         void WaitToBeArmed();
         void ArmNextVBlank( bool bPreemptive );
@@ -59,6 +59,7 @@
 #include "refresh_rate.h"
 #include "InputEmulation.h"
 #include "commit.h"
+#include "rendervulkan.hpp"
 
 #if HAVE_PIPEWIRE
 #include "pipewire.hpp"
@@ -100,17 +101,9 @@ static void handle_pointer_constraint(struct wl_listener *listener, void *data);
 static void wlserver_constrain_cursor( struct wlr_pointer_constraint_v1 *pNewConstraint );
 struct wlr_surface *wlserver_surface_to_main_surface( struct wlr_surface *pSurface );
 
-std::vector<ResListEntry_t>& gamescope_xwayland_server_t::retrieve_commits()
+bool gamescope_xwayland_server_t::retrieve_commit( ResListEntry_t &outEntry )
 {
-	static std::vector<ResListEntry_t> commits;
-	commits.clear();
-	commits.reserve(16);
-
-	{
-		std::lock_guard<std::mutex> lock( wayland_commit_lock );
-		commits.swap(wayland_commit_queue);
-	}
-	return commits;
+	return wayland_commit_queue.Pop( outEntry );
 }
 
 void GamescopeTimelinePoint::Release()
@@ -176,7 +169,7 @@ static std::optional<GamescopeAcquireTimelineState> TimelinePointToEventFd( cons
 	}
 }
 
-std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wlr_buffer *buf )
+std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wlr_buffer *buf, const BufferDamage_t &damage )
 {
 	auto wl_surf = get_wl_surface_info( surf );
 
@@ -209,6 +202,7 @@ std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wl
 		std::in_place_t{},
 		surf,
 		buf,
+		damage,
 		wlserver_surface_is_async(surf),
 		wlserver_surface_is_fifo(surf),
 		pFeedback,
@@ -232,40 +226,117 @@ std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wl
 	return oNewEntry;
 }
 
-void gamescope_xwayland_server_t::wayland_commit(struct wlr_surface *surf, struct wlr_buffer *buf)
+void CommitQueue_t::Push( ResListEntry_t &entry )
 {
-	std::optional<ResListEntry_t> oEntry = PrepareCommit( surf, buf );
-	if ( !oEntry )
+	assert( wlserver_is_lock_held() );
+
+	if ( !m_bSpilling.load( std::memory_order_acquire ) &&
+		 m_Ring.Push( [&]( ResListEntry_t &slot ) { MoveResListEntry( slot, entry ); } ) )
 		return;
 
+	std::unique_lock lock( m_SpillMutex );
+	if ( !m_bSpilling.load( std::memory_order_relaxed ) )
+	{
+		// Only warn once each time, the consumer says when it has caught up.
+		wl_log.errorf( "Commit queue full, holding further commits until steamcompmgr catches up" );
+		m_bSpilling.store( true, std::memory_order_release );
+	}
+
+	m_ulSpilledThisTime++;
+	m_Spill.emplace_back();
+	MoveResListEntry( m_Spill.back(), entry );
+}
+
+bool CommitQueue_t::Pop( ResListEntry_t &outEntry )
+{
+	if ( m_Ring.Pop( [&]( ResListEntry_t &entry ) { MoveResListEntry( outEntry, entry ); } ) )
+		return true;
+
+	if ( !m_bSpilling.load( std::memory_order_acquire ) )
+		return false;
+
+	// The ring is empty and everything spilled was pushed after what was in it.
+	std::unique_lock lock( m_SpillMutex );
+	if ( m_Spill.empty() )
+		return false;
+
+	MoveResListEntry( outEntry, m_Spill.front() );
+	m_Spill.pop_front();
+
+	if ( m_Spill.empty() )
 	{
-		std::lock_guard<std::mutex> lock( wayland_commit_lock );
-		wayland_commit_queue.emplace_back( std::move( *oEntry ) );
+		wl_log.infof( "Commit queue caught up, %lu commits had to be held", m_ulSpilledThisTime );
+		m_ulSpilledThisTime = 0;
+		m_bSpilling.store( false, std::memory_order_release );
 	}
 
+	return true;
+}
+
+static void QueueCommit( CommitQueue_t &queue, ResListEntry_t &entry )
+{
+	wlserver_wl_surface_info *wl_surf = get_wl_surface_info( entry.surf );
+
+	queue.Push( entry );
+
+	// entry is left with an empty vector, let the surface collect its
+	// next presentation feedbacks in that instead of allocating a new one.
+	wl_surf->pending_presentation_feedbacks = std::move( entry.presentation_feedbacks );
+
 	nudge_steamcompmgr();
 }
 
+void gamescope_xwayland_server_t::wayland_commit(struct wlr_surface *surf, struct wlr_buffer *buf, const BufferDamage_t &damage)
+{
+	std::optional<ResListEntry_t> oEntry = PrepareCommit( surf, buf, damage );
+	if ( !oEntry )
+		return;
+
+	QueueCommit( wayland_commit_queue, *oEntry );
+}
+
 struct PendingCommit_t
 {
 	struct wlr_surface *surf;
 	struct wlr_buffer *buf;
+	BufferDamage_t damage;
 };
 
 std::list<PendingCommit_t> g_PendingCommits;
 
-void wlserver_xdg_commit(struct wlr_surface *surf, struct wlr_buffer *buf)
+void wlserver_xdg_commit(struct wlr_surface *surf, struct wlr_buffer *buf, const BufferDamage_t &damage)
 {
-	std::optional<ResListEntry_t> oEntry = PrepareCommit( surf, buf );
+	std::optional<ResListEntry_t> oEntry = PrepareCommit( surf, buf, damage );
 	if ( !oEntry )
 		return;
 
+	QueueCommit( wlserver.xdg_commit_queue, *oEntry );
+}
+
+static BufferDamage_t CaptureBufferDamage( struct wlr_surface *surf )
+{
+	static uint64_t s_ulDamageSerial = 0;
+
+	wlserver_wl_surface_info *wl_surf = get_wl_surface_info( surf );
+
+	BufferDamage_t damage;
+	damage.ulSerial = ++s_ulDamageSerial;
+	damage.ulPrevSerial = std::exchange( wl_surf->last_damage_serial, damage.ulSerial );
+
+	int nRects = 0;
+	const pixman_box32_t *pRects = pixman_region32_rectangles( &surf->buffer_damage, &nRects );
+	if ( nRects <= int( damage.rects.size() ) )
+	{
+		std::copy_n( pRects, nRects, damage.rects.begin() );
+		damage.uRectCount = nRects;
+	}
+	else
 	{
-		std::lock_guard<std::mutex> lock( wlserver.xdg_commit_lock );
-		wlserver.xdg_commit_queue.push_back( std::move( *oEntry ) );
+		damage.rects[0] = *pixman_region32_extents( &surf->buffer_damage );
+		damage.uRectCount = 1;
 	}
 
-	nudge_steamcompmgr();
+	return damage;
 }
 
 void xwayland_surface_commit(struct wlr_surface *wlr_surface) {
@@ -299,21 +370,22 @@ void xwayland_surface_commit(struct wlr_surface *wlr_surface) {
 	}
 
 	struct wlr_buffer *buf = wlr_buffer_lock( tex->buf );
+	BufferDamage_t damage = CaptureBufferDamage( wlr_surface );
 
 	gpuvis_trace_printf( "xwayland_surface_commit wlr_surface %p", wlr_surface );
 
 	if (wlserver_x11_surface_info)
 	{
 		assert(wlserver_x11_surface_info->xwayland_server);
-		wlserver_x11_surface_info->xwayland_server->wayland_commit( wlr_surface, buf );
+		wlserver_x11_surface_info->xwayland_server->wayland_commit( wlr_surface, buf, damage );
 	}
 	else if (wlserver_xdg_surface_info)
 	{
-		wlserver_xdg_commit(wlr_surface, buf);
+		wlserver_xdg_commit(wlr_surface, buf, damage);
 	}
 	else
 	{
-		g_PendingCommits.push_back(PendingCommit_t{ wlr_surface, buf });
+		g_PendingCommits.push_back(PendingCommit_t{ wlr_surface, buf, damage });
 	}
 }
 
@@ -760,7 +832,7 @@ void gamescope_xwayland_server_t::handle_override_window_content( struct wl_clie
                 // Still have the buffer lock from before...
                 assert(x11_surface);
                 assert(x11_surface->xwayland_server);
-                x11_surface->xwayland_server->wayland_commit( pending.surf, pending.buf );
+                x11_surface->xwayland_server->wayland_commit( pending.surf, pending.buf, pending.damage );
 
                 it = g_PendingCommits.erase(it);
             }
@@ -1702,7 +1774,7 @@ wlserver_xdg_surface_info* waylandy_type_surface_new(struct wl_client *client, s
 		{
 			PendingCommit_t pending = *it;
 
-			wlserver_xdg_commit(pending.surf, pending.buf);
+			wlserver_xdg_commit(pending.surf, pending.buf, pending.damage);
 
 			it = g_PendingCommits.erase(it);
 		}
@@ -2006,11 +2078,6 @@ void wlserver_run(void)
 	wlserver.bWaylandServerRunning = false;
 	wlserver.bWaylandServerRunning.notify_all();
 
-	{
-		std::unique_lock lock3(wlserver.xdg_commit_lock);
-		wlserver.xdg_commit_queue.clear();
-	}
-
 	{
 		std::unique_lock lock2(g_wlserver_xdg_shell_windows_lock);
 		wlserver.xdg_wins.clear();
@@ -2747,7 +2814,7 @@ static void wlserver_x11_surface_info_set_wlr( struct wlserver_x11_surface_info
 			wlserver_x11_surface_info *wlserver_x11_surface_info = get_wl_surface_info(wlr_surf)->x11_surface;
 			assert(wlserver_x11_surface_info);
 			assert(wlserver_x11_surface_info->xwayland_server);
-			wlserver_x11_surface_info->xwayland_server->wayland_commit( pending.surf, pending.buf );
+			wlserver_x11_surface_info->xwayland_server->wayland_commit( pending.surf, pending.buf, pending.damage );
 
 			it = g_PendingCommits.erase(it);
 		}
@@ -2905,14 +2972,9 @@ bool wlserver_xdg_dirty()
 	return wlserver.xdg_dirty.exchange(false);
 }
 
-std::vector<ResListEntry_t> wlserver_xdg_commit_queue()
+bool wlserver_xdg_retrieve_commit( ResListEntry_t &outEntry )
 {
-	std::vector<ResListEntry_t> commits;
-	{
-		std::lock_guard<std::mutex> lock( wlserver.xdg_commit_lock );
-		commits = std::move(wlserver.xdg_commit_queue);
-	}
-	return commits;
+	return wlserver.xdg_commit_queue.Pop( outEntry );
 }
 
 uint32_t wlserver_make_new_xwayland_server()
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <wayland-server-core.h>
+#include <array>
 #include <atomic>
 #include <vector>
 #include <memory>
@@ -18,6 +19,7 @@
 #include "vulkan_include.h"
 
 #include "steamcompmgr_shared.hpp"
+#include "Utils/MPSCQueue.h"
 
 #if HAVE_DRM
 #define HAVE_SESSION 1
@@ -55,9 +57,26 @@ struct GamescopeAcquireTimelineState
 	bool bKnownReady = false;
 };
 
+// What a commit changed in its buffer, in buffer coordinates, so we only
+// have to upload that much for wl_shm buffers.
+struct BufferDamage_t
+{
+	// Any more rects than this get collapsed into their bounding box.
+	static constexpr uint32_t k_uMaxRects = 16;
+
+	// Every commit gets a new serial and remembers the one of the commit before it
+	// on the same surface. The damage only makes sense on top of that commit's contents.
+	uint64_t ulSerial = 0;
+	uint64_t ulPrevSerial = 0;
+
+	uint32_t uRectCount = 0;
+	std::array<pixman_box32_t, k_uMaxRects> rects;
+};
+
 struct ResListEntry_t {
 	struct wlr_surface *surf;
 	struct wlr_buffer *buf;
+	BufferDamage_t damage;
 	bool async;
 	bool fifo;
 	std::shared_ptr<wlserver_vk_swapchain_feedback> feedback;
@@ -68,6 +87,45 @@ struct ResListEntry_t {
 	std::optional<GamescopeTimelinePoint> oReleasePoint;
 };
 
+// Moves a commit from src into dst, handing dst's (emptied) presentation
+// feedback vector back to src rather than freeing it.
+// Passing commits along like this keeps the vectors' allocations going round
+// between the surfaces, the queue slots and steamcompmgr.
+inline void MoveResListEntry( ResListEntry_t &dst, ResListEntry_t &src )
+{
+	std::vector<struct wl_resource*> spareFeedbacks = std::move( dst.presentation_feedbacks );
+	spareFeedbacks.clear();
+	dst = std::move( src );
+	src.presentation_feedbacks = std::move( spareFeedbacks );
+}
+
+// Commits waiting for steamcompmgr to pick them up.
+// Normally nothing is allocated or locked to hand a commit over. If steamcompmgr
+// falls far enough behind to fill the ring, commits spill into a list under a
+// mutex until it has caught up, so none are ever lost.
+static constexpr size_t k_zMaxQueuedCommits = 256;
+class CommitQueue_t
+{
+public:
+	// Producer side, with the wlserver lock held, which is what keeps
+	// commits in order between the ring and the spill list.
+	// entry is left with a spare presentation feedback vector, see MoveResListEntry.
+	void Push( ResListEntry_t &entry );
+
+	// Consumer side, steamcompmgr. Returns false if empty.
+	bool Pop( ResListEntry_t &outEntry );
+
+private:
+	gamescope::MPSCQueue<ResListEntry_t, k_zMaxQueuedCommits> m_Ring;
+
+	// Once anything has spilled, everything after it does too until the
+	// consumer has emptied the list, otherwise it would jump the queue.
+	std::atomic<bool> m_bSpilling = { false };
+	std::mutex m_SpillMutex;
+	std::list<ResListEntry_t> m_Spill;
+	uint64_t m_ulSpilledThisTime = 0;
+};
+
 struct wlserver_content_override;
 
 bool wlserver_is_lock_held(void);
@@ -90,9 +148,10 @@ public:
 
 	std::unique_ptr<xwayland_ctx_t> ctx;
 
-	void wayland_commit(struct wlr_surface *surf, struct wlr_buffer *buf);
+	void wayland_commit(struct wlr_surface *surf, struct wlr_buffer *buf, const BufferDamage_t &damage);
 
-	std::vector<ResListEntry_t>& retrieve_commits();
+	// Moves the oldest queued commit into outEntry, returns false if there are none.
+	bool retrieve_commit( ResListEntry_t &outEntry );
 
 	void handle_override_window_content( struct wl_client *client, struct wl_resource *gamescope_swapchain_resource, struct wlr_surface *surface, uint32_t x11_window );
 	void destroy_content_override( struct wlserver_x11_surface_info *x11_surface, struct wlr_surface *surf);
@@ -116,8 +175,7 @@ private:
 	bool xwayland_ready = false;
 	_XDisplay *dpy = NULL;
 
-	std::mutex wayland_commit_lock;
-	std::vector<ResListEntry_t> wayland_commit_queue;
+	CommitQueue_t wayland_commit_queue;
 };
 
 struct wlserver_t {
@@ -200,8 +258,7 @@ struct wlserver_t {
 	struct wl_listener new_pointer_constraint;
 	std::vector<std::shared_ptr<steamcompmgr_win_t>> xdg_wins;
 	std::atomic<bool> xdg_dirty;
-	std::mutex xdg_commit_lock;
-	std::vector<ResListEntry_t> xdg_commit_queue;
+	CommitQueue_t xdg_commit_queue;
 
 	std::vector<wl_resource*> gamescope_controls;
 
@@ -210,7 +267,7 @@ struct wlserver_t {
 
 extern struct wlserver_t wlserver;
 
-std::vector<ResListEntry_t> wlserver_xdg_commit_queue();
+bool wlserver_xdg_retrieve_commit( ResListEntry_t &outEntry );
 
 struct wlserver_keyboard {
 	struct wlr_keyboard *wlr;
@@ -306,6 +363,9 @@ struct wlserver_wl_surface_info
 	uint64_t desired_present_time = 0;
 
 	uint64_t last_refresh_cycle = 0;
+
+	// The BufferDamage_t serial of the last commit.
+	uint64_t last_damage_serial = 0;
 };
 wlserver_wl_surface_info *get_wl_surface_info(struct wlr_surface *wlr_surf);
 
@@ -3,8 +3,10 @@
 #include "backend.h"
 #include "waitable.h"
 
+#include <atomic>
 #include <mutex>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <X11/Xlib.h>
@@ -21,6 +23,7 @@ class gamescope_xwayland_server_t;
 struct ignore;
 struct steamcompmgr_win_t;
 class MouseCursor;
+struct wlr_surface;
 
 extern LogScope xwm_log;
 
@@ -67,6 +70,17 @@ struct xwayland_ctx_t final : public gamescope::IWaitable
 	// wlserver wants it.
 	std::mutex list_mutex;
 	steamcompmgr_win_t				*list;
+	// Index of list by window ID, kept in sync with it under list_mutex.
+	std::unordered_map<Window, steamcompmgr_win_t *> windowsByID;
+	// Lazily filled cache of wlr_surface -> window, validated on lookup.
+	// Only touched by the steamcompmgr thread.
+	std::unordered_map<struct wlr_surface *, steamcompmgr_win_t *> windowsBySurface;
+	// Parents of non-toplevel windows we have had to look up with XQueryTree.
+	// We select StructureNotify on each, entries go away on DestroyNotify and
+	// ReparentNotify as X can reuse the IDs.
+	// find_win can be called from the wlserver thread, so this has its own lock.
+	std::mutex parentCacheMutex;
+	std::unordered_map<Window, Window> parentCache;
 	int				scr;
 	Window			root;
 	XserverRegion	allDamage;
@@ -94,6 +108,25 @@ struct xwayland_ctx_t final : public gamescope::IWaitable
 
 	bool force_windows_fullscreen = false;
 
+	using PropertyHandlerFn_t = void (*)( xwayland_ctx_t *ctx, XPropertyEvent *ev );
+	struct PropertyHandler_t
+	{
+		PropertyHandler_t( const char *pszHandlerName, PropertyHandlerFn_t pfnHandlerFn )
+			: pszName( pszHandlerName ), pfnHandler( pfnHandlerFn ) {}
+
+		const char *pszName;
+		PropertyHandlerFn_t pfnHandler;
+		// Only written by the steamcompmgr thread, but xwm_property_stats
+		// reads them from the console thread.
+		std::atomic<uint64_t> ulCalls = { 0 };
+		std::atomic<uint64_t> ulTotalTime = { 0 };
+	};
+	// What to do when a property changes, by atom.
+	// Filled in by init_xwayland_ctx and never changed after that, so it can
+	// be looked up from any thread. Only the stats in it change.
+	std::unordered_map<Atom, PropertyHandler_t> propertyHandlers;
+	void RegisterPropertyHandler( Atom atom, const char *pszName, PropertyHandlerFn_t pfnHandler );
+
 	std::vector< steamcompmgr_win_t* > GetPossibleFocusWindows();
 	void DetermineAndApplyFocus( const std::vector< steamcompmgr_win_t* > &vecPossibleFocusWindows );
 